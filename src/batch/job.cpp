@@ -0,0 +1,166 @@
+#include "../include/libfilezilla_engine.h"
+#include "job.h"
+
+#include "../commonui/fz_paths.h"
+#include "../commonui/site_manager.h"
+#include "../commonui/xml_file.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace {
+std::array<std::pair<std::wstring_view, CFileExistsNotification::OverwriteAction>, 7> const overwriteActions{{
+	{L"overwrite", CFileExistsNotification::overwrite},
+	{L"newer", CFileExistsNotification::overwriteNewer},
+	{L"size", CFileExistsNotification::overwriteSize},
+	{L"size_or_newer", CFileExistsNotification::overwriteSizeOrNewer},
+	{L"checksum", CFileExistsNotification::overwriteChecksum},
+	{L"resume", CFileExistsNotification::resume},
+	{L"skip", CFileExistsNotification::skip},
+}};
+
+bool load_site(pugi::xml_node element, app_paths const& paths, batch_job & job, Bookmark & bookmark, std::wstring & error)
+{
+	std::wstring const sitePath = GetTextElement_Trimmed(element, "Site");
+	if (!sitePath.empty()) {
+		auto data = site_manager::GetSiteByPath(paths, sitePath, error);
+		if (!data.first) {
+			if (error.empty()) {
+				error = L"Site does not exist.";
+			}
+			return false;
+		}
+		job.site = std::move(*data.first);
+		bookmark = std::move(data.second);
+	}
+	else {
+		auto server = element.child("Server");
+		if (!server || !GetServer(server, job.site)) {
+			error = L"The job neither names a site nor contains a valid server.";
+			return false;
+		}
+	}
+
+	// Nothing can be entered interactively
+	if (job.site.credentials.encrypted_) {
+		error = L"The credentials of the site are protected by a master password.";
+		return false;
+	}
+	if (job.site.credentials.logonType_ == LogonType::ask || job.site.credentials.logonType_ == LogonType::interactive) {
+		error = fz::sprintf(L"Logon type \"%s\" requires user interaction.", GetNameFromLogonType(job.site.credentials.logonType_));
+		return false;
+	}
+
+	// Converting these needs wxWidgets
+	if (job.site.server.GetEncodingType() == ENCODING_CUSTOM) {
+		error = L"Custom character sets are not supported.";
+		return false;
+	}
+
+	return true;
+}
+
+bool load_transfer(pugi::xml_node element, Site const& site, Bookmark const& bookmark, batch_transfer & transfer, std::wstring & error)
+{
+	std::wstring const direction = GetTextAttribute(element, "direction");
+	if (direction == L"download") {
+		transfer.download = true;
+	}
+	else if (direction != L"upload") {
+		error = fz::sprintf(L"Invalid transfer direction \"%s\".", direction);
+		return false;
+	}
+
+	std::wstring const remote = GetTextElement_Trimmed(element, "Remote");
+	if (!remote.empty()) {
+		transfer.remotePath = CServerPath(remote, site.server.GetType());
+	}
+	else {
+		transfer.remotePath = bookmark.m_remoteDir;
+	}
+	if (transfer.remotePath.empty()) {
+		error = fz::sprintf(L"Invalid remote directory \"%s\".", remote);
+		return false;
+	}
+
+	std::wstring const local = GetTextElement_Trimmed(element, "Local");
+	if (!transfer.localPath.SetPath(!local.empty() ? local : bookmark.m_localDir)) {
+		error = fz::sprintf(L"Invalid local directory \"%s\".", local);
+		return false;
+	}
+	if (!transfer.download && !transfer.localPath.Exists()) {
+		error = fz::sprintf(L"Local directory \"%s\" does not exist.", transfer.localPath.GetPath());
+		return false;
+	}
+
+	return true;
+}
+}
+
+bool load_job(std::wstring const& file, app_paths const& paths, batch_job & job, std::wstring & error)
+{
+	// CXmlFile would create a missing file
+	if (fz::local_filesys::get_file_type(fz::to_native(file)) != fz::local_filesys::file) {
+		error = fz::sprintf(L"Job file \"%s\" does not exist.", file);
+		return false;
+	}
+
+	CXmlFile xml(file);
+	auto document = xml.Load();
+	if (!document) {
+		error = xml.GetError();
+		return false;
+	}
+
+	auto element = document.child("Job");
+	if (!element) {
+		error = L"The file does not contain a job.";
+		return false;
+	}
+
+	Bookmark bookmark;
+	if (!load_site(element, paths, job, bookmark, error)) {
+		return false;
+	}
+
+	job.concurrency = std::clamp(static_cast<int>(GetTextElementInt(element, "Concurrency", job.concurrency)), 1, 10);
+	job.retries = std::clamp(static_cast<int>(GetTextElementInt(element, "Retries", job.retries)), 0, 99);
+
+	std::wstring const overwrite = GetTextElement_Trimmed(element, "Overwrite");
+	if (!overwrite.empty()) {
+		auto it = std::find_if(overwriteActions.cbegin(), overwriteActions.cend(), [&](auto const& a) { return a.first == overwrite; });
+		if (it == overwriteActions.cend()) {
+			error = fz::sprintf(L"Invalid overwrite action \"%s\".", overwrite);
+			return false;
+		}
+		job.overwrite = it->second;
+	}
+
+	for (auto filter = element.child("Filters").child("Filter"); filter; filter = filter.next_sibling("Filter")) {
+		CFilter f;
+		if (!load_filter(filter, f)) {
+			error = fz::sprintf(L"Invalid filter \"%s\".", f.name);
+			return false;
+		}
+		job.filters.first.push_back(f);
+		job.filters.second.push_back(std::move(f));
+	}
+
+	for (auto transfer = element.child("Transfer"); transfer; transfer = transfer.next_sibling("Transfer")) {
+		batch_transfer t;
+		if (!load_transfer(transfer, job.site, bookmark, t, error)) {
+			return false;
+		}
+		job.transfers.push_back(std::move(t));
+	}
+	if (job.transfers.empty()) {
+		error = L"The job does not contain any transfers.";
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef FILEZILLA_BATCH_JOB_HEADER
+#define FILEZILLA_BATCH_JOB_HEADER
+
+#include "../include/local_path.h"
+#include "../include/notification.h"
+#include "../include/serverpath.h"
+
+#include "../commonui/filter.h"
+#include "../commonui/site.h"
+
+#include <string>
+#include <vector>
+
+class app_paths;
+
+/*
+ * A batch job describes a set of directory trees to be transferred from or to
+ * a single site, e.g.
+ *
+ * <TabFTP3>
+ *   <Job>
+ *     <Site>0/Migration/Origin</Site>
+ *     <Concurrency>4</Concurrency>
+ *     <Retries>3</Retries>
+ *     <Overwrite>newer</Overwrite>
+ *     <Filters>
+ *       <Filter>...</Filter>
+ *     </Filters>
+ *     <Transfer direction="download">
+ *       <Remote>/data</Remote>
+ *       <Local>/srv/data</Local>
+ *     </Transfer>
+ *   </Job>
+ * </TabFTP3>
+ *
+ * Instead of referring to the site manager through <Site>, the server can be
+ * given inline as <Server> element in the format used by sitemanager.xml.
+ * Remote and local directory default to the ones of the site's bookmark.
+ * The contents of the source directory end up directly in the target
+ * directory. Filters are in the format of filters.xml and exclude matching
+ * files and directories on both sides.
+ */
+
+class batch_transfer final
+{
+public:
+	bool download{};
+	CServerPath remotePath;
+	CLocalPath localPath;
+};
+
+class batch_job final
+{
+public:
+	Site site;
+
+	std::vector<batch_transfer> transfers;
+	ActiveFilters filters;
+
+	// Number of simultaneous transfer connections. Downloads use one
+	// additional connection to list the remote directories.
+	int concurrency{2};
+
+	// How often a failed transfer is retried
+	int retries{3};
+
+	CFileExistsNotification::OverwriteAction overwrite{CFileExistsNotification::overwrite};
+};
+
+// Reads the job file. Sites referred to by path are looked up in the site
+// manager of the given settings directory. On failure, error is set.
+bool load_job(std::wstring const& file, app_paths const& paths, batch_job & job, std::wstring & error);
+
+#endif
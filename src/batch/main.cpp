@@ -0,0 +1,125 @@
+#include "../include/libfilezilla_engine.h"
+#include "job.h"
+#include "runner.h"
+
+#include "../include/engine_context.h"
+#include "../include/engine_options.h"
+
+#include "../commonui/fz_paths.h"
+#include "../commonui/options.h"
+#include "../commonui/xml_cert_store.h"
+
+#include <iostream>
+
+#include <locale.h>
+
+/*
+ * tabftp-batch runs a job file without user interface, see job.h for its
+ * format and runner.h for the output. Settings, sites and trusted
+ * certificates are those of the GUI, they are not modified.
+ */
+
+namespace {
+class batch_options final : public XmlOptions
+{
+public:
+	batch_options()
+		: XmlOptions("")
+	{}
+
+private:
+	// Nothing watches the options after startup
+	virtual void notify_changed() override {}
+
+	virtual void on_dirty() override {}
+};
+
+class batch_cert_store final : public xml_cert_store
+{
+public:
+	using xml_cert_store::xml_cert_store;
+
+protected:
+	virtual bool AllowedToSave() const override { return false; }
+};
+
+// Sites with custom character sets get rejected when loading the job
+class batch_encoding_converter final : public CustomEncodingConverterBase
+{
+public:
+	virtual std::wstring toLocal(std::wstring const&, char const*, size_t) const override
+	{
+		return {};
+	}
+
+	virtual std::string toServer(std::wstring const&, wchar_t const*, size_t) const override
+	{
+		return {};
+	}
+};
+
+void print_usage()
+{
+	std::cerr <<
+		"Usage: tabftp-batch [--verbose] JOBFILE\n"
+		"\n"
+		"Runs the transfers described in the job file without user interface.\n"
+		"Progress is written to stdout as one JSON object per line.\n"
+		"\n"
+		"  --verbose    Print all engine log messages to stderr, not just errors\n"
+		"\n"
+		"Exit status is 0 if everything has been transferred, 1 if anything\n"
+		"failed and 2 if the job could not be started.\n";
+}
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	bool verbose{};
+	std::wstring jobFile;
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg = argv[i];
+		if (arg == "--verbose") {
+			verbose = true;
+		}
+		else if (!arg.empty() && arg[0] != '-' && jobFile.empty()) {
+			jobFile = fz::to_wstring(arg);
+		}
+		else {
+			print_usage();
+			return 2;
+		}
+	}
+	if (jobFile.empty()) {
+		print_usage();
+		return 2;
+	}
+
+	batch_options options;
+	std::wstring error;
+	if (!options.Load(error)) {
+		std::cerr << "Could not load settings: " << fz::to_string(error) << std::endl;
+		return 2;
+	}
+	options.set(OPTION_FZSFTP_EXECUTABLE, FindTool(L"fzsftp", L"../putty/", "FZ_FZSFTP"));
+#if ENABLE_STORJ
+	options.set(OPTION_FZSTORJ_EXECUTABLE, FindTool(L"fzstorj", L"../storj/", "FZ_FZSTORJ"));
+#endif
+
+	app_paths const paths{CLocalPath(options.get_string(OPTION_DEFAULT_SETTINGSDIR)), GetDefaultsDir()};
+
+	batch_job job;
+	if (!load_job(jobFile, paths, job, error)) {
+		std::cerr << fz::to_string(error) << std::endl;
+		return 2;
+	}
+
+	batch_cert_store certs(paths.settings_file(L"trustedcerts"));
+	batch_encoding_converter converter;
+	CFileZillaEngineContext context(options, converter);
+
+	batch_runner runner(context, options, certs, job, std::cout, verbose);
+	return runner.run() ? 0 : 1;
+}
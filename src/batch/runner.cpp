@@ -0,0 +1,739 @@
+#include "../include/libfilezilla_engine.h"
+#include "runner.h"
+
+#include "../include/directorylisting.h"
+#include "../include/engine_context.h"
+#include "../include/misc.h"
+
+#include "../commonui/cert_store.h"
+#include "../commonui/local_recursive_operation.h"
+#include "../commonui/misc.h"
+#include "../commonui/options.h"
+#include "../commonui/remote_recursive_operation.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <type_traits>
+
+using namespace std::literals;
+
+namespace {
+fz::duration const progress_interval = fz::duration::from_seconds(1);
+
+// Makes a remote name usable as local filename
+std::wstring sanitize(std::wstring name)
+{
+#ifdef FZ_WINDOWS
+	std::wstring_view const invalid = L"/\\:*?\"<>|";
+#else
+	std::wstring_view const invalid = L"/";
+#endif
+	for (auto & c : name) {
+		if (invalid.find(c) != std::wstring_view::npos) {
+			c = '_';
+		}
+	}
+	return name;
+}
+
+// Builds one line of output
+class json_event final
+{
+public:
+	explicit json_event(std::string_view name)
+	{
+		out_ = "{\"event\":";
+		append(name);
+	}
+
+	json_event& add(std::string_view key, std::string_view value)
+	{
+		start(key);
+		append(value);
+		return *this;
+	}
+
+	json_event& add(std::string_view key, std::wstring const& value)
+	{
+		std::string const utf8 = fz::to_utf8(value);
+		return add(key, std::string_view(utf8));
+	}
+
+	template<typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+	json_event& add(std::string_view key, T value)
+	{
+		start(key);
+		out_ += std::to_string(value);
+		return *this;
+	}
+
+	std::string str() const
+	{
+		return out_ + "}";
+	}
+
+private:
+	void start(std::string_view key)
+	{
+		out_ += ',';
+		append(key);
+		out_ += ':';
+	}
+
+	void append(std::string_view s)
+	{
+		static char const hex[] = "0123456789abcdef";
+
+		out_ += '"';
+		for (char const c : s) {
+			unsigned char const u = static_cast<unsigned char>(c);
+			if (c == '"' || c == '\\') {
+				out_ += '\\';
+				out_ += c;
+			}
+			else if (u < 0x20) {
+				out_ += "\\u00";
+				out_ += hex[u >> 4];
+				out_ += hex[u & 0xf];
+			}
+			else {
+				out_ += c;
+			}
+		}
+		out_ += '"';
+	}
+
+	std::string out_;
+};
+}
+
+class batch_runner::connection final
+{
+public:
+	explicit connection(batch_runner & runner)
+		: engine_(runner.context_, [&runner](CFileZillaEngine*) { runner.wakeup(); })
+	{}
+
+	CFileZillaEngine engine_;
+
+	// Transfer connections: The item being worked on
+	std::optional<batch_item> item_;
+
+	// Listing connection: The command being executed
+	std::unique_ptr<CCommand> command_;
+
+	bool busy_{};
+	bool connecting_{};
+	bool skipped_{};
+};
+
+class batch_runner::remote_walker final : public remote_recursive_operation
+{
+public:
+	explicit remote_walker(batch_runner & runner)
+		: runner_(runner)
+	{}
+
+	using remote_recursive_operation::LinkIsNotDir;
+	using remote_recursive_operation::ListingFailed;
+	using remote_recursive_operation::ProcessDirectoryListing;
+
+protected:
+	virtual void process_command(std::unique_ptr<CCommand> command) override
+	{
+		runner_.list_commands_.push_back(std::move(command));
+	}
+
+	virtual void operation_finished() override {}
+
+	virtual std::wstring sanitize_filename(std::wstring const& name) override
+	{
+		return sanitize(name);
+	}
+
+	virtual void handle_file(std::wstring const& sourceFile, CLocalPath const& localPath, CServerPath const& remotePath, int64_t size) override
+	{
+		runner_.queue_download(sourceFile, localPath, remotePath, size);
+	}
+
+	virtual void handle_empty_directory(CLocalPath const& localPath) override
+	{
+		runner_.create_local_directory(localPath);
+	}
+
+	virtual void handle_invalid_dir_link(std::wstring const& sourceFile, CLocalPath const& localPath, CServerPath const& remotePath) override
+	{
+		runner_.queue_download(sourceFile, localPath, remotePath, -1);
+	}
+
+	virtual void handle_dir_listing_end() override {}
+	virtual void handle_listing_failed() override {}
+
+private:
+	batch_runner & runner_;
+};
+
+class batch_runner::local_walker final : public local_recursive_operation
+{
+public:
+	local_walker(batch_runner & runner, fz::thread_pool & pool)
+		: local_recursive_operation(pool)
+		, runner_(runner)
+	{}
+
+	virtual ~local_walker()
+	{
+		thread_.join();
+	}
+
+	// Hands out the enumerated directories in order. A listing without
+	// local path marks the end.
+	bool take(listing & d)
+	{
+		fz::scoped_lock l(mutex_);
+		if (m_listedDirectories.empty()) {
+			return false;
+		}
+
+		d = std::move(m_listedDirectories.front());
+		m_listedDirectories.pop_front();
+		return true;
+	}
+
+protected:
+	virtual void on_listed_directory() override
+	{
+		runner_.wakeup();
+	}
+
+	virtual void on_listing_failed() override
+	{
+		++runner_.local_failures_;
+		runner_.wakeup();
+	}
+
+private:
+	batch_runner & runner_;
+};
+
+batch_runner::batch_runner(CFileZillaEngineContext & context, COptionsBase & options, cert_store & certs, batch_job const& job, std::ostream & out, bool verbose)
+	: context_(context)
+	, options_(options)
+	, certs_(certs)
+	, job_(job)
+	, out_(out)
+	, verbose_(verbose)
+{
+	lister_ = std::make_unique<connection>(*this);
+	for (int i = 0; i < job_.concurrency; ++i) {
+		connections_.push_back(std::make_unique<connection>(*this));
+	}
+}
+
+batch_runner::~batch_runner()
+{
+	if (local_) {
+		local_->StopRecursiveOperation();
+	}
+}
+
+void batch_runner::wakeup()
+{
+	fz::scoped_lock l(mtx_);
+	cond_.signal(l);
+}
+
+bool batch_runner::run()
+{
+	start_ = fz::monotonic_clock::now();
+	last_progress_ = start_;
+
+	out_ << json_event("start"sv).add("transfers"sv, job_.transfers.size()).add("concurrency"sv, job_.concurrency).str() << std::endl;
+
+	start();
+	while (!aborted_) {
+		process(*lister_);
+		for (auto & c : connections_) {
+			process(*c);
+		}
+		drain_local();
+		next_listing();
+		schedule();
+
+		if (finished()) {
+			break;
+		}
+
+		if (fz::monotonic_clock::now() - last_progress_ >= progress_interval) {
+			report_progress(false);
+		}
+
+		fz::scoped_lock l(mtx_);
+		cond_.wait(l, progress_interval - (fz::monotonic_clock::now() - last_progress_));
+	}
+
+	report_progress(true);
+	return !error_ && !failed_;
+}
+
+void batch_runner::start()
+{
+	remote_ = std::make_unique<remote_walker>(*this);
+	local_ = std::make_unique<local_walker>(*this, context_.GetThreadPool());
+
+	for (auto const& t : job_.transfers) {
+		if (t.download) {
+			// The start directory itself is listed, its contents go directly into the local directory
+			recursion_root root(t.remotePath, true);
+			root.add_dir_to_visit(t.remotePath, std::wstring(), t.localPath);
+			remote_->AddRecursionRoot(std::move(root));
+		}
+		else {
+			local_recursion_root root;
+			root.add_dir_to_visit(t.localPath, t.remotePath);
+			local_->AddRecursionRoot(std::move(root));
+		}
+	}
+
+	remote_->start_recursive_operation(recursive_operation::recursive_transfer, job_.filters, false);
+	local_done_ = !local_->start_recursive_operation(recursive_operation::recursive_transfer, job_.filters);
+}
+
+bool batch_runner::finished() const
+{
+	if (!local_done_ || remote_->IsActive() || !list_commands_.empty() || lister_->busy_ || !queue_.empty()) {
+		return false;
+	}
+	for (auto const& c : connections_) {
+		if (c->busy_ || c->item_) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void batch_runner::abort(std::wstring const& error)
+{
+	report_error(error);
+
+	aborted_ = true;
+	queue_.clear();
+	list_commands_.clear();
+	remote_->StopRecursiveOperation();
+	local_->StopRecursiveOperation();
+	local_done_ = true;
+}
+
+void batch_runner::process(connection & c)
+{
+	std::unique_ptr<CNotification> notification;
+	while ((notification = c.engine_.GetNextNotification())) {
+		switch (notification->GetID()) {
+		case nId_logmsg:
+			{
+				auto const& msg = static_cast<CLogmsgNotification const&>(*notification);
+				if (verbose_ || msg.msgType == logmsg::error) {
+					std::cerr << fz::to_string(msg.msg) << std::endl;
+				}
+			}
+			break;
+		case nId_operation:
+			{
+				int const reply = static_cast<COperationNotification const&>(*notification).replyCode_;
+				if (&c == lister_.get()) {
+					on_listing_reply(reply);
+					next_listing();
+				}
+				else {
+					on_reply(c, reply);
+					execute(c);
+				}
+			}
+			break;
+		case nId_listing:
+			if (&c == lister_.get()) {
+				process_listing(static_cast<CDirectoryListingNotification const&>(*notification));
+			}
+			break;
+		case nId_asyncrequest:
+			answer(c, unique_static_cast<CAsyncRequestNotification>(std::move(notification)));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// Same as the non-interactive part of the request handling of the GUI.
+// Anything not already trusted there is refused.
+void batch_runner::answer(connection & c, std::unique_ptr<CAsyncRequestNotification> && request)
+{
+	switch (request->GetRequestID()) {
+	case reqId_fileexists:
+		static_cast<CFileExistsNotification&>(*request).overwriteAction = job_.overwrite;
+		c.skipped_ = job_.overwrite == CFileExistsNotification::skip;
+		break;
+	case reqId_hostkey:
+	case reqId_hostkeyChanged:
+		{
+			// Known keys are accepted by fzsftp without asking
+			auto const& n = static_cast<CHostKeyNotification const&>(*request);
+			report_error(fz::sprintf(L"The host key of %s:%d is not trusted, fingerprint: %s", n.GetHost(), n.GetPort(), n.hostKeyFingerprint));
+		}
+		break;
+	case reqId_certificate:
+		{
+			auto & n = static_cast<CCertificateNotification&>(*request);
+			if ((n.info_.system_trust() && options_.get_bool(OPTION_TRUST_SYSTEM_TRUST_STORE)) || certs_.IsTrusted(n.info_)) {
+				n.trusted_ = true;
+			}
+			else {
+				report_error(fz::sprintf(L"The certificate of %s:%d is not trusted.", fz::to_wstring_from_utf8(n.info_.get_host()), n.info_.get_port()));
+			}
+		}
+		break;
+	case reqId_insecure_connection:
+		{
+			auto & n = static_cast<CInsecureConnectionNotification&>(*request);
+			n.allow_ = certs_.IsInsecure(fz::to_utf8(n.server_.GetHost()), n.server_.GetPort());
+			if (!n.allow_) {
+				report_error(fz::sprintf(L"%s:%d does not support encryption.", n.server_.GetHost(), n.server_.GetPort()));
+			}
+		}
+		break;
+	case reqId_tls_no_resumption:
+		{
+			auto & n = static_cast<FtpTlsNoResumptionNotification&>(*request);
+			auto const v = certs_.GetSessionResumptionSupport(fz::to_utf8(n.server_.GetHost()), n.server_.GetPort());
+			n.allow_ = v && !*v;
+		}
+		break;
+	default:
+		break;
+	}
+
+	c.engine_.SetAsyncRequestReply(std::move(request));
+}
+
+void batch_runner::next_listing()
+{
+	auto & c = *lister_;
+	while (!c.busy_ && !list_commands_.empty() && !aborted_) {
+		int res;
+		if (!c.engine_.IsConnected()) {
+			c.connecting_ = true;
+			res = c.engine_.Execute(CConnectCommand(job_.site.server, job_.site.Handle(), job_.site.credentials));
+		}
+		else {
+			c.command_ = std::move(list_commands_.front());
+			list_commands_.pop_front();
+			res = c.engine_.Execute(*c.command_);
+		}
+
+		if (res == FZ_REPLY_WOULDBLOCK) {
+			c.busy_ = true;
+			return;
+		}
+		on_listing_reply(res);
+	}
+}
+
+void batch_runner::on_listing_reply(int reply)
+{
+	auto & c = *lister_;
+	c.busy_ = false;
+
+	if (c.connecting_) {
+		c.connecting_ = false;
+		if (reply != FZ_REPLY_OK) {
+			if ((reply & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR) {
+				abort(L"Could not connect to the server.");
+			}
+			else {
+				report_error(L"Could not connect to the server to list the remote directories.");
+				list_commands_.clear();
+				remote_->StopRecursiveOperation();
+			}
+		}
+		return;
+	}
+
+	// Successful listings have already been handled through their notification
+	auto const command = std::move(c.command_);
+	if (reply == FZ_REPLY_OK || !command || command->GetId() != Command::list) {
+		return;
+	}
+
+	if ((reply & FZ_REPLY_LINKNOTDIR) == FZ_REPLY_LINKNOTDIR) {
+		// Symbolic link to a file, gets downloaded as such
+		remote_->LinkIsNotDir(job_.site);
+		return;
+	}
+
+	// Each directory is tried twice before it gets skipped
+	auto const& list = static_cast<CListCommand const&>(*command);
+	remote_->ListingFailed(reply);
+
+	bool retry{};
+	if (!list_commands_.empty() && list_commands_.front()->GetId() == Command::list) {
+		auto const& next = static_cast<CListCommand const&>(*list_commands_.front());
+		retry = next.GetPath() == list.GetPath() && next.GetSubDir() == list.GetSubDir();
+	}
+	if (!retry) {
+		std::wstring const path = list.GetSubDir().empty() ? list.GetPath().GetPath() : list.GetPath().FormatFilename(list.GetSubDir());
+		report_error(fz::sprintf(L"Could not list %s", path));
+	}
+}
+
+void batch_runner::process_listing(CDirectoryListingNotification const& notification)
+{
+	if (!notification.Primary() || !remote_->IsActive()) {
+		return;
+	}
+
+	if (notification.GetPath().empty()) {
+		remote_->ProcessDirectoryListing(nullptr);
+		return;
+	}
+
+	// Failures are handled through the reply to the list command
+	CDirectoryListing listing;
+	if (!notification.Failed() && lister_->engine_.CacheLookup(notification.GetPath(), listing) == FZ_REPLY_OK) {
+		remote_->ProcessDirectoryListing(&listing);
+	}
+}
+
+void batch_runner::queue_download(std::wstring const& remoteFile, CLocalPath const& localPath, CServerPath const& remotePath, int64_t size)
+{
+	batch_item item;
+	item.download = true;
+	item.localPath = localPath;
+	item.localFile = sanitize(remoteFile);
+	item.remotePath = remotePath;
+	item.remoteFile = remoteFile;
+	item.size = size;
+	item.flags = transfer_flags::download | GetTransferFlags(true, job_.site.server, options_, remoteFile, remotePath);
+	queue_.push_back(std::move(item));
+}
+
+void batch_runner::create_local_directory(CLocalPath const& localPath)
+{
+	batch_item item;
+	item.download = true;
+	item.mkdir = true;
+	item.localPath = localPath;
+	item.attempts = 1;
+
+	bool const created = static_cast<bool>(fz::mkdir(fz::to_native(localPath.GetPath()), true));
+	report(item, created ? "ok"sv : "failed"sv);
+}
+
+void batch_runner::drain_local()
+{
+	if (int const failures = local_failures_.exchange(0)) {
+		report_error(fz::sprintf(L"Could not list %d local directories", failures));
+	}
+
+	local_recursive_operation::listing d;
+	while (!local_done_ && local_->take(d)) {
+		if (d.localPath.empty()) {
+			local_done_ = true;
+			local_->StopRecursiveOperation();
+			break;
+		}
+
+		if (d.files.empty() && d.dirs.empty()) {
+			batch_item item;
+			item.mkdir = true;
+			item.localPath = d.localPath;
+			item.remotePath = d.remotePath;
+			queue_.push_back(std::move(item));
+			continue;
+		}
+
+		// Missing remote directories get created by the transfers
+		for (auto const& file : d.files) {
+			batch_item item;
+			item.localPath = d.localPath;
+			item.localFile = file.name;
+			item.remotePath = d.remotePath;
+			item.remoteFile = file.name;
+			item.size = file.size;
+			item.flags = GetTransferFlags(false, job_.site.server, options_, file.name, d.remotePath);
+			queue_.push_back(std::move(item));
+		}
+	}
+}
+
+void batch_runner::schedule()
+{
+	for (auto & c : connections_) {
+		if (queue_.empty() || aborted_) {
+			break;
+		}
+		if (c->busy_ || c->item_) {
+			continue;
+		}
+
+		c->item_ = std::move(queue_.front());
+		queue_.pop_front();
+		execute(*c);
+	}
+}
+
+void batch_runner::execute(connection & c)
+{
+	while (c.item_ && !c.busy_ && !aborted_) {
+		int res;
+		if (!c.engine_.IsConnected()) {
+			c.connecting_ = true;
+			res = c.engine_.Execute(CConnectCommand(job_.site.server, job_.site.Handle(), job_.site.credentials));
+		}
+		else {
+			auto & item = *c.item_;
+			++item.attempts;
+			c.skipped_ = false;
+
+			if (item.mkdir) {
+				res = c.engine_.Execute(CMkdirCommand(item.remotePath, GetMkdirFlags(job_.site.server, options_, item.remotePath)));
+			}
+			else if (item.download) {
+				res = c.engine_.Execute(CFileTransferCommand(fz::file_writer_factory(item.localPath.GetPath() + item.localFile, context_.GetThreadPool()),
+					item.remotePath, item.remoteFile, item.flags));
+			}
+			else {
+				res = c.engine_.Execute(CFileTransferCommand(fz::file_reader_factory(item.localPath.GetPath() + item.localFile, context_.GetThreadPool()),
+					item.remotePath, item.remoteFile, item.flags));
+			}
+		}
+
+		if (res == FZ_REPLY_WOULDBLOCK) {
+			c.busy_ = true;
+			return;
+		}
+		on_reply(c, res);
+	}
+}
+
+void batch_runner::on_reply(connection & c, int reply)
+{
+	c.busy_ = false;
+	if (!c.item_) {
+		return;
+	}
+
+	auto & item = *c.item_;
+	if (c.connecting_) {
+		c.connecting_ = false;
+		if (reply == FZ_REPLY_OK) {
+			return;
+		}
+		if ((reply & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR) {
+			// E.g. wrong credentials, no point in trying further
+			abort(L"Could not connect to the server.");
+			return;
+		}
+
+		// Like in the GUI, failing to connect counts as failed attempt
+		++item.attempts;
+	}
+	else if (reply == FZ_REPLY_OK) {
+		finish(c, c.skipped_ ? "skipped"sv : "ok"sv);
+		return;
+	}
+
+	// Otherwise the item stays and is tried again, reconnecting if needed
+	if ((reply & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR || item.attempts > job_.retries) {
+		finish(c, "failed"sv);
+	}
+}
+
+void batch_runner::finish(connection & c, std::string_view status)
+{
+	report(*c.item_, status);
+	c.item_.reset();
+}
+
+void batch_runner::report(batch_item const& item, std::string_view status)
+{
+	json_event e(item.mkdir ? "dir"sv : "file"sv);
+	e.add("direction"sv, item.download ? "download"sv : "upload"sv);
+	if (item.mkdir) {
+		if (!item.remotePath.empty()) {
+			e.add("remote"sv, item.remotePath.GetPath());
+		}
+		e.add("local"sv, item.localPath.GetPath());
+	}
+	else {
+		e.add("remote"sv, item.remotePath.FormatFilename(item.remoteFile));
+		e.add("local"sv, item.localPath.GetPath() + item.localFile);
+		e.add("size"sv, item.size);
+	}
+	e.add("status"sv, status).add("attempts"sv, item.attempts);
+	out_ << e.str() << std::endl;
+
+	if (status == "ok"sv) {
+		++done_;
+		if (item.size > 0) {
+			bytes_ += item.size;
+		}
+	}
+	else if (status == "skipped"sv) {
+		++skipped_;
+	}
+	else {
+		++failed_;
+	}
+}
+
+void batch_runner::report_error(std::wstring const& error)
+{
+	error_ = true;
+	out_ << json_event("error"sv).add("message"sv, error).str() << std::endl;
+}
+
+void batch_runner::report_progress(bool done)
+{
+	auto const now = fz::monotonic_clock::now();
+
+	// Add what the running transfers have made so far
+	int64_t bytes = bytes_;
+	int64_t active{};
+	for (auto & c : connections_) {
+		if (!c->item_) {
+			continue;
+		}
+		++active;
+
+		bool changed{};
+		auto const status = c->engine_.GetTransferStatus(changed);
+		if (c->busy_ && !c->connecting_ && status && status.currentOffset > status.startOffset) {
+			bytes += status.currentOffset - status.startOffset;
+		}
+	}
+
+	int64_t rate{};
+	if (done) {
+		auto const ms = (now - start_).get_milliseconds();
+		rate = ms > 0 ? bytes * 1000 / ms : 0;
+	}
+	else {
+		auto const ms = (now - last_progress_).get_milliseconds();
+		rate = ms > 0 ? std::max(int64_t(0), bytes - last_bytes_) * 1000 / ms : 0;
+	}
+	last_progress_ = now;
+	last_bytes_ = bytes;
+
+	json_event e(done ? "done"sv : "progress"sv);
+	if (done) {
+		e.add("status"sv, (!error_ && !failed_) ? "ok"sv : "failed"sv);
+	}
+	e.add("elapsed_ms"sv, (now - start_).get_milliseconds());
+	e.add("done"sv, done_).add("skipped"sv, skipped_).add("failed"sv, failed_);
+	e.add("active"sv, active).add("queued"sv, queue_.size());
+	e.add("bytes"sv, bytes).add("bytes_per_second"sv, rate);
+	out_ << e.str() << std::endl;
+}
@@ -0,0 +1,132 @@
+#ifndef FILEZILLA_BATCH_RUNNER_HEADER
+#define FILEZILLA_BATCH_RUNNER_HEADER
+
+#include "job.h"
+
+#include "../include/FileZillaEngine.h"
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+class CFileZillaEngineContext;
+class COptionsBase;
+class cert_store;
+
+class batch_item final
+{
+public:
+	bool download{};
+
+	// Creates the remote directory instead of transferring a file
+	bool mkdir{};
+
+	CLocalPath localPath;
+	std::wstring localFile;
+	CServerPath remotePath;
+	std::wstring remoteFile;
+	int64_t size{-1};
+	transfer_flags flags{};
+
+	int attempts{};
+};
+
+/*
+ * Runs a batch job without user interface.
+ *
+ * Remote directories are listed recursively on a dedicated connection, local
+ * directories are enumerated in the background. The files found are queued
+ * and handed to the transfer connections as these become idle. Connections
+ * are established on demand and re-established after having been lost.
+ *
+ * Progress is written to the output stream as one JSON object per line:
+ * an event for each finished file and directory, a summary every second, and
+ * a final summary. Requests that would need user interaction are answered
+ * from the stored settings or refused.
+ *
+ * Everything apart from the wakeup callbacks runs on the thread calling run().
+ */
+class batch_runner final
+{
+public:
+	batch_runner(CFileZillaEngineContext & context, COptionsBase & options, cert_store & certs, batch_job const& job, std::ostream & out, bool verbose);
+	~batch_runner();
+
+	batch_runner(batch_runner const&) = delete;
+	batch_runner& operator=(batch_runner const&) = delete;
+
+	// Returns true if all files and directories have been transferred
+	bool run();
+
+private:
+	class connection;
+	class remote_walker;
+	class local_walker;
+
+	void wakeup();
+
+	void start();
+	bool finished() const;
+	void abort(std::wstring const& error);
+
+	void process(connection & c);
+	void answer(connection & c, std::unique_ptr<CAsyncRequestNotification> && request);
+
+	void next_listing();
+	void on_listing_reply(int reply);
+	void process_listing(CDirectoryListingNotification const& notification);
+
+	void queue_download(std::wstring const& remoteFile, CLocalPath const& localPath, CServerPath const& remotePath, int64_t size);
+	void create_local_directory(CLocalPath const& localPath);
+	void drain_local();
+
+	void schedule();
+	void execute(connection & c);
+	void on_reply(connection & c, int reply);
+	void finish(connection & c, std::string_view status);
+
+	void report(batch_item const& item, std::string_view status);
+	void report_error(std::wstring const& error);
+	void report_progress(bool done);
+
+	CFileZillaEngineContext & context_;
+	COptionsBase & options_;
+	cert_store & certs_;
+	batch_job const& job_;
+	std::ostream & out_;
+	bool const verbose_{};
+
+	fz::mutex mtx_;
+	fz::condition cond_;
+
+	std::unique_ptr<connection> lister_;
+	std::deque<std::unique_ptr<CCommand>> list_commands_;
+	std::unique_ptr<remote_walker> remote_;
+
+	std::unique_ptr<local_walker> local_;
+	std::atomic<int> local_failures_{};
+	bool local_done_{true};
+
+	std::vector<std::unique_ptr<connection>> connections_;
+	std::deque<batch_item> queue_;
+
+	fz::monotonic_clock start_;
+	fz::monotonic_clock last_progress_;
+	int64_t last_bytes_{};
+
+	int64_t done_{};
+	int64_t skipped_{};
+	int64_t failed_{};
+	int64_t bytes_{};
+	bool error_{};
+	bool aborted_{};
+};
+
+#endif
@@ -2,6 +2,543 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Listings get handed off in chunks of at most this many entries
+size_t const max_chunk_entries = 5000;
+
+#if defined(__linux__) && defined(SYS_getdents64) && defined(STATX_BASIC_STATS)
+// Reads the directory entries in large batches using getdents64 and stats
+// them relative to the directory descriptor using statx, asking only for the
+// fields needed. Mirrors the semantics of fz::local_filesys.
+class dir_reader final
+{
+public:
+	~dir_reader()
+	{
+		end_find_files();
+	}
+
+	bool begin_find_files(fz::native_string const& path, bool skip_links)
+	{
+		end_find_files();
+
+		skip_links_ = skip_links;
+		fd_ = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		return fd_ != -1;
+	}
+
+	void end_find_files()
+	{
+		if (fd_ != -1) {
+			::close(fd_);
+			fd_ = -1;
+		}
+		pos_ = 0;
+		len_ = 0;
+	}
+
+	bool get_next_file(fz::native_string & name, bool & is_link, fz::local_filesys::type & t, int64_t * size, fz::datetime * time, int * attributes)
+	{
+		unsigned int const mask = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME;
+
+		while (fd_ != -1) {
+			if (pos_ >= len_) {
+				if (buffer_.empty()) {
+					buffer_.resize(64 * 1024);
+				}
+
+				long r;
+				do {
+					r = syscall(SYS_getdents64, fd_, buffer_.data(), buffer_.size());
+				} while (r == -1 && errno == EINTR);
+				if (r <= 0) {
+					end_find_files();
+					return false;
+				}
+				len_ = static_cast<size_t>(r);
+				pos_ = 0;
+			}
+
+			auto const* ent = reinterpret_cast<struct dirent64 const*>(buffer_.data() + pos_);
+			pos_ += ent->d_reclen;
+
+			char const* n = ent->d_name;
+			if (!n[0] || (n[0] == '.' && (!n[1] || (n[1] == '.' && !n[2])))) {
+				continue;
+			}
+
+			is_link = ent->d_type == DT_LNK;
+			if (is_link && skip_links_) {
+				// No need to stat what gets skipped anyhow
+				continue;
+			}
+
+			struct statx buf;
+			int res = statx(fd_, n, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &buf);
+			if (!res && S_ISLNK(buf.stx_mode)) {
+				is_link = true;
+				if (skip_links_) {
+					continue;
+				}
+				res = statx(fd_, n, AT_NO_AUTOMOUNT, mask, &buf);
+				if (res) {
+					// Dangling link
+					name = n;
+					t = fz::local_filesys::file;
+					clear(size, time, attributes);
+					return true;
+				}
+			}
+
+			name = n;
+			if (res) {
+				// Happens for example in case of permission denied
+				t = (ent->d_type == DT_DIR) ? fz::local_filesys::dir : fz::local_filesys::file;
+				clear(size, time, attributes);
+				return true;
+			}
+
+			t = S_ISDIR(buf.stx_mode) ? fz::local_filesys::dir : fz::local_filesys::file;
+			if (size) {
+				*size = (t == fz::local_filesys::dir) ? -1 : static_cast<int64_t>(buf.stx_size);
+			}
+			if (time) {
+				*time = fz::datetime(static_cast<time_t>(buf.stx_mtime.tv_sec), fz::datetime::milliseconds);
+				*time += fz::duration::from_milliseconds(buf.stx_mtime.tv_nsec / 1000000);
+			}
+			if (attributes) {
+				*attributes = buf.stx_mode & 0777;
+			}
+			return true;
+		}
+
+		return false;
+	}
+
+private:
+	static void clear(int64_t * size, fz::datetime * time, int * attributes)
+	{
+		if (size) {
+			*size = -1;
+		}
+		if (time) {
+			*time = fz::datetime();
+		}
+		if (attributes) {
+			*attributes = -1;
+		}
+	}
+
+	int fd_{-1};
+	bool skip_links_{};
+
+	std::vector<char> buffer_;
+	size_t pos_{};
+	size_t len_{};
+};
+#else
+class dir_reader final
+{
+public:
+	bool begin_find_files(fz::native_string const& path, bool skip_links)
+	{
+		skip_links_ = skip_links;
+		return fs_.begin_find_files(path);
+	}
+
+	bool get_next_file(fz::native_string & name, bool & is_link, fz::local_filesys::type & t, int64_t * size, fz::datetime * time, int * attributes)
+	{
+		while (fs_.get_next_file(name, is_link, t, size, time, attributes)) {
+			if (!is_link || !skip_links_) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	fz::local_filesys fs_;
+	bool skip_links_{};
+};
+#endif
+
+size_t walker_threads(bool have_pool)
+{
+	if (!have_pool) {
+		return 1;
+	}
+
+	// Enumerating is bound by I/O latency rather than CPU, even with few cores
+	// a couple of outstanding requests help. Beyond a handful returns diminish.
+	size_t const cores = std::thread::hardware_concurrency();
+	return std::clamp<size_t>(cores, 4, 8);
+}
+}
+
+// Each thread owns a deque of directories. Directories found during enumeration
+// are appended to the deque of the thread that found them. Owners take from the
+// front, idle threads steal from the back of the other deques.
+//
+// The thread that called walk() additionally hands off the results in the order
+// a sequential breadth-first walk would produce, independent of which thread
+// finishes first. Results of directories listed early are kept until then.
+class local_recursive_operation::tree_walker final
+{
+public:
+	tree_walker(local_recursive_operation & op, size_t threads)
+		: op_(op)
+		, filters_(op.m_filters.first)
+		, mode_(op.m_operationMode)
+		, ignore_links_(op.m_ignoreLinks)
+	{
+		for (size_t i = 0; i < threads; ++i) {
+			workers_.emplace_back(std::make_unique<worker>());
+		}
+	}
+
+	void add_dir(CLocalPath const& localPath, CServerPath const& remotePath, bool recurse)
+	{
+		auto n = std::make_shared<node>();
+		n->localPath_ = localPath;
+		n->remotePath_ = remotePath;
+		n->recurse_ = recurse;
+		order_.push_back(n);
+		workers_[0]->queue_.push_back(n);
+	}
+
+	void walk()
+	{
+		for (size_t i = 1; i < workers_.size() && op_.pool_; ++i) {
+			// If spawning fails the other threads pick up the slack
+			workers_[i]->task_ = op_.pool_->spawn([this, i] { work(i); });
+		}
+
+		coordinate();
+
+		{
+			fz::scoped_lock l(idle_mutex_);
+			finished_ = true;
+			for (auto & w : workers_) {
+				w->cond_.signal(l);
+			}
+		}
+		for (auto & w : workers_) {
+			w->task_.join();
+		}
+	}
+
+	// Called with the mutex of the operation held
+	void cancel()
+	{
+		cancelled_ = true;
+		{
+			fz::scoped_lock l(idle_mutex_);
+			for (auto & w : workers_) {
+				w->cond_.signal(l);
+			}
+		}
+		fz::scoped_lock l(results_mutex_);
+		results_cond_.signal(l);
+	}
+
+	// Called with the mutex of the operation held
+	void update_statistics()
+	{
+		uint64_t const dirs = dirs_;
+		uint64_t const entries = entries_;
+		op_.stats_.dirs_ += dirs - reported_dirs_;
+		op_.stats_.entries_ += entries - reported_entries_;
+		op_.stats_.elapsed_ = fz::monotonic_clock::now() - op_.walk_start_;
+		reported_dirs_ = dirs;
+		reported_entries_ = entries;
+	}
+
+private:
+	class node;
+
+	class chunk final
+	{
+	public:
+		listing listing_;
+		std::vector<std::shared_ptr<node>> children_;
+	};
+
+	class node final
+	{
+	public:
+		CLocalPath localPath_;
+		CServerPath remotePath_;
+		bool recurse_{true};
+
+		// Guarded by results_mutex_
+		std::deque<chunk> chunks_;
+		bool done_{};
+	};
+
+	class worker final
+	{
+	public:
+		fz::mutex mutex_{false};
+		std::deque<std::shared_ptr<node>> queue_;
+
+		// Guarded by idle_mutex_
+		fz::condition cond_;
+		bool idle_{};
+
+		dir_reader reader_;
+		fz::async_task task_;
+	};
+
+	void coordinate()
+	{
+		while (!cancelled_) {
+			chunk c;
+			bool have_chunk{};
+			{
+				fz::scoped_lock l(results_mutex_);
+				while (!order_.empty()) {
+					auto & head = *order_.front();
+					if (!head.chunks_.empty()) {
+						c = std::move(head.chunks_.front());
+						head.chunks_.pop_front();
+						have_chunk = true;
+						break;
+					}
+					if (!head.done_) {
+						break;
+					}
+					order_.pop_front();
+				}
+				if (order_.empty()) {
+					// Everything got handed off
+					return;
+				}
+				for (auto & child : c.children_) {
+					order_.emplace_back(std::move(child));
+				}
+			}
+
+			if (have_chunk) {
+				deliver(std::move(c.listing_));
+				continue;
+			}
+
+			// Next directory in order not ready yet, help out
+			if (auto n = take(0)) {
+				process(0, *n);
+				continue;
+			}
+
+			fz::scoped_lock l(results_mutex_);
+			auto const& head = *order_.front();
+			if (head.chunks_.empty() && !head.done_ && !cancelled_) {
+				results_cond_.wait(l);
+			}
+		}
+	}
+
+	void deliver(listing && d)
+	{
+		fz::scoped_lock l(op_.mutex_);
+		if (op_.recursion_roots_.empty()) {
+			cancelled_ = true;
+			return;
+		}
+
+		update_statistics();
+		op_.EnqueueEnumeratedListing(l, std::move(d));
+	}
+
+	void work(size_t i)
+	{
+		auto & w = *workers_[i];
+		while (true) {
+			auto n = take(i);
+			if (!n) {
+				fz::scoped_lock l(idle_mutex_);
+				if (finished_ || cancelled_) {
+					break;
+				}
+
+				// Something might have been queued before we took the lock
+				n = take(i);
+				if (!n) {
+					w.idle_ = true;
+					w.cond_.wait(l);
+					w.idle_ = false;
+					continue;
+				}
+			}
+			process(i, *n);
+		}
+	}
+
+	std::shared_ptr<node> take(size_t i)
+	{
+		{
+			auto & w = *workers_[i];
+			fz::scoped_lock l(w.mutex_);
+			if (!w.queue_.empty()) {
+				auto n = std::move(w.queue_.front());
+				w.queue_.pop_front();
+				return n;
+			}
+		}
+
+		for (size_t j = 1; j < workers_.size(); ++j) {
+			auto & victim = *workers_[(i + j) % workers_.size()];
+			fz::scoped_lock l(victim.mutex_);
+			if (!victim.queue_.empty()) {
+				auto n = std::move(victim.queue_.back());
+				victim.queue_.pop_back();
+				return n;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void process(size_t i, node & n)
+	{
+		auto & w = *workers_[i];
+
+		auto const new_chunk = [&n]() {
+			chunk c;
+			c.listing_.localPath = n.localPath_;
+			c.listing_.remotePath = n.remotePath_;
+			return c;
+		};
+
+		chunk c = new_chunk();
+		bool sentPartial = false;
+
+		if (w.reader_.begin_find_files(fz::to_native(n.localPath_.GetPath()), ignore_links_)) {
+			listing::entry entry;
+			bool isLink{};
+			fz::native_string name;
+			fz::local_filesys::type t{};
+			while (!cancelled_ && w.reader_.get_next_file(name, isLink, t, &entry.size, &entry.time, &entry.attributes)) {
+				++entries_;
+				entry.name = fz::to_wstring(name);
+
+				if (filter_manager::FilenameFiltered(filters_, entry.name, n.localPath_.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
+					continue;
+				}
+
+				entry.flags = (t == fz::local_filesys::type::dir) ? listing::entry::flag_dir : 0;
+				if (isLink) {
+					entry.flags |= listing::entry::flag_link;
+				}
+
+				if (t == fz::local_filesys::dir) {
+					if (n.recurse_) {
+						c.children_.emplace_back(child(n, entry.name));
+					}
+					c.listing_.dirs.emplace_back(std::move(entry));
+				}
+				else {
+					c.listing_.files.emplace_back(std::move(entry));
+				}
+
+				if (c.listing_.files.size() + c.listing_.dirs.size() >= max_chunk_entries) {
+					sentPartial = true;
+					publish(i, n, std::move(c), false);
+					c = new_chunk();
+				}
+			}
+		}
+		else {
+			op_.on_listing_failed();
+		}
+
+		if (!sentPartial || !c.listing_.files.empty() || !c.listing_.dirs.empty()) {
+			publish(i, n, std::move(c), true);
+		}
+		else {
+			publish(i, n, chunk(), true);
+		}
+	}
+
+	std::shared_ptr<node> child(node const& parent, std::wstring const& name)
+	{
+		auto n = std::make_shared<node>();
+		n->localPath_ = parent.localPath_;
+		n->localPath_.AddSegment(name);
+		n->remotePath_ = parent.remotePath_;
+		if (!n->remotePath_.empty() && mode_ == recursive_transfer) {
+			// Non-flatten case
+			n->remotePath_.AddSegment(name);
+		}
+		return n;
+	}
+
+	// An empty chunk, i.e. one without local path, only marks the directory as done.
+	void publish(size_t i, node & n, chunk && c, bool last)
+	{
+		if (!c.children_.empty()) {
+			{
+				auto & w = *workers_[i];
+				fz::scoped_lock l(w.mutex_);
+				w.queue_.insert(w.queue_.end(), c.children_.cbegin(), c.children_.cend());
+			}
+
+			fz::scoped_lock l(idle_mutex_);
+			for (auto & other : workers_) {
+				if (other->idle_) {
+					other->cond_.signal(l);
+				}
+			}
+		}
+
+		if (last) {
+			++dirs_;
+		}
+
+		fz::scoped_lock l(results_mutex_);
+		if (!c.listing_.localPath.empty()) {
+			n.chunks_.emplace_back(std::move(c));
+		}
+		n.done_ = last;
+		results_cond_.signal(l);
+	}
+
+	local_recursive_operation & op_;
+
+	std::vector<CFilter> const filters_;
+	OperationMode const mode_;
+	bool const ignore_links_;
+
+	std::vector<std::unique_ptr<worker>> workers_;
+
+	fz::mutex idle_mutex_{false};
+	bool finished_{};
+
+	fz::mutex results_mutex_{false};
+	fz::condition results_cond_;
+	std::deque<std::shared_ptr<node>> order_;
+
+	std::atomic<bool> cancelled_{};
+	std::atomic<uint64_t> dirs_{};
+	std::atomic<uint64_t> entries_{};
+	uint64_t reported_dirs_{};
+	uint64_t reported_entries_{};
+};
+
+
 local_recursive_operation::local_recursive_operation()
 {}
 
@@ -86,6 +623,9 @@ void local_recursive_operation::StopRecursiveOperation()
 
 		m_operationMode = recursive_none;
 		recursion_roots_.clear();
+		if (walker_) {
+			walker_->cancel();
+		}
 
 		m_processedFiles = 0;
 		m_processedDirectories = 0;
@@ -96,30 +636,28 @@ void local_recursive_operation::StopRecursiveOperation()
 	m_listedDirectories.clear();
 }
 
-void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse)
+local_recursive_operation::walk_statistics local_recursive_operation::GetWalkStatistics()
 {
-	if (recursion_roots_.empty()) {
-		return;
-	}
+	fz::scoped_lock l(mutex_);
+	return stats_;
+}
 
-	auto& root = recursion_roots_.front();
+uint64_t local_recursive_operation::walk_statistics::dirs_per_second() const
+{
+	auto const ms = elapsed_.get_milliseconds();
+	return (ms > 0) ? dirs_ * 1000 / static_cast<uint64_t>(ms) : 0;
+}
 
-	if (recurse) {
-		// Queue for recursion
-		for (auto const& entry : d.dirs) {
-			local_recursion_root::new_dir dir;
-			CLocalPath localSub = d.localPath;
-			localSub.AddSegment(entry.name);
+uint64_t local_recursive_operation::walk_statistics::entries_per_second() const
+{
+	auto const ms = elapsed_.get_milliseconds();
+	return (ms > 0) ? entries_ * 1000 / static_cast<uint64_t>(ms) : 0;
+}
 
-			CServerPath remoteSub = d.remotePath;
-			if (!remoteSub.empty()) {
-				if (m_operationMode == recursive_transfer) {
-					// Non-flatten case
-					remoteSub.AddSegment(entry.name);
-				}
-			}
-			root.add_dir_to_visit(localSub, remoteSub);
-		}
+void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d)
+{
+	if (recursion_roots_.empty()) {
+		return;
 	}
 
 	m_listedDirectories.emplace_back(std::move(d));
@@ -137,92 +675,31 @@ void local_recursive_operation::thread_entry()
 	{
 		fz::scoped_lock l(mutex_);
 
-		// Make copy, as it is used in the unlocked section
-		auto filters = m_filters.first;
+		stats_ = walk_statistics();
+		stats_.threads_ = walker_threads(pool_ != nullptr);
+		walk_start_ = fz::monotonic_clock::now();
 
 		while (!recursion_roots_.empty()) {
-			listing d;
-			bool recurse{true};
-
-			{
-				auto& root = recursion_roots_.front();
-				if (root.m_dirsToVisit.empty()) {
-					recursion_roots_.pop_front();
-					continue;
-				}
-
-				auto const& dir = root.m_dirsToVisit.front();
-				d.localPath = dir.localPath;
-				d.remotePath = dir.remotePath;
-				recurse = dir.recurse;
+			auto& root = recursion_roots_.front();
+			if (root.m_dirsToVisit.empty()) {
+				recursion_roots_.pop_front();
+				continue;
+			}
 
-				root.m_dirsToVisit.pop_front();
+			tree_walker walker(*this, stats_.threads_);
+			for (auto const& dir : root.m_dirsToVisit) {
+				walker.add_dir(dir.localPath, dir.remotePath, dir.recurse);
 			}
+			root.m_dirsToVisit.clear();
 
 			// Do the slow part without holding mutex
+			walker_ = &walker;
 			l.unlock();
-
-			bool sentPartial = false;
-			fz::local_filesys fs;
-			fz::native_string localPath = fz::to_native(d.localPath.GetPath());
-
-			if (fs.begin_find_files(localPath)) {
-				listing::entry entry;
-				bool isLink{};
-				fz::native_string name;
-				fz::local_filesys::type t{};
-				while (fs.get_next_file(name, isLink, t, &entry.size, &entry.time, &entry.attributes)) {
-					if (isLink && m_ignoreLinks) {
-						continue;
-					}
-					entry.name = fz::to_wstring(name);
-
-					if (!filter_manager::FilenameFiltered(filters, entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
-						entry.flags = (t == fz::local_filesys::type::dir) ? listing::entry::flag_dir : 0;
-						if (isLink) {
-							entry.flags |= listing::entry::flag_link;
-						}
-
-						if (t == fz::local_filesys::dir) {
-							d.dirs.emplace_back(std::move(entry));
-						}
-						else {
-							d.files.emplace_back(std::move(entry));
-						}
-
-						// If having queued 5k items, hand off to main thread.
-						if (d.files.size() + d.dirs.size() >= 5000) {
-							sentPartial = true;
-
-							listing next;
-							next.localPath = d.localPath;
-							next.remotePath = d.remotePath;
-
-							l.lock();
-							// Check for cancellation
-							if (recursion_roots_.empty()) {
-								l.unlock();
-								break;
-							}
-							EnqueueEnumeratedListing(l, std::move(d), recurse);
-							l.unlock();
-							d = next;
-						}
-					}
-				}
-			}
-			else {
-				on_listing_failed();
-			}
-
+			walker.walk();
 			l.lock();
-			// Check for cancellation
-			if (recursion_roots_.empty()) {
-				break;
-			}
-			if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
-				EnqueueEnumeratedListing(l, std::move(d), recurse);
-			}
+			walker_ = nullptr;
+
+			walker.update_statistics();
 		}
 
 		listing d;
@@ -231,4 +708,3 @@ void local_recursive_operation::thread_entry()
 
 	on_listed_directory();
 }
-
@@ -82,6 +82,20 @@ public:
 	// thread entry point for processing files
 	void thread_entry();
 
+	// Enumeration throughput of the running or last finished operation
+	class walk_statistics final
+	{
+	public:
+		uint64_t dirs_{};
+		uint64_t entries_{};
+		size_t threads_{};
+		fz::duration elapsed_;
+
+		uint64_t dirs_per_second() const;
+		uint64_t entries_per_second() const;
+	};
+	walk_statistics GetWalkStatistics();
+
 protected:
 	// called by start_recursive_operation for the derived to initialise and call this base class func
 	virtual bool do_start_recursive_operation(OperationMode mode, ActiveFilters const& filters, bool ignore_links);
@@ -93,7 +107,14 @@ protected:
 	virtual void on_listing_failed() = 0;
 
 protected:
-	void EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse);
+	void EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d);
+
+	// Enumerates the directories of a recursion root in parallel
+	class tree_walker;
+	tree_walker* walker_{};
+
+	walk_statistics stats_;
+	fz::monotonic_clock walk_start_;
 
 	std::deque<local_recursion_root> recursion_roots_;
 
@@ -4,6 +4,8 @@
 #include "ipcmutex.h"
 #include "xml_file.h"
 
+#include "../include/engine_options.h"
+
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/translate.hpp>
 #include <libfilezilla/util.hpp>
@@ -348,6 +350,9 @@ CLocalPath XmlOptions::InitSettingsDir()
 	}
 
 	set(OPTION_DEFAULT_SETTINGSDIR, p.GetPath(), true);
+	if (!p.empty()) {
+		set(OPTION_SERVER_CAPABILITIES_FILE, p.GetPath() + L"capabilities.xml", true);
+	}
 	set_ipcmutex_lockfile_path(p.GetPath());
 
 	return p;
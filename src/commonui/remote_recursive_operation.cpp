@@ -1,6 +1,7 @@
 #include "remote_recursive_operation.h"
 #include "chmod_data.h"
 #include "filter.h"
+#include "tree_sync.h"
 
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
@@ -144,8 +145,14 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 	, recursion_root::new_dir const& dir, std::wstring const& remotePath)
 {
 	std::vector<std::wstring> filesToDelete;
+	std::vector<std::pair<std::wstring, std::wstring>> chmodEntries;
 	bool const restricted = static_cast<bool>(dir.restricted);
 
+	bool const sync = sync_ && (m_operationMode == recursive_transfer || m_operationMode == recursive_transfer_flatten);
+	if (sync) {
+		sync_->begin_download_dir(dir.localDir);
+	}
+
 	for (size_t i = pDirectoryListing->size(); i > 0; --i) {
 		const CDirentry& entry = (*pDirectoryListing)[i - 1];
 
@@ -187,6 +194,9 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 			case recursive_transfer_flatten:
 			case recursive_proxy_transfer:
 				{
+					if (sync && !sync_->need_download(sanitize_filename(entry.name), entry.size, entry.has_date() ? entry.time : fz::datetime())) {
+						break;
+					}
 					handle_file(entry.name,	dir.localDir, pDirectoryListing->path, entry.size);
 				}
 				break;
@@ -207,14 +217,21 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 				char permissions[9];
 				bool res = chmodData_->ConvertPermissions(*entry.permissions, permissions);
 				std::wstring newPerms = chmodData_->GetPermissions(res ? permissions : 0, entry.is_dir());
-				process_command(std::make_unique<CChmodCommand>(pDirectoryListing->path, entry.name, newPerms));
+				chmodEntries.emplace_back(entry.name, std::move(newPerms));
 			}
 		}
 	}
 
+	if (sync) {
+		sync_->end_download_dir();
+	}
+
 	if (m_operationMode == recursive_delete && !filesToDelete.empty()) {
 		process_command(std::make_unique<CDeleteCommand>(pDirectoryListing->path, std::move(filesToDelete)));
 	}
+	if (!chmodEntries.empty()) {
+		process_command(std::make_unique<CChmodCommand>(pDirectoryListing->path, std::move(chmodEntries)));
+	}
 }
 
 void remote_recursive_operation::ProcessDirectoryListing(CDirectoryListing const* pDirectoryListing)
@@ -286,6 +303,11 @@ void remote_recursive_operation::SetChmodData(std::unique_ptr<ChmodData>&& chmod
 	chmodData_ = std::move(chmodData);
 }
 
+void remote_recursive_operation::SetTreeSync(std::unique_ptr<tree_sync>&& sync)
+{
+	sync_ = std::move(sync);
+}
+
 void remote_recursive_operation::StopRecursiveOperation()
 {
 	if (m_operationMode != recursive_none) {
@@ -293,6 +315,7 @@ void remote_recursive_operation::StopRecursiveOperation()
 	}
 	recursion_roots_.clear();
 	chmodData_.reset();
+	sync_.reset();
 }
 
 void remote_recursive_operation::ListingFailed(int error)
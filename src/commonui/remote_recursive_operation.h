@@ -16,6 +16,7 @@
 #include <string>
 
 class ChmodData;
+class tree_sync;
 
 class FZCUI_PUBLIC_SYMBOL recursion_root final
 {
@@ -73,6 +74,10 @@ public:
 	// Needed for recursive_chmod
 	void SetChmodData(std::unique_ptr<ChmodData>&& chmodData);
 
+	// For recursive_transfer(_flatten), only transfer files missing or differing locally
+	void SetTreeSync(std::unique_ptr<tree_sync>&& sync);
+	tree_sync const* GetTreeSync() const { return sync_.get(); }
+
 	virtual void StopRecursiveOperation();
 
 protected:
@@ -124,6 +129,8 @@ protected:
 	// Needed for recursive_chmod
 	std::unique_ptr<ChmodData> chmodData_;
 
+	std::unique_ptr<tree_sync> sync_;
+
 	int listFlags_{};
 };
 
@@ -38,6 +38,8 @@ Site::Site(Site const& s)
 	, m_bookmarks(s.m_bookmarks)
 	, m_colour(s.m_colour)
 	, connection_limit_(s.connection_limit_)
+	, speed_limit_inbound_(s.speed_limit_inbound_)
+	, speed_limit_outbound_(s.speed_limit_outbound_)
 {
 	if (s.data_) {
 		data_ = std::make_shared<SiteHandleData>(*s.data_);
@@ -55,6 +57,8 @@ Site& Site::operator=(Site const& s)
 		m_bookmarks = s.m_bookmarks;
 		m_colour = s.m_colour;
 		connection_limit_ = s.connection_limit_;
+		speed_limit_inbound_ = s.speed_limit_inbound_;
+		speed_limit_outbound_ = s.speed_limit_outbound_;
 		data_.reset();
 
 		if (s.data_) {
@@ -99,6 +103,10 @@ bool Site::operator==(Site const& s) const
 		return false;
 	}
 
+	if (speed_limit_inbound_ != s.speed_limit_inbound_ || speed_limit_outbound_ != s.speed_limit_outbound_) {
+		return false;
+	}
+
 	return true;
 }
 
@@ -131,6 +131,10 @@ public:
 
 	unsigned int connection_limit_{};
 
+	// In KiB/s, 0 for unlimited
+	unsigned int speed_limit_inbound_{};
+	unsigned int speed_limit_outbound_{};
+
 private:
 	std::shared_ptr<SiteHandleData> data_;
 };
@@ -6,9 +6,103 @@
 
 #include "../include/version.h"
 
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/mutex.hpp>
 #include <libfilezilla/translate.hpp>
 
 #include <cstring>
+#include <map>
+
+namespace {
+struct indexed_file final
+{
+	CXmlFile file;
+	fz::datetime mtime;
+	int64_t size{-1};
+
+	// Escaped site paths, without the leading 0 or 1, to their Server and Bookmark elements
+	std::map<std::wstring, pugi::xml_node> nodes;
+
+	// Protocol, host and port to site paths, built on first use
+	std::multimap<std::wstring, std::wstring> servers;
+	bool has_servers{};
+};
+
+fz::mutex index_mutex;
+std::map<std::wstring, std::unique_ptr<indexed_file>> index_files;
+
+void index_nodes(indexed_file & f, pugi::xml_node element, std::wstring const& prefix, bool in_server)
+{
+	for (auto child = element.first_child(); child; child = child.next_sibling()) {
+		bool const bookmark = !strcmp(child.name(), "Bookmark");
+		if (in_server != bookmark) {
+			continue;
+		}
+		bool const server = !strcmp(child.name(), "Server");
+		if (!bookmark && !server && strcmp(child.name(), "Folder")) {
+			continue;
+		}
+
+		std::wstring name = GetTextElement_Trimmed(child, "Name");
+		if (name.empty()) {
+			name = GetTextElement_Trimmed(child);
+		}
+		if (name.empty()) {
+			continue;
+		}
+
+		// Like GetElementByPath, the first item with a given name wins
+		auto path = prefix + L"/" + site_manager::EscapeSegment(name);
+		if (!bookmark) {
+			index_nodes(f, child, path, server);
+		}
+		if (server || bookmark) {
+			f.nodes.emplace(std::move(path), child);
+		}
+	}
+}
+
+bool get_file_state(std::wstring const& name, fz::datetime & mtime, int64_t & size)
+{
+	bool is_link{};
+	return fz::local_filesys::get_file_info(fz::to_native(name), is_link, &size, &mtime, nullptr) == fz::local_filesys::file;
+}
+
+// Returns the index for the file, (re)loading it if needed. Caller needs to hold index_mutex
+// and the sitemanager mutex.
+indexed_file* get_indexed_file(std::wstring const& name)
+{
+	auto & f = index_files[name];
+	if (f) {
+		fz::datetime mtime;
+		int64_t size{-1};
+		if (get_file_state(name, mtime, size) && mtime == f->mtime && size == f->size) {
+			return f.get();
+		}
+	}
+
+	f = std::make_unique<indexed_file>();
+	f->file.SetFileName(name);
+	auto document = f->file.Load();
+	if (!document) {
+		index_files.erase(name);
+		return nullptr;
+	}
+	get_file_state(name, f->mtime, f->size);
+
+	auto element = document.child("Servers");
+	if (element) {
+		index_nodes(*f, element, std::wstring(), false);
+	}
+
+	return f.get();
+}
+
+std::wstring server_key(CServer const& server)
+{
+	return fz::sprintf(L"%d %s %u", server.GetProtocol(), fz::str_tolower_ascii(server.GetHost()), server.GetPort());
+}
+}
 
 bool site_manager::Save(std::wstring const& settings_file, CSiteManagerSaveXmlHandler& pHandler, std::wstring& error)
 {
@@ -32,6 +126,7 @@ bool site_manager::Save(std::wstring const& settings_file, CSiteManagerSaveXmlHa
 
 	bool res = pHandler.SaveTo(element);
 
+	InvalidateIndex();
 	if (!file.Save()) {
 		error = fz::sprintf(L"Could not write \"%s\", any changes to the Site Manager could not be saved: %s", file.GetFileName(), file.GetError());
 		return false;
@@ -372,13 +467,9 @@ std::pair<std::unique_ptr<Site>, Bookmark> site_manager::GetSiteByPath(app_paths
 
 	sitePath = sitePath.substr(1);
 
-	// We have to synchronize access to sitemanager.xml so that multiple processed don't write
-	// to the same file or one is reading while the other one writes.
-	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
-
-	CXmlFile file;
+	std::wstring fileName;
 	if (c == '0') {
-		file.SetFileName(paths.settings_file(L"sitemanager"));
+		fileName = paths.settings_file(L"sitemanager");
 	}
 	else {
 		CLocalPath const defaultsDir = paths.defaults_path;
@@ -386,32 +477,32 @@ std::pair<std::unique_ptr<Site>, Bookmark> site_manager::GetSiteByPath(app_paths
 			error = fz::translate("Site does not exist.");
 			return ret;
 		}
-		file.SetFileName(defaultsDir.GetPath() + L"fzdefaults.xml");
+		fileName = defaultsDir.GetPath() + L"fzdefaults.xml";
 	}
 
-	auto document = file.Load();
-	if (!document) {
-		error = fz::translate("Error loading xml file");
+	std::vector<std::wstring> segments;
+	if (!UnescapeSitePath(sitePath, segments) || segments.empty()) {
+		error = fz::translate("Site path is malformed.");
 		return ret;
 	}
 
-	auto element = document.child("Servers");
-	if (!element) {
-		error = fz::translate("Site does not exist.");
-		return ret;
-	}
+	// We have to synchronize access to sitemanager.xml so that multiple processed don't write
+	// to the same file or one is reading while the other one writes.
+	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
+	fz::scoped_lock l(index_mutex);
 
-	std::vector<std::wstring> segments;
-	if (!UnescapeSitePath(sitePath, segments) || segments.empty()) {
-		error = fz::translate("Site path is malformed.");
+	auto * f = get_indexed_file(fileName);
+	if (!f) {
+		error = fz::translate("Error loading xml file");
 		return ret;
 	}
 
-	auto child = GetElementByPath(element, segments);
-	if (!child) {
+	auto it = f->nodes.find(BuildPath(c, segments).substr(1));
+	if (it == f->nodes.end()) {
 		error = fz::translate("Site does not exist.");
 		return ret;
 	}
+	auto child = it->second;
 
 	pugi::xml_node bookmark;
 	if (!strcmp(child.name(), "Bookmark")) {
@@ -420,7 +511,7 @@ std::pair<std::unique_ptr<Site>, Bookmark> site_manager::GetSiteByPath(app_paths
 		segments.pop_back();
 	}
 
-	auto version = file.GetVersion();
+	auto version = f->file.GetVersion();
 
 	ret.first = ReadServerElement(child, version);
 	if (!ret.first) {
@@ -443,6 +534,52 @@ std::pair<std::unique_ptr<Site>, Bookmark> site_manager::GetSiteByPath(app_paths
 	return ret;
 }
 
+std::unique_ptr<Site> site_manager::GetSiteByServer(app_paths const& paths, CServer const& server)
+{
+	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
+	fz::scoped_lock l(index_mutex);
+
+	auto * f = get_indexed_file(paths.settings_file(L"sitemanager"));
+	if (!f) {
+		return nullptr;
+	}
+
+	if (!f->has_servers) {
+		for (auto const& node : f->nodes) {
+			if (!strcmp(node.second.name(), "Server")) {
+				Site site;
+				if (::GetServer(node.second, site)) {
+					f->servers.emplace(server_key(site.server), node.first);
+				}
+			}
+		}
+		f->has_servers = true;
+	}
+
+	std::unique_ptr<Site> ret;
+	auto const range = f->servers.equal_range(server_key(server));
+	for (auto it = range.first; it != range.second; ++it) {
+		auto site = ReadServerElement(f->nodes[it->second], f->file.GetVersion());
+		if (!site || !site->server.SameResource(server)) {
+			continue;
+		}
+		if (ret) {
+			// Ambiguous
+			return nullptr;
+		}
+		ret = std::move(site);
+		ret->SetSitePath(L"0" + it->second);
+	}
+
+	return ret;
+}
+
+void site_manager::InvalidateIndex()
+{
+	fz::scoped_lock l(index_mutex);
+	index_files.clear();
+}
+
 pugi::xml_node site_manager::GetElementByPath(pugi::xml_node node, std::vector<std::wstring> const& segments)
 {
 	for (auto const& segment : segments) {
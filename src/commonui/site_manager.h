@@ -35,6 +35,14 @@ public:
 
 	static std::pair<std::unique_ptr<Site>, Bookmark> GetSiteByPath(app_paths const& paths, std::wstring sitePath, std::wstring& error);
 
+	// Returns the site in sitemanager.xml for the same server, if there is exactly one.
+	static std::unique_ptr<Site> GetSiteByServer(app_paths const& paths, CServer const& server);
+
+	// Site lookups are served from an index of the parsed files, kept for the lifetime
+	// of the process. It notices changes to the files by their size and modification
+	// time, writers in this process can drop it explicitly.
+	static void InvalidateIndex();
+
 	static bool UnescapeSitePath(std::wstring path, std::vector<std::wstring>& result);
 	static std::wstring EscapeSegment(std::wstring segment);
 
@@ -0,0 +1,146 @@
+#include "tree_sync.h"
+#include "misc.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/translate.hpp>
+
+#include <unordered_set>
+
+tree_sync::tree_sync(fz::duration const& threshold, bool compare_time)
+	: threshold_(threshold)
+	, compare_time_(compare_time)
+{
+}
+
+tree_sync::result tree_sync::compare(int64_t source_size, fz::datetime const& source_time, int64_t target_size, fz::datetime const& target_time) const
+{
+	bool const have_sizes = source_size >= 0 && target_size >= 0;
+	bool const have_times = compare_time_ && !source_time.empty() && !target_time.empty();
+
+	if (have_sizes && source_size != target_size) {
+		return result::changed;
+	}
+	if (have_times) {
+		return (CompareWithThreshold(source_time, target_time, threshold_) > 0) ? result::changed : result::unchanged;
+	}
+
+	// Without anything to go by, better transfer once too often
+	return have_sizes ? result::unchanged : result::changed;
+}
+
+void tree_sync::count(result r, int64_t size)
+{
+	switch (r) {
+	case result::added:
+		++plan_.added_;
+		break;
+	case result::changed:
+		++plan_.changed_;
+		break;
+	case result::unchanged:
+		++plan_.unchanged_;
+		return;
+	}
+	if (size > 0) {
+		plan_.transfer_bytes_ += size;
+	}
+}
+
+bool tree_sync::filter_upload(local_recursive_operation::listing & listing, CDirectoryListing const* remote)
+{
+	if (!remote) {
+		for (auto const& file : listing.files) {
+			count(result::added, file.size);
+		}
+		return true;
+	}
+
+	std::unordered_set<std::wstring> local_names;
+
+	auto out = listing.files.begin();
+	for (auto it = listing.files.begin(); it != listing.files.end(); ++it) {
+		local_names.insert(it->name);
+
+		result r = result::added;
+		size_t const index = remote->FindFile_CmpCase(it->name);
+		if (index != std::wstring::npos) {
+			CDirentry const& entry = (*remote)[index];
+			if (entry.is_dir()) {
+				r = result::changed;
+			}
+			else {
+				r = compare(it->size, it->time, entry.size, entry.has_date() ? entry.time : fz::datetime());
+			}
+		}
+		count(r, it->size);
+
+		if (r != result::unchanged) {
+			if (out != it) {
+				*out = std::move(*it);
+			}
+			++out;
+		}
+	}
+	listing.files.erase(out, listing.files.end());
+
+	for (size_t i = 0; i < remote->size(); ++i) {
+		CDirentry const& entry = (*remote)[i];
+		if (!entry.is_dir() && local_names.find(entry.name) == local_names.end()) {
+			++plan_.deleted_;
+		}
+	}
+
+	// The directory itself exists already, no need to queue anything if all its files are up to date
+	return !listing.files.empty();
+}
+
+void tree_sync::begin_download_dir(CLocalPath const& local)
+{
+	local_files_.clear();
+
+	fz::local_filesys fs;
+	if (!fs.begin_find_files(fz::to_native(local.GetPath()))) {
+		return;
+	}
+
+	fz::native_string name;
+	bool is_link{};
+	fz::local_filesys::type t{};
+	local_file f;
+	while (fs.get_next_file(name, is_link, t, &f.size_, &f.time_, nullptr)) {
+		if (t != fz::local_filesys::dir) {
+			local_files_.emplace(fz::to_wstring(name), f);
+		}
+	}
+}
+
+bool tree_sync::need_download(std::wstring const& local_name, int64_t size, fz::datetime const& time)
+{
+	result r = result::added;
+
+	auto it = local_files_.find(local_name);
+	if (it != local_files_.end()) {
+		it->second.seen_ = true;
+		r = compare(size, time, it->second.size_, it->second.time_);
+	}
+	count(r, size);
+
+	return r != result::unchanged;
+}
+
+void tree_sync::end_download_dir()
+{
+	for (auto const& f : local_files_) {
+		if (!f.second.seen_) {
+			++plan_.deleted_;
+		}
+	}
+	local_files_.clear();
+}
+
+std::wstring tree_sync::plan::summary() const
+{
+	return fz::sprintf(fztranslate("Synchronization: %u new and %u changed files with %d bytes to transfer, %u files up to date, %u files only present on the target side have been kept."),
+		added_, changed_, transfer_bytes_, unchanged_, deleted_);
+}
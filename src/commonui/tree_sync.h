@@ -0,0 +1,79 @@
+#ifndef FILEZILLA_COMMONUI_TREE_SYNC_HEADER
+#define FILEZILLA_COMMONUI_TREE_SYNC_HEADER
+
+#include "../include/directorylisting.h"
+
+#include "local_recursive_operation.h"
+#include "visibility.h"
+
+#include <libfilezilla/time.hpp>
+
+#include <map>
+#include <string>
+
+// Decides which files need to be transferred to bring a target directory tree
+// up to date with a source tree.
+//
+// Files missing on the target side are added, files differing in size or being
+// newer on the source side are changed, everything else is left alone. Files only
+// present on the target side are counted as deleted, but never removed.
+class FZCUI_PUBLIC_SYMBOL tree_sync final
+{
+public:
+	enum class result
+	{
+		added,
+		changed,
+		unchanged
+	};
+
+	// Modification times are compared with the given threshold, see CompareWithThreshold
+	explicit tree_sync(fz::duration const& threshold = fz::duration(), bool compare_time = true);
+
+	result compare(int64_t source_size, fz::datetime const& source_time, int64_t target_size, fz::datetime const& target_time) const;
+
+	// Upload direction: Removes all files from the listing that are up to date on
+	// the server. remote is null if the directory does not exist on the server.
+	// Returns false if nothing needs to be queued for the directory.
+	bool filter_upload(local_recursive_operation::listing & listing, CDirectoryListing const* remote);
+
+	// Download direction: Call begin_download_dir for each remote directory, then
+	// need_download for each of its files.
+	void begin_download_dir(CLocalPath const& local);
+	bool need_download(std::wstring const& local_name, int64_t size, fz::datetime const& time);
+	void end_download_dir();
+
+	class plan final
+	{
+	public:
+		uint64_t added_{};
+		uint64_t changed_{};
+		uint64_t unchanged_{};
+		uint64_t deleted_{};
+
+		// Of the added and changed files
+		int64_t transfer_bytes_{};
+
+		std::wstring summary() const;
+	};
+	plan const& get_plan() const { return plan_; }
+
+private:
+	void count(result r, int64_t size);
+
+	fz::duration const threshold_;
+	bool const compare_time_{};
+
+	plan plan_;
+
+	class local_file final
+	{
+	public:
+		int64_t size_{-1};
+		fz::datetime time_;
+		bool seen_{};
+	};
+	std::map<std::wstring, local_file> local_files_;
+};
+
+#endif
@@ -356,7 +356,7 @@ bool CUpdater::CreateTransferCommand(std::wstring const& url, std::wstring const
 	std::wstring file = path.GetLastSegment();
 	path = path.GetParent();
 
-	transfer_flags const flags = transfer_flags::download;
+	transfer_flags const flags = transfer_flags::download | transfer_flags::fsync;
 	auto cmd = new CFileTransferCommand(fz::file_writer_factory(local_file, engine_context_.GetThreadPool(), fz::file_writer_flags::fsync), path, file, flags);
 	resume_offset_ = cmd->GetWriter().size();
 	if (resume_offset_ == fz::aio_base::nosize) {
@@ -517,6 +517,11 @@ bool GetServer(pugi::xml_node node, Site & site)
 	auto maximumMultipleConnections = GetTextElementInt(node, "MaximumMultipleConnections");
 	site.connection_limit_ = static_cast<unsigned int>(maximumMultipleConnections);
 
+	auto const speedLimitInbound = GetTextElementInt(node, "SpeedLimitInbound");
+	site.speed_limit_inbound_ = speedLimitInbound > 0 ? static_cast<unsigned int>(speedLimitInbound) : 0;
+	auto const speedLimitOutbound = GetTextElementInt(node, "SpeedLimitOutbound");
+	site.speed_limit_outbound_ = speedLimitOutbound > 0 ? static_cast<unsigned int>(speedLimitOutbound) : 0;
+
 	std::string_view encodingType = node.child_value("EncodingType");
 	if (encodingType == "UTF-8") {
 		site.server.SetEncodingType(ENCODING_UTF8);
@@ -76,6 +76,12 @@ void SetServer(pugi::xml_node node, Site const& site, login_manager& lim, COptio
 	if (site.connection_limit_) {
 		AddTextElement(node, "MaximumMultipleConnections", site.connection_limit_);
 	}
+	if (site.speed_limit_inbound_) {
+		AddTextElement(node, "SpeedLimitInbound", site.speed_limit_inbound_);
+	}
+	if (site.speed_limit_outbound_) {
+		AddTextElement(node, "SpeedLimitOutbound", site.speed_limit_outbound_);
+	}
 
 	if (CServer::ProtocolHasFeature(site.server.GetProtocol(), ProtocolFeature::Charset)) {
 		switch (site.server.GetEncodingType())
@@ -46,6 +46,11 @@ int CFileZillaEngine::CacheLookup(const CServerPath& path, CDirectoryListing& li
 	return impl_->CacheLookup(path, listing);
 }
 
+void CFileZillaEngine::SetRateLimitGroup(std::wstring const& group)
+{
+	impl_->SetRateLimitGroup(group);
+}
+
 int CFileZillaEngine::Cancel()
 {
 	return impl_->Cancel();
@@ -11,6 +11,10 @@ void activity_logger::record(_direction direction, uint64_t amount)
 			}
 		}
 	}
+
+	if (parent_) {
+		parent_->record(direction, amount);
+	}
 }
 
 std::pair<uint64_t, uint64_t> activity_logger::extract_amounts()
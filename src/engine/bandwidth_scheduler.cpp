@@ -0,0 +1,169 @@
+#include "filezilla.h"
+
+#include "../include/bandwidth_scheduler.h"
+
+namespace {
+std::wstring site_key(CServer const& server)
+{
+	return fz::sprintf(L"%d %s %u %s", server.GetProtocol(), fz::str_tolower_ascii(server.GetHost()), server.GetPort(), server.GetUser());
+}
+
+template<typename T>
+void remove_expired(T & nodes)
+{
+	for (auto it = nodes.begin(); it != nodes.end(); ) {
+		if (it->expired()) {
+			it = nodes.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+}
+
+bandwidth_scheduler::node::node(std::shared_ptr<node> const& parent, fz::rate_limiter & parent_limiter, activity_logger & parent_logger, std::wstring const& name)
+	: parent_(parent)
+	, logger_(&parent_logger)
+	, name_(name)
+{
+	parent_limiter.add(&limiter_);
+}
+
+bandwidth_scheduler::node::~node()
+{
+	// limiter_ removes itself from its parent
+}
+
+bandwidth_scheduler::bandwidth_scheduler(fz::rate_limiter & global, activity_logger & global_logger)
+	: global_(global)
+	, global_logger_(global_logger)
+{
+}
+
+bandwidth_scheduler::~bandwidth_scheduler()
+{
+}
+
+void bandwidth_scheduler::set_site_limits(CServer const& server, fz::rate::type inbound, fz::rate::type outbound)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto const key = site_key(server);
+	if (inbound == fz::rate::unlimited && outbound == fz::rate::unlimited) {
+		site_limits_.erase(key);
+	}
+	else {
+		site_limits_[key] = std::make_pair(inbound, outbound);
+	}
+
+	auto it = sites_.find(key);
+	if (it != sites_.end()) {
+		if (auto n = it->second.node_.lock()) {
+			n->limiter_.set_limits(inbound, outbound);
+		}
+	}
+}
+
+std::shared_ptr<bandwidth_scheduler::node> bandwidth_scheduler::acquire(CServer const& server, std::wstring const& group)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto const key = site_key(server);
+	auto & s = sites_[key];
+
+	auto site_node = s.node_.lock();
+	if (!site_node) {
+		// All groups are gone with it
+		s.groups_.clear();
+		s.anonymous_.clear();
+
+		site_node = std::make_shared<node>(nullptr, global_, global_logger_, server.Format(ServerFormat::with_user_and_optional_port));
+		auto const limits = site_limits_.find(key);
+		if (limits != site_limits_.end()) {
+			site_node->limiter_.set_limits(limits->second.first, limits->second.second);
+		}
+		s.node_ = site_node;
+	}
+
+	std::shared_ptr<node> ret;
+	if (group.empty()) {
+		remove_expired(s.anonymous_);
+		ret = std::make_shared<node>(site_node, site_node->limiter_, site_node->logger_, std::wstring());
+		s.anonymous_.push_back(ret);
+	}
+	else {
+		auto & g = s.groups_[group];
+		ret = g.lock();
+		if (!ret) {
+			ret = std::make_shared<node>(site_node, site_node->limiter_, site_node->logger_, group);
+			g = ret;
+		}
+	}
+
+	return ret;
+}
+
+std::vector<bandwidth_scheduler::usage> bandwidth_scheduler::extract_usage()
+{
+	fz::scoped_lock l(mutex_);
+
+	auto const now = fz::monotonic_clock::now();
+	int64_t const elapsed = last_extraction_ ? (now - last_extraction_).get_milliseconds() : 0;
+	last_extraction_ = now;
+
+	std::vector<usage> ret;
+	ret.emplace_back();
+	ret[0].limits[fz::direction::inbound] = global_.limit(fz::direction::inbound);
+	ret[0].limits[fz::direction::outbound] = global_.limit(fz::direction::outbound);
+
+	auto const add = [&](node & n, int depth) -> usage const& {
+		usage u;
+		u.depth = depth;
+		u.name = n.name_;
+		u.limits[fz::direction::inbound] = n.limiter_.limit(fz::direction::inbound);
+		u.limits[fz::direction::outbound] = n.limiter_.limit(fz::direction::outbound);
+
+		auto const amounts = n.logger_.extract_amounts();
+		if (elapsed > 0) {
+			u.rates[fz::direction::inbound] = amounts.second * 1000 / elapsed;
+			u.rates[fz::direction::outbound] = amounts.first * 1000 / elapsed;
+		}
+		ret.emplace_back(std::move(u));
+		return ret.back();
+	};
+
+	for (auto it = sites_.begin(); it != sites_.end(); ) {
+		auto site_node = it->second.node_.lock();
+		if (!site_node) {
+			it = sites_.erase(it);
+			continue;
+		}
+
+		// Global rates are summed up from the sites, the amounts of the global
+		// activity logger belong to whoever has set its notifier.
+		auto const& site_usage = add(*site_node, 1);
+		ret[0].rates[0] += site_usage.rates[0];
+		ret[0].rates[1] += site_usage.rates[1];
+
+		remove_expired(it->second.anonymous_);
+		for (auto const& weak : it->second.anonymous_) {
+			if (auto n = weak.lock()) {
+				add(*n, 2);
+			}
+		}
+		for (auto g = it->second.groups_.begin(); g != it->second.groups_.end(); ) {
+			if (auto n = g->second.lock()) {
+				add(*n, 2);
+				++g;
+			}
+			else {
+				g = it->second.groups_.erase(g);
+			}
+		}
+
+		++it;
+	}
+
+	return ret;
+}
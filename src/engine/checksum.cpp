@@ -0,0 +1,216 @@
+#include "filezilla.h"
+#include "checksum.h"
+
+#include <libfilezilla/encode.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/hash.hpp>
+
+#include <optional>
+#include <vector>
+
+namespace {
+size_t const chunk_size = 256 * 1024;
+
+// CRC-32 as used by XCRC (IEEE 802.3, reflected), slicing by 8 bytes
+struct crc32_tables final
+{
+	crc32_tables()
+	{
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = (c >> 1) ^ (0xedb88320u & (0u - (c & 1)));
+			}
+			t_[0][i] = c;
+		}
+		for (int i = 0; i < 256; ++i) {
+			for (int s = 1; s < 8; ++s) {
+				t_[s][i] = (t_[s - 1][i] >> 8) ^ t_[0][t_[s - 1][i] & 0xff];
+			}
+		}
+	}
+
+	uint32_t t_[8][256];
+};
+
+uint32_t crc32_update(uint32_t crc, uint8_t const* p, size_t len)
+{
+	static crc32_tables const tables;
+	auto const& t = tables.t_;
+
+	crc = ~crc;
+	while (len >= 8) {
+		uint32_t const a = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24));
+		uint32_t const b = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<uint32_t>(p[7]) << 24);
+		crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^
+			t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff] ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+	}
+	return ~crc;
+}
+
+size_t digest_length(checksum_algorithm alg)
+{
+	switch (alg) {
+	case checksum_algorithm::crc32:
+		return 4;
+	case checksum_algorithm::md5:
+		return 16;
+	case checksum_algorithm::sha1:
+		return 20;
+	case checksum_algorithm::sha256:
+		return 32;
+	default:
+		return 0;
+	}
+}
+}
+
+std::wstring checksum_name(checksum_algorithm alg)
+{
+	switch (alg) {
+	case checksum_algorithm::crc32:
+		return L"CRC32";
+	case checksum_algorithm::md5:
+		return L"MD5";
+	case checksum_algorithm::sha1:
+		return L"SHA-1";
+	case checksum_algorithm::sha256:
+		return L"SHA-256";
+	default:
+		return std::wstring();
+	}
+}
+
+checksum_algorithm checksum_from_name(std::wstring_view name)
+{
+	auto const n = fz::str_toupper_ascii(name);
+	if (n == L"SHA-256" || n == L"SHA256") {
+		return checksum_algorithm::sha256;
+	}
+	if (n == L"SHA-1" || n == L"SHA1") {
+		return checksum_algorithm::sha1;
+	}
+	if (n == L"MD5") {
+		return checksum_algorithm::md5;
+	}
+	if (n == L"CRC32" || n == L"CRC-32") {
+		return checksum_algorithm::crc32;
+	}
+	return checksum_algorithm::none;
+}
+
+std::string normalize_checksum(checksum_algorithm alg, std::wstring_view digest)
+{
+	size_t const len = digest_length(alg);
+	if (!len) {
+		return std::string();
+	}
+
+	// Some servers don't zero-pad CRCs
+	if (alg == checksum_algorithm::crc32 && !digest.empty() && digest.size() < 8) {
+		std::wstring padded(8 - digest.size(), '0');
+		padded += digest;
+		return normalize_checksum(alg, padded);
+	}
+
+	auto const raw = fz::hex_decode(digest);
+	if (raw.size() != len) {
+		return std::string();
+	}
+	return fz::hex_encode<std::string>(raw);
+}
+
+std::string find_checksum(checksum_algorithm alg, std::wstring_view reply)
+{
+	// Skip the reply code, the digest is the first token that looks like one.
+	auto tokens = fz::strtok_view(reply, L" \t");
+	for (size_t i = 1; i < tokens.size(); ++i) {
+		auto const& token = tokens[i];
+		if (alg != checksum_algorithm::crc32 && token.size() != digest_length(alg) * 2) {
+			continue;
+		}
+		auto digest = normalize_checksum(alg, token);
+		if (!digest.empty()) {
+			return digest;
+		}
+	}
+	return std::string();
+}
+
+local_checksum::local_checksum(fz::thread_pool & pool, fz::event_handler & handler, std::wstring const& file, checksum_algorithm alg)
+	: handler_(handler)
+	, file_(file)
+	, alg_(alg)
+{
+	task_ = pool.spawn([this]() { entry(); });
+	if (!task_) {
+		handler_.send_event<checksum_event>(this, std::string());
+	}
+}
+
+local_checksum::~local_checksum()
+{
+	quit_ = true;
+	task_.join();
+
+	auto const filter = [this](fz::event_base const& ev) -> bool {
+		return ev.derived_type() == checksum_event::type() && std::get<0>(static_cast<checksum_event const&>(ev).v_) == this;
+	};
+	handler_.filter_events(filter);
+}
+
+void local_checksum::entry()
+{
+	std::string digest;
+
+	fz::file f(fz::to_native(file_), fz::file::reading, fz::file::existing);
+	if (f.opened()) {
+		std::optional<fz::hash_accumulator> acc;
+		switch (alg_) {
+		case checksum_algorithm::md5:
+			acc.emplace(fz::hash_algorithm::md5);
+			break;
+		case checksum_algorithm::sha1:
+			acc.emplace(fz::hash_algorithm::sha1);
+			break;
+		case checksum_algorithm::sha256:
+			acc.emplace(fz::hash_algorithm::sha256);
+			break;
+		default:
+			break;
+		}
+		uint32_t crc{};
+
+		std::vector<uint8_t> buffer(chunk_size);
+		fz::rwresult read;
+		while (!quit_ && (read = f.read2(buffer.data(), buffer.size())) && read.value_ > 0) {
+			if (acc) {
+				acc->update(buffer.data(), read.value_);
+			}
+			else {
+				crc = crc32_update(crc, buffer.data(), read.value_);
+			}
+		}
+		if (quit_) {
+			return;
+		}
+
+		if (read) {
+			if (acc) {
+				digest = fz::hex_encode<std::string>(acc->digest());
+			}
+			else if (alg_ == checksum_algorithm::crc32) {
+				digest = fz::sprintf("%08x", crc);
+			}
+		}
+	}
+
+	if (!quit_) {
+		handler_.send_event<checksum_event>(this, digest);
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef FILEZILLA_ENGINE_CHECKSUM_HEADER
+#define FILEZILLA_ENGINE_CHECKSUM_HEADER
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+
+// Checksums the engine can compute locally, in order of preference
+enum class checksum_algorithm
+{
+	none,
+	crc32,
+	md5,
+	sha1,
+	sha256
+};
+
+// Names as used by the FTP HASH command, e.g. "SHA-256"
+std::wstring checksum_name(checksum_algorithm alg);
+checksum_algorithm checksum_from_name(std::wstring_view name);
+
+// Returns the digest as lowercase hex, or an empty string if it isn't a valid digest
+// for the given algorithm.
+std::string normalize_checksum(checksum_algorithm alg, std::wstring_view digest);
+
+// Finds the digest in a server reply such as "213 SHA-256 0-1234 <digest> file" or
+// "250 <digest>". Returns an empty string if there is none.
+std::string find_checksum(checksum_algorithm alg, std::wstring_view reply);
+
+class local_checksum;
+
+// Arguments: Source, digest in lowercase hex. The digest is empty if the file
+// could not be read.
+struct checksum_event_type;
+typedef fz::simple_event<checksum_event_type, local_checksum const*, std::string> checksum_event;
+
+// Checksums a local file on the thread pool, concurrent transfers each get a
+// thread of their own. Sends a checksum_event to the handler when done.
+class local_checksum final
+{
+public:
+	local_checksum(fz::thread_pool & pool, fz::event_handler & handler, std::wstring const& file, checksum_algorithm alg);
+
+	// Stops hashing, the handler does not get an event afterwards
+	~local_checksum();
+
+	local_checksum(local_checksum const&) = delete;
+	local_checksum& operator=(local_checksum const&) = delete;
+
+	checksum_algorithm algorithm() const { return alg_; }
+
+private:
+	void entry();
+
+	fz::event_handler & handler_;
+	std::wstring const file_;
+	checksum_algorithm const alg_;
+
+	std::atomic<bool> quit_{};
+	fz::async_task task_;
+};
+
+#endif
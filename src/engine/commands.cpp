@@ -121,8 +121,22 @@ CMkdirCommand::CMkdirCommand(const CServerPath& path, transfer_flags const& flag
 {
 }
 
+CMkdirCommand::CMkdirCommand(std::vector<CServerPath> && paths, transfer_flags const& flags)
+	: paths_(std::move(paths))
+	, flags_(flags)
+{
+}
+
 bool CMkdirCommand::valid() const
 {
+	if (!paths_.empty()) {
+		for (auto const& path : paths_) {
+			if (path.empty() || !path.HasParent()) {
+				return false;
+			}
+		}
+		return true;
+	}
 	return !GetPath().empty() && GetPath().HasParent();
 }
 
@@ -145,7 +159,23 @@ CChmodCommand::CChmodCommand(CServerPath const& path, std::wstring const& file,
 	, m_permission(permission)
 {}
 
+CChmodCommand::CChmodCommand(CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> && entries)
+	: m_path(path)
+	, entries_(std::move(entries))
+{}
+
 bool CChmodCommand::valid() const
 {
+	if (!entries_.empty()) {
+		if (GetPath().empty()) {
+			return false;
+		}
+		for (auto const& entry : entries_) {
+			if (entry.first.empty() || entry.second.empty()) {
+				return false;
+			}
+		}
+		return true;
+	}
 	return !GetPath().empty() && !GetFile().empty() && !GetPermission().empty();
 }
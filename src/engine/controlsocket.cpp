@@ -2,11 +2,13 @@
 #include "activity_logger_layer.h"
 #include "controlsocket.h"
 #include "directorycache.h"
+#include "dns_cache.h"
 #include "engineprivate.h"
 #include "lookup.h"
 #include "logging_private.h"
 #include "proxy.h"
 #include "servercapabilities.h"
+#include "uring_file.h"
 
 #include "../include/local_path.h"
 #include "../include/engine_options.h"
@@ -17,6 +19,8 @@
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/rate_limited_layer.hpp>
 
+#include <algorithm>
+
 #include <string.h>
 
 #ifndef FZ_WINDOWS
@@ -33,6 +37,44 @@
 	#endif
 #endif
 
+namespace {
+// Sits directly on top of a socket connected to a resolved address and
+// reports the original hostname as peer, e.g. for SNI and certificate checks.
+class peer_host_layer final : public fz::socket_layer
+{
+public:
+	peer_host_layer(fz::socket_interface& next_layer, fz::native_string const& host)
+		: fz::socket_layer(nullptr, next_layer, true)
+		, host_(host)
+	{
+		next_layer.set_event_handler(nullptr);
+	}
+
+	virtual ~peer_host_layer()
+	{
+		next_layer_.set_event_handler(nullptr);
+	}
+
+	virtual int read(void* buffer, unsigned int size, int& error) override
+	{
+		return next_layer_.read(buffer, size, error);
+	}
+
+	virtual int write(void const* buffer, unsigned int size, int& error) override
+	{
+		return next_layer_.write(buffer, size, error);
+	}
+
+	virtual fz::native_string peer_host() const override
+	{
+		return host_;
+	}
+
+private:
+	fz::native_string const host_;
+};
+}
+
 CControlSocket::CControlSocket(CFileZillaEnginePrivate & engine, bool use_shm)
 	: event_handler(engine.event_loop_)
 	, engine_(engine)
@@ -441,6 +483,115 @@ int CControlSocket::CheckOverwriteFile()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
+int CControlSocket::CompareChecksums(CFileTransferOpData & data)
+{
+	if (!data.localChecksum_) {
+		if (!data.checksumTask_) {
+			log(logmsg::status, _("Calculating %s checksum of %s"), checksum_name(data.checksumAlgorithm_), data.localName_);
+			data.checksumTask_ = std::make_unique<local_checksum>(engine_.GetThreadPool(), *this, data.localName_, data.checksumAlgorithm_);
+		}
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	std::string const local = std::move(*data.localChecksum_);
+	std::string const remote = std::move(data.remoteChecksum_);
+	data.localChecksum_.reset();
+	data.remoteChecksum_.clear();
+
+	auto const name = checksum_name(data.checksumAlgorithm_);
+	if (local.empty()) {
+		log(logmsg::status, _("Could not calculate checksum of %s"), data.localName_);
+		return FZ_REPLY_NOTSUPPORTED;
+	}
+
+	log(logmsg::debug_info, L"Local %s checksum: %s, remote: %s", name, local, remote);
+	if (local == remote) {
+		log(logmsg::status, _("%s checksums of local and remote file match"), name);
+		return FZ_REPLY_OK;
+	}
+
+	if (data.transferInitiated_) {
+		log(logmsg::error, _("%s checksums of local and remote file differ, file got corrupted during transfer"), name);
+	}
+	else {
+		log(logmsg::status, _("%s checksums of local and remote file differ"), name);
+	}
+	return FZ_REPLY_ERROR;
+}
+
+void CControlSocket::OnChecksum(local_checksum const* source, std::string const& digest)
+{
+	if (operations_.empty() || operations_.back()->opId != Command::transfer) {
+		return;
+	}
+
+	auto & data = static_cast<CFileTransferOpData &>(*operations_.back());
+	if (!source || data.checksumTask_.get() != source) {
+		return;
+	}
+
+	data.checksumTask_.reset();
+	data.localChecksum_ = digest;
+	SendNextCommand();
+}
+
+void CMkdirManyOpData::FilterKnown(CDirectoryCache & cache, CServer const& server)
+{
+	auto const known = [&](CServerPath const& path) {
+		CDirectoryListing listing;
+		bool outdated{};
+		if (cache.Lookup(listing, server, path, true, outdated)) {
+			return true;
+		}
+
+		CDirentry entry;
+		bool dirDidExist{};
+		bool matchedCase{};
+		return cache.LookupFile(entry, server, path.GetParent(), path.GetLastSegment(), dirDidExist, matchedCase) && entry.is_dir();
+	};
+
+	paths_.erase(std::remove_if(paths_.begin(), paths_.end(), known), paths_.end());
+}
+
+void CMkdirManyOpData::Created(CDirectoryCache & cache, CServer const& server, CServerPath const& path)
+{
+	CServerPath const parent = path.GetParent();
+	cache.UpdateFile(server, parent, path.GetLastSegment(), true, CDirectoryCache::dir);
+	if (changedParents_.empty() || changedParents_.back() != parent) {
+		changedParents_.push_back(parent);
+	}
+}
+
+CChmodManyOpData::CChmodManyOpData(CControlSocket & controlSocket, CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> const& entries)
+	: COpData(Command::chmod, L"CChmodManyOpData")
+	, CProtocolOpData(controlSocket)
+	, path_(path)
+	, entries_(entries)
+{
+}
+
+int CChmodManyOpData::Send()
+{
+	if (next_ >= entries_.size()) {
+		return failed_ ? FZ_REPLY_ERROR : FZ_REPLY_OK;
+	}
+
+	auto const& entry = entries_[next_++];
+	controlSocket_.Chmod(CChmodCommand(path_, entry.first, entry.second));
+	return FZ_REPLY_CONTINUE;
+}
+
+int CChmodManyOpData::SubcommandResult(int prevResult, COpData const&)
+{
+	if ((prevResult & FZ_REPLY_DISCONNECTED) || prevResult == FZ_REPLY_NOTSUPPORTED) {
+		return prevResult;
+	}
+	if (prevResult != FZ_REPLY_OK) {
+		failed_ = true;
+	}
+	return FZ_REPLY_CONTINUE;
+}
+
 SleepOpData::SleepOpData(CControlSocket & controlSocket, fz::duration const& delay)
 	: COpData(Command::sleep, L"SleepOpData")
 	, fz::event_handler(controlSocket.event_loop_)
@@ -756,16 +907,29 @@ int CRealControlSocket::Send(unsigned char const* buffer, unsigned int len)
 
 void CRealControlSocket::operator()(fz::event_base const& ev)
 {
-	if (!fz::dispatch<fz::socket_event, fz::hostaddress_event>(ev, this,
+	if (attempt_timer_ && ev.derived_type() == fz::timer_event::type() && std::get<0>(static_cast<fz::timer_event const&>(ev).v_) == attempt_timer_) {
+		OnAttemptTimer();
+		return;
+	}
+
+	if (!fz::dispatch<fz::socket_event, fz::hostaddress_event, dns_cache_event>(ev, this,
 		&CRealControlSocket::OnSocketEvent,
-		&CRealControlSocket::OnHostAddress))
+		&CRealControlSocket::OnHostAddress,
+		&CRealControlSocket::OnDnsResolved))
 	{
 		CControlSocket::operator()(ev);
 	}
 }
 
-void CRealControlSocket::OnSocketEvent(fz::socket_event_source*, fz::socket_event_flag t, int error)
+void CRealControlSocket::OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error)
 {
+	for (size_t i = 0; i < candidates_.size(); ++i) {
+		if (source == candidates_[i].socket_.get()) {
+			OnCandidateEvent(i, t, error);
+			return;
+		}
+	}
+
 	if (!active_layer_) {
 		return;
 	}
@@ -869,9 +1033,8 @@ void CRealControlSocket::CreateSocket(std::wstring const& host)
 {
 	ResetSocket();
 	socket_ = std::make_unique<fz::socket>(engine_.GetThreadPool(), nullptr);
-	activity_logger_layer_ = std::make_unique<activity_logger_layer>(nullptr, *socket_, engine_.activity_logger_);
-	ratelimit_layer_ = std::make_unique<fz::rate_limited_layer>(nullptr, *activity_logger_layer_, &engine_.GetRateLimiter());
-	active_layer_ = ratelimit_layer_.get();
+	ApplySocketOptions(*socket_);
+	CreateLayers(*socket_);
 
 	const int proxy_type = engine_.GetOptions().get_int(OPTION_PROXY_TYPE);
 	if (proxy_type > static_cast<int>(ProxyType::NONE) && proxy_type < static_cast<int>(ProxyType::count) && !currentServer_.GetBypassProxy()) {
@@ -906,10 +1069,35 @@ int CRealControlSocket::DoConnect(std::wstring const& host, unsigned int port)
 		log(logmsg::debug_info, L"Using custom encoding: %s", currentServer_.GetCustomEncoding());
 	}
 
+	fz::native_string const native_host = fz::to_native(ConvertDomainName(host));
+
+	int const proxy_type = engine_.GetOptions().get_int(OPTION_PROXY_TYPE);
+	bool const use_proxy = proxy_type > static_cast<int>(ProxyType::NONE) && proxy_type < static_cast<int>(ProxyType::count) && !currentServer_.GetBypassProxy();
+	if (!use_proxy && fz::get_address_type(native_host) == fz::address_type::unknown) {
+		// Resolve through the shared cache and race the resulting addresses ourselves
+		ResetSocket();
+
+		log(logmsg::status, _("Resolving address of %s"), host);
+
+		connect_host_ = native_host;
+		connect_port_ = port;
+		connect_start_ = fz::monotonic_clock::now();
+		resolving_ = true;
+
+		int error{};
+		std::vector<std::string> addresses;
+		if (engine_.GetContext().GetDnsCache().lookup(*this, connect_host_, error, addresses)) {
+			// Deliver asynchronously, we're still inside the operation's Send()
+			send_event<dns_cache_event>(connect_host_, error, std::move(addresses));
+		}
+
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
 	CreateSocket(host);
 
 	active_layer_->set_event_handler(this);
-	int res = active_layer_->connect(fz::to_native(ConvertDomainName(host)), port);
+	int res = active_layer_->connect(native_host, port);
 
 	if (res) {
 		log(logmsg::error, _("Could not connect to server: %s"), fz::socket_error_description(res));
@@ -919,6 +1107,176 @@ int CRealControlSocket::DoConnect(std::wstring const& host, unsigned int port)
 	return FZ_REPLY_WOULDBLOCK;
 }
 
+void CRealControlSocket::CreateLayers(fz::socket_interface & next)
+{
+	activity_logger_layer_ = std::make_unique<activity_logger_layer>(nullptr, next, engine_.GetActivityLogger());
+	ratelimit_layer_ = std::make_unique<fz::rate_limited_layer>(nullptr, *activity_logger_layer_, &engine_.GetRateLimiter());
+	active_layer_ = ratelimit_layer_.get();
+}
+
+void CRealControlSocket::ApplySocketOptions(fz::socket & s)
+{
+	if (socket_flags_) {
+		s.set_flags(socket_flags_, true);
+	}
+	if (keepalive_interval_) {
+		s.set_keepalive_interval(keepalive_interval_);
+	}
+}
+
+void CRealControlSocket::OnDnsResolved(fz::native_string const& host, int error, std::vector<std::string> const& addresses)
+{
+	if (!resolving_ || host != connect_host_) {
+		return;
+	}
+	resolving_ = false;
+
+	if (!error && addresses.empty()) {
+		error = EINVAL;
+	}
+	if (error) {
+		log(logmsg::status, _("Connection attempt failed with \"%s\"."), fz::socket_error_description(error));
+		OnSocketError(error);
+		return;
+	}
+
+	log(logmsg::debug_info, L"Resolved %s to %d addresses in %d ms", host, addresses.size(), (fz::monotonic_clock::now() - connect_start_).get_milliseconds());
+
+	// Interleave the address families, starting with the one the resolver
+	// preferred, see RFC 8305 section 4.
+	auto const preferred = fz::get_address_type(addresses.front());
+	std::vector<std::string const*> primary, secondary;
+	for (auto const& address : addresses) {
+		if (fz::get_address_type(address) == preferred) {
+			primary.push_back(&address);
+		}
+		else {
+			secondary.push_back(&address);
+		}
+	}
+
+	connect_addresses_.clear();
+	for (size_t i = 0; i < primary.size() || i < secondary.size(); ++i) {
+		if (i < primary.size()) {
+			connect_addresses_.push_back(*primary[i]);
+		}
+		if (i < secondary.size()) {
+			connect_addresses_.push_back(*secondary[i]);
+		}
+	}
+	next_address_ = 0;
+	last_connect_error_ = 0;
+
+	if (!StartConnectAttempt()) {
+		OnSocketError(last_connect_error_ ? last_connect_error_ : EINVAL);
+	}
+}
+
+bool CRealControlSocket::StartConnectAttempt()
+{
+	stop_timer(attempt_timer_);
+	attempt_timer_ = 0;
+
+	while (next_address_ < connect_addresses_.size()) {
+		std::string const& address = connect_addresses_[next_address_++];
+
+		connect_candidate c;
+		c.socket_ = std::make_unique<fz::socket>(engine_.GetThreadPool(), this);
+		c.address_ = address;
+		c.started_ = fz::monotonic_clock::now();
+		ApplySocketOptions(*c.socket_);
+
+		if (fz::get_address_type(address) == fz::address_type::ipv6) {
+			log(logmsg::status, _("Connecting to %s..."), fz::sprintf("[%s]:%u", address, connect_port_));
+		}
+		else {
+			log(logmsg::status, _("Connecting to %s..."), fz::sprintf("%s:%u", address, connect_port_));
+		}
+
+		int res = c.socket_->connect(fz::to_native(address), connect_port_);
+		if (res) {
+			last_connect_error_ = res;
+			log(logmsg::status, _("Connection attempt failed with \"%s\", trying next address."), fz::socket_error_description(res));
+			continue;
+		}
+
+		candidates_.push_back(std::move(c));
+		SetAlive();
+
+		// If this attempt doesn't finish within the Connection Attempt Delay,
+		// race it against the next address.
+		if (next_address_ < connect_addresses_.size()) {
+			attempt_timer_ = add_timer(fz::duration::from_milliseconds(250), true);
+		}
+		return true;
+	}
+
+	return !candidates_.empty();
+}
+
+void CRealControlSocket::OnAttemptTimer()
+{
+	attempt_timer_ = 0;
+	if (!StartConnectAttempt()) {
+		OnSocketError(last_connect_error_ ? last_connect_error_ : EINVAL);
+	}
+}
+
+void CRealControlSocket::OnCandidateEvent(size_t index, fz::socket_event_flag t, int error)
+{
+	if (t != fz::socket_event_flag::connection) {
+		return;
+	}
+
+	auto & c = candidates_[index];
+	if (error) {
+		last_connect_error_ = error;
+		log(logmsg::debug_info, L"Connection attempt to %s failed after %d ms", c.address_, (fz::monotonic_clock::now() - c.started_).get_milliseconds());
+		candidates_.erase(candidates_.begin() + index);
+
+		if (next_address_ < connect_addresses_.size()) {
+			// A failed attempt starts the next one right away, the
+			// attempt delay only paces attempts that are still pending.
+			log(logmsg::status, _("Connection attempt failed with \"%s\", trying next address."), fz::socket_error_description(error));
+			if (!StartConnectAttempt()) {
+				OnSocketError(error);
+			}
+		}
+		else if (candidates_.empty()) {
+			log(logmsg::status, _("Connection attempt failed with \"%s\"."), fz::socket_error_description(error));
+			OnSocketError(error);
+		}
+		return;
+	}
+
+	auto const now = fz::monotonic_clock::now();
+	log(logmsg::debug_info, L"Connected to %s in %d ms, %d ms after resolving started", c.address_, (now - c.started_).get_milliseconds(), (now - connect_start_).get_milliseconds());
+
+	socket_ = std::move(c.socket_);
+	ResetConnectAttempts();
+
+	// Upper layers, in particular TLS, need to see the hostname and not the address
+	peer_host_layer_ = std::make_unique<peer_host_layer>(*socket_, connect_host_);
+	CreateLayers(*peer_host_layer_);
+	active_layer_->set_event_handler(this);
+	SetSocketBufferSizes();
+
+	OnConnect();
+}
+
+void CRealControlSocket::ResetConnectAttempts()
+{
+	if (resolving_) {
+		engine_.GetContext().GetDnsCache().cancel(*this);
+		resolving_ = false;
+	}
+	stop_timer(attempt_timer_);
+	attempt_timer_ = 0;
+	candidates_.clear();
+	connect_addresses_.clear();
+	next_address_ = 0;
+}
+
 int CRealControlSocket::DoClose(int nErrorCode)
 {
 	log(logmsg::debug_debug, L"CRealControlSocket::DoClose(%d)", nErrorCode);
@@ -931,10 +1289,13 @@ void CRealControlSocket::ResetSocket()
 {
 	active_layer_ = nullptr;
 
+	ResetConnectAttempts();
+
 	// Destroy in reverse order
 	proxy_layer_.reset();
 	ratelimit_layer_.reset();
 	activity_logger_layer_.reset();
+	peer_host_layer_.reset();
 	socket_.reset();
 
 	send_buffer_.clear();
@@ -1022,6 +1383,14 @@ bool CControlSocket::SetFileExistsAction(CFileExistsNotification *pFileExistsNot
 			ResetOperation(FZ_REPLY_OK);
 		}
 		break;
+	case CFileExistsNotification::overwriteChecksum:
+		// Only files of the same size need to be compared, the operation falls back to
+		// overwriting if the checksum cannot be obtained.
+		if (pFileExistsNotification->localSize == pFileExistsNotification->remoteSize && pFileExistsNotification->localSize >= 0) {
+			data.compareChecksums_ = true;
+		}
+		SendNextCommand();
+		break;
 	case CFileExistsNotification::resume:
 		if (data.download() && data.localFileSize_ != fz::aio_base::nosize) {
 			data.resume_ = true;
@@ -1118,6 +1487,11 @@ void CControlSocket::Mkdir(CServerPath const&, transfer_flags const&)
 	Push(std::make_unique<CNotSupportedOpData>());
 }
 
+void CControlSocket::Mkdir(std::vector<CServerPath> const&, transfer_flags const&)
+{
+	Push(std::make_unique<CNotSupportedOpData>());
+}
+
 void CControlSocket::Rename(CRenameCommand const&)
 {
 	Push(std::make_unique<CNotSupportedOpData>());
@@ -1128,6 +1502,11 @@ void CControlSocket::Chmod(CChmodCommand const&)
 	Push(std::make_unique<CNotSupportedOpData>());
 }
 
+void CControlSocket::Chmod(CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> const& entries)
+{
+	Push(std::make_unique<CChmodManyOpData>(*this, path, entries));
+}
+
 void CControlSocket::Lookup(CServerPath const& path, std::wstring const& file, CDirentry * entry)
 {
 	Push(std::make_unique<LookupOpData>(*this, path, file, entry));
@@ -1138,17 +1517,23 @@ void CControlSocket::Lookup(CServerPath const& path, std::vector<std::wstring> c
 	Push(std::make_unique<LookupManyOpData>(*this, path, files));
 }
 
+void CControlSocket::Stat(CServerPath const&, std::wstring const&, CDirentry &)
+{
+	Push(std::make_unique<CNotSupportedOpData>());
+}
+
 void CControlSocket::operator()(fz::event_base const& ev)
 {
-	fz::dispatch<fz::timer_event, CObtainLockEvent>(ev, this,
+	fz::dispatch<fz::timer_event, CObtainLockEvent, checksum_event>(ev, this,
 		&CControlSocket::OnTimer,
-		&CControlSocket::OnObtainLock);
+		&CControlSocket::OnObtainLock,
+		&CControlSocket::OnChecksum);
 }
 
 void CControlSocket::RecordActivity(activity_logger::_direction direction, uint64_t amount)
 {
 	SetAlive();
-	engine_.activity_logger_.record(direction, amount);
+	engine_.GetActivityLogger().record(direction, amount);
 }
 
 void CControlSocket::SendDirectoryListingNotification(CServerPath const& path, bool failed)
@@ -1186,29 +1571,37 @@ bool CControlSocket::InitBufferPool(bool use_shm)
 	return *buffer_pool_;
 }
 
-std::unique_ptr<fz::writer_base> CControlSocket::OpenWriter(fz::writer_factory_holder & factory, uint64_t resumeOffset, bool withProgress)
+std::unique_ptr<fz::reader_base> CControlSocket::OpenReader(fz::reader_factory_holder & factory, uint64_t offset, uint64_t size)
 {
 	if (!factory || !buffer_pool_) {
 		return {};
 	}
 
-	auto file_writer = dynamic_cast<fz::file_writer_factory*>(&*factory);
-	if (file_writer) {
-		std::wstring tmp;
-		CLocalPath local_path(file_writer->name(), &tmp);
-		if (local_path.HasParent()) {
-			fz::native_string last_created;
-			fz::mkdir(fz::to_native(local_path.GetPath()), true, fz::mkdir_permissions::normal, &last_created);
-			if (!last_created.empty()) {
-				// Send out notification
-				auto n = std::make_unique<CLocalDirCreatedNotification>();
-				if (n->dir.SetPath(fz::to_wstring(last_created))) {
-					engine_.AddNotification(std::move(n));
-				}
+	if (dynamic_cast<fz::file_reader_factory*>(&*factory)) {
+		int const mode = engine_.GetOptions().get_int(OPTION_LOCAL_FILE_IO);
+		if (mode) {
+			auto reader = open_uring_reader(factory->name(), *buffer_pool_, engine_.GetThreadPool(), offset, size, max_buffer_count(), mode == 2);
+			if (reader) {
+				return reader;
 			}
+			log(logmsg::debug_info, L"Could not use io_uring, falling back to regular reader");
 		}
 	}
 
+	return factory->open(*buffer_pool_, offset, size, max_buffer_count());
+}
+
+std::unique_ptr<fz::writer_base> CControlSocket::OpenWriter(fz::writer_factory_holder & factory, uint64_t resumeOffset, bool withProgress, bool fsync)
+{
+	if (!factory || !buffer_pool_) {
+		return {};
+	}
+
+	auto file_writer = dynamic_cast<fz::file_writer_factory*>(&*factory);
+	if (file_writer) {
+		CreateLocalDir(file_writer->name());
+	}
+
 	fz::writer_base::progress_cb_t status_update;
 	if (withProgress) {
 		status_update = [&s = engine_.transfer_status_](fz::writer_base const*, uint64_t written) {
@@ -1216,9 +1609,39 @@ std::unique_ptr<fz::writer_base> CControlSocket::OpenWriter(fz::writer_factory_h
 			s.Update(written);
 		};
 	}
+	// The uring writer does not sync, leave files which need to be durable to the factory
+	if (file_writer && !fsync) {
+		int const mode = engine_.GetOptions().get_int(OPTION_LOCAL_FILE_IO);
+		if (mode) {
+			auto cb = status_update;
+			auto writer = open_uring_writer(file_writer->name(), *buffer_pool_, engine_.GetThreadPool(), resumeOffset, std::move(cb), max_buffer_count(), mode == 2);
+			if (writer) {
+				return writer;
+			}
+			log(logmsg::debug_info, L"Could not use io_uring, falling back to regular writer");
+		}
+	}
+
 	return factory->open(*buffer_pool_, resumeOffset, status_update, max_buffer_count());
 }
 
+void CControlSocket::CreateLocalDir(std::wstring const& file)
+{
+	std::wstring tmp;
+	CLocalPath local_path(file, &tmp);
+	if (local_path.HasParent()) {
+		fz::native_string last_created;
+		fz::mkdir(fz::to_native(local_path.GetPath()), true, fz::mkdir_permissions::normal, &last_created);
+		if (!last_created.empty()) {
+			// Send out notification
+			auto n = std::make_unique<CLocalDirCreatedNotification>();
+			if (n->dir.SetPath(fz::to_wstring(last_created))) {
+				engine_.AddNotification(std::move(n));
+			}
+		}
+	}
+}
+
 int64_t CalculateNextChunkSize(int64_t remaining, int64_t lastChunkSize, fz::duration const& lastChunkDuration, int64_t minChunkSize, int64_t multiple, int64_t partCount, int64_t maxPartCount, int64_t maxChunkSize)
 {
 	if (remaining <= 0) {
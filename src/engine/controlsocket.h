@@ -6,6 +6,7 @@
 #include "../include/server.h"
 #include "../include/serverpath.h"
 
+#include "checksum.h"
 #include "logging_private.h"
 #include "oplock_manager.h"
 
@@ -135,6 +136,7 @@ public:
 	CFileTransferOpData(wchar_t const* name, CFileTransferCommand const& cmd);
 
 	bool download() const { return flags_ & transfer_flags::download; }
+	bool fsync() const { return flags_ & transfer_flags::fsync; }
 
 	bool tryAbsolutePath_{};
 	bool resume_{};
@@ -156,6 +158,13 @@ public:
 
 	int64_t remoteFileSize_{-1};
 	fz::datetime remoteFileTime_;
+
+	// Checksum comparison, see CControlSocket::CompareChecksums
+	bool compareChecksums_{}; // Set by the overwriteChecksum file exists action
+	checksum_algorithm checksumAlgorithm_{checksum_algorithm::none};
+	std::string remoteChecksum_;
+	std::optional<std::string> localChecksum_;
+	std::unique_ptr<local_checksum> checksumTask_;
 };
 
 class CMkdirOpData : public COpData
@@ -172,6 +181,52 @@ public:
 	std::vector<std::wstring> segments_;
 };
 
+class CDirectoryCache;
+
+// Creates many directories whose parents already exist, with the commands
+// for several of them in flight at once. Needs no oplock, creating a
+// directory that already exists is harmless.
+class CMkdirManyOpData : public COpData
+{
+public:
+	CMkdirManyOpData(wchar_t const* name, std::vector<CServerPath> const& paths)
+		: COpData(Command::mkdir, name)
+		, paths_(paths)
+	{
+	}
+
+protected:
+	// Drops the directories the cache already knows about
+	void FilterKnown(CDirectoryCache & cache, CServer const& server);
+
+	// Call for each directory once the server has confirmed its existence
+	void Created(CDirectoryCache & cache, CServer const& server, CServerPath const& path);
+
+	std::vector<CServerPath> paths_;
+	size_t failed_{};
+
+	// Parents of the created directories, for listing notifications
+	std::vector<CServerPath> changedParents_;
+};
+
+// Sets the permissions of several entries of one directory by issuing
+// a separate chmod for each. Used by protocols without a batched chmod.
+class CChmodManyOpData final : public COpData, public CProtocolOpData<CControlSocket>
+{
+public:
+	CChmodManyOpData(CControlSocket & controlSocket, CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> const& entries);
+
+	virtual int Send() override;
+	virtual int ParseResponse() override { return FZ_REPLY_INTERNALERROR; }
+	virtual int SubcommandResult(int prevResult, COpData const& previousOperation) override;
+
+private:
+	CServerPath const path_;
+	std::vector<std::pair<std::wstring, std::wstring>> const entries_;
+	size_t next_{};
+	bool failed_{};
+};
+
 class CChangeDirOpData : public COpData
 {
 public:
@@ -216,8 +271,10 @@ public:
 	virtual void Delete(CServerPath const& path, std::vector<std::wstring>&& files);
 	virtual void RemoveDir(CServerPath const& path = CServerPath(), std::wstring const& subDir = std::wstring());
 	virtual void Mkdir(CServerPath const& path, transfer_flags const& flags);
+	virtual void Mkdir(std::vector<CServerPath> const& paths, transfer_flags const& flags);
 	virtual void Rename(CRenameCommand const& command);
 	virtual void Chmod(CChmodCommand const& command);
+	virtual void Chmod(CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> const& entries);
 	void Sleep(fz::duration const& delay);
 
 	Command GetCurrentCommandId() const;
@@ -278,9 +335,15 @@ protected:
 	virtual void Lookup(CServerPath const& path, std::wstring const& file, CDirentry * entry = nullptr);
 	virtual void Lookup(CServerPath const& path, std::vector<std::wstring> const& files);
 
+	// Looks up a single file on the server without listing its directory.
+	// Fails with FZ_REPLY_NOTSUPPORTED if the protocol or server cannot do that,
+	// with FZ_REPLY_ERROR_NOTFOUND if there is no such file.
+	virtual void Stat(CServerPath const& path, std::wstring const& file, CDirentry & entry);
+
 	friend class SleepOpData;
 	friend class LookupOpData;
 	friend class LookupManyOpData;
+	friend class CChmodManyOpData;
 	friend class CProtocolOpData<CControlSocket>;
 
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) = 0;
@@ -302,6 +365,13 @@ protected:
 
 	int CheckOverwriteFile();
 
+	// Compares the local file of the current transfer against remoteChecksum_. The first call
+	// starts checksumming the local file on the thread pool and returns FZ_REPLY_WOULDBLOCK, the
+	// operation gets resumed through SendNextCommand once done.
+	// Returns FZ_REPLY_OK if the checksums match, FZ_REPLY_ERROR if they differ and
+	// FZ_REPLY_NOTSUPPORTED if the local file could not be checksummed.
+	int CompareChecksums(CFileTransferOpData & data);
+
 	bool ParsePwdReply(std::wstring reply, const CServerPath& defaultPath = CServerPath());
 
 	virtual void Push(std::unique_ptr<COpData> && pNewOpData);
@@ -310,7 +380,11 @@ protected:
 
 	bool InitBufferPool(bool use_shm);
 
-	std::unique_ptr<fz::writer_base> OpenWriter(fz::writer_factory_holder & h, uint64_t resumeOffset, bool withProgress);
+	std::unique_ptr<fz::reader_base> OpenReader(fz::reader_factory_holder & h, uint64_t offset, uint64_t size = fz::aio_base::nosize);
+	std::unique_ptr<fz::writer_base> OpenWriter(fz::writer_factory_holder & h, uint64_t resumeOffset, bool withProgress, bool fsync);
+
+	// Creates the directory a local file is to be written to
+	void CreateLocalDir(std::wstring const& file);
 
 	std::optional<fz::aio_buffer_pool> buffer_pool_;
 	std::vector<std::unique_ptr<COpData>> operations_;
@@ -337,6 +411,7 @@ protected:
 
 	void OnTimer(fz::timer_id id);
 	void OnObtainLock();
+	void OnChecksum(local_checksum const* source, std::string const& digest);
 };
 
 class activity_logger_layer;
@@ -356,6 +431,7 @@ public:
 
 protected:
 	void CreateSocket(std::wstring const& host);
+	void CreateLayers(fz::socket_interface & next);
 
 	virtual int DoClose(int nErrorCode = FZ_REPLY_DISCONNECTED | FZ_REPLY_ERROR) override;
 	virtual void ResetSocket();
@@ -376,13 +452,46 @@ protected:
 		return Send(reinterpret_cast<unsigned char const*>(buffer), len);
 	}
 
+	// Flags and keepalive interval applied to every socket created by DoConnect
+	int socket_flags_{};
+	fz::duration keepalive_interval_;
+
 	std::unique_ptr<fz::socket> socket_;
+	std::unique_ptr<fz::socket_layer> peer_host_layer_;
 	std::unique_ptr<activity_logger_layer> activity_logger_layer_;
 	std::unique_ptr<fz::rate_limited_layer> ratelimit_layer_;
 	std::unique_ptr<CProxySocket> proxy_layer_;
 	fz::socket_layer* active_layer_{};
 
 	fz::buffer send_buffer_;
+
+private:
+	// Name resolution through the shared DNS cache and Happy Eyeballs
+	// (RFC 8305) connection racing when connecting without a proxy.
+	void OnDnsResolved(fz::native_string const& host, int error, std::vector<std::string> const& addresses);
+	void OnCandidateEvent(size_t index, fz::socket_event_flag t, int error);
+	void OnAttemptTimer();
+	bool StartConnectAttempt();
+	void ApplySocketOptions(fz::socket & s);
+	void ResetConnectAttempts();
+
+	struct connect_candidate final
+	{
+		std::unique_ptr<fz::socket> socket_;
+		std::string address_;
+		fz::monotonic_clock started_;
+	};
+
+	fz::native_string connect_host_;
+	unsigned int connect_port_{};
+	bool resolving_{};
+	fz::monotonic_clock connect_start_;
+
+	std::vector<std::string> connect_addresses_;
+	size_t next_address_{};
+	std::vector<connect_candidate> candidates_;
+	fz::timer_id attempt_timer_{};
+	int last_connect_error_{};
 };
 
 #endif
@@ -33,6 +33,9 @@ void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& ser
 	tServerIter sit = CreateServerEntry(server);
 	assert(sit != m_serverList.end());
 
+	// The listing supersedes single-file lookups
+	sit->statList.erase(listing.path);
+
 	m_totalFileCount += listing.size();
 
 	tCacheIter cit;
@@ -260,6 +263,8 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 		return false;
 	}
 
+	ForgetStat(sit, path, filename);
+
 	bool const cmpCase = server.GetCaseSensitivity() == CaseSensitivity::yes;
 	bool dir{};
 
@@ -324,6 +329,8 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 		return false;
 	}
 
+	ForgetStat(sit, path, filename);
+
 	bool updated = false;
 
 	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
@@ -397,6 +404,129 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 	return updated;
 }
 
+void CDirectoryCache::UpdateEntry(CServer const& server, CServerPath const& path, CDirentry const& direntry)
+{
+	fz::scoped_lock lock(mutex_);
+
+	tServerIter sit = GetServerEntry(server);
+	if (sit == m_serverList.end()) {
+		return;
+	}
+
+	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+		auto & entry = const_cast<CCacheEntry&>(*iter);
+		if (path != entry.listing.path) {
+			continue;
+		}
+
+		UpdateLru(sit, iter);
+
+		size_t const i = entry.listing.FindFile_CmpCase(direntry.name);
+		if (i != std::string::npos) {
+			if (entry.listing[i].is_dir() != direntry.is_dir()) {
+				entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
+			}
+			entry.listing.get(i) = direntry;
+		}
+		else {
+			if (direntry.is_dir()) {
+				entry.listing.m_flags |= CDirectoryListing::unsure_dir_added | CDirectoryListing::listing_has_dirs;
+			}
+			else {
+				entry.listing.m_flags |= CDirectoryListing::unsure_file_added;
+			}
+			entry.listing.Append(CDirentry(direntry));
+
+			++m_totalFileCount;
+		}
+		entry.modificationTime = fz::monotonic_clock::now();
+	}
+}
+
+void CDirectoryCache::StoreStat(CServer const& server, CServerPath const& path, std::wstring const& filename, CDirentry const* entry)
+{
+	fz::scoped_lock lock(mutex_);
+
+	tServerIter sit = CreateServerEntry(server);
+
+	tCacheIter cit;
+	bool unused;
+	if (Lookup(cit, sit, path, true, unused)) {
+		// Already merged into the listing by UpdateEntry
+		return;
+	}
+
+	auto const now = fz::monotonic_clock::now();
+	for (auto it = sit->statList.begin(); it != sit->statList.end(); ) {
+		if (now - it->second.time > ttl_) {
+			it = sit->statList.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	auto & stat = sit->statList[path];
+	if (stat.files.empty()) {
+		stat.time = now;
+	}
+	if (entry) {
+		stat.files[filename] = *entry;
+	}
+	else {
+		stat.files[filename] = std::nullopt;
+	}
+}
+
+CDirectoryCache::StatResult CDirectoryCache::LookupStat(CServer const& server, CServerPath const& path, std::wstring const& filename, CDirentry & entry)
+{
+	fz::scoped_lock lock(mutex_);
+
+	tServerIter sit = GetServerEntry(server);
+	if (sit == m_serverList.end()) {
+		return StatResult::unknown;
+	}
+
+	auto it = sit->statList.find(path);
+	if (it == sit->statList.end()) {
+		return StatResult::unknown;
+	}
+	if (fz::monotonic_clock::now() - it->second.time > ttl_) {
+		sit->statList.erase(it);
+		return StatResult::unknown;
+	}
+
+	auto const file = it->second.files.find(filename);
+	if (file == it->second.files.end()) {
+		return StatResult::dir_known;
+	}
+	if (!file->second) {
+		return StatResult::missing;
+	}
+
+	entry = *file->second;
+	return StatResult::found;
+}
+
+void CDirectoryCache::ForgetStat(tServerIter const& sit, CServerPath const& path, std::wstring const& filename)
+{
+	// Compared without regard to case, forgetting too much is harmless
+	for (auto & stat : sit->statList) {
+		if (!path.equal_nocase(stat.first)) {
+			continue;
+		}
+		auto & files = stat.second.files;
+		for (auto it = files.begin(); it != files.end(); ) {
+			if (!fz::stricmp(filename, it->first)) {
+				it = files.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+}
+
 bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
 	fz::scoped_lock lock(mutex_);
@@ -406,6 +536,8 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 		return false;
 	}
 
+	ForgetStat(sit, path, filename);
+
 	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
 		auto & entry = const_cast<CCacheEntry&>(*iter);
 		if (!path.equal_nocase(entry.listing.path)) {
@@ -507,6 +639,15 @@ void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path,
 		absolutePath.clear();
 	}
 
+	for (auto it = sit->statList.begin(); it != sit->statList.end(); ) {
+		if (!absolutePath.empty() && (it->first.equal_nocase(absolutePath) || absolutePath.IsParentOf(it->first, true))) {
+			it = sit->statList.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
 	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ) {
 		auto & entry = const_cast<CCacheEntry&>(*iter);
 		// Delete exact matches and subdirs
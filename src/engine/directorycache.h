@@ -19,6 +19,8 @@ version.
 #include <libfilezilla/mutex.hpp>
 
 #include <list>
+#include <map>
+#include <optional>
 #include <set>
 
 enum class LookupFlags
@@ -77,6 +79,14 @@ public:
 		dir
 	};
 
+	enum class StatResult
+	{
+		unknown,   // Nothing has been looked up in the directory
+		dir_known, // Only other files of the directory have been looked up
+		found,
+		missing
+	};
+
 	CDirectoryCache();
 	~CDirectoryCache();
 
@@ -95,6 +105,16 @@ public:
 	bool InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
 	bool UpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type = file, int64_t size = -1, std::wstring const& ownerGroup = std::wstring{});
 	bool RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
+
+	// Merges an entry obtained without listing its directory, e.g. through MLST,
+	// into the cached listing of the directory, if any.
+	void UpdateEntry(CServer const& server, CServerPath const& path, CDirentry const& direntry);
+
+	// Remembers the result of looking up a single file in a directory that is not
+	// cached, entry is null if there was no such file. Repeated lookups of the file
+	// need no round trip, lookups of other files can list the directory instead.
+	void StoreStat(CServer const& server, CServerPath const& path, std::wstring const& filename, CDirentry const* entry);
+	StatResult LookupStat(CServer const& server, CServerPath const& path, std::wstring const& filename, CDirentry & entry);
 	void InvalidateServer(CServer const& server);
 	void RemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename, CServerPath const& target);
 	void Rename(CServer const& server, CServerPath const& pathFrom, std::wstring const& fileFrom, CServerPath const& pathTo, std::wstring const& fileTo);
@@ -139,6 +159,16 @@ protected:
 
 		CServer server;
 		std::set<CCacheEntry> cacheList;
+
+		// Files looked up in directories which are not cached,
+		// disengaged if the file did not exist.
+		class CStatEntry final
+		{
+		public:
+			fz::monotonic_clock time;
+			std::map<std::wstring, std::optional<CDirentry>> files;
+		};
+		std::map<CServerPath, CStatEntry> statList;
 	};
 
 	typedef std::list<CServerEntry>::iterator tServerIter;
@@ -157,6 +187,9 @@ protected:
 
 	void UpdateLru(tServerIter const& sit, tCacheIter const& cit);
 
+	// Drops what is known about the file from the results of single-file lookups
+	void ForgetStat(tServerIter const& sit, CServerPath const& path, std::wstring const& filename);
+
 	void Prune();
 
 	typedef std::pair<tServerIter, tCacheIter> tFullEntryPosition;
@@ -0,0 +1,144 @@
+#include "filezilla.h"
+#include "dns_cache.h"
+
+#include "../include/engine_options.h"
+
+#include <algorithm>
+
+namespace {
+// Upper bound for remembering failed lookups, a broken resolver
+// shouldn't keep a host unreachable for long.
+fz::duration const negative_ttl = fz::duration::from_seconds(10);
+
+size_t const max_entries = 1000;
+}
+
+dns_cache::dns_cache(fz::thread_pool & pool, fz::event_loop & loop, COptionsBase & options)
+	: fz::event_handler(loop)
+	, pool_(pool)
+	, options_(options)
+{
+}
+
+dns_cache::~dns_cache()
+{
+	remove_handler();
+
+	fz::scoped_lock l(mutex_);
+	entries_.clear();
+}
+
+bool dns_cache::lookup(fz::event_handler & handler, fz::native_string const& host, int & error, std::vector<std::string> & addresses)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto const now = fz::monotonic_clock::now();
+
+	auto it = entries_.find(host);
+	if (it != entries_.end()) {
+		auto & e = it->second;
+		if (e.lookup_) {
+			// Already being resolved, join in
+			e.waiters_.push_back(&handler);
+			return false;
+		}
+		if (e.expires_ > now) {
+			error = e.error_;
+			addresses = e.addresses_;
+			return true;
+		}
+	}
+	else {
+		prune(now);
+		it = entries_.emplace(host, entry()).first;
+	}
+
+	auto & e = it->second;
+	e.error_ = 0;
+	e.addresses_.clear();
+	e.lookup_ = std::make_unique<fz::hostname_lookup>(pool_, *this);
+	if (!e.lookup_->lookup(host)) {
+		entries_.erase(it);
+		error = EINVAL;
+		addresses.clear();
+		return true;
+	}
+	e.waiters_.push_back(&handler);
+
+	return false;
+}
+
+void dns_cache::cancel(fz::event_handler & handler)
+{
+	fz::scoped_lock l(mutex_);
+	for (auto & it : entries_) {
+		auto & waiters = it.second.waiters_;
+		waiters.erase(std::remove(waiters.begin(), waiters.end(), &handler), waiters.end());
+	}
+}
+
+void dns_cache::clear()
+{
+	fz::scoped_lock l(mutex_);
+	for (auto it = entries_.begin(); it != entries_.end(); ) {
+		if (it->second.lookup_) {
+			++it;
+		}
+		else {
+			it = entries_.erase(it);
+		}
+	}
+}
+
+void dns_cache::prune(fz::monotonic_clock const& now)
+{
+	if (entries_.size() < max_entries) {
+		return;
+	}
+
+	for (auto it = entries_.begin(); it != entries_.end(); ) {
+		if (!it->second.lookup_ && it->second.expires_ <= now) {
+			it = entries_.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void dns_cache::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::hostname_lookup_event>(ev, this, &dns_cache::on_lookup_done);
+}
+
+void dns_cache::on_lookup_done(fz::hostname_lookup* source, int error, std::vector<std::string> const& addresses)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto it = entries_.begin();
+	for (; it != entries_.end(); ++it) {
+		if (it->second.lookup_.get() == source) {
+			break;
+		}
+	}
+	if (it == entries_.end()) {
+		return;
+	}
+
+	auto & e = it->second;
+	e.lookup_.reset();
+
+	e.error_ = error;
+	e.addresses_ = addresses;
+
+	fz::duration ttl = fz::duration::from_seconds(options_.get_int(OPTION_DNS_CACHE_TTL));
+	if (error && ttl > negative_ttl) {
+		ttl = negative_ttl;
+	}
+	e.expires_ = fz::monotonic_clock::now() + ttl;
+
+	for (auto * handler : e.waiters_) {
+		handler->send_event<dns_cache_event>(it->first, error, addresses);
+	}
+	e.waiters_.clear();
+}
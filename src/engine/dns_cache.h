@@ -0,0 +1,70 @@
+#ifndef FILEZILLA_ENGINE_DNS_CACHE_HEADER
+#define FILEZILLA_ENGINE_DNS_CACHE_HEADER
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/hostname_lookup.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class COptionsBase;
+
+// Arguments: Hostname the lookup was made for, error code, resolved addresses
+struct dns_cache_event_type;
+typedef fz::simple_event<dns_cache_event_type, fz::native_string, int, std::vector<std::string>> dns_cache_event;
+
+// Shared hostname resolver for all engines of a context.
+//
+// Concurrent lookups of the same name are coalesced into a single query,
+// results are kept for OPTION_DNS_CACHE_TTL seconds. Failed lookups are
+// remembered for a shorter time so that a mistyped hostname in a queue with
+// many items doesn't cause a burst of identical queries.
+class dns_cache final : public fz::event_handler
+{
+public:
+	dns_cache(fz::thread_pool & pool, fz::event_loop & loop, COptionsBase & options);
+	virtual ~dns_cache();
+
+	dns_cache(dns_cache const&) = delete;
+	dns_cache& operator=(dns_cache const&) = delete;
+
+	// Returns true if a cached result is available, error and addresses are then set.
+	// Otherwise returns false and handler gets sent a dns_cache_event once the lookup
+	// has finished.
+	bool lookup(fz::event_handler & handler, fz::native_string const& host, int & error, std::vector<std::string> & addresses);
+
+	// Handler no longer receives results of pending lookups. Already sent events
+	// are not revoked.
+	void cancel(fz::event_handler & handler);
+
+	void clear();
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+	void on_lookup_done(fz::hostname_lookup* source, int error, std::vector<std::string> const& addresses);
+
+	void prune(fz::monotonic_clock const& now);
+
+	struct entry
+	{
+		fz::monotonic_clock expires_;
+		int error_{};
+		std::vector<std::string> addresses_;
+
+		// Only set while the lookup is running
+		std::unique_ptr<fz::hostname_lookup> lookup_;
+		std::vector<fz::event_handler*> waiters_;
+	};
+
+	fz::thread_pool & pool_;
+	COptionsBase & options_;
+
+	fz::mutex mutex_;
+	std::map<fz::native_string, entry> entries_;
+};
+
+#endif
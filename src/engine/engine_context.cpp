@@ -1,15 +1,20 @@
 #include "filezilla.h"
 
 #include "../include/activity_logger.h"
+#include "../include/bandwidth_scheduler.h"
 #include "../include/engine_context.h"
 #include "../include/engine_options.h"
 #include "../include/logfile_writer.h"
+#include "../include/multicast_reader.h"
 #include "../include/sizeformatting.h"
 
 #include "directorycache.h"
+#include "dns_cache.h"
 #include "logging_private.h"
 #include "oplock_manager.h"
 #include "pathcache.h"
+#include "servercapabilities.h"
+#include "socket_tuner.h"
 
 #include <libfilezilla/event_loop.hpp>
 #include <libfilezilla/rate_limiter.hpp>
@@ -98,10 +103,12 @@ public:
 	{
 		directory_cache_.SetTtl(fz::duration::from_seconds(options.get_int(OPTION_CACHE_TTL)));
 		rate_limit_mgr_.add(&rate_limiter_);
+		CServerCapabilities::Load(options.get_string(OPTION_SERVER_CAPABILITIES_FILE));
 	}
 
 	~Impl()
 	{
+		CServerCapabilities::Save();
 	}
 
 	COptionsBase& options_;
@@ -112,11 +119,15 @@ public:
 	option_change_handler option_change_handler_{options_, loop_, rate_limit_mgr_, rate_limiter_};
 	CDirectoryCache directory_cache_;
 	CPathCache path_cache_;
+	dns_cache dns_cache_{pool_, loop_, options_};
 	OpLockManager opLockManager_;
 	fz::tls_system_trust_store tlsSystemTrustStore_;
 	activity_logger activity_logger_;
+	bandwidth_scheduler bandwidth_scheduler_{rate_limiter_, activity_logger_};
 	logfile_writer logfile_writer_;
 	SizeFormatter size_formatter_;
+	multicast_reader_hub multicast_reader_hub_{pool_, options_};
+	socket_buffer_budget socket_buffer_budget_{options_};
 };
 
 CFileZillaEngineContext::CFileZillaEngineContext(COptionsBase & options, CustomEncodingConverterBase const& customEncodingConverter)
@@ -145,6 +156,11 @@ fz::rate_limiter& CFileZillaEngineContext::GetRateLimiter()
 	return impl_->rate_limiter_;
 }
 
+bandwidth_scheduler& CFileZillaEngineContext::GetBandwidthScheduler()
+{
+	return impl_->bandwidth_scheduler_;
+}
+
 CDirectoryCache& CFileZillaEngineContext::GetDirectoryCache()
 {
 	return impl_->directory_cache_;
@@ -155,6 +171,11 @@ CPathCache& CFileZillaEngineContext::GetPathCache()
 	return impl_->path_cache_;
 }
 
+dns_cache& CFileZillaEngineContext::GetDnsCache()
+{
+	return impl_->dns_cache_;
+}
+
 OpLockManager& CFileZillaEngineContext::GetOpLockManager()
 {
 	return impl_->opLockManager_;
@@ -175,6 +196,16 @@ logfile_writer & CFileZillaEngineContext::GetLogFileWriter()
 	return impl_->logfile_writer_;
 }
 
+multicast_reader_hub & CFileZillaEngineContext::GetMulticastReaderHub()
+{
+	return impl_->multicast_reader_hub_;
+}
+
+socket_buffer_budget & CFileZillaEngineContext::GetSocketBufferBudget()
+{
+	return impl_->socket_buffer_budget_;
+}
+
 SizeFormatter & CFileZillaEngineContext::size_formatter()
 {
 	return impl_->size_formatter_;
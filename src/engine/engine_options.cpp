@@ -38,6 +38,7 @@ unsigned int register_engine_options()
 		{ "Preallocate space", false, option_flags::normal },
 		{ "View hidden files", false, option_flags::normal },
 		{ "Preserve timestamps", false, option_flags::normal },
+		{ "Verify transfers", false, option_flags::normal },
 
 		// Make it large enough by default
 		// to enable a large TCP window scale
@@ -65,6 +66,7 @@ unsigned int register_engine_options()
 		{ "FTP Proxy login sequence", L"", option_flags::normal },
 		{ "SFTP keyfiles", L"", option_flags::platform },
 		{ "SFTP compression", false, option_flags::normal },
+		{ "SFTP share connections", false, option_flags::normal },
 		{ "Proxy type", 0, option_flags::normal, 0, 3 },
 		{ "Proxy host", L"", option_flags::normal },
 		{ "Proxy port", 0, option_flags::normal, 1, 65535 },
@@ -79,7 +81,14 @@ unsigned int register_engine_options()
 		{ "TCP Keepalive Interval", 15, option_flags::numeric_clamp, 1, 10000 },
 		{ "Cache TTL", 600, option_flags::numeric_clamp, 30, 60*60*24 },
 		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 },
-		{ "Directory listing item limit", 10000000, option_flags::numeric_clamp, 1000000, 2000000000 }
+		{ "Directory listing item limit", 10000000, option_flags::numeric_clamp, 1000000, 2000000000 },
+		{ "DNS cache TTL", 60, option_flags::numeric_clamp, 0, 60*60 },
+		{ "Upload multicast buffer", 32, option_flags::numeric_clamp, 0, 1024 },
+		{ "Server capabilities file", L"", option_flags::internal },
+		{ "HTTP download segments", 1, option_flags::numeric_clamp, 1, 16 },
+		{ "Local file I/O", 0, option_flags::numeric_clamp, 0, 2 },
+		{ "Socket buffer autotuning", true, option_flags::normal },
+		{ "Socket buffer memory limit", 256, option_flags::numeric_clamp, 16, 4096 }
 	});
 	return value;
 }
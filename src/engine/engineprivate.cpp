@@ -120,6 +120,7 @@ void CFileZillaEnginePrivate::shutdown()
 	}
 
 	controlSocket_.reset();
+	rate_limit_node_.reset();
 	currentCommand_.reset();
 
 	{
@@ -324,6 +325,7 @@ int CFileZillaEnginePrivate::Disconnect(CDisconnectCommand const&)
 		res = controlSocket_->Disconnect();
 		controlSocket_.reset();
 	}
+	rate_limit_node_.reset();
 
 	return res;
 }
@@ -422,7 +424,12 @@ int CFileZillaEnginePrivate::RemoveDir(CRemoveDirCommand const& command)
 
 int CFileZillaEnginePrivate::Mkdir(CMkdirCommand const& command)
 {
-	controlSocket_->Mkdir(command.GetPath(), {});
+	if (!command.GetPaths().empty()) {
+		controlSocket_->Mkdir(command.GetPaths(), command.GetFlags());
+	}
+	else {
+		controlSocket_->Mkdir(command.GetPath(), {});
+	}
 	return FZ_REPLY_CONTINUE;
 }
 
@@ -434,7 +441,12 @@ int CFileZillaEnginePrivate::Rename(CRenameCommand const& command)
 
 int CFileZillaEnginePrivate::Chmod(CChmodCommand const& command)
 {
-	controlSocket_->Chmod(command);
+	if (!command.GetEntries().empty()) {
+		controlSocket_->Chmod(command.GetPath(), command.GetEntries());
+	}
+	else {
+		controlSocket_->Chmod(command);
+	}
 	return FZ_REPLY_CONTINUE;
 }
 
@@ -532,6 +544,10 @@ int CFileZillaEnginePrivate::ContinueConnect()
 		return FZ_REPLY_WOULDBLOCK;
 	}
 
+	// Sockets of a previous connection need to be gone before leaving its group
+	controlSocket_.reset();
+	rate_limit_node_ = context_.GetBandwidthScheduler().acquire(server, rate_limit_group_);
+
 	switch (server.GetProtocol())
 	{
 #if ENABLE_FTP
@@ -567,6 +583,12 @@ int CFileZillaEnginePrivate::ContinueConnect()
 	return FZ_REPLY_CONTINUE;
 }
 
+void CFileZillaEnginePrivate::SetRateLimitGroup(std::wstring const& group)
+{
+	fz::scoped_lock lock(mutex_);
+	rate_limit_group_ = group;
+}
+
 void CFileZillaEnginePrivate::OnInvalidateCurrentWorkingDir(CServer const& server, CServerPath const& path)
 {
 	if (!controlSocket_ || controlSocket_->GetCurrentServer() != server) {
@@ -1,6 +1,7 @@
 #ifndef FILEZILLA_ENGINEPRIVATE_HEADER
 #define FILEZILLA_ENGINEPRIVATE_HEADER
 
+#include "../include/bandwidth_scheduler.h"
 #include "../include/engine_context.h"
 #include "../include/FileZillaEngine.h"
 #include "../include/optionsbase.h"
@@ -83,7 +84,10 @@ public:
 	std::unique_ptr<CNotification> GetNextNotification();
 
 	COptionsBase& GetOptions() { return options_; }
-	fz::rate_limiter& GetRateLimiter() { return rate_limiter_; }
+	// Limiter and activity logger of the rate limit group of the current connection
+	fz::rate_limiter& GetRateLimiter() { return rate_limit_node_ ? rate_limit_node_->limiter() : rate_limiter_; }
+	activity_logger& GetActivityLogger() { return rate_limit_node_ ? rate_limit_node_->logger() : activity_logger_; }
+	void SetRateLimitGroup(std::wstring const& group);
 	CDirectoryCache& GetDirectoryCache() { return directory_cache_; }
 	CPathCache& GetPathCache() { return path_cache_; }
 	fz::thread_pool& GetThreadPool() { return thread_pool_; }
@@ -161,6 +165,10 @@ protected:
 
 	static std::vector<CFileZillaEnginePrivate*> m_engineList;
 
+	// Needs to outlive the sockets
+	std::shared_ptr<bandwidth_scheduler::node> rate_limit_node_;
+	std::wstring rate_limit_group_;
+
 	std::unique_ptr<CControlSocket> controlSocket_;
 
 	std::unique_ptr<CCommand> currentCommand_;
@@ -18,13 +18,16 @@ enum filetransferStates
         filetransfer_init = 0,
         filetransfer_waitcwd,
         filetransfer_waitlist,
+        filetransfer_waitstat,
         filetransfer_size,
         filetransfer_mdtm,
         filetransfer_resumetest,
         filetransfer_transfer,
         filetransfer_waittransfer,
         filetransfer_waitresumetest,
-        filetransfer_mfmt
+        filetransfer_mfmt,
+        filetransfer_checksum,
+        filetransfer_waitchecksum
 };
 }
 
@@ -69,6 +72,14 @@ int CFtpFileTransferOpData::Send()
 		break;
 	case filetransfer_resumetest:
 	case filetransfer_transfer:
+		if (compareChecksums_) {
+			compareChecksums_ = false;
+			if (binary) {
+				opState = filetransfer_checksum;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+
 		if (controlSocket_.m_pTransferSocket) {
 			log(logmsg::debug_verbose, L"m_pTransferSocket != 0");
 			controlSocket_.m_pTransferSocket.reset();
@@ -126,7 +137,7 @@ int CFtpFileTransferOpData::Send()
 			controlSocket_.m_pTransferSocket = std::make_unique<CTransferSocket>(engine_, controlSocket_, download() ? TransferMode::download : TransferMode::upload);
 			controlSocket_.m_pTransferSocket->m_binaryMode = binary;
 			if (download()) {
-				auto writer = controlSocket_.OpenWriter(writer_factory_, resumeOffset, true);
+				auto writer = controlSocket_.OpenWriter(writer_factory_, resumeOffset, true, fsync());
 				if (!writer) {
 					return FZ_REPLY_CRITICALERROR;
 				}
@@ -140,7 +151,7 @@ int CFtpFileTransferOpData::Send()
 				controlSocket_.m_pTransferSocket->set_writer(std::move(writer), flags_ & ftp_transfer_flags::ascii);
 			}
 			else {
-				auto reader = reader_factory_->open(*controlSocket_.buffer_pool_, resumeOffset, fz::aio_base::nosize, controlSocket_.max_buffer_count());
+				auto reader = controlSocket_.OpenReader(reader_factory_, resumeOffset);
 				if (!reader) {
 					return FZ_REPLY_CRITICALERROR;
 				}
@@ -177,6 +188,16 @@ int CFtpFileTransferOpData::Send()
 
 		break;
 	}
+	case filetransfer_checksum:
+		cmd = ChecksumCommand();
+		if (cmd.empty()) {
+			log(logmsg::status, _("Server does not support checksums"));
+			return OnChecksumResult(FZ_REPLY_NOTSUPPORTED);
+		}
+		cmd += remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_);
+		break;
+	case filetransfer_waitchecksum:
+		return OnChecksumResult(controlSocket_.CompareChecksums(*this));
 	default:
 		log(logmsg::debug_warning, L"Unhandled opState: %d", opState);
 		return FZ_REPLY_ERROR;
@@ -307,6 +328,19 @@ int CFtpFileTransferOpData::ParseResponse()
 		break;
 	case filetransfer_mfmt:
 		return FZ_REPLY_OK;
+	case filetransfer_checksum:
+		if (code == 2) {
+			remoteChecksum_ = find_checksum(checksumAlgorithm_, response);
+		}
+		else if (code == 5 && checksumCommand_ != hash_command) {
+			CServerCapabilities::SetCapability(currentServer_, checksumCommand_, no);
+		}
+		if (remoteChecksum_.empty()) {
+			log(logmsg::status, _("Could not obtain checksum of remote file"));
+			return OnChecksumResult(FZ_REPLY_NOTSUPPORTED);
+		}
+		opState = filetransfer_waitchecksum;
+		break;
 	default:
 		log(logmsg::debug_warning, L"Unknown op state");
 		return FZ_REPLY_INTERNALERROR;
@@ -315,6 +349,47 @@ int CFtpFileTransferOpData::ParseResponse()
 	return FZ_REPLY_CONTINUE;
 }
 
+int CFtpFileTransferOpData::OnStatResult(int result)
+{
+	if (result & FZ_REPLY_DISCONNECTED) {
+		return result;
+	}
+
+	if (result == FZ_REPLY_OK) {
+		remoteFileSize_ = statEntry_.size;
+		if (statEntry_.has_date()) {
+			remoteFileTime_ = statEntry_.time;
+		}
+	}
+	else if (result != FZ_REPLY_ERROR_NOTFOUND) {
+		if (result == FZ_REPLY_NOTSUPPORTED && CServerCapabilities::GetCapability(currentServer_, size_command) == yes) {
+			opState = filetransfer_size;
+			return FZ_REPLY_CONTINUE;
+		}
+
+		opState = filetransfer_waitlist;
+		controlSocket_.List(CServerPath(), L"", LIST_FLAG_REFRESH);
+		return FZ_REPLY_CONTINUE;
+	}
+
+	if (download() &&
+		!statEntry_.has_time() &&
+		options_.get_int(OPTION_PRESERVE_TIMESTAMPS) &&
+		CServerCapabilities::GetCapability(currentServer_, mdtm_command) == yes)
+	{
+		opState = filetransfer_mdtm;
+	}
+	else {
+		opState = filetransfer_resumetest;
+		int res = controlSocket_.CheckOverwriteFile();
+		if (res != FZ_REPLY_OK) {
+			return res;
+		}
+	}
+
+	return FZ_REPLY_CONTINUE;
+}
+
 int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 {
 	if (opState == filetransfer_waitcwd) {
@@ -325,7 +400,20 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 			bool found = engine_.GetDirectoryCache().LookupFile(entry, currentServer_, tryAbsolutePath_ ? remotePath_ : currentPath_, remoteFile_, dirDidExist, matchedCase);
 			if (!found) {
 				if (!dirDidExist) {
-					opState = filetransfer_waitlist;
+					// A single file is cheaper to look up than a large directory, but a
+					// further file of the same directory gets its directory listed.
+					switch (engine_.GetDirectoryCache().LookupStat(currentServer_, tryAbsolutePath_ ? remotePath_ : currentPath_, remoteFile_, statEntry_)) {
+					case CDirectoryCache::StatResult::found:
+						return OnStatResult(FZ_REPLY_OK);
+					case CDirectoryCache::StatResult::missing:
+						return OnStatResult(FZ_REPLY_ERROR_NOTFOUND);
+					case CDirectoryCache::StatResult::dir_known:
+						opState = filetransfer_waitlist;
+						break;
+					default:
+						opState = filetransfer_waitstat;
+						break;
+					}
 				}
 				else if (download() && options_.get_int(OPTION_PRESERVE_TIMESTAMPS) && CServerCapabilities::GetCapability(currentServer_, mdtm_command) == yes) {
 					opState = filetransfer_mdtm;
@@ -361,7 +449,12 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 					}
 				}
 			}
-			if (opState == filetransfer_waitlist) {
+			if (opState == filetransfer_waitstat) {
+				// Look up just this file instead of listing a possibly huge directory
+				controlSocket_.Stat(tryAbsolutePath_ ? remotePath_ : currentPath_, remoteFile_, statEntry_);
+				return FZ_REPLY_CONTINUE;
+			}
+			else if (opState == filetransfer_waitlist) {
 				controlSocket_.List(CServerPath(), L"", LIST_FLAG_REFRESH);
 				return FZ_REPLY_CONTINUE;
 			}
@@ -377,6 +470,9 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 			opState = filetransfer_size;
 		}
 	}
+	else if (opState == filetransfer_waitstat) {
+		return OnStatResult(prevResult);
+	}
 	else if (opState == filetransfer_waitlist) {
 		if (prevResult == FZ_REPLY_OK) {
 			CDirentry entry;
@@ -432,23 +528,14 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		}
 	}
 	else if (opState == filetransfer_waittransfer) {
-		if (prevResult == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
-			if (!download() &&
-				CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
-			{
-				localFileTime_ = reader_factory_.mtime();
-				if (!localFileTime_.empty()) {
-					opState = filetransfer_mfmt;
-					return FZ_REPLY_CONTINUE;
-				}
-			}
-			else if (download() && !remoteFileTime_.empty()) {
-				if (!writer_factory_->set_mtime(remoteFileTime_)) {
-					log(logmsg::debug_warning, L"Could not set modification time");
-				}
-			}
+		if (prevResult != FZ_REPLY_OK) {
+			return prevResult;
+		}
+		if (binary && options_.get_int(OPTION_VERIFY_TRANSFERS)) {
+			opState = filetransfer_checksum;
+			return FZ_REPLY_CONTINUE;
 		}
-		return prevResult;
+		return FinishTransfer();
 	}
 	else if (opState == filetransfer_waitresumetest) {
 		if (prevResult != FZ_REPLY_OK) {
@@ -478,3 +565,79 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 
 	return FZ_REPLY_CONTINUE;
 }
+
+int CFtpFileTransferOpData::FinishTransfer()
+{
+	if (options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (!download() &&
+			CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
+		{
+			localFileTime_ = reader_factory_.mtime();
+			if (!localFileTime_.empty()) {
+				opState = filetransfer_mfmt;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+		else if (download() && !remoteFileTime_.empty()) {
+			if (!writer_factory_->set_mtime(remoteFileTime_)) {
+				log(logmsg::debug_warning, L"Could not set modification time");
+			}
+		}
+	}
+	return FZ_REPLY_OK;
+}
+
+std::wstring CFtpFileTransferOpData::ChecksumCommand()
+{
+	std::wstring name;
+	if (CServerCapabilities::GetCapability(currentServer_, hash_command, &name) == yes) {
+		checksumAlgorithm_ = checksum_from_name(name);
+		if (checksumAlgorithm_ != checksum_algorithm::none) {
+			checksumCommand_ = hash_command;
+			return L"HASH ";
+		}
+	}
+
+	static std::tuple<capabilityNames, checksum_algorithm, wchar_t const*> const commands[] = {
+		{xsha256_command, checksum_algorithm::sha256, L"XSHA256 "},
+		{xsha1_command, checksum_algorithm::sha1, L"XSHA1 "},
+		{xmd5_command, checksum_algorithm::md5, L"XMD5 "},
+		{xcrc_command, checksum_algorithm::crc32, L"XCRC "}
+	};
+	for (auto const& [cap, alg, cmd] : commands) {
+		if (CServerCapabilities::GetCapability(currentServer_, cap) == yes) {
+			checksumCommand_ = cap;
+			checksumAlgorithm_ = alg;
+			return cmd;
+		}
+	}
+
+	return std::wstring();
+}
+
+int CFtpFileTransferOpData::OnChecksumResult(int result)
+{
+	if (result == FZ_REPLY_WOULDBLOCK) {
+		return result;
+	}
+
+	if (!transferInitiated_) {
+		// Comparing prior to the transfer
+		if (result == FZ_REPLY_OK) {
+			if (download()) {
+				log(logmsg::status, _("Skipping download of %s"), remotePath_.FormatFilename(remoteFile_));
+			}
+			else {
+				log(logmsg::status, _("Skipping upload of %s"), localName_);
+			}
+			return FZ_REPLY_OK;
+		}
+		opState = filetransfer_resumetest;
+		return FZ_REPLY_CONTINUE;
+	}
+
+	if (result == FZ_REPLY_ERROR) {
+		return FZ_REPLY_ERROR;
+	}
+	return FinishTransfer();
+}
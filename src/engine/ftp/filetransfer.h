@@ -2,6 +2,7 @@
 #define FILEZILLA_ENGINE_FTP_FILETRANSFER_HEADER
 
 #include "ftpcontrolsocket.h"
+#include "../servercapabilities.h"
 
 class CFtpFileTransferOpData final : public CFileTransferOpData, public CFtpTransferOpData, public CFtpOpData
 {
@@ -15,6 +16,22 @@ public:
 	int TestResumeCapability();
 
 	bool fileDidExist_{true};
+
+private:
+	// Picks the command to obtain the remote checksum with, empty if there's none
+	std::wstring ChecksumCommand();
+	int OnChecksumResult(int result);
+
+	// Continues with the result of the single-file lookup into statEntry_
+	int OnStatResult(int result);
+
+	// Sets the timestamp once the transfer is done
+	int FinishTransfer();
+
+	capabilityNames checksumCommand_{};
+
+	// Filled in by the single-file lookup
+	CDirentry statEntry_;
 };
 
 #endif
@@ -12,6 +12,7 @@
 #include "rawtransfer.h"
 #include "rename.h"
 #include "rmd.h"
+#include "stat.h"
 #include "transfersocket.h"
 
 #include "../directorycache.h"
@@ -599,6 +600,11 @@ void CFtpControlSocket::Mkdir(CServerPath const& path, transfer_flags const&)
 	Push(std::move(pData));
 }
 
+void CFtpControlSocket::Mkdir(std::vector<CServerPath> const& paths, transfer_flags const&)
+{
+	Push(std::make_unique<CFtpMkdirManyOpData>(*this, paths));
+}
+
 void CFtpControlSocket::Rename(CRenameCommand const& command)
 {
 	Push(std::make_unique<CFtpRenameOpData>(*this, command));
@@ -609,6 +615,11 @@ void CFtpControlSocket::Chmod(CChmodCommand const& command)
 	Push(std::make_unique<CFtpChmodOpData>(*this, command));
 }
 
+void CFtpControlSocket::Stat(CServerPath const& path, std::wstring const& file, CDirentry & entry)
+{
+	Push(std::make_unique<CFtpStatOpData>(*this, path, file, entry));
+}
+
 int CFtpControlSocket::GetExternalIPAddress(std::string& address)
 {
 	// Local IP should work. Only a complete moron would use IPv6
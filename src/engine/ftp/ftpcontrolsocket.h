@@ -62,8 +62,10 @@ protected:
 	virtual void Delete(CServerPath const& path, std::vector<std::wstring>&& files) override;
 	virtual void RemoveDir(CServerPath const& path, std::wstring const& subDir) override;
 	virtual void Mkdir(CServerPath const& path, transfer_flags const& flags = {}) override;
+	virtual void Mkdir(std::vector<CServerPath> const& paths, transfer_flags const& flags) override;
 	virtual void Rename(CRenameCommand const& command) override;
 	virtual void Chmod(CChmodCommand const& command) override;
+	virtual void Stat(CServerPath const& path, std::wstring const& file, CDirentry & entry) override;
 	void Transfer(std::wstring const& cmd, CFtpTransferOpData* oldData);
 
 	void TransferEnd();
@@ -135,10 +137,12 @@ protected:
 	friend class CFtpListOpData;
 	friend class CFtpLogonOpData;
 	friend class CFtpMkdirOpData;
+	friend class CFtpMkdirManyOpData;
 	friend class CFtpRawCommandOpData;
 	friend class CFtpRawTransferOpData;
 	friend class CFtpRemoveDirOpData;
 	friend class CFtpRenameOpData;
+	friend class CFtpStatOpData;
 };
 
 typedef CProtocolOpData<CFtpControlSocket> CFtpOpData;
@@ -1,6 +1,7 @@
 #include "../filezilla.h"
 
 #include "logon.h"
+#include "../checksum.h"
 #include "../proxy.h"
 #include "../servercapabilities.h"
 #include "../tls.h"
@@ -109,19 +110,20 @@ int CFtpLogonOpData::Send()
 			}
 
 			opState = LOGON_WELCOME;
-			int ret = controlSocket_.DoConnect(host_, port_);
-			if (ret == FZ_REPLY_WOULDBLOCK) {
-				// Enable TCP_NODELAY, speeds things up a bit.
-				controlSocket_.socket_->set_flags(fz::socket::flag_nodelay | fz::socket::flag_keepalive, true);
 
-				// Enable SO_KEEPALIVE, lots of clueless users have broken routers and
-				// firewalls which terminate the control connection on long transfers.
-				int v = options_.get_int(OPTION_TCP_KEEPALIVE_INTERVAL);
-				if (v >= 1 && v < 10000) {
-					controlSocket_.socket_->set_keepalive_interval(fz::duration::from_minutes(v));
-				}
+			// Enable TCP_NODELAY, speeds things up a bit.
+			// Enable SO_KEEPALIVE, lots of clueless users have broken routers and
+			// firewalls which terminate the control connection on long transfers.
+			controlSocket_.socket_flags_ = fz::socket::flag_nodelay | fz::socket::flag_keepalive;
+			int v = options_.get_int(OPTION_TCP_KEEPALIVE_INTERVAL);
+			if (v >= 1 && v < 10000) {
+				controlSocket_.keepalive_interval_ = fz::duration::from_minutes(v);
+			}
+			else {
+				controlSocket_.keepalive_interval_ = fz::duration();
 			}
-			return ret;
+
+			return controlSocket_.DoConnect(host_, port_);
 		}
 	case LOGON_AUTH_WAIT:
 		log(logmsg::debug_info, L"LogonSend() called during LOGON_AUTH_WAIT, ignoring");
@@ -143,7 +145,13 @@ int CFtpLogonOpData::Send()
 			return FZ_REPLY_WOULDBLOCK;
 		}
 	case LOGON_SYST:
-		return controlSocket_.SendCommand(L"SYST");
+	case LOGON_FEAT:
+	case LOGON_CLNT:
+	case LOGON_OPTSUTF8:
+	case LOGON_PBSZ:
+	case LOGON_PROT:
+	case LOGON_OPTSMLST:
+		return SendPipelined();
 	case LOGON_LOGON:
 		{
 			t_loginCommand cmd = loginSequence.front();
@@ -222,45 +230,86 @@ int CFtpLogonOpData::Send()
 			}
 		}
 		break;
+	case LOGON_CUSTOMCOMMANDS:
+		if (customCommandIndex >= currentServer_.GetPostLoginCommands().size()) {
+			log(logmsg::debug_warning, L"pData->customCommandIndex >= m_pCurrentServer->GetPostLoginCommands().size()");
+			return FZ_REPLY_INTERNALERROR | FZ_REPLY_DISCONNECTED;
+		}
+		return controlSocket_.SendCommand(currentServer_.GetPostLoginCommands()[customCommandIndex]);
+	default:
+		log(logmsg::debug_warning, L"unknown op state: %d", opState);
+		break;
+	}
+
+	return FZ_REPLY_INTERNALERROR;
+}
+
+std::wstring CFtpLogonOpData::GetCommand(int state) const
+{
+	switch (state)
+	{
+	case LOGON_SYST:
+		return L"SYST";
 	case LOGON_FEAT:
-		return controlSocket_.SendCommand(L"FEAT");
+		return L"FEAT";
 	case LOGON_CLNT:
 		// Some servers refuse to enable UTF8 if client does not send CLNT command
 		// to fix compatibility with Internet Explorer, but in the process breaking
 		// compatibility with other clients.
 		// Rather than forcing MS to fix Internet Explorer, letting other clients
 		// suffer is a questionable decision in my opinion.
-		return controlSocket_.SendCommand(L"CLNT FileZilla");
+		return L"CLNT FileZilla";
 	case LOGON_OPTSUTF8:
 		// Handle servers that disobey RFC 2640 by having UTF8 in their FEAT
 		// response but do not use UTF8 unless OPTS UTF8 ON gets send.
 		// However these servers obey a conflicting ietf draft:
 		// http://www.ietf.org/proceedings/02nov/I-D/draft-ietf-ftpext-utf-8-option-00.txt
 		// Example servers are, amongst others, G6 FTP Server and RaidenFTPd.
-		return controlSocket_.SendCommand(L"OPTS UTF8 ON");
+		return L"OPTS UTF8 ON";
 	case LOGON_PBSZ:
-		return controlSocket_.SendCommand(L"PBSZ 0");
+		return L"PBSZ 0";
 	case LOGON_PROT:
-		return controlSocket_.SendCommand(L"PROT P");
-	case LOGON_CUSTOMCOMMANDS:
-		if (customCommandIndex >= currentServer_.GetPostLoginCommands().size()) {
-			log(logmsg::debug_warning, L"pData->customCommandIndex >= m_pCurrentServer->GetPostLoginCommands().size()");
-			return FZ_REPLY_INTERNALERROR | FZ_REPLY_DISCONNECTED;
-		}
-		return controlSocket_.SendCommand(currentServer_.GetPostLoginCommands()[customCommandIndex]);
+		return L"PROT P";
 	case LOGON_OPTSMLST:
 		{
 			std::wstring args;
 			CServerCapabilities::GetCapability(currentServer_, opst_mlst_command, &args);
-			return controlSocket_.SendCommand(L"OPTS MLST " + args);
+			return L"OPTS MLST " + args;
 		}
-		break;
 	default:
-		log(logmsg::debug_warning, L"unknown op state: %d", opState);
-		break;
+		return std::wstring();
 	}
+}
 
-	return FZ_REPLY_INTERNALERROR;
+int CFtpLogonOpData::SendPipelined()
+{
+	// None of the replies to these commands decides whether the other commands
+	// of the same group get sent, so each group is sent in a single flight:
+	// SYST and FEAT, then everything that depends on the FEAT reply.
+	int state = opState;
+	int res = controlSocket_.SendCommand(GetCommand(state));
+	while (res == FZ_REPLY_WOULDBLOCK) {
+		if (state == LOGON_SYST) {
+			if (!neededCommands[LOGON_FEAT] || CServerCapabilities::GetCapability(currentServer_, feat_command) != unknown) {
+				break;
+			}
+			state = LOGON_FEAT;
+		}
+		else if (state >= LOGON_CLNT && state < LOGON_OPTSMLST) {
+			state = NextState(state);
+			if (state > LOGON_OPTSMLST) {
+				break;
+			}
+		}
+		else {
+			break;
+		}
+
+		pipelined_.push_back(state);
+		res = controlSocket_.SendCommand(GetCommand(state), false, false);
+	}
+
+	return res;
 }
 
 int CFtpLogonOpData::ParseResponse()
@@ -272,6 +321,15 @@ int CFtpLogonOpData::ParseResponse()
 		if (code != 2 && code != 3) {
 			return FZ_REPLY_DISCONNECTED | (code == 5 ? FZ_REPLY_CRITICALERROR : FZ_REPLY_ERROR);
 		}
+
+		// Persisted capabilities are only trusted as long as the server still greets the same way
+		auto const& lines = controlSocket_.m_MultilineResponseLines;
+		if (!CServerCapabilities::CheckFingerprint(currentServer_, lines.empty() ? response : lines.front())) {
+			log(logmsg::debug_info, L"Welcome message has changed, discarding persisted server capabilities");
+			if (currentServer_.GetEncodingType() == ENCODING_AUTO) {
+				controlSocket_.m_useUTF8 = true;
+			}
+		}
 	}
 	else if (opState == LOGON_AUTH_TLS ||
 	         opState == LOGON_AUTH_SSL)
@@ -475,19 +533,37 @@ int CFtpLogonOpData::ParseResponse()
 		}
 	}
 
+	if (!pipelined_.empty()) {
+		// Reply to the next command already sent
+		opState = pipelined_.front();
+		pipelined_.pop_front();
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	opState = NextState(opState);
+	if (opState == LOGON_DONE) {
+		log(logmsg::status, _("Logged in"));
+		log(logmsg::debug_info, L"Measured latency of %d ms", controlSocket_.m_rtt.GetLatency());
+		return FZ_REPLY_OK;
+	}
+
+	return FZ_REPLY_CONTINUE;
+}
+
+// Skips over commands not needed or whose outcome is already known
+int CFtpLogonOpData::NextState(int state)
+{
 	for (;;) {
-		++opState;
+		++state;
 
-		if (opState == LOGON_DONE) {
-			log(logmsg::status, _("Logged in"));
-			log(logmsg::debug_info, L"Measured latency of %d ms", controlSocket_.m_rtt.GetLatency());
-			return FZ_REPLY_OK;
+		if (state == LOGON_DONE) {
+			break;
 		}
 
-		if (!neededCommands[opState]) {
+		if (!neededCommands[state]) {
 			continue;
 		}
-		else if (opState == LOGON_SYST) {
+		else if (state == LOGON_SYST) {
 			std::wstring system;
 			capabilities cap = CServerCapabilities::GetCapability(currentServer_, syst_command, &system);
 			if (cap == unknown) {
@@ -512,7 +588,7 @@ int CFtpLogonOpData::ParseResponse()
 				}
 			}
 		}
-		else if (opState == LOGON_FEAT) {
+		else if (state == LOGON_FEAT) {
 			capabilities cap = CServerCapabilities::GetCapability(currentServer_, feat_command);
 			if (cap == unknown) {
 				break;
@@ -523,7 +599,7 @@ int CFtpLogonOpData::ParseResponse()
 				controlSocket_.m_useUTF8 = false;
 			}
 		}
-		else if (opState == LOGON_CLNT) {
+		else if (state == LOGON_CLNT) {
 			if (!controlSocket_.m_useUTF8) {
 				continue;
 			}
@@ -532,7 +608,7 @@ int CFtpLogonOpData::ParseResponse()
 				break;
 			}
 		}
-		else if (opState == LOGON_OPTSUTF8) {
+		else if (state == LOGON_OPTSUTF8) {
 			if (!controlSocket_.m_useUTF8) {
 				continue;
 			}
@@ -541,7 +617,7 @@ int CFtpLogonOpData::ParseResponse()
 				break;
 			}
 		}
-		else if (opState == LOGON_OPTSMLST) {
+		else if (state == LOGON_OPTSMLST) {
 			std::wstring facts;
 			if (CServerCapabilities::GetCapability(currentServer_, mlsd_command, &facts) != yes) {
 				continue;
@@ -620,7 +696,7 @@ int CFtpLogonOpData::ParseResponse()
 		}
 	}
 
-	return FZ_REPLY_CONTINUE;
+	return state;
 }
 
 bool CFtpLogonOpData::PrepareLoginSequence()
@@ -898,6 +974,35 @@ void CFtpLogonOpData::ParseFeat(std::wstring line)
 	else if (HasFeature(up, L"EPSV")) {
 		CServerCapabilities::SetCapability(currentServer_, epsv_command, yes);
 	}
+	else if (HasFeature(up, L"HASH")) {
+		// Algorithms separated by semicolons, the one HASH uses is marked with an asterisk
+		checksum_algorithm selected = checksum_algorithm::none;
+		if (up.size() > 5) {
+			for (auto name : fz::strtok_view(std::wstring_view(up).substr(5), L";")) {
+				if (!name.empty() && name.back() == '*') {
+					selected = checksum_from_name(name.substr(0, name.size() - 1));
+				}
+			}
+		}
+		if (selected != checksum_algorithm::none) {
+			CServerCapabilities::SetCapability(currentServer_, hash_command, yes, checksum_name(selected));
+		}
+		else {
+			CServerCapabilities::SetCapability(currentServer_, hash_command, no);
+		}
+	}
+	else if (HasFeature(up, L"XSHA256")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha256_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA1")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha1_command, yes);
+	}
+	else if (HasFeature(up, L"XMD5")) {
+		CServerCapabilities::SetCapability(currentServer_, xmd5_command, yes);
+	}
+	else if (HasFeature(up, L"XCRC")) {
+		CServerCapabilities::SetCapability(currentServer_, xcrc_command, yes);
+	}
 }
 
 void CFtpLogonOpData::tls_handshake_finished()
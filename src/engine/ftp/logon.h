@@ -68,6 +68,10 @@ private:
 
 	bool PrepareLoginSequence();
 
+	std::wstring GetCommand(int state) const;
+	int SendPipelined();
+	int NextState(int state);
+
 	std::wstring host_;
 	unsigned int port_{};
 
@@ -75,6 +79,9 @@ private:
 
 	int neededCommands[ftpLogonStates::LOGON_DONE]{};
 
+	// States of the commands sent after the one of opState, replies pending
+	std::deque<int> pipelined_;
+
 	std::deque<t_loginCommand> loginSequence;
 
 	int ftp_proxy_type_{};
@@ -189,3 +189,73 @@ int CFtpMkdirOpData::ParseResponse()
 
 	return FZ_REPLY_INTERNALERROR;
 }
+
+namespace {
+// Number of MKD commands awaiting their reply at any time
+size_t const mkd_pipeline_depth = 16;
+}
+
+int CFtpMkdirManyOpData::Send()
+{
+	if (!opState) {
+		FilterKnown(engine_.GetDirectoryCache(), currentServer_);
+		if (paths_.empty()) {
+			return FZ_REPLY_OK;
+		}
+
+		log(logmsg::status, fztranslate("Creating %u directory...", "Creating %u directories...", paths_.size()), paths_.size());
+		opState = 1;
+	}
+
+	return SendPipelined();
+}
+
+int CFtpMkdirManyOpData::SendPipelined()
+{
+	// All parents exist already, so none of the commands depends on the
+	// outcome of the others.
+	int res = FZ_REPLY_WOULDBLOCK;
+	while (res == FZ_REPLY_WOULDBLOCK && sent_ < paths_.size() && sent_ - done_ < mkd_pipeline_depth) {
+		res = controlSocket_.SendCommand(L"MKD " + paths_[sent_].GetPath(), false, sent_ == done_);
+		++sent_;
+	}
+
+	return res;
+}
+
+int CFtpMkdirManyOpData::ParseResponse()
+{
+	int const code = controlSocket_.GetReplyCode();
+	if (code == 1) {
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	if (done_ >= sent_) {
+		log(logmsg::debug_warning, L"Reply without pending MKD command");
+		return FZ_REPLY_INTERNALERROR;
+	}
+
+	CServerPath const& path = paths_[done_++];
+	if (code == 2 || code == 3 || IsAlreadyExistsResponse(controlSocket_.m_Response, path)) {
+		Created(engine_.GetDirectoryCache(), currentServer_, path);
+	}
+	else {
+		++failed_;
+	}
+
+	if (done_ < paths_.size()) {
+		return SendPipelined();
+	}
+
+	for (auto const& parent : changedParents_) {
+		controlSocket_.SendDirectoryListingNotification(parent, false);
+	}
+
+	if (failed_) {
+		// Not fatal, the transfers create missing directories themselves
+		log(logmsg::debug_warning, L"%u directories could not be created", failed_);
+		return FZ_REPLY_ERROR;
+	}
+
+	return FZ_REPLY_OK;
+}
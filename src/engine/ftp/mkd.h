@@ -15,4 +15,22 @@ public:
 	virtual int ParseResponse() override;
 };
 
+class CFtpMkdirManyOpData final : public CMkdirManyOpData, public CFtpOpData
+{
+public:
+	CFtpMkdirManyOpData(CFtpControlSocket & controlSocket, std::vector<CServerPath> const& paths)
+		: CMkdirManyOpData(L"CFtpMkdirManyOpData", paths)
+		, CFtpOpData(controlSocket)
+	{}
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+
+private:
+	int SendPipelined();
+
+	size_t sent_{};
+	size_t done_{};
+};
+
 #endif
@@ -0,0 +1,51 @@
+#include "../filezilla.h"
+
+#include "stat.h"
+#include "../directorycache.h"
+#include "../directorylistingparser.h"
+#include "../servercapabilities.h"
+
+int CFtpStatOpData::Send()
+{
+	if (CServerCapabilities::GetCapability(currentServer_, mlsd_command) != yes) {
+		return FZ_REPLY_NOTSUPPORTED;
+	}
+
+	return controlSocket_.SendCommand(L"MLST " + path_.FormatFilename(file_, false));
+}
+
+int CFtpStatOpData::ParseResponse()
+{
+	int const code = controlSocket_.GetReplyCode();
+	if (code != 2) {
+		if (controlSocket_.m_Response.substr(0, 3) == L"550") {
+			engine_.GetDirectoryCache().StoreStat(currentServer_, path_, file_, nullptr);
+			return FZ_REPLY_ERROR_NOTFOUND;
+		}
+		return FZ_REPLY_ERROR;
+	}
+
+	// The facts are on the one line of the reply starting with a space
+	for (auto const& line : controlSocket_.m_MultilineResponseLines) {
+		if (line.size() < 2 || line[0] != ' ') {
+			continue;
+		}
+
+		// The pathname in the reply may or may not be the full path, use the name we asked for
+		CDirectoryListingParser parser(&controlSocket_, currentServer_);
+		parser.AddLine(line.substr(1), std::wstring(file_), fz::datetime());
+		CDirectoryListing const listing = parser.Parse(path_);
+		if (listing.size() != 1) {
+			break;
+		}
+
+		entry_ = listing[0];
+		engine_.GetDirectoryCache().UpdateEntry(currentServer_, path_, entry_);
+		engine_.GetDirectoryCache().StoreStat(currentServer_, path_, file_, &entry_);
+
+		return FZ_REPLY_OK;
+	}
+
+	log(logmsg::debug_info, L"Could not parse MLST reply");
+	return FZ_REPLY_ERROR;
+}
@@ -0,0 +1,27 @@
+#ifndef FILEZILLA_ENGINE_FTP_STAT_HEADER
+#define FILEZILLA_ENGINE_FTP_STAT_HEADER
+
+#include "ftpcontrolsocket.h"
+
+// Looks up a single file using MLST
+class CFtpStatOpData final : public COpData, public CFtpOpData
+{
+public:
+	CFtpStatOpData(CFtpControlSocket & controlSocket, CServerPath const& path, std::wstring const& file, CDirentry & entry)
+		: COpData(Command::lookup, L"CFtpStatOpData")
+		, CFtpOpData(controlSocket)
+		, path_(path)
+		, file_(file)
+		, entry_(entry)
+	{}
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+
+private:
+	CServerPath const path_;
+	std::wstring const file_;
+	CDirentry & entry_;
+};
+
+#endif
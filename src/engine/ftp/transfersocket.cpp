@@ -4,6 +4,7 @@
 #include "../engineprivate.h"
 #include "../proxy.h"
 #include "../servercapabilities.h"
+#include "../socket_tuner.h"
 #include "../tls.h"
 
 #include "ftpcontrolsocket.h"
@@ -71,6 +72,7 @@ void CTransferSocket::ResetSocket()
 	activity_logger_layer_.reset();
 	socket_.reset();
 	buffer_.release();
+	buffer_tuner_.reset();
 }
 
 std::wstring CTransferSocket::SetupActiveTransfer(std::string const& ip)
@@ -259,12 +261,24 @@ void CTransferSocket::OnConnect()
 		socket_->set_flags(fz::socket::flag_nodelay, false);
 	}
 
+	bool tune{};
+	if ((m_transferMode == TransferMode::download || m_transferMode == TransferMode::upload) && engine_.GetOptions().get_int(OPTION_SOCKET_BUFFER_AUTOTUNE)) {
+		bool const receive = m_transferMode == TransferMode::download;
+		int const base_size = GetSocketBufferSize(receive);
+		if (base_size > 0 && socket_buffer_tuner::can_tune(receive)) {
+			buffer_tuner_ = std::make_unique<socket_buffer_tuner>(engine_.GetContext().GetSocketBufferBudget(), base_size, receive);
+			tune = true;
+		}
+	}
 #ifdef FZ_WINDOWS
 	if (m_transferMode == TransferMode::upload) {
 		// For send buffer tuning
-		add_timer(fz::duration::from_seconds(1), false);
+		tune = true;
 	}
 #endif
+	if (tune) {
+		add_timer(fz::duration::from_seconds(1), false);
+	}
 
 	if (!activity_block_) {
 		TriggerPostponedEvents();
@@ -344,6 +358,7 @@ bool CTransferSocket::OnReceive()
 				}
 				else {
 					buffer_->add(static_cast<size_t>(numread));
+					transferred_ += numread;
 					return true;
 				}
 			}
@@ -453,6 +468,7 @@ bool CTransferSocket::OnSend()
 			engine_.transfer_status_.SetMadeProgress();
 		}
 		engine_.transfer_status_.Update(written);
+		transferred_ += written;
 
 		buffer_->consume(written);
 
@@ -533,7 +549,7 @@ bool CTransferSocket::DoSetupPassiveTransfer()
 
 bool CTransferSocket::InitLayers(bool active)
 {
-	activity_logger_layer_ = std::make_unique<activity_logger_layer>(nullptr, *socket_, engine_.activity_logger_);
+	activity_logger_layer_ = std::make_unique<activity_logger_layer>(nullptr, *socket_, engine_.GetActivityLogger());
 	ratelimit_layer_ = std::make_unique<fz::rate_limited_layer>(nullptr, *activity_logger_layer_, &engine_.GetRateLimiter());
 	active_layer_ = ratelimit_layer_.get();
 
@@ -795,15 +811,22 @@ void CTransferSocket::TriggerPostponedEvents()
 	}
 }
 
-void CTransferSocket::SetSocketBufferSizes(fz::socket_base& socket)
+int CTransferSocket::GetSocketBufferSize(bool receive) const
 {
-	const int size_read = engine_.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_RECV);
+	if (receive) {
+		return engine_.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_RECV);
+	}
 #if FZ_WINDOWS
-	const int size_write = -1;
+	// Tuned through ideal_send_buffer_size instead
+	return -1;
 #else
-	const int size_write = engine_.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_SEND);
+	return engine_.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_SEND);
 #endif
-	socket.set_buffer_sizes(size_read, size_write);
+}
+
+void CTransferSocket::SetSocketBufferSizes(fz::socket_base& socket)
+{
+	socket.set_buffer_sizes(GetSocketBufferSize(true), GetSocketBufferSize(false));
 }
 
 void CTransferSocket::operator()(fz::event_base const& ev)
@@ -816,6 +839,15 @@ void CTransferSocket::operator()(fz::event_base const& ev)
 
 void CTransferSocket::OnTimer(fz::timer_id)
 {
+	if (buffer_tuner_ && socket_ && socket_->is_connected()) {
+		int const latency = controlSocket_.m_rtt.GetLatency();
+		int const size = buffer_tuner_->update(*socket_, transferred_, fz::duration::from_milliseconds(latency > 0 ? latency : 0));
+		if (size != -1) {
+			controlSocket_.log(logmsg::debug_verbose, L"Changed socket buffer size to %d bytes", size);
+		}
+	}
+	transferred_ = 0;
+
 #if FZ_WINDOWS
 	if (socket_ && socket_->is_connected()) {
 		int const ideal_send_buffer = socket_->ideal_send_buffer_size();
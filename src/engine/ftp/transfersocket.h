@@ -8,6 +8,7 @@
 class CFileZillaEnginePrivate;
 class CFtpControlSocket;
 class CDirectoryListingParser;
+class socket_buffer_tuner;
 
 enum class TransferMode
 {
@@ -74,6 +75,7 @@ protected:
 	std::unique_ptr<fz::listen_socket> CreateSocketServer(int port);
 
 	void SetSocketBufferSizes(fz::socket_base & socket);
+	int GetSocketBufferSize(bool receive) const;
 
 	virtual void operator()(fz::event_base const& ev);
 	void OnBufferAvailability(fz::aio_waitable const* w);
@@ -121,6 +123,10 @@ protected:
 	std::unique_ptr<fz::writer_base> writer_;
 	fz::buffer_lease buffer_;
 	size_t resumetest_{};
+
+	// Grows the buffers of the data connection with its bandwidth-delay product
+	std::unique_ptr<socket_buffer_tuner> buffer_tuner_;
+	uint64_t transferred_{};
 };
 
 #endif
@@ -1,9 +1,16 @@
 #include "../filezilla.h"
 
 #include "filetransfer.h"
+#include "segment.h"
+
+#include "../../include/engine_options.h"
+
+#include "../proxy.h"
 
 #include <libfilezilla/local_filesys.hpp>
 
+#include <algorithm>
+
 #include <assert.h>
 #include <string.h>
 
@@ -12,8 +19,18 @@ enum filetransferStates
 {
 	filetransfer_init = 0,
 	filetransfer_transfer,
-	filetransfer_waittransfer
+	filetransfer_waittransfer,
+	filetransfer_waitsegments
 };
+
+// The first request of a segmented download asks for this many bytes. If the
+// server honors the range, the rest of the file gets split into slices.
+int64_t const probe_size = 8 * 1024 * 1024;
+
+int64_t const min_slice_size = 8 * 1024 * 1024;
+int64_t const max_slice_size = 64 * 1024 * 1024;
+
+int const max_slice_retries = 3;
 }
 
 CHttpFileTransferOpData::CHttpFileTransferOpData(CHttpControlSocket & controlSocket, CFileTransferCommand const& cmd)
@@ -38,6 +55,12 @@ CHttpFileTransferOpData::CHttpFileTransferOpData(CHttpControlSocket & controlSoc
 	}
 }
 
+CHttpFileTransferOpData::~CHttpFileTransferOpData()
+{
+	// Writers report progress to the slices
+	segments_.clear();
+	rr_.response_.writer_.reset();
+}
 
 int CHttpFileTransferOpData::Send()
 {
@@ -53,7 +76,7 @@ int CHttpFileTransferOpData::Send()
 		}
 
 		if (reader_factory_) {
-			rr_.request_.body_ = reader_factory_->open(*controlSocket_.buffer_pool_, 0, fz::aio_base::nosize, controlSocket_.max_buffer_count());
+			rr_.request_.body_ = controlSocket_.OpenReader(reader_factory_, 0);
 			if (!rr_.request_.body_) {
 				return FZ_REPLY_CRITICALERROR;
 			}
@@ -73,7 +96,13 @@ int CHttpFileTransferOpData::Send()
 		}
 		return FZ_REPLY_CONTINUE;
 	case filetransfer_transfer:
-		if (resume_ && localFileSize_ != 0 && localFileSize_ != fz::aio_base::nosize) {
+		rr_.request_.headers_.erase("Range");
+		probing_ = CanSegment();
+		if (probing_) {
+			int64_t const offset = ResumeOffset();
+			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-%d", offset, offset + probe_size - 1);
+		}
+		else if (resume_ && localFileSize_ != 0 && localFileSize_ != fz::aio_base::nosize) {
 			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-", localFileSize_);
 		}
 
@@ -82,6 +111,8 @@ int CHttpFileTransferOpData::Send()
 		opState = filetransfer_waittransfer;
 		controlSocket_.Request(make_simple_rr(&rr_));
 		return FZ_REPLY_CONTINUE;
+	case filetransfer_waitsegments:
+		return NextSlice();
 	default:
 		break;
 	}
@@ -93,12 +124,23 @@ fz::http::continuation CHttpFileTransferOpData::OnHeader(std::shared_ptr<HttpReq
 {
 	log(logmsg::debug_verbose, L"CHttpFileTransferOpData::OnHeader");
 
+	if (segmented_) {
+		return OnSliceHeader();
+	}
+
 	if (rr_.response_.code_ == 416 && resume_) {
 		resume_ = false;
 		opState = filetransfer_transfer;
 		return fz::http::continuation::error;
 	}
 
+	if (rr_.response_.code_ == 416 && probing_) {
+		// Empty file, fetch it as a whole
+		segmentable_ = false;
+		opState = filetransfer_transfer;
+		return fz::http::continuation::error;
+	}
+
 	if (rr_.response_.code_ < 200 || rr_.response_.code_ >= 400) {
 		return fz::http::continuation::error;
 	}
@@ -144,13 +186,31 @@ fz::http::continuation CHttpFileTransferOpData::OnHeader(std::shared_ptr<HttpReq
 		return fz::http::continuation::done;
 	}
 
+	if (probing_) {
+		probing_ = false;
+		if (rr_.response_.code_ == 206) {
+			int64_t first{};
+			int64_t last{};
+			int64_t complete{};
+			if (!ParseContentRange(rr_.response_.get_header("Content-Range"), first, last, complete) || first != ResumeOffset()) {
+				log(logmsg::error, _("Server replied with an unexpected range"));
+				return fz::http::continuation::error;
+			}
+			if (!StartSegments(first, last, complete)) {
+				return fz::http::continuation::error;
+			}
+			return fz::http::continuation::next;
+		}
+		// Otherwise the server ignored the range and sends the whole file
+	}
+
 	// Check if the server disallowed resume
 	if (resume_ && rr_.response_.code_ != 206) {
 		resume_ = false;
 	}
 
 	if (writer_factory_) {
-		auto writer = controlSocket_.OpenWriter(writer_factory_, resume_ ? localFileSize_ : 0, true);
+		auto writer = controlSocket_.OpenWriter(writer_factory_, resume_ ? localFileSize_ : 0, true, fsync());
 		if (!writer) {
 			return fz::http::continuation::error;
 		}
@@ -178,5 +238,322 @@ int CHttpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		return FZ_REPLY_CONTINUE;
 	}
 
+	if (segmented_) {
+		rr_.response_.writer_.reset();
+
+		auto & s = slices_[primarySlice_];
+		s.active_ = false;
+		if (prevResult == FZ_REPLY_OK && (s.end_ == -1 || s.start_ + s.received_ == s.end_)) {
+			s.done_ = true;
+		}
+		else if (!s.done_) {
+			SliceFailed(primarySlice_);
+		}
+		return FZ_REPLY_CONTINUE;
+	}
+
 	return prevResult;
 }
+
+int CHttpFileTransferOpData::Reset(int result)
+{
+	segments_.clear();
+	rr_.response_.writer_.reset();
+
+	if (segmented_ && result != FZ_REPLY_OK && !slices_.empty()) {
+		// Only keep what has been received contiguously, so that the download
+		// can be resumed.
+		int64_t end{};
+		for (auto const& s : slices_) {
+			end = s.start_ + s.received_;
+			if (!s.done_) {
+				break;
+			}
+		}
+
+		auto const* factory = dynamic_cast<fz::file_writer_factory*>(&*writer_factory_);
+		if (factory) {
+			fz::file f(fz::to_native(factory->name()), fz::file::writing, fz::file::existing);
+			if (f && f.seek(end, fz::file::begin) == end) {
+				f.truncate();
+			}
+		}
+	}
+
+	return result;
+}
+
+int64_t CHttpFileTransferOpData::ResumeOffset() const
+{
+	return (resume_ && localFileSize_ > 0) ? localFileSize_ : 0;
+}
+
+bool CHttpFileTransferOpData::CanSegment()
+{
+	if (!segmentable_ || options_.get_int(OPTION_HTTP_DOWNLOAD_SEGMENTS) <= 1) {
+		return false;
+	}
+
+	if (reader_factory_ || rr_.request_.verb_ != "GET") {
+		return false;
+	}
+
+	// Slices are written into the file at their offsets
+	if (!writer_factory_ || !dynamic_cast<fz::file_writer_factory*>(&*writer_factory_)) {
+		return false;
+	}
+
+	// The slice writers bypass the factory and with it any fsync it would do
+	if (fsync()) {
+		return false;
+	}
+
+	// The additional connections do not support proxies
+	int const proxy_type = options_.get_int(OPTION_PROXY_TYPE);
+	if (proxy_type > static_cast<int>(ProxyType::NONE) && proxy_type < static_cast<int>(ProxyType::count) && !currentServer_.GetBypassProxy()) {
+		return false;
+	}
+
+	return true;
+}
+
+bool CHttpFileTransferOpData::StartSegments(int64_t first, int64_t last, int64_t complete)
+{
+	auto const* factory = dynamic_cast<fz::file_writer_factory*>(&*writer_factory_);
+	if (!factory) {
+		return false;
+	}
+
+	controlSocket_.CreateLocalDir(factory->name());
+	{
+		fz::file f(fz::to_native(factory->name()), fz::file::writing, first ? fz::file::existing : fz::file::empty);
+		if (!f || f.seek(first, fz::file::begin) != first || !f.truncate()) {
+			log(logmsg::error, _("Could not open \"%s\" for writing"), factory->name());
+			return false;
+		}
+		if (complete != -1 && options_.get_int(OPTION_PREALLOCATE_SPACE)) {
+			if (f.seek(complete, fz::file::begin) != complete || !f.truncate()) {
+				log(logmsg::error, _("Could not preallocate space for \"%s\""), factory->name());
+				return false;
+			}
+		}
+	}
+
+	int64_t const segments = options_.get_int(OPTION_HTTP_DOWNLOAD_SEGMENTS);
+
+	// The probe is the first slice
+	auto & probe = slices_.emplace_back();
+	probe.start_ = first;
+	probe.end_ = last + 1;
+
+	if (complete != -1) {
+		int64_t const size = std::clamp((complete - probe.end_) / (segments * 4), min_slice_size, max_slice_size);
+		for (int64_t pos = probe.end_; pos < complete; pos += size) {
+			auto & s = slices_.emplace_back();
+			s.start_ = pos;
+			s.end_ = std::min(pos + size, complete);
+		}
+	}
+	else if (probe.end_ - probe.start_ == probe_size) {
+		// Size unknown, the primary connection fetches the rest
+		auto & s = slices_.emplace_back();
+		s.start_ = probe.end_;
+	}
+
+	primarySlice_ = 0;
+	probe.active_ = true;
+	auto writer = OpenSliceWriter(0);
+	if (!writer) {
+		return false;
+	}
+	rr_.response_.writer_ = std::move(writer);
+
+	if (engine_.transfer_status_.empty()) {
+		engine_.transfer_status_.Init(complete, first, false);
+		engine_.transfer_status_.SetStartTime();
+	}
+
+	segmented_ = true;
+	opState = filetransfer_waitsegments;
+
+	for (int64_t i = 1; i < segments; ++i) {
+		auto segment = std::make_unique<http_segment>(controlSocket_, controlSocket_.nextSegmentId_++);
+		if (!AssignSlice(*segment)) {
+			break;
+		}
+		segments_.push_back(std::move(segment));
+	}
+	if (!segments_.empty()) {
+		log(logmsg::debug_info, L"Downloading %d slices over %d connections", slices_.size(), segments_.size() + 1);
+	}
+
+	return !failed_;
+}
+
+fz::http::continuation CHttpFileTransferOpData::OnSliceHeader()
+{
+	auto & s = slices_[primarySlice_];
+	if (rr_.response_.code_ == 416 && s.end_ == -1) {
+		// Nothing after the already received data
+		s.done_ = true;
+		return fz::http::continuation::error;
+	}
+
+	int64_t first{};
+	int64_t last{};
+	int64_t complete{};
+	if (rr_.response_.code_ != 206 || !ParseContentRange(rr_.response_.get_header("Content-Range"), first, last, complete) || first != s.start_ + s.received_) {
+		log(logmsg::debug_warning, L"Server replied with code %d and unexpected range to range request", rr_.response_.code_);
+		return fz::http::continuation::error;
+	}
+
+	auto writer = OpenSliceWriter(primarySlice_);
+	if (!writer) {
+		return fz::http::continuation::error;
+	}
+	rr_.response_.writer_ = std::move(writer);
+
+	return fz::http::continuation::next;
+}
+
+std::unique_ptr<fz::writer_base> CHttpFileTransferOpData::OpenSliceWriter(size_t i)
+{
+	auto const* factory = dynamic_cast<fz::file_writer_factory*>(&*writer_factory_);
+	if (!factory || !controlSocket_.buffer_pool_) {
+		return {};
+	}
+
+	// Not using the factory, it would truncate the file at the offset
+	auto & s = slices_[i];
+	int64_t const offset = s.start_ + s.received_;
+	fz::file f(fz::to_native(factory->name()), fz::file::writing, fz::file::existing);
+	if (!f || f.seek(offset, fz::file::begin) != offset) {
+		log(logmsg::error, _("Could not open \"%s\" for writing"), factory->name());
+		return {};
+	}
+
+	auto progress = [&s, &status = engine_.transfer_status_](fz::writer_base const*, uint64_t written) {
+		s.received_ += static_cast<int64_t>(written);
+		status.SetMadeProgress();
+		status.Update(written);
+	};
+	return std::make_unique<fz::file_writer>(factory->name(), *controlSocket_.buffer_pool_, std::move(f), engine_.GetThreadPool(), false, std::move(progress), controlSocket_.max_buffer_count());
+}
+
+bool CHttpFileTransferOpData::AssignSlice(http_segment & segment)
+{
+	if (failed_) {
+		return false;
+	}
+
+	for (size_t i = 0; i < slices_.size(); ++i) {
+		auto & s = slices_[i];
+		// Segments only fetch slices of known length
+		if (s.done_ || s.active_ || s.end_ == -1) {
+			continue;
+		}
+
+		auto writer = OpenSliceWriter(i);
+		if (!writer) {
+			failed_ = true;
+			return false;
+		}
+		if (!segment.Start(rr_.request_, s.start_ + s.received_, s.end_, std::move(writer))) {
+			return false;
+		}
+		s.active_ = true;
+		segment.slice_ = i;
+		return true;
+	}
+
+	return false;
+}
+
+bool CHttpFileTransferOpData::SliceFailed(size_t i)
+{
+	auto & s = slices_[i];
+	if (s.end_ != -1 && s.start_ + s.received_ >= s.end_) {
+		// Everything got written, only the end of the response was missed
+		s.done_ = true;
+		return true;
+	}
+
+	if (++s.retries_ > max_slice_retries) {
+		log(logmsg::error, _("Could not download the range starting at %d"), s.start_ + s.received_);
+		failed_ = true;
+		return false;
+	}
+
+	log(logmsg::debug_info, L"Retrying range starting at %d", s.start_ + s.received_);
+	return true;
+}
+
+int CHttpFileTransferOpData::NextSlice()
+{
+	if (failed_) {
+		return FZ_REPLY_ERROR;
+	}
+
+	bool active{};
+	for (size_t i = 0; i < slices_.size(); ++i) {
+		auto & s = slices_[i];
+		if (s.done_) {
+			continue;
+		}
+		if (s.active_) {
+			active = true;
+			continue;
+		}
+
+		primarySlice_ = i;
+		s.active_ = true;
+
+		int64_t const start = s.start_ + s.received_;
+		if (s.end_ == -1) {
+			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-", start);
+		}
+		else {
+			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-%d", start, s.end_ - 1);
+		}
+		controlSocket_.Request(make_simple_rr(&rr_));
+		return FZ_REPLY_CONTINUE;
+	}
+
+	if (active) {
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	return FZ_REPLY_OK;
+}
+
+void CHttpFileTransferOpData::OnSegmentDone(uint64_t id, bool success)
+{
+	auto it = std::find_if(segments_.begin(), segments_.end(), [id](auto const& segment) { return segment->id_ == id; });
+	if (it == segments_.end()) {
+		return;
+	}
+
+	auto & segment = **it;
+	segment.ReleaseWriter();
+
+	auto & s = slices_[segment.slice_];
+	s.active_ = false;
+	if (success && s.start_ + s.received_ == s.end_) {
+		s.done_ = true;
+		if (!AssignSlice(segment)) {
+			segments_.erase(it);
+		}
+	}
+	else {
+		// Leave the slice to the remaining connections. If the server limits
+		// the number of connections, this one would likely fail again.
+		log(logmsg::debug_warning, L"Segment connection failed");
+		SliceFailed(segment.slice_);
+		segments_.erase(it);
+	}
+
+	if (opState == filetransfer_waitsegments && !controlSocket_.operations_.empty() && controlSocket_.operations_.back().get() == this) {
+		// The primary connection is idle
+		controlSocket_.SendNextCommand();
+	}
+}
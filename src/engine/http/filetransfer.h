@@ -5,24 +5,64 @@
 
 #include <libfilezilla/file.hpp>
 
+#include <atomic>
+#include <deque>
+
 class CServerPath;
+class http_segment;
 
 class CHttpFileTransferOpData final : public CFileTransferOpData, public CHttpOpData
 {
 public:
 	CHttpFileTransferOpData(CHttpControlSocket & controlSocket, CFileTransferCommand const&);
 	CHttpFileTransferOpData(CHttpControlSocket & controlSocket, CHttpRequestCommand const&);
+	virtual ~CHttpFileTransferOpData();
 
 	virtual int Send() override;
 	virtual int ParseResponse() override { return FZ_REPLY_INTERNALERROR; }
 	virtual int SubcommandResult(int prevResult, COpData const& previousOperation) override;
+	virtual int Reset(int result) override;
+
+	void OnSegmentDone(uint64_t id, bool success);
 
 private:
 	fz::http::continuation OnHeader(std::shared_ptr<HttpRequestResponse> const&);
 
+	int64_t ResumeOffset() const;
+
+	// Segmented downloads
+	bool CanSegment();
+	bool StartSegments(int64_t first, int64_t last, int64_t complete);
+	fz::http::continuation OnSliceHeader();
+	std::unique_ptr<fz::writer_base> OpenSliceWriter(size_t i);
+	bool AssignSlice(http_segment & segment);
+	bool SliceFailed(size_t i);
+	int NextSlice();
+
 	HttpRequestResponse rr_;
 
 	int redirectCount_{};
+
+	// Large downloads are split into slices, fetched in parallel over the
+	// primary connection and additional segment connections.
+	struct slice final
+	{
+		int64_t start_{};
+		int64_t end_{-1}; // Exclusive, -1 if up to the end of the file
+		std::atomic<int64_t> received_{};
+		int retries_{};
+		bool active_{};
+		bool done_{};
+	};
+	std::deque<slice> slices_;
+	size_t primarySlice_{};
+	bool segmentable_{true};
+	bool probing_{};
+	bool segmented_{};
+	bool failed_{};
+
+	// Declared after the slices their writers report progress to
+	std::vector<std::unique_ptr<http_segment>> segments_;
 };
 
 #endif
@@ -121,6 +121,13 @@ bool CHttpControlSocket::SetAsyncRequestReply(CAsyncRequestNotification *pNotifi
 			}
 
 			CCertificateNotification* pCertificateNotification = static_cast<CCertificateNotification *>(pNotification);
+			trustedCertificate_.clear();
+			if (pCertificateNotification->trusted_) {
+				auto const& certificates = pCertificateNotification->info_.get_certificates();
+				if (!certificates.empty()) {
+					trustedCertificate_ = certificates[0].get_raw_data();
+				}
+			}
 			tls_layer_->set_verification_result(pCertificateNotification->trusted_);
 		}
 		break;
@@ -230,7 +237,7 @@ void CHttpControlSocket::SetSocketBufferSizes()
 
 void CHttpControlSocket::operator()(fz::event_base const& ev)
 {
-	if (fz::dispatch<fz::certificate_verification_event, fz::http::client::done_event>(ev, this, &CHttpControlSocket::OnVerifyCert, &CHttpControlSocket::OnRequestDone)) {
+	if (fz::dispatch<fz::certificate_verification_event, fz::http::client::done_event, CHttpSegmentDoneEvent>(ev, this, &CHttpControlSocket::OnVerifyCert, &CHttpControlSocket::OnRequestDone, &CHttpControlSocket::OnSegmentDone)) {
 		return;
 	}
 	CRealControlSocket::operator()(ev);
@@ -252,3 +259,15 @@ void CHttpControlSocket::OnRequestDone(uint64_t id, bool success)
 		op->OnResponse(id, success);
 	}
 }
+
+void CHttpControlSocket::OnSegmentDone(uint64_t id, bool success)
+{
+	// The transfer may have pushed a request of its own on the primary connection
+	for (auto it = operations_.rbegin(); it != operations_.rend(); ++it) {
+		auto op = dynamic_cast<CHttpFileTransferOpData*>(it->get());
+		if (op) {
+			op->OnSegmentDone(id, success);
+			return;
+		}
+	}
+}
@@ -28,6 +28,10 @@ namespace fz {
 class tls_layer;
 }
 
+// Parameters are the id of the segment and whether its range was fetched successfully
+struct http_segment_done_event_type{};
+typedef fz::simple_event<http_segment_done_event_type, uint64_t, bool> CHttpSegmentDoneEvent;
+
 class CHttpControlSocket;
 class http_client : public fz::http::client::client
 {
@@ -76,9 +80,16 @@ protected:
 	virtual void operator()(fz::event_base const& ev) override;
 	void OnVerifyCert(fz::tls_layer* source, fz::tls_session_info& info);
 	void OnRequestDone(uint64_t id, bool success);
+	void OnSegmentDone(uint64_t id, bool success);
 
 	std::unique_ptr<fz::tls_layer> tls_layer_;
 
+	// Leaf certificate of the primary connection once trusted. Additional
+	// connections of segmented downloads only accept this one.
+	std::vector<uint8_t> trustedCertificate_;
+
+	uint64_t nextSegmentId_{};
+
 	virtual void ResetSocket() override;
 
 	virtual void SetSocketBufferSizes() override;
@@ -88,6 +99,7 @@ protected:
 	friend class CHttpRequestOpData;
 	friend class CHttpConnectOpData;
 	friend class http_client;
+	friend class http_segment;
 
 private:
 	std::optional<http_client> client_;
@@ -0,0 +1,182 @@
+#include "../filezilla.h"
+
+#include "filetransfer.h"
+#include "segment.h"
+
+#include "../../include/engine_options.h"
+
+#include "../activity_logger_layer.h"
+#include "../engineprivate.h"
+#include "../tls.h"
+
+using namespace std::literals;
+
+http_segment::http_segment(CHttpControlSocket & controlSocket, uint64_t id)
+	: fz::event_handler(controlSocket.event_loop_)
+	, fz::http::client::client(*this, *controlSocket.buffer_pool_, controlSocket.logger(), "FileZilla/"s + ENGINE_VERSION)
+	, id_(id)
+	, controlSocket_(controlSocket)
+{
+}
+
+http_segment::~http_segment()
+{
+	destroy();
+	remove_handler();
+}
+
+bool http_segment::Start(HttpRequest const& request, int64_t start, int64_t end, std::unique_ptr<fz::writer_base> && writer)
+{
+	if (!writer) {
+		return false;
+	}
+
+	rr_.request_.uri_ = request.uri_;
+	rr_.request_.flags_ = request.flags_;
+	rr_.request_.verb_ = "GET";
+	rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-%d", start, end - 1);
+	rr_.set_on_header([this](auto const&) { return OnHeader(); });
+
+	start_ = start;
+	writer_ = std::move(writer);
+	busy_ = true;
+
+	return add_request(make_simple_rr(&rr_));
+}
+
+void http_segment::ReleaseWriter()
+{
+	writer_.reset();
+	rr_.response_.writer_.reset();
+}
+
+fz::http::continuation http_segment::OnHeader()
+{
+	if (rr_.response_.code_ != 206) {
+		controlSocket_.log(logmsg::debug_warning, L"Server replied with code %d to range request", rr_.response_.code_);
+		return fz::http::continuation::error;
+	}
+
+	int64_t first{};
+	int64_t last{};
+	int64_t complete{};
+	if (!ParseContentRange(rr_.response_.get_header("Content-Range"), first, last, complete) || first != start_) {
+		controlSocket_.log(logmsg::debug_warning, L"Server replied with unexpected range");
+		return fz::http::continuation::error;
+	}
+
+	rr_.response_.writer_ = std::move(writer_);
+	return fz::http::continuation::next;
+}
+
+fz::socket_interface* http_segment::create_socket(fz::native_string const&, unsigned short, bool tls)
+{
+	destroy_socket();
+
+	auto & engine = controlSocket_.GetEngine();
+
+	socket_ = std::make_unique<fz::socket>(engine.GetThreadPool(), nullptr);
+	activity_logger_layer_ = std::make_unique<activity_logger_layer>(nullptr, *socket_, engine.GetActivityLogger());
+	ratelimit_layer_ = std::make_unique<fz::rate_limited_layer>(nullptr, *activity_logger_layer_, &engine.GetRateLimiter());
+	fz::socket_layer* active = ratelimit_layer_.get();
+
+	int const size_read = engine.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_RECV);
+#if FZ_WINDOWS
+	int const size_write = -1;
+#else
+	int const size_write = engine.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_SEND);
+#endif
+	socket_->set_buffer_sizes(size_read, size_write);
+
+	if (tls) {
+		tls_layer_ = std::make_unique<fz::tls_layer>(controlSocket_.event_loop_, nullptr, *active, &engine.GetContext().GetTlsSystemTrustStore(), controlSocket_.logger());
+		tls_layer_->set_alpn("http/1.1");
+		tls_layer_->set_min_tls_ver(get_min_tls_ver(engine.GetOptions()));
+		if (!tls_layer_->client_handshake(this)) {
+			destroy_socket();
+			return nullptr;
+		}
+		active = tls_layer_.get();
+	}
+
+	return active;
+}
+
+void http_segment::destroy_socket()
+{
+	tls_layer_.reset();
+	ratelimit_layer_.reset();
+	activity_logger_layer_.reset();
+	socket_.reset();
+}
+
+void http_segment::on_alive()
+{
+	controlSocket_.SetAlive();
+}
+
+void http_segment::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::certificate_verification_event, fz::http::client::done_event>(ev, this,
+		&http_segment::OnVerifyCert,
+		&http_segment::OnRequestDone);
+}
+
+void http_segment::OnVerifyCert(fz::tls_layer* source, fz::tls_session_info& info)
+{
+	if (!tls_layer_ || source != tls_layer_.get()) {
+		return;
+	}
+
+	// No prompting for additional connections, the certificate needs to be
+	// the one already trusted for the primary connection.
+	auto const& certificates = info.get_certificates();
+	bool const trusted = !certificates.empty() && !controlSocket_.trustedCertificate_.empty() &&
+		certificates[0].get_raw_data() == controlSocket_.trustedCertificate_;
+	if (!trusted) {
+		controlSocket_.log(logmsg::debug_warning, L"Certificate of additional connection differs from the trusted one");
+	}
+	tls_layer_->set_verification_result(trusted);
+}
+
+void http_segment::OnRequestDone(uint64_t, bool success)
+{
+	busy_ = false;
+
+	// Handled by the control socket, the segment may get destroyed in response
+	controlSocket_.send_event<CHttpSegmentDoneEvent>(id_, success);
+}
+
+bool ParseContentRange(std::string_view value, int64_t & first, int64_t & last, int64_t & complete)
+{
+	// bytes first-last/complete, with an asterisk if the complete length is unknown
+	if (value.substr(0, 6) != "bytes "sv) {
+		return false;
+	}
+	value = value.substr(6);
+
+	size_t const dash = value.find('-');
+	size_t const slash = value.find('/');
+	if (dash == std::string_view::npos || slash == std::string_view::npos || slash < dash) {
+		return false;
+	}
+
+	first = fz::to_integral<int64_t>(value.substr(0, dash), -1);
+	last = fz::to_integral<int64_t>(value.substr(dash + 1, slash - dash - 1), -1);
+	if (first < 0 || last < first) {
+		return false;
+	}
+
+	auto const c = value.substr(slash + 1);
+	if (c == "*"sv) {
+		complete = -1;
+	}
+	else {
+		complete = fz::to_integral<int64_t>(c, -1);
+		if (complete <= last) {
+			return false;
+		}
+	}
+
+	return true;
+}
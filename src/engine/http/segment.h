@@ -0,0 +1,64 @@
+#ifndef FILEZILLA_ENGINE_HTTP_SEGMENT_HEADER
+#define FILEZILLA_ENGINE_HTTP_SEGMENT_HEADER
+
+#include "httpcontrolsocket.h"
+
+#include <libfilezilla/rate_limited_layer.hpp>
+
+#include <string_view>
+
+class activity_logger_layer;
+
+// An additional connection of a segmented download. Fetches one range of the
+// file at a time, the connection is kept alive for the next one. Completion
+// is reported to the control socket through CHttpSegmentDoneEvent.
+//
+// Unlike the primary connection, it does not support proxies. Its TLS
+// certificate needs to be the one trusted for the primary connection.
+class http_segment final : public fz::event_handler, public fz::http::client::client
+{
+public:
+	http_segment(CHttpControlSocket & controlSocket, uint64_t id);
+	virtual ~http_segment();
+
+	// Fetches the range [start, end) of the request's URI into the writer
+	bool Start(HttpRequest const& request, int64_t start, int64_t end, std::unique_ptr<fz::writer_base> && writer);
+
+	// Needs to be called after a failed range before it can be retried
+	void ReleaseWriter();
+
+	uint64_t const id_;
+
+	// Index of the slice being fetched
+	size_t slice_{};
+
+	bool busy_{};
+
+protected:
+	virtual fz::socket_interface* create_socket(fz::native_string const& host, unsigned short port, bool tls) override;
+	virtual void destroy_socket() override;
+	virtual void on_alive() override;
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+	void OnVerifyCert(fz::tls_layer* source, fz::tls_session_info& info);
+	void OnRequestDone(uint64_t id, bool success);
+
+	fz::http::continuation OnHeader();
+
+	CHttpControlSocket & controlSocket_;
+
+	HttpRequestResponse rr_;
+	int64_t start_{};
+	std::unique_ptr<fz::writer_base> writer_;
+
+	std::unique_ptr<fz::socket> socket_;
+	std::unique_ptr<activity_logger_layer> activity_logger_layer_;
+	std::unique_ptr<fz::rate_limited_layer> ratelimit_layer_;
+	std::unique_ptr<fz::tls_layer> tls_layer_;
+};
+
+// Parses the value of a Content-Range header, complete is -1 if unknown
+bool ParseContentRange(std::string_view value, int64_t & first, int64_t & last, int64_t & complete);
+
+#endif
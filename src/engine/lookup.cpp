@@ -5,6 +5,7 @@
 
 enum {
 	lookup_init = 0,
+	lookup_stat,
 	lookup_list
 };
 
@@ -55,7 +56,29 @@ int LookupOpData::Send()
 			return FZ_REPLY_ERROR_NOTFOUND;
 		}
 
-		if (opState == lookup_init) {
+		if (opState == lookup_init && !(results & LookupResults::direxists)) {
+			// Asking for just the one file is much cheaper than listing a large directory,
+			// but once a second file of the same directory is needed, list it instead.
+			CDirentry statEntry;
+			switch (engine_.GetDirectoryCache().LookupStat(currentServer_, path_, file_, statEntry)) {
+			case CDirectoryCache::StatResult::found:
+				*entry_ = std::move(statEntry);
+				log(logmsg::debug_info, L"Found entry for '%s' from an earlier lookup", file_);
+				return FZ_REPLY_OK;
+			case CDirectoryCache::StatResult::missing:
+				log(logmsg::debug_info, L"'%s' did not exist in an earlier lookup", file_);
+				return FZ_REPLY_ERROR_NOTFOUND;
+			case CDirectoryCache::StatResult::dir_known:
+				opState = lookup_list;
+				controlSocket_.List(path_, std::wstring(), LIST_FLAG_REFRESH);
+				return FZ_REPLY_CONTINUE;
+			default:
+				opState = lookup_stat;
+				controlSocket_.Stat(path_, file_, *entry_);
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+		else if (opState == lookup_init || opState == lookup_stat) {
 			opState = lookup_list;
 			controlSocket_.List(path_, std::wstring(), LIST_FLAG_REFRESH);
 			return FZ_REPLY_CONTINUE;
@@ -70,6 +93,13 @@ int LookupOpData::Send()
 int LookupOpData::SubcommandResult(int prevResult, COpData const&)
 {
 	switch (opState) {
+	case lookup_stat:
+		if (prevResult == FZ_REPLY_OK || prevResult == FZ_REPLY_ERROR_NOTFOUND || (prevResult & FZ_REPLY_DISCONNECTED)) {
+			return prevResult;
+		}
+		entry_->clear();
+		log(logmsg::debug_info, L"Could not look up '%s' directly, listing '%s' instead", file_, path_.GetPath());
+		return FZ_REPLY_CONTINUE;
 	case lookup_list:
 		if (prevResult == FZ_REPLY_OK) {
 			return FZ_REPLY_CONTINUE;
@@ -0,0 +1,657 @@
+#include "filezilla.h"
+
+#include "../include/engine_options.h"
+#include "../include/multicast_reader.h"
+
+#include "uring_file.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <algorithm>
+#include <deque>
+
+#include <string.h>
+
+namespace {
+size_t const chunk_size = 256 * 1024;
+}
+
+class multicast_reader;
+
+// Connection between a source and one of its readers
+class multicast_link final
+{
+public:
+	// Guarded by the source's mutex
+	uint64_t pos_{};
+	bool waiting_{};
+	bool dropped_{};
+
+	// Only cleared by the reader on destruction. Never lock while holding
+	// the reader's own mutex.
+	fz::mutex mutex_{false};
+	multicast_reader* reader_{};
+};
+
+class multicast_source final
+{
+public:
+	multicast_source(std::wstring const& file, uint64_t size, fz::datetime const& mtime, uint64_t budget, fz::thread_pool & pool);
+	~multicast_source();
+
+	bool joinable(uint64_t size, fz::datetime const& mtime);
+
+	std::shared_ptr<multicast_link> attach(multicast_reader & reader);
+	void detach(std::shared_ptr<multicast_link> const& link);
+
+	enum class state
+	{
+		data,
+		wait,
+		eof,
+		error,
+		dropped
+	};
+	state poll(multicast_link & link);
+	size_t copy(multicast_link & link, uint8_t* out, size_t max);
+
+private:
+	void entry();
+	bool drop_laggards(fz::scoped_lock & l);
+	void notify(fz::scoped_lock & l);
+
+	std::wstring const file_;
+	uint64_t const size_;
+	fz::datetime const mtime_;
+	uint64_t const budget_;
+
+	fz::mutex mutex_{false};
+	fz::condition cond_;
+
+	// Chunks are chunk_size large, except for the last one at end of file
+	std::deque<std::vector<uint8_t>> chunks_;
+	uint64_t base_{};
+	uint64_t end_{};
+	bool eof_{};
+	bool error_{};
+	bool quit_{};
+
+	std::vector<std::shared_ptr<multicast_link>> links_;
+	std::vector<std::shared_ptr<multicast_link>> to_wake_;
+
+	fz::async_task task_;
+};
+
+class multicast_reader final : public fz::reader_base
+{
+public:
+	multicast_reader(std::wstring const& name, fz::aio_buffer_pool & pool, size_t max_buffers, uint64_t size, std::shared_ptr<multicast_source> const& source, std::unique_ptr<fz::reader_factory> && file_factory);
+	virtual ~multicast_reader();
+
+	bool attach();
+
+	// Called by the source once data is available or the reader got dropped
+	void wakeup();
+
+private:
+	virtual std::pair<fz::aio_result, fz::buffer_lease> do_get_buffer(fz::scoped_lock & l) override;
+	virtual bool do_seek(fz::scoped_lock & l) override;
+	virtual void do_close(fz::scoped_lock & l) override;
+
+	virtual void on_buffer_availability(fz::aio_waitable const* w) override;
+
+	void detach();
+	bool open_private(uint64_t offset, uint64_t size);
+
+	// The private reader locks mtx_ when signalling us from its own thread,
+	// so it must only be called into with mtx_ released.
+	std::pair<fz::aio_result, fz::buffer_lease> get_private_buffer(fz::scoped_lock & l);
+
+	// Kept alive until destruction, releasing the last reference joins the source's thread
+	std::shared_ptr<multicast_source> source_;
+	std::shared_ptr<multicast_link> link_;
+	bool detached_{};
+	uint64_t consumed_{};
+
+	std::unique_ptr<fz::reader_factory> file_factory_;
+	std::unique_ptr<fz::reader_base> private_;
+
+	// Set if the private reader signalled while mtx_ was released
+	bool private_signalled_{};
+};
+
+multicast_source::multicast_source(std::wstring const& file, uint64_t size, fz::datetime const& mtime, uint64_t budget, fz::thread_pool & pool)
+	: file_(file)
+	, size_(size)
+	, mtime_(mtime)
+	, budget_(budget)
+{
+	task_ = pool.spawn([this]() { entry(); });
+	if (!task_) {
+		error_ = true;
+	}
+}
+
+multicast_source::~multicast_source()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	task_.join();
+}
+
+bool multicast_source::joinable(uint64_t size, fz::datetime const& mtime)
+{
+	fz::scoped_lock l(mutex_);
+	return !error_ && !base_ && size == size_ && mtime == mtime_;
+}
+
+std::shared_ptr<multicast_link> multicast_source::attach(multicast_reader & reader)
+{
+	fz::scoped_lock l(mutex_);
+	if (error_ || base_) {
+		// Start of file already discarded
+		return nullptr;
+	}
+
+	auto link = std::make_shared<multicast_link>();
+	link->reader_ = &reader;
+	links_.push_back(link);
+	cond_.signal(l);
+
+	return link;
+}
+
+void multicast_source::detach(std::shared_ptr<multicast_link> const& link)
+{
+	fz::scoped_lock l(mutex_);
+	links_.erase(std::remove(links_.begin(), links_.end(), link), links_.end());
+	cond_.signal(l);
+}
+
+multicast_source::state multicast_source::poll(multicast_link & link)
+{
+	fz::scoped_lock l(mutex_);
+	if (link.dropped_ || link.pos_ < base_) {
+		return state::dropped;
+	}
+	if (link.pos_ < end_) {
+		return state::data;
+	}
+	if (error_) {
+		return state::error;
+	}
+	if (eof_) {
+		return state::eof;
+	}
+	link.waiting_ = true;
+	return state::wait;
+}
+
+size_t multicast_source::copy(multicast_link & link, uint8_t* out, size_t max)
+{
+	fz::scoped_lock l(mutex_);
+	if (link.dropped_ || link.pos_ < base_ || link.pos_ >= end_) {
+		return 0;
+	}
+
+	uint64_t const offset = link.pos_ - base_;
+	auto const& chunk = chunks_[static_cast<size_t>(offset / chunk_size)];
+	size_t const chunk_offset = static_cast<size_t>(offset % chunk_size);
+	size_t const n = std::min(max, chunk.size() - chunk_offset);
+	memcpy(out, chunk.data() + chunk_offset, n);
+	link.pos_ += n;
+
+	// Might free up room in the window
+	cond_.signal(l);
+
+	return n;
+}
+
+void multicast_source::entry()
+{
+	fz::file f;
+	bool const opened = static_cast<bool>(f.open(fz::to_native(file_), fz::file::reading, fz::file::existing));
+
+	fz::scoped_lock l(mutex_);
+	if (!opened) {
+		error_ = true;
+		notify(l);
+	}
+
+	while (!quit_) {
+		if (eof_ || error_ || links_.empty()) {
+			cond_.wait(l);
+			continue;
+		}
+
+		uint64_t min_pos = end_;
+		for (auto const& link : links_) {
+			min_pos = std::min(min_pos, link->pos_);
+		}
+
+		// Discard chunks all readers are done with. As long as the budget permits,
+		// the start of the file is kept so that uploads starting a bit later can
+		// still join.
+		while (!chunks_.empty() && base_ + chunks_.front().size() <= min_pos && end_ - base_ + chunk_size > budget_) {
+			base_ += chunks_.front().size();
+			chunks_.pop_front();
+		}
+
+		if (end_ - base_ + chunk_size > budget_) {
+			// Window is full, bound by the slowest reader
+			if (!drop_laggards(l)) {
+				cond_.wait(l);
+			}
+			continue;
+		}
+
+		std::vector<uint8_t> chunk(chunk_size);
+		l.unlock();
+		int64_t const read = f.read(chunk.data(), static_cast<int64_t>(chunk_size));
+		l.lock();
+
+		if (read < 0) {
+			error_ = true;
+		}
+		else if (!read) {
+			eof_ = true;
+		}
+		else {
+			chunk.resize(static_cast<size_t>(read));
+			end_ += static_cast<uint64_t>(read);
+			chunks_.emplace_back(std::move(chunk));
+		}
+		notify(l);
+	}
+}
+
+bool multicast_source::drop_laggards(fz::scoped_lock & l)
+{
+	// Only punish slow readers if others are starving
+	bool starving{};
+	for (auto const& link : links_) {
+		if (link->waiting_) {
+			starving = true;
+			break;
+		}
+	}
+	if (!starving) {
+		return false;
+	}
+
+	bool dropped{};
+	for (auto it = links_.begin(); it != links_.end(); ) {
+		auto & link = *it;
+		if (link->pos_ + budget_ / 2 < end_) {
+			link->dropped_ = true;
+			to_wake_.push_back(link);
+			it = links_.erase(it);
+			dropped = true;
+		}
+		else {
+			++it;
+		}
+	}
+
+	if (dropped) {
+		notify(l);
+	}
+	return dropped;
+}
+
+void multicast_source::notify(fz::scoped_lock & l)
+{
+	for (auto const& link : links_) {
+		if (link->waiting_) {
+			link->waiting_ = false;
+			to_wake_.push_back(link);
+		}
+	}
+	if (to_wake_.empty()) {
+		return;
+	}
+
+	// Readers lock their own mutex when woken, which in turn may
+	// call into the source. Wake them without holding our mutex.
+	auto wake = std::move(to_wake_);
+	to_wake_.clear();
+	l.unlock();
+	for (auto const& link : wake) {
+		fz::scoped_lock ll(link->mutex_);
+		if (link->reader_) {
+			link->reader_->wakeup();
+		}
+	}
+	l.lock();
+}
+
+
+multicast_reader::multicast_reader(std::wstring const& name, fz::aio_buffer_pool & pool, size_t max_buffers, uint64_t size, std::shared_ptr<multicast_source> const& source, std::unique_ptr<fz::reader_factory> && file_factory)
+	: fz::reader_base(name, pool, max_buffers)
+	, source_(source)
+	, file_factory_(std::move(file_factory))
+{
+	fz::scoped_lock l(mtx_);
+	size_ = size;
+	max_size_ = size;
+	start_offset_ = 0;
+	remaining_ = size;
+}
+
+multicast_reader::~multicast_reader()
+{
+	// Nothing in here may happen with mtx_ held, the source and the private
+	// reader both lock it when signalling us.
+	std::unique_ptr<fz::reader_base> p;
+	{
+		fz::scoped_lock l(mtx_);
+		p = std::move(private_);
+	}
+	p.reset();
+
+	if (link_) {
+		{
+			fz::scoped_lock l(link_->mutex_);
+			link_->reader_ = nullptr;
+		}
+		source_->detach(link_);
+	}
+	source_.reset();
+
+	buffer_pool_.remove_waiter(*this);
+	remove_waiters();
+}
+
+bool multicast_reader::attach()
+{
+	fz::scoped_lock l(mtx_);
+	link_ = source_->attach(*this);
+	return link_ != nullptr;
+}
+
+void multicast_reader::wakeup()
+{
+	fz::scoped_lock l(mtx_);
+	signal_availibility();
+}
+
+void multicast_reader::on_buffer_availability(fz::aio_waitable const* w)
+{
+	fz::scoped_lock l(mtx_);
+	if (w == private_.get()) {
+		private_signalled_ = true;
+	}
+	signal_availibility();
+}
+
+void multicast_reader::detach()
+{
+	// Keeps the link itself, the reader pointer in it is cleared in the destructor
+	if (!detached_ && link_) {
+		source_->detach(link_);
+	}
+	detached_ = true;
+}
+
+bool multicast_reader::open_private(uint64_t offset, uint64_t size)
+{
+	detach();
+
+	private_ = file_factory_->open(buffer_pool_, offset, size, max_buffers_);
+	if (!private_) {
+		error_ = true;
+		return false;
+	}
+	return true;
+}
+
+std::pair<fz::aio_result, fz::buffer_lease> multicast_reader::get_private_buffer(fz::scoped_lock & l)
+{
+	// Only replaced or reset by the consumer itself, safe to use unlocked
+	auto & p = *private_;
+	for (;;) {
+		private_signalled_ = false;
+		l.unlock();
+		auto ret = p.get_buffer(*this);
+		l.lock();
+
+		// Our caller registers its waiter only once we return. If the private
+		// reader became ready in between, that wakeup would be lost.
+		if (ret.first != fz::aio_result::wait || !private_signalled_) {
+			return ret;
+		}
+	}
+}
+
+std::pair<fz::aio_result, fz::buffer_lease> multicast_reader::do_get_buffer(fz::scoped_lock & l)
+{
+	if (private_) {
+		return get_private_buffer(l);
+	}
+
+	if (error_ || detached_ || !link_) {
+		return {fz::aio_result::error, fz::buffer_lease()};
+	}
+
+	if (!remaining_) {
+		return {fz::aio_result::ok, fz::buffer_lease()};
+	}
+
+	switch (source_->poll(*link_)) {
+	case multicast_source::state::wait:
+		return {fz::aio_result::wait, fz::buffer_lease()};
+	case multicast_source::state::dropped:
+		// Fell too far behind, continue on our own
+		if (!open_private(start_offset_ + size_ - remaining_, remaining_)) {
+			return {fz::aio_result::error, fz::buffer_lease()};
+		}
+		return get_private_buffer(l);
+	case multicast_source::state::data:
+		break;
+	default:
+		// File got shorter or could not be read
+		error_ = true;
+		return {fz::aio_result::error, fz::buffer_lease()};
+	}
+
+	fz::buffer_lease b = buffer_pool_.get_buffer(*this);
+	if (!b) {
+		return {fz::aio_result::wait, fz::buffer_lease()};
+	}
+
+	size_t const max = static_cast<size_t>(std::min(static_cast<uint64_t>(b->capacity()), remaining_));
+	size_t const copied = source_->copy(*link_, b->get(max), max);
+	if (!copied) {
+		// Got dropped in the meantime
+		b = fz::buffer_lease();
+		return do_get_buffer(l);
+	}
+	b->add(copied);
+	remaining_ -= copied;
+	consumed_ += copied;
+
+	return {fz::aio_result::ok, std::move(b)};
+}
+
+bool multicast_reader::do_seek(fz::scoped_lock & l)
+{
+	if (private_) {
+		uint64_t const offset = start_offset_;
+		uint64_t const size = size_;
+		auto & p = *private_;
+		l.unlock();
+		bool const ret = p.seek(offset, size);
+		l.lock();
+		return ret;
+	}
+
+	if (!detached_ && !start_offset_ && !consumed_) {
+		// Nothing consumed yet, stay in the window
+		return true;
+	}
+
+	return open_private(start_offset_, size_);
+}
+
+void multicast_reader::do_close(fz::scoped_lock &)
+{
+	// The private reader, if any, is released in the destructor
+	detach();
+}
+
+
+class multicast_announcements final
+{
+public:
+	size_t count(std::wstring const& file)
+	{
+		fz::scoped_lock l(mutex_);
+		auto it = counts_.find(file);
+		return it != counts_.end() ? it->second : 0;
+	}
+
+	fz::mutex mutex_{false};
+	std::map<std::wstring, size_t> counts_;
+};
+
+class multicast_announcement final
+{
+public:
+	multicast_announcement(std::shared_ptr<multicast_announcements> const& announcements, std::wstring const& file)
+		: announcements_(announcements)
+		, file_(file)
+	{
+		fz::scoped_lock l(announcements_->mutex_);
+		++announcements_->counts_[file_];
+	}
+
+	~multicast_announcement()
+	{
+		fz::scoped_lock l(announcements_->mutex_);
+		auto it = announcements_->counts_.find(file_);
+		if (it != announcements_->counts_.end() && !--it->second) {
+			announcements_->counts_.erase(it);
+		}
+	}
+
+	multicast_announcement(multicast_announcement const&) = delete;
+	multicast_announcement& operator=(multicast_announcement const&) = delete;
+
+private:
+	std::shared_ptr<multicast_announcements> const announcements_;
+	std::wstring const file_;
+};
+
+multicast_reader_hub::multicast_reader_hub(fz::thread_pool & pool, COptionsBase & options)
+	: pool_(pool)
+	, options_(options)
+	, announcements_(std::make_shared<multicast_announcements>())
+{
+}
+
+multicast_reader_hub::~multicast_reader_hub()
+{
+}
+
+std::shared_ptr<multicast_source> multicast_reader_hub::get_source(std::wstring const& file, uint64_t size, fz::datetime const& mtime)
+{
+	uint64_t const budget = static_cast<uint64_t>(options_.get_int(OPTION_UPLOAD_MULTICAST_BUFFER)) * 1024 * 1024;
+	if (!budget) {
+		return nullptr;
+	}
+
+	fz::scoped_lock l(mutex_);
+
+	for (auto it = sources_.begin(); it != sources_.end(); ) {
+		if (it->second.expired()) {
+			it = sources_.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	auto it = sources_.find(file);
+	if (it != sources_.end()) {
+		auto source = it->second.lock();
+		if (source && source->joinable(size, mtime)) {
+			return source;
+		}
+	}
+
+	// A window of its own only pays off if another upload is going to join
+	if (announcements_->count(file) < 2) {
+		return nullptr;
+	}
+
+	auto source = std::make_shared<multicast_source>(file, size, mtime, budget, pool_);
+	sources_[file] = source;
+
+	return source;
+}
+
+std::shared_ptr<multicast_announcement> multicast_reader_hub::announce(std::wstring const& file)
+{
+	return std::make_shared<multicast_announcement>(announcements_, file);
+}
+
+
+multicast_reader_factory::multicast_reader_factory(std::wstring const& file, fz::thread_pool & pool, multicast_reader_hub & hub)
+	: fz::reader_factory(file)
+	, pool_(pool)
+	, hub_(hub)
+	, file_factory_(std::make_unique<fz::file_reader_factory>(file, pool))
+{
+}
+
+multicast_reader_factory::multicast_reader_factory(multicast_reader_factory const& op)
+	: fz::reader_factory(op)
+	, pool_(op.pool_)
+	, hub_(op.hub_)
+	, file_factory_(op.file_factory_->clone())
+{
+}
+
+std::unique_ptr<fz::reader_factory> multicast_reader_factory::clone() const
+{
+	return std::unique_ptr<fz::reader_factory>(new multicast_reader_factory(*this));
+}
+
+uint64_t multicast_reader_factory::size() const
+{
+	return file_factory_->size();
+}
+
+fz::datetime multicast_reader_factory::mtime() const
+{
+	return file_factory_->mtime();
+}
+
+std::unique_ptr<fz::reader_base> multicast_reader_factory::open(fz::aio_buffer_pool & pool, uint64_t offset, uint64_t size, size_t max_buffers)
+{
+	// Only whole-file reads are shared, resumed uploads read on their own
+	uint64_t const file_size = file_factory_->size();
+	if (!offset && size == fz::aio_base::nosize && file_size != fz::aio_base::nosize && file_size) {
+		auto source = hub_.get_source(name(), file_size, file_factory_->mtime());
+		if (source) {
+			auto reader = std::make_unique<multicast_reader>(name(), pool, max_buffers, file_size, source, file_factory_->clone());
+			if (reader->attach()) {
+				return reader;
+			}
+		}
+	}
+
+	int const io_mode = hub_.options_.get_int(OPTION_LOCAL_FILE_IO);
+	if (io_mode) {
+		auto reader = open_uring_reader(name(), pool, pool_, offset, size, max_buffers, io_mode == 2);
+		if (reader) {
+			return reader;
+		}
+	}
+
+	return file_factory_->open(pool, offset, size, max_buffers);
+}
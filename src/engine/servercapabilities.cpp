@@ -1,10 +1,95 @@
 #include "filezilla.h"
 #include "servercapabilities.h"
 
+#include "../include/xmlutils.h"
+
+#include <libfilezilla/local_filesys.hpp>
+
 #include <assert.h>
 
 std::map<CServer, CCapabilities> CServerCapabilities::m_serverMap;
 fz::mutex CServerCapabilities::m_(false);
+std::wstring CServerCapabilities::file_;
+bool CServerCapabilities::modified_{};
+
+namespace {
+// Increase whenever the meaning of a persisted capability changes
+int const persisted_version = 1;
+
+fz::duration const persisted_expiry = fz::duration::from_days(7);
+
+// Capabilities that can be discovered by SYST and FEAT or that depend on
+// their result. The others are cheap to find out again or depend on
+// more than just the server software.
+struct persisted_capability
+{
+	capabilityNames name;
+	char const* key;
+};
+
+persisted_capability const persisted_capabilities[] = {
+	{syst_command, "syst"},
+	{feat_command, "feat"},
+	{clnt_command, "clnt"},
+	{utf8_command, "utf8"},
+	{mlsd_command, "mlsd"},
+	{opst_mlst_command, "opts_mlst"},
+	{mfmt_command, "mfmt"},
+	{mdtm_command, "mdtm"},
+	{size_command, "size"},
+	{mode_z_support, "mode_z"},
+	{tvfs_support, "tvfs"},
+	{list_hidden_support, "list_hidden"},
+	{rest_stream, "rest_stream"},
+	{epsv_command, "epsv"},
+	{hash_command, "hash"},
+	{xsha256_command, "xsha256"},
+	{xsha1_command, "xsha1"},
+	{xmd5_command, "xmd5"},
+	{xcrc_command, "xcrc"},
+	{auth_tls_command, "auth_tls"},
+	{auth_ssl_command, "auth_ssl"}
+};
+
+void SaveServer(pugi::xml_node node, CServer const& server)
+{
+	SetAttributeInt(node, "Protocol", server.GetProtocol());
+	SetAttributeInt(node, "Type", server.GetType());
+	SetTextAttribute(node, "Host", server.GetHost());
+	SetAttributeInt(node, "Port", server.GetPort());
+	SetTextAttribute(node, "User", server.GetUser());
+	SetAttributeInt(node, "TimezoneOffset", server.GetTimezoneOffset());
+	SetAttributeInt(node, "PasvMode", server.GetPasvMode());
+	SetAttributeInt(node, "BypassProxy", server.GetBypassProxy() ? 1 : 0);
+	SetAttributeInt(node, "Encoding", server.GetEncodingType());
+	if (server.GetEncodingType() == ENCODING_CUSTOM) {
+		SetTextAttribute(node, "CustomEncoding", server.GetCustomEncoding());
+	}
+	for (auto const& parameter : server.GetExtraParameters()) {
+		auto element = AddTextElement(node, "Parameter", parameter.second);
+		SetTextAttributeUtf8(element, "Name", parameter.first);
+	}
+}
+
+CServer LoadServer(pugi::xml_node node)
+{
+	CServer server;
+	server.SetProtocol(static_cast<ServerProtocol>(GetAttributeInt(node, "Protocol")));
+	if (!server.SetHost(GetTextAttribute(node, "Host"), GetAttributeInt(node, "Port"))) {
+		return CServer();
+	}
+	server.SetType(static_cast<ServerType>(GetAttributeInt(node, "Type")));
+	server.SetUser(GetTextAttribute(node, "User"));
+	server.SetTimezoneOffset(GetAttributeInt(node, "TimezoneOffset"));
+	server.SetPasvMode(static_cast<PasvMode>(GetAttributeInt(node, "PasvMode")));
+	server.SetBypassProxy(GetAttributeInt(node, "BypassProxy") != 0);
+	server.SetEncodingType(static_cast<CharsetEncoding>(GetAttributeInt(node, "Encoding")), GetTextAttribute(node, "CustomEncoding"));
+	for (auto parameter = node.child("Parameter"); parameter; parameter = parameter.next_sibling("Parameter")) {
+		server.SetExtraParameter(fz::to_utf8(GetTextAttribute(parameter, "Name")), GetTextElement(parameter));
+	}
+	return server;
+}
+}
 
 capabilities CCapabilities::GetCapability(capabilityNames name, std::wstring* pOption) const
 {
@@ -82,6 +167,7 @@ capabilities CServerCapabilities::GetCapability(const CServer& server, capabilit
 void CServerCapabilities::SetCapability(const CServer& server, capabilityNames name, capabilities cap, std::wstring const& option)
 {
 	fz::scoped_lock l(m_);
+	modified_ = true;
 
 	const std::map<CServer, CCapabilities>::iterator iter = m_serverMap.find(server);
 	if (iter == m_serverMap.end()) {
@@ -97,6 +183,7 @@ void CServerCapabilities::SetCapability(const CServer& server, capabilityNames n
 void CServerCapabilities::SetCapability(const CServer& server, capabilityNames name, capabilities cap, int option)
 {
 	fz::scoped_lock l(m_);
+	modified_ = true;
 
 	const std::map<CServer, CCapabilities>::iterator iter = m_serverMap.find(server);
 	if (iter == m_serverMap.end()) {
@@ -108,3 +195,153 @@ void CServerCapabilities::SetCapability(const CServer& server, capabilityNames n
 
 	iter->second.SetCapability(name, cap, option);
 }
+
+void CServerCapabilities::Load(std::wstring const& file)
+{
+	fz::scoped_lock l(m_);
+
+	file_ = file;
+	if (file_.empty()) {
+		return;
+	}
+
+	pugi::xml_document doc;
+	if (!doc.load_file(fz::to_native(file_).c_str())) {
+		return;
+	}
+
+	auto element = doc.child("TabFTP3").child("ServerCapabilities");
+	if (GetAttributeInt(element, "Version") != persisted_version) {
+		return;
+	}
+
+	auto const now = fz::datetime::now();
+	for (auto node = element.child("Server"); node; node = node.next_sibling("Server")) {
+		fz::datetime const discovered(static_cast<time_t>(node.attribute("Discovered").as_llong()), fz::datetime::seconds);
+		if (discovered.empty() || now - discovered > persisted_expiry) {
+			continue;
+		}
+
+		CServer const server = LoadServer(node);
+		if (!server || m_serverMap.find(server) != m_serverMap.end()) {
+			continue;
+		}
+
+		CCapabilities caps;
+		caps.fingerprint_ = GetTextAttribute(node, "Fingerprint");
+		caps.discovered_ = discovered;
+		caps.loaded_ = true;
+		for (auto capability = node.child("Capability"); capability; capability = capability.next_sibling("Capability")) {
+			std::string const key = fz::to_utf8(GetTextAttribute(capability, "Name"));
+			for (auto const& persisted : persisted_capabilities) {
+				if (key != persisted.key) {
+					continue;
+				}
+
+				std::wstring const value = GetTextAttribute(capability, "Value");
+				if (value == L"yes") {
+					CCapabilities::t_cap & cap = caps.m_capabilityMap[persisted.name];
+					cap.cap = yes;
+					cap.option = GetTextAttribute(capability, "Option");
+					cap.number = GetAttributeInt(capability, "Number");
+				}
+				else if (value == L"no") {
+					caps.m_capabilityMap[persisted.name].cap = no;
+				}
+				break;
+			}
+		}
+		if (caps.fingerprint_.empty() || caps.m_capabilityMap.empty()) {
+			continue;
+		}
+
+		// MLST/MLSD specs require use of UTC
+		if (caps.GetCapability(mlsd_command) == yes) {
+			caps.SetCapability(inferred_timezone_offset, no);
+		}
+
+		m_serverMap[server] = std::move(caps);
+	}
+}
+
+void CServerCapabilities::Save()
+{
+	fz::scoped_lock l(m_);
+
+	if (file_.empty() || !modified_) {
+		return;
+	}
+
+	pugi::xml_document doc;
+	auto element = doc.append_child("TabFTP3").append_child("ServerCapabilities");
+	SetAttributeInt(element, "Version", persisted_version);
+
+	auto const now = fz::datetime::now();
+	for (auto const& entry : m_serverMap) {
+		CCapabilities const& caps = entry.second;
+		if (caps.fingerprint_.empty() || caps.discovered_.empty() || now - caps.discovered_ > persisted_expiry) {
+			continue;
+		}
+
+		auto node = element.append_child("Server");
+		SaveServer(node, entry.first);
+		SetTextAttribute(node, "Fingerprint", caps.fingerprint_);
+		node.append_attribute("Discovered").set_value(static_cast<long long>(caps.discovered_.get_time_t()));
+
+		for (auto const& persisted : persisted_capabilities) {
+			std::wstring option;
+			int number{};
+			auto const cap = caps.GetCapability(persisted.name, &option);
+			if (cap == unknown) {
+				continue;
+			}
+
+			auto capability = node.append_child("Capability");
+			SetTextAttributeUtf8(capability, "Name", persisted.key);
+			if (cap == yes) {
+				caps.GetCapability(persisted.name, &number);
+				SetTextAttributeUtf8(capability, "Value", "yes");
+				if (!option.empty()) {
+					SetTextAttribute(capability, "Option", option);
+				}
+				if (number) {
+					SetAttributeInt(capability, "Number", number);
+				}
+			}
+			else {
+				SetTextAttributeUtf8(capability, "Value", "no");
+			}
+		}
+	}
+
+	// Write to a temporary file first, a crash must not leave a truncated file behind.
+	std::wstring const tmp = file_ + L"~";
+	if (doc.save_file(fz::to_native(tmp).c_str()) && fz::rename_file(fz::to_native(tmp), fz::to_native(file_))) {
+		modified_ = false;
+	}
+}
+
+bool CServerCapabilities::CheckFingerprint(CServer const& server, std::wstring const& fingerprint)
+{
+	fz::scoped_lock l(m_);
+
+	CCapabilities & caps = m_serverMap[server];
+	if (caps.loaded_) {
+		caps.loaded_ = false;
+		if (caps.fingerprint_ != fingerprint) {
+			caps = CCapabilities();
+			caps.fingerprint_ = fingerprint;
+			caps.discovered_ = fz::datetime::now();
+			modified_ = true;
+			return false;
+		}
+	}
+	else if (caps.fingerprint_.empty()) {
+		// Fresh discovery, the capabilities follow
+		caps.fingerprint_ = fingerprint;
+		caps.discovered_ = fz::datetime::now();
+		modified_ = true;
+	}
+
+	return true;
+}
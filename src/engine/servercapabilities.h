@@ -4,6 +4,7 @@
 #include "../include/server.h"
 
 #include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
 
 #include <map>
 
@@ -34,6 +35,11 @@ enum capabilityNames
 	list_hidden_support, // LIST -a command
 	rest_stream, // supports REST+STOR in addition to APPE
 	epsv_command,
+	hash_command, // Option holds the algorithm selected by default, e.g. SHA-256
+	xsha256_command,
+	xsha1_command,
+	xmd5_command,
+	xcrc_command,
 
 	// Server timezone offset. If using FTP, LIST details are unspecified and
 	// can return different times than the UTC based times using the MLST or
@@ -46,7 +52,10 @@ enum capabilityNames
 	auth_tls_command,
 	auth_ssl_command,
 
-	tls_resumption
+	tls_resumption,
+
+	// SFTP-protocol specific
+	check_file_extension
 };
 
 class CCapabilities final
@@ -58,6 +67,8 @@ public:
 	void SetCapability(capabilityNames name, capabilities cap, int option);
 
 protected:
+	friend class CServerCapabilities;
+
 	struct t_cap
 	{
 		capabilities cap{unknown};
@@ -65,6 +76,14 @@ protected:
 		int number{};
 	};
 	std::map<capabilityNames, t_cap> m_capabilityMap;
+
+	// Welcome message of the server the capabilities got discovered with.
+	// Only capabilities with a fingerprint get persisted.
+	std::wstring fingerprint_;
+	fz::datetime discovered_;
+
+	// Loaded from disk and not yet confirmed by a connection
+	bool loaded_{};
 };
 
 class CServerCapabilities final
@@ -77,9 +96,22 @@ public:
 	static void SetCapability(const CServer& server, capabilityNames name, capabilities cap, std::wstring const& option = std::wstring());
 	static void SetCapability(const CServer& server, capabilityNames name, capabilities cap, int option);
 
+	// Capabilities of FTP servers are persisted, so that known servers need not
+	// be probed again on every new connection. They are discarded if the
+	// welcome message of the server changes, or once they are a week old.
+	static void Load(std::wstring const& file);
+	static void Save();
+
+	// Call with the welcome message of each new connection. Returns false if
+	// the persisted capabilities of the server have been discarded.
+	static bool CheckFingerprint(CServer const& server, std::wstring const& fingerprint);
+
 protected:
 	static std::map<CServer, CCapabilities> m_serverMap;
 
+	static std::wstring file_;
+	static bool modified_;
+
 	static fz::mutex m_;
 };
 
@@ -10,6 +10,10 @@ enum chmodStates
 	chmod_waitcwd,
 	chmod_chmod
 };
+
+// Bounds the length of a single mchmod command
+size_t const max_batch_files = 1000;
+size_t const max_batch_length = 32 * 1024;
 }
 
 int CSftpChmodOpData::Send()
@@ -50,3 +54,62 @@ int CSftpChmodOpData::SubcommandResult(int prevResult, COpData const&)
 		return FZ_REPLY_INTERNALERROR;
 	}
 }
+
+int CSftpChmodManyOpData::Send()
+{
+	if (path_.empty()) {
+		log(logmsg::debug_info, L"Empty path");
+		return FZ_REPLY_INTERNALERROR;
+	}
+
+	if (opState == chmod_init) {
+		log(logmsg::status, _("Setting permissions of %u items in '%s'"), entries_.size(), path_.GetPath());
+		opState = chmod_chmod;
+	}
+
+	std::wstring cmd = L"mchmod " + controlSocket_.QuoteFilename(path_.GetPath());
+
+	batch_ = 0;
+	reported_ = 0;
+	while (batch_ < entries_.size() && batch_ < max_batch_files && cmd.size() < max_batch_length) {
+		auto const& entry = entries_[batch_++];
+		engine_.GetDirectoryCache().UpdateFile(currentServer_, path_, entry.first, false, CDirectoryCache::unknown);
+		cmd += L" " + entry.second + L" " + controlSocket_.QuoteFilename(entry.first);
+	}
+
+	return controlSocket_.SendCommand(cmd);
+}
+
+void CSftpChmodManyOpData::OnBatchResult(size_t index, bool success)
+{
+	if (index >= batch_) {
+		log(logmsg::debug_warning, L"Result for unknown batch index %u", index);
+		return;
+	}
+	++reported_;
+
+	if (!success) {
+		failed_ = true;
+	}
+}
+
+int CSftpChmodManyOpData::ParseResponse()
+{
+	// As with mrm, the batch can also fail as a whole
+	if (reported_ < batch_) {
+		failed_ = true;
+	}
+	entries_.erase(entries_.begin(), entries_.begin() + batch_);
+	batch_ = 0;
+
+	if (!entries_.empty()) {
+		return FZ_REPLY_CONTINUE;
+	}
+
+	return failed_ ? FZ_REPLY_ERROR : FZ_REPLY_OK;
+}
+
+int CSftpChmodManyOpData::SubcommandResult(int, COpData const&)
+{
+	return FZ_REPLY_INTERNALERROR;
+}
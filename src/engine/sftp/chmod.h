@@ -21,4 +21,34 @@ private:
 	bool useAbsolute_{};
 };
 
+// Sets the permissions of several entries of one directory using a single
+// mchmod command, fzsftp keeps the SETSTAT requests pipelined.
+class CSftpChmodManyOpData final : public COpData, public CSftpOpData
+{
+public:
+	CSftpChmodManyOpData(CSftpControlSocket & controlSocket, CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> const& entries)
+		: COpData(Command::chmod, L"CSftpChmodManyOpData")
+		, CSftpOpData(controlSocket)
+		, path_(path)
+		, entries_(entries)
+	{}
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+	virtual int SubcommandResult(int, COpData const&) override;
+
+	void OnBatchResult(size_t index, bool success);
+
+private:
+	CServerPath const path_;
+	std::vector<std::pair<std::wstring, std::wstring>> entries_;
+
+	// Entries of the mchmod command in flight, fzsftp reports the result
+	// of each by its index in the batch.
+	size_t batch_{};
+	size_t reported_{};
+
+	bool failed_{};
+};
+
 #endif
@@ -74,6 +74,9 @@ int CSftpConnectOpData::Send()
 			if (options_.get_int(OPTION_SFTP_COMPRESSION)) {
 				args.push_back(fzT("-C"));
 			}
+			if (options_.get_int(OPTION_SFTP_SHARE_CONNECTIONS)) {
+				args.push_back(fzT("-share"));
+			}
 
 			controlSocket_.process_ = std::make_unique<fz::process>(engine_.GetThreadPool(), controlSocket_);
 #ifndef FZ_WINDOWS
@@ -3,51 +3,78 @@
 #include "delete.h"
 #include "../directorycache.h"
 
+namespace {
+// Bounds the length of a single mrm command
+size_t const max_batch_files = 1000;
+size_t const max_batch_length = 32 * 1024;
+}
+
 int CSftpDeleteOpData::Send()
 {
-	std::wstring const& file = files_.back();
-	if (file.empty()) {
-		log(logmsg::debug_info, L"Empty filename");
+	if (path_.empty()) {
+		log(logmsg::debug_info, L"Empty path");
 		return FZ_REPLY_INTERNALERROR;
 	}
 
-	std::wstring filename = path_.FormatFilename(file);
-	if (filename.empty()) {
-		log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
-		return FZ_REPLY_ERROR;
-	}
-
 	if (time_.empty()) {
 		time_ = fz::datetime::now();
 	}
 
-	engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+	std::wstring cmd = L"mrm " + controlSocket_.QuoteFilename(path_.GetPath());
+
+	batch_.clear();
+	reported_ = 0;
+	while (!files_.empty() && batch_.size() < max_batch_files && cmd.size() < max_batch_length) {
+		std::wstring const& file = files_.back();
+		if (file.empty()) {
+			log(logmsg::debug_info, L"Empty filename");
+			return FZ_REPLY_INTERNALERROR;
+		}
 
-	return controlSocket_.SendCommand(L"rm " + controlSocket_.QuoteFilename(filename));
+		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+
+		cmd += L" " + controlSocket_.QuoteFilename(file);
+		batch_.push_back(std::move(files_.back()));
+		files_.pop_back();
+	}
+
+	return controlSocket_.SendCommand(cmd);
 }
 
-int CSftpDeleteOpData::ParseResponse()
+void CSftpDeleteOpData::OnBatchResult(size_t index, bool success)
 {
-	if (controlSocket_.result_ != FZ_REPLY_OK) {
+	if (index >= batch_.size()) {
+		log(logmsg::debug_warning, L"Result for unknown batch index %u", index);
+		return;
+	}
+	++reported_;
+
+	if (!success) {
 		deleteFailed_ = true;
+		return;
 	}
-	else {
-		std::wstring const& file = files_.back();
 
-		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
+	engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, batch_[index]);
 
-		auto const now = fz::datetime::now();
-		if (!time_.empty() && (now - time_).get_seconds() >= 1) {
-			controlSocket_.SendDirectoryListingNotification(path_, false);
-			time_ = now;
-			needSendListing_ = false;
-		}
-		else {
-			needSendListing_ = true;
-		}
+	auto const now = fz::datetime::now();
+	if (!time_.empty() && (now - time_).get_seconds() >= 1) {
+		controlSocket_.SendDirectoryListingNotification(path_, false);
+		time_ = now;
+		needSendListing_ = false;
+	}
+	else {
+		needSendListing_ = true;
 	}
+}
 
-	files_.pop_back();
+int CSftpDeleteOpData::ParseResponse()
+{
+	// Individual results have already been processed, but the batch
+	// can fail as a whole, e.g. if the directory does not exist.
+	if (reported_ < batch_.size()) {
+		deleteFailed_ = true;
+	}
+	batch_.clear();
 
 	if (!files_.empty()) {
 		return FZ_REPLY_CONTINUE;
@@ -16,6 +16,8 @@ public:
 	virtual int SubcommandResult(int prevResult, COpData const&) override;
 	virtual int Reset(int result) override;
 
+	void OnBatchResult(size_t index, bool success);
+
 	CServerPath path_;
 	std::vector<std::wstring> files_;
 
@@ -27,6 +29,12 @@ public:
 
 	// Set to true if deletion of at least one file failed
 	bool deleteFailed_{};
+
+private:
+	// Files of the mrm command in flight, fzsftp reports the result
+	// of each by its index in the batch.
+	std::vector<std::wstring> batch_;
+	size_t reported_{};
 };
 
 #endif
@@ -1,13 +1,18 @@
 #include "../filezilla.h"
 
 #include "../directorycache.h"
+#include "../servercapabilities.h"
 #include "filetransfer.h"
+#include "io_ring.h"
 
 #include "../../include/engine_options.h"
 
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/process.hpp>
 
+#include <algorithm>
+#include <new>
+
 #include <assert.h>
 
 namespace {
@@ -16,9 +21,12 @@ enum filetransferStates
 	filetransfer_init = 0,
 	filetransfer_waitcwd,
 	filetransfer_waitlist,
+	filetransfer_waitstat,
 	filetransfer_mtime,
 	filetransfer_transfer,
-	filetransfer_chmtime
+	filetransfer_chmtime,
+	filetransfer_checksum,
+	filetransfer_waitchecksum
 };
 }
 
@@ -52,6 +60,11 @@ int CSftpFileTransferOpData::Send()
 		controlSocket_.ChangeDir(remotePath_);
 		return FZ_REPLY_CONTINUE;
 	}
+	else if (opState == filetransfer_transfer && compareChecksums_) {
+		compareChecksums_ = false;
+		opState = filetransfer_checksum;
+		return FZ_REPLY_CONTINUE;
+	}
 	else if (opState == filetransfer_transfer) {
 		// Bit convoluted, but we need to guarantee that local filenames are passed as UTF-8 to fzsftp,
 		// whereas we need to use server encoding for remote filenames.
@@ -123,6 +136,17 @@ int CSftpFileTransferOpData::Send()
 		std::wstring seconds = fz::sprintf(L"%d", ticks);
 		return controlSocket_.SendCommand(L"chmtime " + seconds + L" " + quotedFilename);
 	}
+	else if (opState == filetransfer_checksum) {
+		if (CServerCapabilities::GetCapability(currentServer_, check_file_extension) == no) {
+			log(logmsg::status, _("Server does not support checksums"));
+			return OnChecksumResult(FZ_REPLY_NOTSUPPORTED);
+		}
+		std::wstring quotedFilename = controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_));
+		return controlSocket_.SendCommand(L"chkfile " + quotedFilename);
+	}
+	else if (opState == filetransfer_waitchecksum) {
+		return OnChecksumResult(controlSocket_.CompareChecksums(*this));
+	}
 
 	return FZ_REPLY_INTERNALERROR;
 }
@@ -130,23 +154,36 @@ int CSftpFileTransferOpData::Send()
 int CSftpFileTransferOpData::ParseResponse()
 {
 	if (opState == filetransfer_transfer) {
+		ReleaseRing();
 		writer_.reset();
-		if (controlSocket_.result_ == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
-			if (download()) {
-				if (!remoteFileTime_.empty()) {
-					if (!writer_factory_->set_mtime(remoteFileTime_)) {
-						log(logmsg::debug_warning, L"Could not set modification time");
-					}
-				}
+		if (controlSocket_.result_ != FZ_REPLY_OK) {
+			return controlSocket_.result_;
+		}
+		if (options_.get_int(OPTION_VERIFY_TRANSFERS)) {
+			opState = filetransfer_checksum;
+			return FZ_REPLY_CONTINUE;
+		}
+		return FinishTransfer();
+	}
+	else if (opState == filetransfer_checksum) {
+		if (controlSocket_.result_ == FZ_REPLY_OK) {
+			// Reply is the algorithm followed by the digest
+			auto const pos = controlSocket_.response_.find(' ');
+			if (pos != std::wstring::npos) {
+				checksumAlgorithm_ = checksum_from_name(controlSocket_.response_.substr(0, pos));
+				remoteChecksum_ = normalize_checksum(checksumAlgorithm_, controlSocket_.response_.substr(pos + 1));
 			}
-			else {
-				if (!localFileTime_.empty()) {
-					opState = filetransfer_chmtime;
-					return FZ_REPLY_CONTINUE;
-				}
+		}
+		if (remoteChecksum_.empty()) {
+			if (controlSocket_.result_ != FZ_REPLY_OK) {
+				CServerCapabilities::SetCapability(currentServer_, check_file_extension, no);
 			}
+			log(logmsg::status, _("Could not obtain checksum of remote file"));
+			return OnChecksumResult(FZ_REPLY_NOTSUPPORTED);
 		}
-		return controlSocket_.result_;
+		CServerCapabilities::SetCapability(currentServer_, check_file_extension, yes);
+		opState = filetransfer_waitchecksum;
+		return FZ_REPLY_CONTINUE;
 	}
 	else if (opState == filetransfer_mtime) {
 		if (controlSocket_.result_ == FZ_REPLY_OK && !controlSocket_.response_.empty()) {
@@ -190,6 +227,40 @@ int CSftpFileTransferOpData::ParseResponse()
 	return FZ_REPLY_INTERNALERROR;
 }
 
+int CSftpFileTransferOpData::OnStatResult(int result)
+{
+	if (result & FZ_REPLY_DISCONNECTED) {
+		return result;
+	}
+
+	if (result == FZ_REPLY_OK) {
+		remoteFileSize_ = statEntry_.size;
+		if (statEntry_.has_date()) {
+			remoteFileTime_ = statEntry_.time;
+		}
+	}
+	else if (result != FZ_REPLY_ERROR_NOTFOUND) {
+		opState = filetransfer_waitlist;
+		controlSocket_.List(CServerPath(), L"", LIST_FLAG_REFRESH);
+		return FZ_REPLY_CONTINUE;
+	}
+
+	if (download() && !statEntry_.has_time() &&
+		options_.get_int(OPTION_PRESERVE_TIMESTAMPS))
+	{
+		opState = filetransfer_mtime;
+	}
+	else {
+		opState = filetransfer_transfer;
+		int res = controlSocket_.CheckOverwriteFile();
+		if (res != FZ_REPLY_OK) {
+			return res;
+		}
+	}
+
+	return FZ_REPLY_CONTINUE;
+}
+
 int CSftpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 {
 	if (opState == filetransfer_waitcwd) {
@@ -200,7 +271,20 @@ int CSftpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 			bool found = engine_.GetDirectoryCache().LookupFile(entry, currentServer_, tryAbsolutePath_ ? remotePath_ : currentPath_, remoteFile_, dirDidExist, matchedCase);
 			if (!found) {
 				if (!dirDidExist) {
-					opState = filetransfer_waitlist;
+					// A single file is cheaper to look up than a large directory, but a
+					// further file of the same directory gets its directory listed.
+					switch (engine_.GetDirectoryCache().LookupStat(currentServer_, tryAbsolutePath_ ? remotePath_ : currentPath_, remoteFile_, statEntry_)) {
+					case CDirectoryCache::StatResult::found:
+						return OnStatResult(FZ_REPLY_OK);
+					case CDirectoryCache::StatResult::missing:
+						return OnStatResult(FZ_REPLY_ERROR_NOTFOUND);
+					case CDirectoryCache::StatResult::dir_known:
+						opState = filetransfer_waitlist;
+						break;
+					default:
+						opState = filetransfer_waitstat;
+						break;
+					}
 				}
 				else if (download() && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
 					opState = filetransfer_mtime;
@@ -234,7 +318,12 @@ int CSftpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 					}
 				}
 			}
-			if (opState == filetransfer_waitlist) {
+			if (opState == filetransfer_waitstat) {
+				// Look up just this file instead of listing a possibly huge directory
+				controlSocket_.Stat(tryAbsolutePath_ ? remotePath_ : currentPath_, remoteFile_, statEntry_);
+				return FZ_REPLY_CONTINUE;
+			}
+			else if (opState == filetransfer_waitlist) {
 				controlSocket_.List(CServerPath(), L"", LIST_FLAG_REFRESH);
 				return FZ_REPLY_CONTINUE;
 			}
@@ -250,6 +339,9 @@ int CSftpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 			opState = filetransfer_mtime;
 		}
 	}
+	else if (opState == filetransfer_waitstat) {
+		return OnStatResult(prevResult);
+	}
 	else if (opState == filetransfer_waitlist) {
 		if (prevResult == FZ_REPLY_OK) {
 			CDirentry entry;
@@ -308,6 +400,53 @@ int CSftpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 	return FZ_REPLY_CONTINUE;
 }
 
+int CSftpFileTransferOpData::FinishTransfer()
+{
+	if (options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (download()) {
+			if (!remoteFileTime_.empty()) {
+				if (!writer_factory_->set_mtime(remoteFileTime_)) {
+					log(logmsg::debug_warning, L"Could not set modification time");
+				}
+			}
+		}
+		else {
+			if (!localFileTime_.empty()) {
+				opState = filetransfer_chmtime;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+	}
+	return FZ_REPLY_OK;
+}
+
+int CSftpFileTransferOpData::OnChecksumResult(int result)
+{
+	if (result == FZ_REPLY_WOULDBLOCK) {
+		return result;
+	}
+
+	if (!transferInitiated_) {
+		// Comparing prior to the transfer
+		if (result == FZ_REPLY_OK) {
+			if (download()) {
+				log(logmsg::status, _("Skipping download of %s"), remotePath_.FormatFilename(remoteFile_));
+			}
+			else {
+				log(logmsg::status, _("Skipping upload of %s"), localName_);
+			}
+			return FZ_REPLY_OK;
+		}
+		opState = filetransfer_transfer;
+		return FZ_REPLY_CONTINUE;
+	}
+
+	if (result == FZ_REPLY_ERROR) {
+		return FZ_REPLY_ERROR;
+	}
+	return FinishTransfer();
+}
+
 void CSftpFileTransferOpData::OnOpenRequested(uint64_t offset)
 {
 	if (reader_ || writer_) {
@@ -315,10 +454,21 @@ void CSftpFileTransferOpData::OnOpenRequested(uint64_t offset)
 		return;
 	}
 
+	// Needs to be taken before opening the reader, it could claim all buffers otherwise
+	ring_lease_ = controlSocket_.buffer_pool_->get_buffer(*this);
+	if (!ring_lease_ || ring_lease_->capacity() < sizeof(sftp_io_ring) || reinterpret_cast<uintptr_t>(ring_lease_->get()) % alignof(sftp_io_ring)) {
+		log(logmsg::debug_warning, L"Could not set up descriptor ring");
+		ReleaseRing();
+		controlSocket_.AddToSendBuffer("--\n");
+		return;
+	}
+	ring_ = new (ring_lease_->get()) sftp_io_ring{};
+
 	if (download()) {
 		if (resume_) {
 			offset = writer_factory_.size();
 			if (offset == fz::aio_base::nosize) {
+				ReleaseRing();
 				controlSocket_.AddToSendBuffer("-1\n");
 				return;
 			}
@@ -326,20 +476,24 @@ void CSftpFileTransferOpData::OnOpenRequested(uint64_t offset)
 		else {
 			offset = 0;
 		}
-		writer_ = controlSocket_.OpenWriter(writer_factory_, offset, true);
+		writer_ = controlSocket_.OpenWriter(writer_factory_, offset, true, fsync());
 		if (!writer_) {
+			ReleaseRing();
 			controlSocket_.AddToSendBuffer("--\n");
 			return;
 		}
 	}
 	else {
-		reader_ = reader_factory_->open(*controlSocket_.buffer_pool_, offset, fz::aio_base::nosize, controlSocket_.max_buffer_count());
+		reader_ = controlSocket_.OpenReader(reader_factory_, offset);
 		if (!reader_) {
+			ReleaseRing();
 			controlSocket_.AddToSendBuffer("--\n");
 			return;
 		}
 	}
 	auto info = controlSocket_.buffer_pool_->shared_memory_info();
+	base_address_ = std::get<1>(info);
+	size_t const ring_offset = ring_lease_->get() - base_address_;
 #ifdef FZ_WINDOWS
 	HANDLE target;
 	if (!DuplicateHandle(GetCurrentProcess(), std::get<0>(info), controlSocket_.process_->handle(), &target, 0, false, DUPLICATE_SAME_ACCESS)) {
@@ -348,65 +502,169 @@ void CSftpFileTransferOpData::OnOpenRequested(uint64_t offset)
 		controlSocket_.ResetOperation(FZ_REPLY_ERROR);
 		return;
 	}
-	controlSocket_.AddToSendBuffer(fz::sprintf("-%u %u %u\n", reinterpret_cast<uintptr_t>(target), std::get<2>(info), offset));
+	controlSocket_.AddToSendBuffer(fz::sprintf("-%u %u %u %u\n", reinterpret_cast<uintptr_t>(target), std::get<2>(info), offset, ring_offset));
 #else
-	controlSocket_.AddToSendBuffer(fz::sprintf("-%d %u %u\n", std::get<0>(info), std::get<2>(info), offset));
+	controlSocket_.AddToSendBuffer(fz::sprintf("-%d %u %u %u\n", std::get<0>(info), std::get<2>(info), offset, ring_offset));
 #endif
-	base_address_ = std::get<1>(info);
+
+	Pump();
 }
 
+void CSftpFileTransferOpData::OnNextBufferRequested()
+{
+	Pump();
+}
 
-void CSftpFileTransferOpData::OnNextBufferRequested(uint64_t processed)
+void CSftpFileTransferOpData::Pump()
 {
+	if (!ring_ || finalizing_) {
+		return;
+	}
+
+	ring_->producer_waiting.store(0);
+	Reclaim();
+
 	if (reader_) {
-		fz::aio_result r;
-		std::tie(r, buffer_) = reader_->get_buffer(*this);
-		if (r == fz::aio_result::wait) {
-			return;
-		}
-		if (r == fz::aio_result::error) {
-			controlSocket_.AddToSendBuffer("--1\n");
-			return;
-		}
-		if (buffer_->size()) {
-			controlSocket_.AddToSendBuffer(fz::sprintf("-%d %d\n", buffer_->get() - base_address_, buffer_->size()));
-		}
-		else {
-			controlSocket_.AddToSendBuffer(fz::sprintf("-0\n"));
+		while (!ring_done_ && in_flight_.size() + 1 < sftp_io_ring_slots) {
+			fz::aio_result r;
+			fz::buffer_lease b;
+			std::tie(r, b) = reader_->get_buffer(*this);
+			if (r == fz::aio_result::wait) {
+				WaitForRelease();
+				break;
+			}
+			if (r == fz::aio_result::error) {
+				Push(-1, fz::buffer_lease());
+			}
+			else if (!b->size()) {
+				Push(0, fz::buffer_lease());
+			}
+			else {
+				int64_t const size = b->size();
+				Push(size, std::move(b));
+			}
 		}
 	}
 	else if (writer_) {
-		buffer_->resize(processed);
-		auto r = writer_->add_buffer(std::move(buffer_), *this);
-		if (r == fz::aio_result::ok) {
-			buffer_ = controlSocket_.buffer_pool_->get_buffer(*this);
-			if (!buffer_) {
-				r = fz::aio_result::wait;
+		if (!FeedWriter()) {
+			if (!ring_done_) {
+				Push(-1, fz::buffer_lease());
 			}
 		}
-		if (r == fz::aio_result::wait) {
-			return;
+		while (!ring_done_ && in_flight_.size() + 1 < sftp_io_ring_slots) {
+			fz::buffer_lease b = controlSocket_.buffer_pool_->get_buffer(*this);
+			if (!b) {
+				WaitForRelease();
+				break;
+			}
+			int64_t const size = b->capacity();
+			Push(size, std::move(b));
+		}
+	}
+
+	WakeConsumer();
+}
+
+void CSftpFileTransferOpData::Push(int64_t size, fz::buffer_lease && b)
+{
+	auto & slot = ring_->slots[head_ % sftp_io_ring_slots];
+	slot.offset = b ? static_cast<uint64_t>(b->get() - base_address_) : 0;
+	slot.size = size;
+	if (b) {
+		in_flight_.push_back(std::move(b));
+	}
+	else {
+		// EOF or error, fzsftp won't ask for anything past it
+		ring_done_ = true;
+	}
+	ring_->head.store(++head_, std::memory_order_release);
+}
+
+void CSftpFileTransferOpData::Reclaim()
+{
+	uint64_t const tail = ring_->tail.load(std::memory_order_acquire);
+	for (; tail_ < tail && !in_flight_.empty(); ++tail_) {
+		if (writer_) {
+			auto & b = in_flight_.front();
+			int64_t const used = ring_->slots[tail_ % sftp_io_ring_slots].size;
+			b->resize(used > 0 ? std::min(static_cast<size_t>(used), b->capacity()) : 0);
+			completed_.push_back(std::move(b));
 		}
+		in_flight_.pop_front();
+	}
+}
+
+bool CSftpFileTransferOpData::FeedWriter()
+{
+	while (!completed_.empty() && !writer_waiting_) {
+		auto r = writer_->add_buffer(std::move(completed_.front()), *this);
+		completed_.pop_front();
 		if (r == fz::aio_result::error) {
-			controlSocket_.AddToSendBuffer("--1\n");
-			return;
+			completed_.clear();
+			return false;
 		}
-		controlSocket_.AddToSendBuffer(fz::sprintf("-%d %d\n", buffer_->get() - base_address_, buffer_->capacity()));
+		writer_waiting_ = r == fz::aio_result::wait;
 	}
-	else {
-		controlSocket_.AddToSendBuffer("--1\n");
+	return true;
+}
+
+void CSftpFileTransferOpData::WaitForRelease()
+{
+	if (in_flight_.empty()) {
 		return;
 	}
+
+	// Have fzsftp wake us once half the buffers are back, not for each single one.
+	// No need to recheck the tail, fzsftp also wakes us before waiting itself.
+	ring_->wake_below.store(static_cast<uint32_t>(in_flight_.size() / 2), std::memory_order_relaxed);
+	ring_->producer_waiting.store(1);
 }
 
-void CSftpFileTransferOpData::OnFinalizeRequested(uint64_t lastWrite)
+void CSftpFileTransferOpData::WakeConsumer()
 {
-	finalizing_ = true;
-	buffer_->resize(lastWrite);
-	auto r = writer_->add_buffer(std::move(buffer_), *this);
-	if (r == fz::aio_result::ok) {
-		r = writer_->finalize(*this);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (ring_->consumer_waiting.load(std::memory_order_relaxed) && ring_->tail.load(std::memory_order_acquire) != head_) {
+		if (ring_->consumer_waiting.exchange(0)) {
+			controlSocket_.AddToSendBuffer("-\n");
+		}
 	}
+}
+
+void CSftpFileTransferOpData::ReleaseRing()
+{
+	in_flight_.clear();
+	completed_.clear();
+	ring_ = nullptr;
+	ring_lease_ = fz::buffer_lease();
+	head_ = 0;
+	tail_ = 0;
+	ring_done_ = false;
+}
+
+void CSftpFileTransferOpData::OnFinalizeRequested()
+{
+	if (!writer_ || !ring_) {
+		controlSocket_.AddToSendBuffer("-0\n");
+		return;
+	}
+
+	if (!finalizing_) {
+		finalizing_ = true;
+		Reclaim();
+
+		// Buffers fzsftp did not get to anymore
+		in_flight_.clear();
+	}
+
+	if (!FeedWriter()) {
+		controlSocket_.AddToSendBuffer("-0\n");
+		return;
+	}
+	if (writer_waiting_) {
+		return;
+	}
+
+	auto r = writer_->finalize(*this);
 	if (r == fz::aio_result::wait) {
 		return;
 	}
@@ -444,15 +702,12 @@ void CSftpFileTransferOpData::operator()(fz::event_base const& ev)
 
 void CSftpFileTransferOpData::OnBufferAvailability(fz::aio_waitable const* w)
 {
-	if (w == reader_.get()) {
-		OnNextBufferRequested(0);
-	}
-	else if (w == writer_.get()) {
+	if (w == writer_.get()) {
+		writer_waiting_ = false;
 		if (finalizing_) {
-			OnFinalizeRequested(0);
-		}
-		else {
-			OnNextBufferRequested(0);
+			OnFinalizeRequested();
+			return;
 		}
 	}
+	Pump();
 }
@@ -3,6 +3,10 @@
 
 #include "sftpcontrolsocket.h"
 
+#include <deque>
+
+struct sftp_io_ring;
+
 class CSftpFileTransferOpData final : public CFileTransferOpData, public CSftpOpData, public fz::event_handler
 {
 public:
@@ -16,8 +20,8 @@ public:
 
 	void OnSizeRequested();
 	void OnOpenRequested(uint64_t offset);
-	void OnNextBufferRequested(uint64_t processed);
-	void OnFinalizeRequested(uint64_t lastWrite);
+	void OnNextBufferRequested();
+	void OnFinalizeRequested();
 
 	virtual int Send() override;
 	virtual int ParseResponse() override;
@@ -27,12 +31,43 @@ private:
 	virtual void operator()(fz::event_base const& ev) override;
 	void OnBufferAvailability(fz::aio_waitable const* w);
 
+	int OnChecksumResult(int result);
+
+	// Continues with the result of the single-file lookup into statEntry_
+	int OnStatResult(int result);
+
+	// Filled in by the single-file lookup
+	CDirentry statEntry_;
+
+	// Sets the timestamp once the transfer is done
+	int FinishTransfer();
+
+	// Moves buffers between the descriptor ring and the reader or writer
+	void Pump();
+	void Push(int64_t size, fz::buffer_lease && b);
+	void Reclaim();
+	bool FeedWriter();
+	void WaitForRelease();
+	void WakeConsumer();
+	void ReleaseRing();
+
 	std::unique_ptr<fz::reader_base> reader_;
 	std::unique_ptr<fz::writer_base> writer_;
+	bool writer_waiting_{};
 	bool finalizing_{};
 
 	uint8_t const* base_address_{};
-	fz::buffer_lease buffer_;
+
+	fz::buffer_lease ring_lease_;
+	sftp_io_ring* ring_{};
+	uint64_t head_{};
+	uint64_t tail_{};
+	bool ring_done_{};
+
+	// Handed to fzsftp in ring order, and for downloads the filled buffers
+	// not yet accepted by the writer.
+	std::deque<fz::buffer_lease> in_flight_;
+	std::deque<fz::buffer_lease> completed_;
 };
 
 #endif
@@ -50,6 +50,7 @@ size_t SftpInputParser::lines(sftpEvent eventType) const
 	case sftpEvent::io_open:
 	case sftpEvent::io_finalize:
 	case sftpEvent::io_nextbuf:
+	case sftpEvent::BatchResult:
 		return 1;
 	case sftpEvent::AskHostkey:
 	case sftpEvent::AskHostkeyChanged:
@@ -0,0 +1,34 @@
+#ifndef FILEZILLA_ENGINE_SFTP_IO_RING_HEADER
+#define FILEZILLA_ENGINE_SFTP_IO_RING_HEADER
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Single-producer/single-consumer descriptor ring shared with fzsftp, see
+// fzsftp_ring in putty/fzsftp.h for the protocol. The layout has to match.
+//
+// The engine is always the producer: Filled buffers are handed to fzsftp for
+// uploads, empty buffers for downloads.
+size_t const sftp_io_ring_slots = 32;
+
+struct sftp_io_ring_slot final
+{
+	uint64_t offset;
+	int64_t size;
+};
+
+struct sftp_io_ring final
+{
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) std::atomic<uint32_t> consumer_waiting;
+	alignas(64) std::atomic<uint32_t> producer_waiting;
+	std::atomic<uint32_t> wake_below;
+	alignas(64) sftp_io_ring_slot slots[sftp_io_ring_slots];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8 && std::atomic<uint64_t>::is_always_lock_free, "Ring indexes need to be lock-free to be shared with fzsftp");
+static_assert(sizeof(sftp_io_ring) == 256 + sftp_io_ring_slots * 16, "Layout has to match fzsftp_ring");
+
+#endif
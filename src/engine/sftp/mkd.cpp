@@ -3,6 +3,8 @@
 #include "../directorycache.h"
 #include "mkd.h"
 
+#include <algorithm>
+
 namespace {
 enum mkdStates
 {
@@ -140,3 +142,69 @@ int CSftpMkdirOpData::ParseResponse()
 
 	return FZ_REPLY_INTERNALERROR;
 }
+
+namespace {
+// Number of directories per mkdirs command, fzsftp sends all requests of a
+// command before waiting for the replies.
+size_t const mkdirs_batch_size = 64;
+}
+
+int CSftpMkdirManyOpData::Send()
+{
+	if (!opState) {
+		FilterKnown(engine_.GetDirectoryCache(), currentServer_);
+		if (paths_.empty()) {
+			return FZ_REPLY_OK;
+		}
+
+		log(logmsg::status, fztranslate("Creating %u directory...", "Creating %u directories...", paths_.size()), paths_.size());
+		opState = 1;
+	}
+
+	std::wstring cmd = L"mkdirs";
+	sent_ = std::min(paths_.size(), done_ + mkdirs_batch_size);
+	for (size_t i = done_; i < sent_; ++i) {
+		cmd += L" " + controlSocket_.QuoteFilename(paths_[i].GetPath());
+	}
+	return controlSocket_.SendCommand(cmd);
+}
+
+int CSftpMkdirManyOpData::ParseResponse()
+{
+	if (controlSocket_.result_ != FZ_REPLY_OK) {
+		return controlSocket_.result_;
+	}
+
+	// One character per directory, 1 if it got created, 2 if it existed already
+	auto const& response = controlSocket_.response_;
+	if (response.size() != sent_ - done_) {
+		log(logmsg::debug_warning, L"Malformed mkdirs reply: %s", response);
+		return FZ_REPLY_ERROR;
+	}
+
+	for (auto const c : response) {
+		CServerPath const& path = paths_[done_++];
+		if (c == '1' || c == '2') {
+			Created(engine_.GetDirectoryCache(), currentServer_, path);
+		}
+		else {
+			++failed_;
+		}
+	}
+
+	if (done_ < paths_.size()) {
+		return FZ_REPLY_CONTINUE;
+	}
+
+	for (auto const& parent : changedParents_) {
+		controlSocket_.SendDirectoryListingNotification(parent, false);
+	}
+
+	if (failed_) {
+		// Not fatal, the transfers create missing directories themselves
+		log(logmsg::debug_warning, L"%u directories could not be created", failed_);
+		return FZ_REPLY_ERROR;
+	}
+
+	return FZ_REPLY_OK;
+}
@@ -15,4 +15,20 @@ public:
 	virtual int ParseResponse() override;
 };
 
+class CSftpMkdirManyOpData final : public CMkdirManyOpData, public CSftpOpData
+{
+public:
+	CSftpMkdirManyOpData(CSftpControlSocket & controlSocket, std::vector<CServerPath> const& paths)
+		: CMkdirManyOpData(L"CSftpMkdirManyOpData", paths)
+		, CSftpOpData(controlSocket)
+	{}
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+
+private:
+	size_t done_{};
+	size_t sent_{};
+};
+
 #endif
@@ -12,6 +12,7 @@
 #include "rename.h"
 #include "rmd.h"
 #include "sftpcontrolsocket.h"
+#include "stat.h"
 
 #include "../directorycache.h"
 #include "../directorylistingparser.h"
@@ -260,7 +261,7 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 	case sftpEvent::io_nextbuf:
 		if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
 			auto & data = static_cast<CSftpFileTransferOpData&>(*operations_.back());
-			data.OnNextBufferRequested(fz::to_integral<uint64_t>(message.text[0]));
+			data.OnNextBufferRequested();
 		}
 		break;
 	case sftpEvent::io_open:
@@ -278,7 +279,23 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 	case sftpEvent::io_finalize:
 		if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
 			auto & data = static_cast<CSftpFileTransferOpData&>(*operations_.back());
-			data.OnFinalizeRequested(fz::to_integral<uint64_t>(message.text[0]));
+			data.OnFinalizeRequested();
+		}
+		break;
+	case sftpEvent::BatchResult:
+		if (!operations_.empty()) {
+			auto tokens = fz::strtok_view(message.text[0], ' ');
+			if (tokens.size() != 2) {
+				break;
+			}
+			size_t const index = fz::to_integral<size_t>(tokens[0], size_t(-1));
+			bool const success = tokens[1] == L"1";
+			if (operations_.back()->opId == Command::del) {
+				static_cast<CSftpDeleteOpData&>(*operations_.back()).OnBatchResult(index, success);
+			}
+			else if (auto * data = dynamic_cast<CSftpChmodManyOpData*>(operations_.back().get())) {
+				data->OnBatchResult(index, success);
+			}
 		}
 		break;
 	default:
@@ -534,6 +551,12 @@ void CSftpControlSocket::Cancel()
 	}
 }
 
+size_t CSftpControlSocket::max_buffer_count() const
+{
+	size_t const count = CControlSocket::max_buffer_count();
+	return count > 1 ? count - 1 : count;
+}
+
 void CSftpControlSocket::Mkdir(CServerPath const& path, transfer_flags const&)
 {
 	auto pData = std::make_unique<CSftpMkdirOpData>(*this);
@@ -541,6 +564,11 @@ void CSftpControlSocket::Mkdir(CServerPath const& path, transfer_flags const&)
 	Push(std::move(pData));
 }
 
+void CSftpControlSocket::Mkdir(std::vector<CServerPath> const& paths, transfer_flags const&)
+{
+	Push(std::make_unique<CSftpMkdirManyOpData>(*this, paths));
+}
+
 std::wstring CSftpControlSocket::QuoteFilename(std::wstring const& filename)
 {
 	return L"\"" + fz::replaced_substrings(filename, L"\"", L"\"\"") + L"\"";
@@ -574,6 +602,16 @@ void CSftpControlSocket::Chmod(CChmodCommand const& command)
 	Push(std::make_unique<CSftpChmodOpData>(*this, command));
 }
 
+void CSftpControlSocket::Chmod(CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> const& entries)
+{
+	Push(std::make_unique<CSftpChmodManyOpData>(*this, path, entries));
+}
+
+void CSftpControlSocket::Stat(CServerPath const& path, std::wstring const& file, CDirentry & entry)
+{
+	Push(std::make_unique<CSftpStatOpData>(*this, path, file, entry));
+}
+
 void CSftpControlSocket::Rename(CRenameCommand const& command)
 {
 	Push(std::make_unique<CSftpRenameOpData>(*this, command));
@@ -23,12 +23,18 @@ public:
 	virtual void Delete(CServerPath const& path, std::vector<std::wstring>&& files) override;
 	virtual void RemoveDir(CServerPath const& path = CServerPath(), std::wstring const& subDir = std::wstring()) override;
 	virtual void Mkdir(CServerPath const& path, transfer_flags const& flags = {}) override;
+	virtual void Mkdir(std::vector<CServerPath> const& paths, transfer_flags const& flags) override;
 	virtual void Rename(CRenameCommand const& command) override;
 	virtual void Chmod(CChmodCommand const& command) override;
+	virtual void Chmod(CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> const& entries) override;
+	virtual void Stat(CServerPath const& path, std::wstring const& file, CDirentry & entry) override;
 	virtual void Cancel() override;
 
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) override;
 
+	// One buffer of the pool holds the descriptor ring shared with fzsftp
+	virtual size_t max_buffer_count() const override;
+
 protected:
 	virtual void Push(std::unique_ptr<COpData> && pNewOpData) override;
 
@@ -69,13 +75,16 @@ protected:
 	friend class CProtocolOpData<CSftpControlSocket>;
 	friend class CSftpChangeDirOpData;
 	friend class CSftpChmodOpData;
+	friend class CSftpChmodManyOpData;
 	friend class CSftpConnectOpData;
 	friend class CSftpDeleteOpData;
 	friend class CSftpFileTransferOpData;
 	friend class CSftpListOpData;
 	friend class CSftpMkdirOpData;
+	friend class CSftpMkdirManyOpData;
 	friend class CSftpRemoveDirOpData;
 	friend class CSftpRenameOpData;
+	friend class CSftpStatOpData;
 };
 
 typedef CProtocolOpData<CSftpControlSocket> CSftpOpData;
@@ -0,0 +1,48 @@
+#include "../filezilla.h"
+
+#include "stat.h"
+#include "../directorycache.h"
+
+int CSftpStatOpData::Send()
+{
+	return controlSocket_.SendCommand(L"stat " + controlSocket_.QuoteFilename(path_.FormatFilename(file_)));
+}
+
+int CSftpStatOpData::ParseResponse()
+{
+	if (controlSocket_.result_ != FZ_REPLY_OK) {
+		return controlSocket_.result_;
+	}
+
+	// Either a question mark if not found, or type, size and modification time
+	auto const& response = controlSocket_.response_;
+	if (response == L"?") {
+		engine_.GetDirectoryCache().StoreStat(currentServer_, path_, file_, nullptr);
+		return FZ_REPLY_ERROR_NOTFOUND;
+	}
+
+	auto const tokens = fz::strtok_view(response, L" ");
+	if (tokens.size() != 3 || tokens[0].size() != 1) {
+		log(logmsg::debug_warning, L"Malformed stat reply: %s", response);
+		return FZ_REPLY_ERROR;
+	}
+
+	CDirentry entry;
+	entry.name = file_;
+	if (tokens[0][0] == 'd') {
+		entry.flags |= CDirentry::flag_dir;
+	}
+	entry.size = fz::to_integral<int64_t>(tokens[1], -1);
+
+	auto const mtime = fz::to_integral<int64_t>(tokens[2]);
+	if (mtime > 0) {
+		entry.time = fz::datetime(static_cast<time_t>(mtime), fz::datetime::seconds);
+		entry.time += fz::duration::from_minutes(currentServer_.GetTimezoneOffset());
+	}
+
+	entry_ = entry;
+	engine_.GetDirectoryCache().UpdateEntry(currentServer_, path_, entry_);
+	engine_.GetDirectoryCache().StoreStat(currentServer_, path_, file_, &entry_);
+
+	return FZ_REPLY_OK;
+}
@@ -0,0 +1,27 @@
+#ifndef FILEZILLA_ENGINE_SFTP_STAT_HEADER
+#define FILEZILLA_ENGINE_SFTP_STAT_HEADER
+
+#include "sftpcontrolsocket.h"
+
+// Looks up a single file using fzsftp's stat command
+class CSftpStatOpData final : public COpData, public CSftpOpData
+{
+public:
+	CSftpStatOpData(CSftpControlSocket & controlSocket, CServerPath const& path, std::wstring const& file, CDirentry & entry)
+		: COpData(Command::lookup, L"CSftpStatOpData")
+		, CSftpOpData(controlSocket)
+		, path_(path)
+		, file_(file)
+		, entry_(entry)
+	{}
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+
+private:
+	CServerPath const path_;
+	std::wstring const file_;
+	CDirentry & entry_;
+};
+
+#endif
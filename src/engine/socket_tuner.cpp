@@ -0,0 +1,142 @@
+#include "filezilla.h"
+#include "socket_tuner.h"
+
+#include "../include/engine_options.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace {
+int const max_buffer_size = 32 * 1024 * 1024;
+int const granularity = 64 * 1024;
+
+// Round-trip time as smoothed by the kernel, zero if not available
+fz::duration kernel_rtt([[maybe_unused]] fz::socket & socket)
+{
+#ifdef __linux__
+	tcp_info info{};
+	socklen_t len = sizeof(info);
+	if (!getsockopt(socket.get_descriptor(), IPPROTO_TCP, TCP_INFO, &info, &len) && info.tcpi_rtt) {
+		return fz::duration::from_microseconds(info.tcpi_rtt);
+	}
+#endif
+	return {};
+}
+
+// The size the kernel has actually granted, it silently caps requests,
+// e.g. at net.core.rmem_max or net.core.wmem_max on Linux.
+int effective_size([[maybe_unused]] fz::socket & socket, bool receive, int requested)
+{
+#ifdef __linux__
+	int value{};
+	socklen_t len = sizeof(value);
+	if (!getsockopt(socket.get_descriptor(), SOL_SOCKET, receive ? SO_RCVBUF : SO_SNDBUF, &value, &len)) {
+		// Reported doubled to include the kernel's bookkeeping overhead
+		return value / 2;
+	}
+#endif
+	return requested;
+}
+}
+
+bool socket_buffer_tuner::can_tune([[maybe_unused]] bool receive)
+{
+#ifdef __linux__
+	// The receive window is clamped to the buffer size in effect during the
+	// handshake, growing the buffer later does not open the window.
+	return !receive;
+#else
+	return true;
+#endif
+}
+
+socket_buffer_budget::socket_buffer_budget(COptionsBase & options)
+	: options_(options)
+{
+}
+
+int64_t socket_buffer_budget::resize(int64_t current, int64_t wanted)
+{
+	int64_t const limit = static_cast<int64_t>(options_.get_int(OPTION_SOCKET_BUFFER_MEMORY_LIMIT)) * 1024 * 1024;
+
+	fz::scoped_lock l(mtx_);
+	used_ -= current;
+	if (wanted > 0) {
+		wanted = std::min(wanted, std::max(int64_t(0), limit - used_));
+		used_ += wanted;
+	}
+	else {
+		wanted = 0;
+	}
+	return wanted;
+}
+
+socket_buffer_tuner::socket_buffer_tuner(socket_buffer_budget & budget, int base_size, bool receive)
+	: budget_(budget)
+	, base_size_(base_size)
+	, receive_(receive)
+	, size_(base_size)
+	, ceiling_(std::max(base_size, max_buffer_size))
+	, last_(fz::monotonic_clock::now())
+{
+}
+
+socket_buffer_tuner::~socket_buffer_tuner()
+{
+	budget_.resize(reserved_, 0);
+}
+
+int socket_buffer_tuner::update(fz::socket & socket, uint64_t transferred, fz::duration const& fallback_rtt)
+{
+	auto const now = fz::monotonic_clock::now();
+	auto const elapsed = now - last_;
+	last_ = now;
+	if (elapsed.get_milliseconds() <= 0) {
+		return -1;
+	}
+
+	auto rtt = kernel_rtt(socket);
+	if (!rtt) {
+		rtt = fallback_rtt;
+	}
+	if (rtt.get_microseconds() <= 0) {
+		return -1;
+	}
+
+	// Bytes in flight over one round trip at the observed rate. Twice that
+	// leaves room for the window to grow if the buffer has been the limit.
+	int64_t const bdp = static_cast<int64_t>(transferred) * rtt.get_microseconds() / (elapsed.get_milliseconds() * 1000);
+	int64_t target = std::min(int64_t(max_buffer_size), bdp * 2);
+	target = (target + granularity - 1) / granularity * granularity;
+	target = std::max(int64_t(base_size_), std::min(target, int64_t(ceiling_)));
+
+	// Shrink only if far off, so that short stalls do not throw away the window
+	if (target <= size_ && target * 2 > size_) {
+		return -1;
+	}
+
+	reserved_ = budget_.resize(reserved_, target - base_size_);
+	int const size = base_size_ + static_cast<int>(reserved_);
+	if (size == size_) {
+		return -1;
+	}
+
+	int const res = receive_ ? socket.set_buffer_sizes(size, -1) : socket.set_buffer_sizes(-1, size);
+	int const actual = res ? size_ : effective_size(socket, receive_, size);
+	if (actual < size) {
+		// Only account what got granted and stop asking for more
+		reserved_ = budget_.resize(reserved_, std::max(0, actual - base_size_));
+		ceiling_ = base_size_ + static_cast<int>(reserved_);
+		if (ceiling_ == size_) {
+			return -1;
+		}
+	}
+	size_ = base_size_ + static_cast<int>(reserved_);
+
+	return actual;
+}
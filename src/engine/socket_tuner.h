@@ -0,0 +1,72 @@
+#ifndef FILEZILLA_ENGINE_SOCKET_TUNER_HEADER
+#define FILEZILLA_ENGINE_SOCKET_TUNER_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/socket.hpp>
+#include <libfilezilla/time.hpp>
+
+class COptionsBase;
+
+// Memory shared by the kernel buffers of all data connections of an engine
+// context. Only the part of a buffer exceeding the configured base size is
+// accounted, so that many idle connections do not eat into the budget.
+class socket_buffer_budget final
+{
+public:
+	explicit socket_buffer_budget(COptionsBase & options);
+
+	socket_buffer_budget(socket_buffer_budget const&) = delete;
+	socket_buffer_budget& operator=(socket_buffer_budget const&) = delete;
+
+	// Changes a reservation from current to wanted bytes. Returns the new
+	// reservation, which may be less than wanted if the limit is reached.
+	int64_t resize(int64_t current, int64_t wanted);
+
+private:
+	COptionsBase & options_;
+
+	fz::mutex mtx_{false};
+	int64_t used_{};
+};
+
+// Sizes the socket buffers of a single data connection to its measured
+// bandwidth-delay product.
+//
+// Needs to be updated periodically with the number of bytes transferred since
+// the last update. The round-trip time is taken from the kernel where
+// available, otherwise the fallback, e.g. the latency of the control
+// connection, is used.
+class socket_buffer_tuner final
+{
+public:
+	socket_buffer_tuner(socket_buffer_budget & budget, int base_size, bool receive);
+	~socket_buffer_tuner();
+
+	socket_buffer_tuner(socket_buffer_tuner const&) = delete;
+	socket_buffer_tuner& operator=(socket_buffer_tuner const&) = delete;
+
+	// Returns the new buffer size as granted by the system if it has been
+	// changed, -1 otherwise.
+	int update(fz::socket & socket, uint64_t transferred, fz::duration const& fallback_rtt);
+
+	// Whether tuning has any effect for buffers of the given direction
+	static bool can_tune(bool receive);
+
+	int size() const { return size_; }
+
+private:
+	socket_buffer_budget & budget_;
+
+	int const base_size_;
+	bool const receive_;
+
+	int size_;
+	int64_t reserved_{};
+
+	// Lowered if the system grants less than requested
+	int ceiling_;
+
+	fz::monotonic_clock last_;
+};
+
+#endif
@@ -106,13 +106,13 @@ int CStorjFileTransferOpData::Send()
 		{
 		    uint64_t offset{};
 			if (download()) {
-				writer_ = controlSocket_.OpenWriter(writer_factory_, offset, true);
+				writer_ = controlSocket_.OpenWriter(writer_factory_, offset, true, fsync());
 				if (!writer_) {
 					return FZ_REPLY_CRITICALERROR;
 				}
 			}
 			else {
-				reader_ = reader_factory_->open(*controlSocket_.buffer_pool_, offset, fz::aio_base::nosize, controlSocket_.max_buffer_count());
+				reader_ = controlSocket_.OpenReader(reader_factory_, offset);
 				if (!reader_) {
 					return FZ_REPLY_CRITICALERROR;
 				}
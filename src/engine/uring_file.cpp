@@ -0,0 +1,867 @@
+#include "filezilla.h"
+
+#include "uring_file.h"
+
+#ifdef HAVE_LIBURING
+
+#include <libfilezilla/thread_pool.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <liburing.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+size_t const slot_size = 1024 * 1024;
+size_t const queue_depth = 16;
+
+// Required by O_DIRECT for buffers, offsets and lengths
+size_t const alignment = 4096;
+
+// Smaller files are not worth bypassing the page cache
+uint64_t const direct_threshold = 1024ull * 1024 * 1024;
+
+uint64_t const wakeup_marker = ~uint64_t(0);
+
+size_t const no_slot = std::numeric_limits<size_t>::max();
+
+class uring final
+{
+public:
+	uring() = default;
+	~uring();
+
+	uring(uring const&) = delete;
+	uring& operator=(uring const&) = delete;
+
+	bool init();
+
+	uint8_t* buffer(size_t slot) { return memory_ + slot * slot_size; }
+
+	bool prep_read(int fd, size_t slot, size_t pos, size_t len, uint64_t offset);
+	bool prep_write(int fd, size_t slot, size_t pos, size_t len, uint64_t offset);
+	bool prep_wakeup();
+
+	io_uring ring_{};
+
+private:
+	bool initialized_{};
+
+	// Registration can fail, e.g. due to RLIMIT_MEMLOCK. The buffers are then
+	// used with regular reads and writes.
+	bool registered_{};
+
+	uint8_t* memory_{};
+};
+
+uring::~uring()
+{
+	if (initialized_) {
+		io_uring_queue_exit(&ring_);
+	}
+	free(memory_);
+}
+
+bool uring::init()
+{
+	// Room for the wakeup and for resubmitting short reads or writes
+	if (io_uring_queue_init(queue_depth * 2, &ring_, 0) < 0) {
+		return false;
+	}
+	initialized_ = true;
+
+	void* p{};
+	if (posix_memalign(&p, alignment, queue_depth * slot_size)) {
+		return false;
+	}
+	memory_ = static_cast<uint8_t*>(p);
+
+	std::vector<iovec> iov(queue_depth);
+	for (size_t i = 0; i < queue_depth; ++i) {
+		iov[i].iov_base = buffer(i);
+		iov[i].iov_len = slot_size;
+	}
+	registered_ = io_uring_register_buffers(&ring_, iov.data(), static_cast<unsigned int>(iov.size())) == 0;
+
+	return true;
+}
+
+bool uring::prep_read(int fd, size_t slot, size_t pos, size_t len, uint64_t offset)
+{
+	io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+	if (!sqe) {
+		return false;
+	}
+	if (registered_) {
+		io_uring_prep_read_fixed(sqe, fd, buffer(slot) + pos, static_cast<unsigned int>(len), offset, static_cast<int>(slot));
+	}
+	else {
+		io_uring_prep_read(sqe, fd, buffer(slot) + pos, static_cast<unsigned int>(len), offset);
+	}
+	sqe->user_data = slot;
+	return true;
+}
+
+bool uring::prep_write(int fd, size_t slot, size_t pos, size_t len, uint64_t offset)
+{
+	io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+	if (!sqe) {
+		return false;
+	}
+	if (registered_) {
+		io_uring_prep_write_fixed(sqe, fd, buffer(slot) + pos, static_cast<unsigned int>(len), offset, static_cast<int>(slot));
+	}
+	else {
+		io_uring_prep_write(sqe, fd, buffer(slot) + pos, static_cast<unsigned int>(len), offset);
+	}
+	sqe->user_data = slot;
+	return true;
+}
+
+bool uring::prep_wakeup()
+{
+	io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+	if (!sqe) {
+		return false;
+	}
+	io_uring_prep_nop(sqe);
+	sqe->user_data = wakeup_marker;
+	return true;
+}
+
+bool set_direct(int fd, bool direct)
+{
+	int const flags = fcntl(fd, F_GETFL);
+	if (flags == -1) {
+		return false;
+	}
+	return fcntl(fd, F_SETFL, direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT)) == 0;
+}
+
+
+class uring_reader final : public fz::reader_base
+{
+public:
+	uring_reader(std::wstring const& name, fz::aio_buffer_pool & pool, size_t max_buffers, fz::thread_pool & tpool);
+	virtual ~uring_reader();
+
+	bool open(uint64_t offset, uint64_t size, bool direct);
+
+private:
+	virtual std::pair<fz::aio_result, fz::buffer_lease> do_get_buffer(fz::scoped_lock & l) override;
+	virtual bool do_seek(fz::scoped_lock & l) override;
+	virtual void do_close(fz::scoped_lock & l) override;
+
+	virtual void on_buffer_availability(fz::aio_waitable const* w) override;
+
+	void entry();
+	void on_read(size_t i, int res);
+
+	// Keeps all free slots busy reading ahead
+	void fill();
+	void stop();
+
+	struct slot final
+	{
+		enum class state
+		{
+			free,
+			reading,
+			ready,
+
+			// Still being read into, but no longer needed after a seek
+			stale
+		};
+
+		uint64_t offset_{};
+		size_t skip_{};   // Leading bytes before the range, only with O_DIRECT
+		size_t want_{};   // Bytes belonging to the range
+		size_t size_{};   // Bytes requested, want_ rounded up to the alignment with O_DIRECT
+		size_t filled_{};
+		size_t consumed_{};
+		state state_{state::free};
+	};
+
+	fz::thread_pool & tpool_;
+	fz::async_task task_;
+
+	int fd_{-1};
+	bool direct_{};
+	uring ring_;
+
+	std::vector<slot> slots_;
+	std::deque<size_t> order_;
+	std::vector<size_t> free_;
+
+	// Next offset to read from and end of the range
+	uint64_t next_{};
+	uint64_t end_{};
+
+	size_t pending_{};
+	bool waiting_{};
+	bool quit_{};
+};
+
+uring_reader::uring_reader(std::wstring const& name, fz::aio_buffer_pool & pool, size_t max_buffers, fz::thread_pool & tpool)
+	: fz::reader_base(name, pool, max_buffers)
+	, tpool_(tpool)
+{
+}
+
+uring_reader::~uring_reader()
+{
+	if (task_) {
+		{
+			fz::scoped_lock l(mtx_);
+			stop();
+		}
+		task_.join();
+	}
+	if (fd_ != -1) {
+		::close(fd_);
+	}
+
+	buffer_pool_.remove_waiter(*this);
+	remove_waiters();
+}
+
+bool uring_reader::open(uint64_t offset, uint64_t size, bool direct)
+{
+	fd_ = ::open(fz::to_native(name()).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd_ == -1) {
+		return false;
+	}
+
+	struct stat st{};
+	if (fstat(fd_, &st) || st.st_size < 0) {
+		return false;
+	}
+	uint64_t const file_size = static_cast<uint64_t>(st.st_size);
+	if (offset > file_size) {
+		return false;
+	}
+	if (size == fz::aio_base::nosize) {
+		size = file_size - offset;
+	}
+	else if (size > file_size - offset) {
+		return false;
+	}
+
+	direct_ = direct && size >= direct_threshold && set_direct(fd_, true);
+#if HAVE_POSIX_FADVISE
+	if (!direct_) {
+		posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_SEQUENTIAL);
+	}
+#endif
+
+	if (!ring_.init()) {
+		return false;
+	}
+
+	slots_.resize(queue_depth);
+	for (size_t i = queue_depth; i > 0; --i) {
+		free_.push_back(i - 1);
+	}
+
+	task_ = tpool_.spawn([this]() { entry(); });
+	if (!task_) {
+		return false;
+	}
+
+	fz::scoped_lock l(mtx_);
+	max_size_ = file_size;
+	start_offset_ = offset;
+	size_ = size;
+	remaining_ = size;
+
+	next_ = offset;
+	end_ = offset + size;
+	fill();
+
+	return !error_;
+}
+
+void uring_reader::fill()
+{
+	bool added{};
+	while (!quit_ && !error_ && !free_.empty() && next_ < end_) {
+		size_t const i = free_.back();
+		auto & s = slots_[i];
+
+		s.offset_ = direct_ ? (next_ - next_ % alignment) : next_;
+		s.skip_ = static_cast<size_t>(next_ - s.offset_);
+		s.want_ = static_cast<size_t>(std::min(static_cast<uint64_t>(slot_size - s.skip_), end_ - next_));
+		s.size_ = s.skip_ + s.want_;
+		if (direct_ && s.size_ % alignment) {
+			s.size_ += alignment - s.size_ % alignment;
+		}
+		s.filled_ = 0;
+		s.consumed_ = 0;
+
+		if (!ring_.prep_read(fd_, i, 0, s.size_, s.offset_)) {
+			break;
+		}
+		s.state_ = slot::state::reading;
+		++pending_;
+		added = true;
+
+		free_.pop_back();
+		order_.push_back(i);
+		next_ += s.want_;
+	}
+
+	if (added && io_uring_submit(&ring_.ring_) < 0) {
+		error_ = true;
+	}
+}
+
+void uring_reader::stop()
+{
+	if (quit_) {
+		return;
+	}
+	quit_ = true;
+	if (ring_.prep_wakeup()) {
+		++pending_;
+		io_uring_submit(&ring_.ring_);
+	}
+}
+
+void uring_reader::entry()
+{
+	while (true) {
+		io_uring_cqe* cqe{};
+		int const r = io_uring_wait_cqe(&ring_.ring_, &cqe);
+
+		fz::scoped_lock l(mtx_);
+		if (r < 0) {
+			if (r == -EINTR) {
+				continue;
+			}
+			error_ = true;
+			signal_availibility();
+			break;
+		}
+
+		uint64_t const data = cqe->user_data;
+		int const res = cqe->res;
+		io_uring_cqe_seen(&ring_.ring_, cqe);
+
+		--pending_;
+		if (data != wakeup_marker) {
+			on_read(static_cast<size_t>(data), res);
+		}
+		if (quit_ && !pending_) {
+			break;
+		}
+	}
+}
+
+void uring_reader::on_read(size_t i, int res)
+{
+	auto & s = slots_[i];
+	if (s.state_ == slot::state::stale) {
+		s.state_ = slot::state::free;
+		free_.push_back(i);
+		fill();
+
+		// A reader waiting for a slot gets woken up once the new read is
+		// ready, unless the read could not be started.
+		if (waiting_ && (error_ || order_.empty())) {
+			waiting_ = false;
+			signal_availibility();
+		}
+		return;
+	}
+
+	if (res < 0) {
+		error_ = true;
+	}
+	else {
+		s.filled_ += static_cast<size_t>(res);
+		if (s.filled_ < s.skip_ + s.want_) {
+			if (!res) {
+				// File got shorter
+				error_ = true;
+			}
+			else if (ring_.prep_read(fd_, i, s.filled_, s.size_ - s.filled_, s.offset_ + s.filled_)) {
+				++pending_;
+				if (io_uring_submit(&ring_.ring_) < 0) {
+					error_ = true;
+				}
+				return;
+			}
+			else {
+				error_ = true;
+			}
+		}
+		else {
+			s.state_ = slot::state::ready;
+		}
+	}
+
+	if (waiting_ && (error_ || (!order_.empty() && i == order_.front()))) {
+		waiting_ = false;
+		signal_availibility();
+	}
+}
+
+std::pair<fz::aio_result, fz::buffer_lease> uring_reader::do_get_buffer(fz::scoped_lock &)
+{
+	if (error_) {
+		return {fz::aio_result::error, fz::buffer_lease()};
+	}
+
+	if (!remaining_) {
+		return {fz::aio_result::ok, fz::buffer_lease()};
+	}
+
+	if (order_.empty()) {
+		fill();
+		if (order_.empty()) {
+			if (free_.size() < slots_.size()) {
+				// All slots are still busy with reads from before a seek
+				waiting_ = true;
+				return {fz::aio_result::wait, fz::buffer_lease()};
+			}
+			error_ = true;
+			return {fz::aio_result::error, fz::buffer_lease()};
+		}
+	}
+
+	size_t const i = order_.front();
+	auto & s = slots_[i];
+	if (s.state_ != slot::state::ready) {
+		waiting_ = true;
+		return {fz::aio_result::wait, fz::buffer_lease()};
+	}
+
+	fz::buffer_lease b = buffer_pool_.get_buffer(*this);
+	if (!b) {
+		return {fz::aio_result::wait, fz::buffer_lease()};
+	}
+
+	size_t const n = std::min(s.want_ - s.consumed_, b->capacity());
+	memcpy(b->get(n), ring_.buffer(i) + s.skip_ + s.consumed_, n);
+	b->add(n);
+	s.consumed_ += n;
+	remaining_ -= n;
+
+	if (s.consumed_ == s.want_) {
+		s.state_ = slot::state::free;
+		order_.pop_front();
+		free_.push_back(i);
+		fill();
+	}
+
+	return {fz::aio_result::ok, std::move(b)};
+}
+
+bool uring_reader::do_seek(fz::scoped_lock &)
+{
+	for (size_t i : order_) {
+		auto & s = slots_[i];
+		if (s.state_ == slot::state::reading) {
+			// The buffer is only reused once the read has finished
+			s.state_ = slot::state::stale;
+		}
+		else {
+			s.state_ = slot::state::free;
+			free_.push_back(i);
+		}
+	}
+	order_.clear();
+	waiting_ = false;
+
+	next_ = start_offset_;
+	end_ = start_offset_ + remaining_;
+	fill();
+
+	return !error_;
+}
+
+void uring_reader::do_close(fz::scoped_lock &)
+{
+	// Joined in the destructor, the thread needs the mutex to finish
+	if (task_) {
+		stop();
+	}
+}
+
+void uring_reader::on_buffer_availability(fz::aio_waitable const*)
+{
+	fz::scoped_lock l(mtx_);
+	signal_availibility();
+}
+
+
+class uring_writer final : public fz::writer_base
+{
+public:
+	uring_writer(std::wstring const& name, fz::aio_buffer_pool & pool, progress_cb_t && progress_cb, size_t max_buffers, fz::thread_pool & tpool);
+	virtual ~uring_writer();
+
+	bool open(uint64_t offset, bool direct);
+
+	virtual fz::aio_result preallocate(uint64_t size) override;
+
+private:
+	virtual fz::aio_result do_add_buffer(fz::scoped_lock & l, fz::buffer_lease && b) override;
+	virtual fz::aio_result do_finalize(fz::scoped_lock & l) override;
+	virtual void do_close(fz::scoped_lock & l) override;
+
+	void entry();
+	void on_write(size_t i, int res);
+
+	// Copies the pending buffers into free slots, full slots get written
+	void drain();
+	bool write(size_t i);
+	void stop();
+
+	struct slot final
+	{
+		uint64_t offset_{};
+		size_t size_{};
+		size_t written_{};
+	};
+
+	fz::thread_pool & tpool_;
+	fz::async_task task_;
+
+	int fd_{-1};
+	uring ring_;
+
+	std::vector<slot> slots_;
+	std::vector<size_t> free_;
+	size_t current_{no_slot};
+
+	// Buffers are returned to the pool as soon as they have been copied
+	std::deque<fz::buffer_lease> buffers_;
+	size_t max_pending_{1};
+
+	uint64_t start_{};
+	uint64_t pos_{};
+
+	// O_DIRECT gets enabled once enough has been written
+	bool want_direct_{};
+	bool direct_{};
+
+	size_t pending_{};
+	bool flushing_{};
+	bool waiting_{};
+	bool quit_{};
+};
+
+uring_writer::uring_writer(std::wstring const& name, fz::aio_buffer_pool & pool, progress_cb_t && progress_cb, size_t max_buffers, fz::thread_pool & tpool)
+	: fz::writer_base(name, pool, std::move(progress_cb), max_buffers)
+	, tpool_(tpool)
+	, max_pending_(std::max(max_buffers, size_t(1)))
+{
+}
+
+uring_writer::~uring_writer()
+{
+	if (task_) {
+		{
+			fz::scoped_lock l(mtx_);
+			stop();
+		}
+		task_.join();
+	}
+	if (fd_ != -1) {
+		::close(fd_);
+	}
+
+	remove_waiters();
+}
+
+bool uring_writer::open(uint64_t offset, bool direct)
+{
+	fd_ = ::open(fz::to_native(name()).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+	if (fd_ == -1) {
+		return false;
+	}
+
+	// Same as the regular writer: Anything past the offset gets discarded
+	if (ftruncate(fd_, static_cast<off_t>(offset))) {
+		return false;
+	}
+
+	want_direct_ = direct && !(offset % alignment);
+
+	if (!ring_.init()) {
+		return false;
+	}
+
+	slots_.resize(queue_depth);
+	for (size_t i = queue_depth; i > 0; --i) {
+		free_.push_back(i - 1);
+	}
+
+	task_ = tpool_.spawn([this]() { entry(); });
+	if (!task_) {
+		return false;
+	}
+
+	fz::scoped_lock l(mtx_);
+	start_ = offset;
+	pos_ = offset;
+
+	return true;
+}
+
+fz::aio_result uring_writer::preallocate(uint64_t size)
+{
+	fz::scoped_lock l(mtx_);
+	if (error_) {
+		return fz::aio_result::error;
+	}
+
+	// Keeping the size, nothing needs to be undone if the transfer fails.
+	// Only a hint, not all filesystems support it.
+	fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(pos_), static_cast<off_t>(size));
+	return fz::aio_result::ok;
+}
+
+bool uring_writer::write(size_t i)
+{
+	auto & s = slots_[i];
+	if (want_direct_ && !direct_ && s.offset_ - start_ >= direct_threshold && s.size_ == slot_size) {
+		direct_ = set_direct(fd_, true);
+		want_direct_ = direct_;
+	}
+
+	if (!ring_.prep_write(fd_, i, s.written_, s.size_ - s.written_, s.offset_ + s.written_)) {
+		return false;
+	}
+	++pending_;
+	return true;
+}
+
+void uring_writer::drain()
+{
+	bool added{};
+	while (!buffers_.empty() && !error_) {
+		if (current_ == no_slot) {
+			if (free_.empty()) {
+				break;
+			}
+			current_ = free_.back();
+			free_.pop_back();
+
+			auto & s = slots_[current_];
+			s.offset_ = pos_;
+			s.size_ = 0;
+			s.written_ = 0;
+		}
+
+		auto & s = slots_[current_];
+		auto & b = buffers_.front();
+		size_t const n = std::min(slot_size - s.size_, b->size());
+		memcpy(ring_.buffer(current_) + s.size_, b->get(), n);
+		b->consume(n);
+		s.size_ += n;
+		pos_ += n;
+
+		if (b->empty()) {
+			buffers_.pop_front();
+		}
+
+		if (s.size_ == slot_size) {
+			if (!write(current_)) {
+				error_ = true;
+				break;
+			}
+			current_ = no_slot;
+			added = true;
+		}
+	}
+
+	if (added && io_uring_submit(&ring_.ring_) < 0) {
+		error_ = true;
+	}
+}
+
+fz::aio_result uring_writer::do_add_buffer(fz::scoped_lock &, fz::buffer_lease && b)
+{
+	buffers_.emplace_back(std::move(b));
+	drain();
+
+	if (error_) {
+		return fz::aio_result::error;
+	}
+	if (buffers_.size() >= max_pending_) {
+		waiting_ = true;
+		return fz::aio_result::wait;
+	}
+	return fz::aio_result::ok;
+}
+
+fz::aio_result uring_writer::do_finalize(fz::scoped_lock &)
+{
+	flushing_ = true;
+	drain();
+	if (error_) {
+		return fz::aio_result::error;
+	}
+
+	if (buffers_.empty() && current_ != no_slot) {
+		if (!direct_ || !pending_) {
+			if (direct_) {
+				// The tail is not aligned
+				direct_ = false;
+				if (!set_direct(fd_, false)) {
+					error_ = true;
+					return fz::aio_result::error;
+				}
+			}
+			if (!write(current_) || io_uring_submit(&ring_.ring_) < 0) {
+				error_ = true;
+				return fz::aio_result::error;
+			}
+			current_ = no_slot;
+		}
+	}
+
+	if (!buffers_.empty() || current_ != no_slot || pending_) {
+		waiting_ = true;
+		return fz::aio_result::wait;
+	}
+
+	return fz::aio_result::ok;
+}
+
+void uring_writer::do_close(fz::scoped_lock &)
+{
+	// Joined in the destructor, the thread needs the mutex to finish
+	if (task_) {
+		stop();
+	}
+}
+
+void uring_writer::stop()
+{
+	if (quit_) {
+		return;
+	}
+	quit_ = true;
+	if (ring_.prep_wakeup()) {
+		++pending_;
+		io_uring_submit(&ring_.ring_);
+	}
+}
+
+void uring_writer::entry()
+{
+	while (true) {
+		io_uring_cqe* cqe{};
+		int const r = io_uring_wait_cqe(&ring_.ring_, &cqe);
+
+		fz::scoped_lock l(mtx_);
+		if (r < 0) {
+			if (r == -EINTR) {
+				continue;
+			}
+			error_ = true;
+			signal_availibility();
+			break;
+		}
+
+		uint64_t const data = cqe->user_data;
+		int const res = cqe->res;
+		io_uring_cqe_seen(&ring_.ring_, cqe);
+
+		--pending_;
+		if (data != wakeup_marker) {
+			on_write(static_cast<size_t>(data), res);
+		}
+		if (quit_ && !pending_) {
+			break;
+		}
+	}
+}
+
+void uring_writer::on_write(size_t i, int res)
+{
+	auto & s = slots_[i];
+	if (res <= 0) {
+		error_ = true;
+	}
+	else {
+		s.written_ += static_cast<size_t>(res);
+		if (progress_cb_) {
+			progress_cb_(this, static_cast<uint64_t>(res));
+		}
+
+		if (s.written_ < s.size_) {
+			if (!write(i) || io_uring_submit(&ring_.ring_) < 0) {
+				error_ = true;
+			}
+		}
+		else {
+			free_.push_back(i);
+			if (!quit_) {
+				drain();
+			}
+		}
+	}
+
+	if (!waiting_) {
+		return;
+	}
+	if (flushing_) {
+		// Called again to write the tail or once everything got written
+		if (!error_ && (pending_ || !buffers_.empty())) {
+			return;
+		}
+	}
+	else if (!error_ && buffers_.size() >= max_pending_) {
+		return;
+	}
+	waiting_ = false;
+	signal_availibility();
+}
+}
+
+std::unique_ptr<fz::reader_base> open_uring_reader(std::wstring const& name, fz::aio_buffer_pool & pool, fz::thread_pool & tpool,
+	uint64_t offset, uint64_t size, size_t max_buffers, bool direct)
+{
+	auto reader = std::make_unique<uring_reader>(name, pool, max_buffers, tpool);
+	if (!reader->open(offset, size, direct)) {
+		return nullptr;
+	}
+	return reader;
+}
+
+std::unique_ptr<fz::writer_base> open_uring_writer(std::wstring const& name, fz::aio_buffer_pool & pool, fz::thread_pool & tpool,
+	uint64_t offset, fz::writer_base::progress_cb_t && progress_cb, size_t max_buffers, bool direct)
+{
+	auto writer = std::make_unique<uring_writer>(name, pool, std::move(progress_cb), max_buffers, tpool);
+	if (!writer->open(offset, direct)) {
+		return nullptr;
+	}
+	return writer;
+}
+
+#else
+
+std::unique_ptr<fz::reader_base> open_uring_reader(std::wstring const&, fz::aio_buffer_pool &, fz::thread_pool &,
+	uint64_t, uint64_t, size_t, bool)
+{
+	return nullptr;
+}
+
+std::unique_ptr<fz::writer_base> open_uring_writer(std::wstring const&, fz::aio_buffer_pool &, fz::thread_pool &,
+	uint64_t, fz::writer_base::progress_cb_t &&, size_t, bool)
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef FILEZILLA_ENGINE_URING_FILE_HEADER
+#define FILEZILLA_ENGINE_URING_FILE_HEADER
+
+#include <libfilezilla/aio/reader.hpp>
+#include <libfilezilla/aio/writer.hpp>
+
+namespace fz {
+class thread_pool;
+}
+
+// Readers and writers for local files that keep a deep queue of requests in
+// flight through io_uring, so that fast storage is kept busy. Data is staged
+// in aligned, registered buffers of their own, which also allows bypassing
+// the page cache with O_DIRECT on large files.
+//
+// Only available on Linux if built with liburing. The functions return
+// nullptr if not available or if the ring cannot be set up, e.g. if denied
+// by a seccomp policy. Callers then fall back to the regular readers and
+// writers.
+std::unique_ptr<fz::reader_base> open_uring_reader(std::wstring const& name, fz::aio_buffer_pool & pool, fz::thread_pool & tpool,
+	uint64_t offset, uint64_t size, size_t max_buffers, bool direct);
+
+std::unique_ptr<fz::writer_base> open_uring_writer(std::wstring const& name, fz::aio_buffer_pool & pool, fz::thread_pool & tpool,
+	uint64_t offset, fz::writer_base::progress_cb_t && progress_cb, size_t max_buffers, bool direct);
+
+#endif
@@ -54,6 +54,11 @@ public:
 
 	int CacheLookup(CServerPath const& path, CDirectoryListing& listing);
 
+	// Engines in the same group share a rate limiter below the one of the site
+	// they are connected to. Engines without group get one of their own.
+	// Takes effect on the next connection.
+	void SetRateLimitGroup(std::wstring const& group);
+
 private:
 	std::unique_ptr<CFileZillaEnginePrivate> impl_;
 };
@@ -19,6 +19,12 @@ public:
 	};
 
 	activity_logger() = default;
+
+	// Recorded amounts also get recorded in the parent
+	explicit activity_logger(activity_logger * parent)
+		: parent_(parent)
+	{}
+
 	virtual ~activity_logger() noexcept = default;
 
 	void record(_direction direction, uint64_t amount);
@@ -28,6 +34,8 @@ public:
 	void set_notifier(std::function<void()> && notification_cb);
 
 private:
+	activity_logger * const parent_{};
+
 	std::atomic_uint64_t amounts_[2]{};
 
 	fz::mutex mtx_;
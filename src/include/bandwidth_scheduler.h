@@ -0,0 +1,98 @@
+#ifndef FILEZILLA_ENGINE_BANDWIDTH_SCHEDULER_HEADER
+#define FILEZILLA_ENGINE_BANDWIDTH_SCHEDULER_HEADER
+
+#include "activity_logger.h"
+#include "visibility.h"
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/rate_limiter.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CServer;
+
+// Arranges the rate limiters in a hierarchy: Below the global limiter there is
+// one limiter per site, below each site one per group of engines, e.g. a tab
+// or the transfer queue. Engines add their sockets to the limiter of their group.
+//
+// Bandwidth is shared fairly among siblings, tokens not used by one get
+// redistributed among the others. Thus each site, and within a site each
+// group, is guaranteed its share of its parent's limit, no matter how many
+// connections the other ones have.
+class FZC_PUBLIC_SYMBOL bandwidth_scheduler final
+{
+public:
+	bandwidth_scheduler(fz::rate_limiter & global, activity_logger & global_logger);
+	~bandwidth_scheduler();
+
+	bandwidth_scheduler(bandwidth_scheduler const&) = delete;
+	bandwidth_scheduler& operator=(bandwidth_scheduler const&) = delete;
+
+	// In bytes per second. Applies to connections made afterwards as well.
+	void set_site_limits(CServer const& server, fz::rate::type inbound, fz::rate::type outbound);
+
+	class node final
+	{
+	public:
+		node(std::shared_ptr<node> const& parent, fz::rate_limiter & parent_limiter, activity_logger & parent_logger, std::wstring const& name);
+		~node();
+
+		node(node const&) = delete;
+		node& operator=(node const&) = delete;
+
+		fz::rate_limiter & limiter() { return limiter_; }
+		activity_logger & logger() { return logger_; }
+
+	private:
+		friend class bandwidth_scheduler;
+
+		// Keep parent alive while attached to it
+		std::shared_ptr<node> const parent_;
+		fz::rate_limiter limiter_;
+		activity_logger logger_;
+		std::wstring const name_;
+	};
+
+	// Engines with an empty group each get a group of their own.
+	std::shared_ptr<node> acquire(CServer const& server, std::wstring const& group);
+
+	struct usage final
+	{
+		// 0 for the global limiter, 1 for sites, 2 for groups
+		int depth{};
+
+		// Site or group name, empty for the global limiter and for anonymous groups
+		std::wstring name;
+
+		// Indexed by fz::direction::type, in bytes per second
+		fz::rate::type limits[2]{fz::rate::unlimited, fz::rate::unlimited};
+		uint64_t rates[2]{};
+	};
+
+	// Returns the rates averaged since the previous call, sites are followed by their groups.
+	std::vector<usage> extract_usage();
+
+private:
+	fz::mutex mutex_;
+
+	fz::rate_limiter & global_;
+	activity_logger & global_logger_;
+
+	std::map<std::wstring, std::pair<fz::rate::type, fz::rate::type>> site_limits_;
+
+	struct site final
+	{
+		std::weak_ptr<node> node_;
+		std::map<std::wstring, std::weak_ptr<node>> groups_;
+		std::vector<std::weak_ptr<node>> anonymous_;
+	};
+	std::map<std::wstring, site> sites_;
+
+	fz::monotonic_clock last_extraction_;
+};
+
+#endif
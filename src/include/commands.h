@@ -319,13 +319,20 @@ class FZC_PUBLIC_SYMBOL CMkdirCommand final : public CCommandHelper<CMkdirComman
 public:
 	explicit CMkdirCommand(CServerPath const& path, transfer_flags const& flags);
 
+	// Creates all the given directories. Unlike with a single directory, their
+	// parents need to exist already. Paths known to exist are skipped.
+	// Succeeds only if all directories could be created.
+	explicit CMkdirCommand(std::vector<CServerPath> && paths, transfer_flags const& flags);
+
 	CServerPath GetPath() const { return m_path; }
+	std::vector<CServerPath> const& GetPaths() const { return paths_; }
 	transfer_flags const& GetFlags() const { return flags_; }
 
 	bool valid() const;
 
 protected:
 	CServerPath const m_path;
+	std::vector<CServerPath> const paths_;
 	transfer_flags const flags_;
 };
 
@@ -357,9 +364,14 @@ public:
 	// i.e. chmod 755 foo.bar
 	CChmodCommand(CServerPath const& path, std::wstring const& file, std::wstring const& permission);
 
+	// Sets the permissions of several entries of the same directory, given
+	// as pairs of name and permission. Succeeds only if all could be set.
+	CChmodCommand(CServerPath const& path, std::vector<std::pair<std::wstring, std::wstring>> && entries);
+
 	CServerPath GetPath() const { return m_path; }
 	std::wstring GetFile() const { return m_file; }
 	std::wstring GetPermission() const { return m_permission; }
+	std::vector<std::pair<std::wstring, std::wstring>> const& GetEntries() const { return entries_; }
 
 	bool valid() const;
 
@@ -367,6 +379,7 @@ protected:
 	CServerPath const m_path;
 	std::wstring const m_file;
 	std::wstring const m_permission;
+	std::vector<std::pair<std::wstring, std::wstring>> const entries_;
 };
 
 #endif
@@ -6,12 +6,16 @@
 #include <memory>
 
 class activity_logger;
+class bandwidth_scheduler;
 class CDirectoryCache;
+class dns_cache;
 class COptionsBase;
 class CPathCache;
 class OpLockManager;
 class logfile_writer;
+class multicast_reader_hub;
 class SizeFormatter;
+class socket_buffer_budget;
 
 namespace fz {
 class event_loop;
@@ -40,13 +44,17 @@ public:
 	fz::thread_pool& GetThreadPool();
 	fz::event_loop& GetEventLoop();
 	fz::rate_limiter& GetRateLimiter();
+	bandwidth_scheduler& GetBandwidthScheduler();
 	CDirectoryCache& GetDirectoryCache();
 	CPathCache& GetPathCache();
+	dns_cache& GetDnsCache();
 	CustomEncodingConverterBase const& GetCustomEncodingConverter() { return customEncodingConverter_; }
 	OpLockManager& GetOpLockManager();
 	fz::tls_system_trust_store& GetTlsSystemTrustStore();
 	activity_logger& GetActivityLogger();
 	logfile_writer & GetLogFileWriter();
+	multicast_reader_hub & GetMulticastReaderHub();
+	socket_buffer_budget & GetSocketBufferBudget();
 	SizeFormatter & size_formatter();
 
 protected:
@@ -46,6 +46,7 @@ enum engineOptions : unsigned int
 	OPTION_VIEW_HIDDEN_FILES,
 
 	OPTION_PRESERVE_TIMESTAMPS,
+	OPTION_VERIFY_TRANSFERS,	// Compare checksums of local and remote file after transfers
 
 	OPTION_SOCKET_BUFFERSIZE_RECV,
 	OPTION_SOCKET_BUFFERSIZE_SEND,
@@ -60,6 +61,8 @@ enum engineOptions : unsigned int
 
 	OPTION_SFTP_KEYFILES,
 	OPTION_SFTP_COMPRESSION,
+	OPTION_SFTP_SHARE_CONNECTIONS,	// Let fzsftp processes connecting to the same server and
+	                                // user run their sessions over a single SSH connection
 
 	OPTION_PROXY_TYPE,
 	OPTION_PROXY_HOST,
@@ -83,6 +86,26 @@ enum engineOptions : unsigned int
 
 	OPTION_DIRECTORY_LISTING_ITEM_LIMIT,
 
+	OPTION_DNS_CACHE_TTL,		// In seconds, 0 only coalesces concurrent lookups
+
+	OPTION_UPLOAD_MULTICAST_BUFFER,	// In MiB, memory for sharing reads of files
+	                                // uploaded to several sites at once. 0 disables.
+
+	OPTION_SERVER_CAPABILITIES_FILE,	// Full path, capabilities of FTP servers are
+	                                	// not persisted if empty.
+
+	OPTION_HTTP_DOWNLOAD_SEGMENTS,	// Number of connections a single HTTP download may
+	                              	// use for fetching ranges in parallel. 1, the default,
+	                              	// disables this.
+
+	OPTION_LOCAL_FILE_IO,	// 0: Threaded reads and writes, 1: io_uring,
+	                     	// 2: io_uring with O_DIRECT for large files
+
+	OPTION_SOCKET_BUFFER_AUTOTUNE,	// Size data connection buffers to the measured
+	                              	// bandwidth-delay product
+
+	OPTION_SOCKET_BUFFER_MEMORY_LIMIT,	// In MiB, total of buffers grown by autotuning
+
 	OPTIONS_ENGINE_NUM
 };
 
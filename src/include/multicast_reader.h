@@ -0,0 +1,82 @@
+#ifndef FILEZILLA_ENGINE_MULTICAST_READER_HEADER
+#define FILEZILLA_ENGINE_MULTICAST_READER_HEADER
+
+#include "visibility.h"
+
+#include <libfilezilla/aio/reader.hpp>
+#include <libfilezilla/mutex.hpp>
+
+#include <map>
+#include <memory>
+
+class COptionsBase;
+class multicast_source;
+class multicast_announcement;
+class multicast_announcements;
+
+// Keeps track of local files currently being uploaded by several engines at once,
+// e.g. when uploading to all open tabs.
+//
+// Each such file is read from disk only once into a window of shared chunks,
+// every upload copies from that window into its own buffer pool. The window is
+// bounded by the OPTION_UPLOAD_MULTICAST_BUFFER memory budget and the slowest
+// upload. An upload that falls too far behind while others are starving is
+// dropped from the window and continues with a private reader.
+//
+// Only files announced for at least two uploads get a new window, an existing
+// window is joined as long as it still holds the start of the file. All other
+// files are read by a regular file reader.
+class FZC_PUBLIC_SYMBOL multicast_reader_hub final
+{
+public:
+	multicast_reader_hub(fz::thread_pool & pool, COptionsBase & options);
+	~multicast_reader_hub();
+
+	multicast_reader_hub(multicast_reader_hub const&) = delete;
+	multicast_reader_hub& operator=(multicast_reader_hub const&) = delete;
+
+	// Announces an upcoming upload of the file, e.g. when queueing it for
+	// several sites. The announcement lasts until the handle is released.
+	std::shared_ptr<multicast_announcement> announce(std::wstring const& file);
+
+private:
+	friend class multicast_reader_factory;
+
+	std::shared_ptr<multicast_source> get_source(std::wstring const& file, uint64_t size, fz::datetime const& mtime);
+
+	fz::thread_pool & pool_;
+	COptionsBase & options_;
+
+	fz::mutex mutex_{false};
+	std::map<std::wstring, std::weak_ptr<multicast_source>> sources_;
+
+	// Shared with the handles, which may outlive the hub
+	std::shared_ptr<multicast_announcements> announcements_;
+};
+
+class FZC_PUBLIC_SYMBOL multicast_reader_factory final : public fz::reader_factory
+{
+public:
+	multicast_reader_factory(std::wstring const& file, fz::thread_pool & pool, multicast_reader_hub & hub);
+
+	virtual std::unique_ptr<fz::reader_factory> clone() const override;
+
+	virtual std::unique_ptr<fz::reader_base> open(fz::aio_buffer_pool & pool, uint64_t offset = 0, uint64_t size = fz::aio_base::nosize, size_t max_buffers = 0) override;
+
+	virtual bool seekable() const override { return true; }
+
+	virtual uint64_t size() const override;
+	virtual fz::datetime mtime() const override;
+
+	virtual bool multiple_buffer_usage() const override { return true; }
+	virtual size_t preferred_buffer_count() const override { return 4; }
+
+private:
+	multicast_reader_factory(multicast_reader_factory const& op);
+
+	fz::thread_pool & pool_;
+	multicast_reader_hub & hub_;
+	std::unique_ptr<fz::reader_factory> file_factory_;
+};
+
+#endif
@@ -179,6 +179,7 @@ public:
 		resume, // Overwrites if cannot be resumed
 		rename,
 		skip,
+		overwriteChecksum, // Overwrite if source file differs in size or checksum from target file
 
 		ACTION_COUNT
 	};
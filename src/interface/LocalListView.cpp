@@ -15,6 +15,7 @@
 #include <algorithm>
 #include "dndobjects.h"
 #include "Options.h"
+#include "StatusView.h"
 #ifdef __WXMSW__
 #include "lm.h"
 #include "volume_enumerator.h"
@@ -27,6 +28,7 @@
 #include "local_recursive_operation.h"
 #include "timeformatting.h"
 
+#include "../commonui/tree_sync.h"
 #include "../include/sizeformatting.h"
 
 #include <libfilezilla/local_filesys.hpp>
@@ -295,6 +297,7 @@ BEGIN_EVENT_TABLE(CLocalListView, CFileListCtrl<CLocalFileData>)
 #endif
 	EVT_MENU(XRCID("ID_CONTEXT_REFRESH"), CLocalListView::OnMenuRefresh)
 	EVT_MENU(XRCID("ID_UPLOAD_TO_ALL"), CLocalListView::OnMenuUploadToAll)
+	EVT_MENU(XRCID("ID_SYNC_UPLOAD"), CLocalListView::OnMenuSyncUpload)
 END_EVENT_TABLE()
 
 CLocalListView::CLocalListView(CView* pParent, CState& state, CQueueView *pQueue, COptionsBase & options, CEditHandler* edit_handler)
@@ -857,6 +860,7 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 	item = new wxMenuItem(&menu, XRCID("ID_ADDTOQUEUE"), _("&Add files to queue"), _("Add selected files and folders to the transfer queue"));
 	item->SetBitmap(MakeBmpBundle(wxArtProvider::GetBitmap(_T("ART_UPLOADADD"), wxART_MENU)));
 	menu.Append(item);
+	menu.Append(XRCID("ID_SYNC_UPLOAD"), _("S&ynchronize to server"), _("Upload only those of the selected files and directories that are missing or differ on the server"));
 
 	// Add "Upload to all remote sites" menu item
 	if (m_pContextControl) {
@@ -908,6 +912,9 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 		menu.Enable(XRCID("ID_UPLOAD"), false);
 		menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 	}
+	if (!m_state.IsRemoteConnected() || !m_state.IsRemoteIdle()) {
+		menu.Enable(XRCID("ID_SYNC_UPLOAD"), false);
+	}
 
 	int index = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
 	int count = 0;
@@ -933,6 +940,7 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 		menu.Delete(XRCID("ID_ENTER"));
 		menu.Enable(XRCID("ID_UPLOAD"), false);
 		menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
+		menu.Enable(XRCID("ID_SYNC_UPLOAD"), false);
 		menu.Enable(XRCID("ID_DELETE"), false);
 		menu.Enable(XRCID("ID_RENAME"), false);
 		menu.Enable(XRCID("ID_EDIT"), false);
@@ -952,6 +960,7 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 		if (m_state.GetLocalRecursiveOperation() && m_state.GetLocalRecursiveOperation()->IsActive()) {
 			menu.Enable(XRCID("ID_UPLOAD"), false);
 			menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
+			menu.Enable(XRCID("ID_SYNC_UPLOAD"), false);
 		}
 	}
 
@@ -1061,6 +1070,84 @@ void CLocalListView::OnMenuUpload(wxCommandEvent& event, CState* pState)
 	}
 }
 
+void CLocalListView::OnMenuSyncUpload(wxCommandEvent&)
+{
+	Site const& site = m_state.GetSite();
+	CServerPath const remoteDir = m_state.GetRemotePath();
+	auto recursiveOperation = m_state.GetLocalRecursiveOperation();
+	if (!site || remoteDir.empty() || !recursiveOperation || recursiveOperation->IsActive() || !m_state.IsRemoteIdle()) {
+		wxBell();
+		return;
+	}
+
+	tree_sync sync(fz::duration::from_minutes(options_.get_int(OPTION_COMPARISON_THRESHOLD)));
+
+	// Selected files are compared against the current remote listing
+	CLocalRecursiveOperation::listing files;
+	files.localPath = m_dir;
+	files.remotePath = remoteDir;
+
+	local_recursion_root root;
+	std::vector<CServerPath> remoteRoots;
+
+	long item = -1;
+	for (;;) {
+		item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+		if (!item && m_hasParent) {
+			continue;
+		}
+		if (item == -1) {
+			break;
+		}
+
+		CLocalFileData const* data = GetData(item);
+		if (!data) {
+			break;
+		}
+		if (data->comparison_flags == fill) {
+			continue;
+		}
+
+		if (data->is_dir()) {
+			CLocalPath localPath = m_dir;
+			CServerPath remotePath = remoteDir;
+			if (!localPath.ChangePath(data->name) || !remotePath.ChangePath(data->name)) {
+				continue;
+			}
+
+			root.add_dir_to_visit(localPath, remotePath);
+			remoteRoots.push_back(remotePath);
+		}
+		else {
+			CLocalRecursiveOperation::listing::entry entry;
+			entry.name = data->name;
+			entry.size = data->size;
+			entry.time = data->time;
+			entry.attributes = data->attributes;
+			files.files.push_back(entry);
+		}
+	}
+
+	if (!files.files.empty()) {
+		auto const remoteListing = m_state.GetRemoteDir();
+		if (sync.filter_upload(files, (remoteListing && remoteListing->path == remoteDir) ? remoteListing.get() : nullptr)) {
+			m_pQueue->QueueFiles(false, site, files);
+			m_pQueue->QueueFile_Finish(true);
+		}
+	}
+
+	if (!root.empty()) {
+		recursiveOperation->AddRecursionRoot(std::move(root));
+		CFilterManager filter;
+		if (!recursiveOperation->StartSync(remoteRoots, filter.GetActiveFilters())) {
+			wxBell();
+		}
+	}
+	else if (m_state.GetMainFrame().GetStatusView()) {
+		m_state.GetMainFrame().GetStatusView()->AddToLog(logmsg::status, sync.get_plan().summary(), fz::datetime::now());
+	}
+}
+
 void CLocalListView::OnMenuUploadToAll(wxCommandEvent& event)
 {
 	if (!m_pContextControl) {
@@ -1070,27 +1157,96 @@ void CLocalListView::OnMenuUploadToAll(wxCommandEvent& event)
 
 	bool queue_only = event.GetId() == XRCID("ID_ADDTOQUEUE");
 
-	// Count connected remote sites
-	int connectedCount = 0;
+	// Collect connected remote sites
+	std::vector<CLocalRecursiveOperation::upload_target> targets;
 	for (size_t i = 0; i < m_pContextControl->GetTabCount(); ++i) {
 		auto *controls = m_pContextControl->GetControlsFromTabIndex(i);
 		if (controls && controls->pState && controls->pState->IsRemoteConnected()) {
-			connectedCount++;
+			Site const& site = controls->pState->GetSite();
+			CServerPath const remotePath = controls->pState->GetRemotePath();
+			if (site && !remotePath.empty()) {
+				CLocalRecursiveOperation::upload_target target;
+				target.site_ = site;
+				target.remote_root_ = remotePath;
+				targets.emplace_back(std::move(target));
+			}
 		}
 	}
-	
-	if (connectedCount == 0) {
+
+	if (targets.empty()) {
 		wxBell();
 		return;
 	}
 
-	// Iterate over all connected remote sites and upload to each
-	for (size_t i = 0; i < m_pContextControl->GetTabCount(); ++i) {
-		auto *controls = m_pContextControl->GetControlsFromTabIndex(i);
-		if (controls && controls->pState && controls->pState->IsRemoteConnected()) {
-			// Upload to this remote site's current directory
-			OnMenuUpload(event, controls->pState);
+	// Directories are enumerated only once by this tab's recursive operation
+	// and the listings are fanned out to every target.
+	auto recursiveOperation = m_state.GetLocalRecursiveOperation();
+	if (!recursiveOperation || recursiveOperation->IsActive()) {
+		wxBell();
+		return;
+	}
+
+	CServerPath const scanRoot = targets.front().remote_root_;
+
+	CLocalRecursiveOperation::listing files;
+	files.localPath = m_dir;
+
+	local_recursion_root root;
+
+	long item = -1;
+	for (;;) {
+		item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+		if (!item && m_hasParent) {
+			continue;
 		}
+		if (item == -1) {
+			break;
+		}
+
+		const CLocalFileData *data = GetData(item);
+		if (!data) {
+			break;
+		}
+
+		if (data->comparison_flags == fill) {
+			continue;
+		}
+
+		if (data->is_dir()) {
+			CLocalPath localPath = m_dir;
+			if (!localPath.ChangePath(data->name)) {
+				continue;
+			}
+			CServerPath remotePath = scanRoot;
+			if (!remotePath.ChangePath(data->name)) {
+				continue;
+			}
+
+			root.add_dir_to_visit(localPath, remotePath);
+		}
+		else {
+			CLocalRecursiveOperation::listing::entry entry;
+			entry.name = data->name;
+			entry.size = data->size;
+			entry.time = data->time;
+			entry.attributes = data->attributes;
+			files.files.push_back(entry);
+		}
+	}
+
+	if (!files.files.empty()) {
+		for (auto const& target : targets) {
+			files.remotePath = target.remote_root_;
+			m_pQueue->QueueFiles(queue_only, target.site_, files, targets.size() > 1);
+		}
+		m_pQueue->QueueFile_Finish(!queue_only);
+	}
+
+	if (!root.empty()) {
+		recursiveOperation->AddRecursionRoot(std::move(root));
+		recursiveOperation->SetUploadTargets(scanRoot, std::move(targets));
+		CFilterManager filter;
+		recursiveOperation->StartRecursiveOperation(recursive_operation::recursive_transfer, filter.GetActiveFilters(), !queue_only);
 	}
 }
 
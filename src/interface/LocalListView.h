@@ -128,6 +128,7 @@ protected:
 	void OnMenuEnter(wxCommandEvent& event);
 	void OnMenuRefresh(wxCommandEvent& event);
 	void OnMenuUploadToAll(wxCommandEvent& event);
+	void OnMenuSyncUpload(wxCommandEvent& event);
 
 #ifdef __WXMSW__
 	void OnVolumesEnumerated(wxCommandEvent& event);
@@ -1296,28 +1296,60 @@ void CLocalTreeView::OnMenuUploadToAll(wxCommandEvent& event)
 		return;
 	}
 
-	// Count connected remote sites
-	int connectedCount = 0;
+	if (!m_contextMenuItem.IsOk()) {
+		return;
+	}
+
+	CLocalPath path(GetDirFromItem(m_contextMenuItem));
+	if (!path.HasParent()) {
+		return;
+	}
+
+	// Collect connected remote sites
+	std::vector<CLocalRecursiveOperation::upload_target> targets;
 	for (size_t i = 0; i < m_pContextControl->GetTabCount(); ++i) {
 		auto *controls = m_pContextControl->GetControlsFromTabIndex(i);
 		if (controls && controls->pState && controls->pState->IsRemoteConnected()) {
-			connectedCount++;
+			Site const& site = controls->pState->GetSite();
+			CServerPath const remotePath = controls->pState->GetRemotePath();
+			if (site && !remotePath.empty()) {
+				CLocalRecursiveOperation::upload_target target;
+				target.site_ = site;
+				target.remote_root_ = remotePath;
+				targets.emplace_back(std::move(target));
+			}
 		}
 	}
-	
-	if (connectedCount == 0) {
+
+	if (targets.empty()) {
 		wxBell();
 		return;
 	}
 
-	// Iterate over all connected remote sites and upload to each
-	for (size_t i = 0; i < m_pContextControl->GetTabCount(); ++i) {
-		auto *controls = m_pContextControl->GetControlsFromTabIndex(i);
-		if (controls && controls->pState && controls->pState->IsRemoteConnected()) {
-			// Upload to this remote site's current directory
-			OnMenuUpload(event, controls->pState);
-		}
+	// The directory is enumerated only once by this tab's recursive operation
+	// and the listings are fanned out to every target.
+	auto recursiveOperation = m_state.GetLocalRecursiveOperation();
+	if (!recursiveOperation || recursiveOperation->IsActive()) {
+		wxBell();
+		return;
+	}
+
+	CServerPath const scanRoot = targets.front().remote_root_;
+	CServerPath remotePath = scanRoot;
+	if (!remotePath.ChangePath(GetItemText(m_contextMenuItem).ToStdWstring())) {
+		wxBell();
+		return;
 	}
+
+	local_recursion_root root;
+	root.add_dir_to_visit(path, remotePath);
+	recursiveOperation->AddRecursionRoot(std::move(root));
+	recursiveOperation->SetUploadTargets(scanRoot, std::move(targets));
+
+	bool const queue_only = event.GetId() == XRCID("ID_ADDTOQUEUE");
+
+	CFilterManager filter;
+	recursiveOperation->StartRecursiveOperation(recursive_operation::recursive_transfer, filter.GetActiveFilters(), !queue_only);
 }
 
 // Create a new Directory
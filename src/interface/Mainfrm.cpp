@@ -31,6 +31,7 @@
 #include "power_management.h"
 #include "queue.h"
 #include "quickconnectbar.h"
+#include "remote_index.h"
 #include "remote_recursive_operation.h"
 #include "RemoteListView.h"
 #include "RemoteTreeView.h"
@@ -597,7 +598,7 @@ CMainFrame::CMainFrame(COptions& options)
 	// so that contextchange events can be processed in the right order.
 	m_pContextControl = new CContextControl(*this);
 
-	m_pStatusBar = new CStatusBar(this, m_engineContext.GetActivityLogger(), options_);
+	m_pStatusBar = new CStatusBar(this, m_engineContext.GetActivityLogger(), m_engineContext.GetBandwidthScheduler(), options_);
 	if (m_pStatusBar) {
 		SetStatusBar(m_pStatusBar);
 	}
@@ -639,7 +640,7 @@ CMainFrame::CMainFrame(COptions& options)
 	cert_store_ = std::make_unique<CertStore>(options_.get_int(OPTION_DEFAULT_KIOSKMODE) == 2);
 	async_request_queue_ = std::make_unique<CAsyncRequestQueue>(this, options_, *cert_store_);
 
-	edit_handler_ = std::make_unique<CEditHandler>(options_);
+	edit_handler_ = std::make_unique<CEditHandler>(options_, m_engineContext.GetThreadPool());
 
 #ifdef __WXMSW__
 	long style = wxSP_NOBORDER | wxSP_LIVE_UPDATE;
@@ -796,6 +797,7 @@ CMainFrame::~CMainFrame()
 
 	CContextManager::Get()->DestroyAllStates();
 	async_request_queue_.reset();
+	remote_index_.reset();
 #if FZ_MANUALUPDATECHECK
 	delete m_pUpdater;
 #endif
@@ -809,6 +811,18 @@ CMainFrame::~CMainFrame()
 #endif
 }
 
+CRemoteIndex* CMainFrame::GetRemoteIndex()
+{
+	if (!options_.get_bool(OPTION_REMOTE_INDEX)) {
+		return nullptr;
+	}
+
+	if (!remote_index_) {
+		remote_index_ = std::make_unique<CRemoteIndex>(options_.get_string(OPTION_DEFAULT_SETTINGSDIR) + L"remoteindex.sqlite3", m_engineContext.GetThreadPool());
+	}
+	return remote_index_->opened() ? remote_index_.get() : nullptr;
+}
+
 void CMainFrame::HandleResize()
 {
 	wxSize clientSize = GetClientSize();
@@ -26,6 +26,7 @@ class COptions;
 class CQueue;
 class CQueueView;
 class CQuickconnectBar;
+class CRemoteIndex;
 class Site;
 class CSplitterWindowEx;
 class CStatusView;
@@ -56,6 +57,9 @@ public:
 	COptions& GetOptions() { return options_; }
 	CEditHandler* GetEditHandler() { return edit_handler_.get(); }
 
+	// Returns nullptr if the remote index is disabled or cannot be opened
+	CRemoteIndex* GetRemoteIndex();
+
 	// Window size and position as well as pane sizes
 	void RememberSplitterPositions();
 	bool RestoreSplitterPositions();
@@ -183,6 +187,7 @@ private:
 	std::unique_ptr<CAsyncRequestQueue> async_request_queue_;
 	CMainFrameStateEventHandler* m_pStateEventHandler{};
 	std::unique_ptr<CEditHandler> edit_handler_;
+	std::unique_ptr<CRemoteIndex> remote_index_;
 
 	CWindowStateManager* m_pWindowStateManager{};
 
@@ -47,8 +47,8 @@ static unsigned int register_interface_options()
 		{ "Concurrent download limit", 0, option_flags::numeric_clamp, 0, 10 },
 		{ "Concurrent upload limit", 0, option_flags::numeric_clamp, 0, 10 },
 		{ "Show debug menu", false, option_flags::normal },
-		{ "File exists action download", 0, option_flags::normal, 0, 7 },
-		{ "File exists action upload", 0, option_flags::normal, 0, 7 },
+		{ "File exists action download", 0, option_flags::normal, 0, 8 },
+		{ "File exists action upload", 0, option_flags::normal, 0, 8 },
 		{ "Allow ascii resume", false, option_flags::normal },
 		{ "Greeting version", L"", option_flags::normal },
 		{ "Greeting resources", L"", option_flags::normal },
@@ -118,7 +118,10 @@ static unsigned int register_interface_options()
 		{ "Disable update footer", false, option_flags::normal },
 		{ "Tab data", L"", option_flags::normal | option_flags::sensitive_data, option_type::xml },
 		{ "Highest shown overlay id", 0, option_flags::normal },
-		{ "Resolve local symlinks", DEFAULT_LOCAL_SYMLINK_RESOLVE, option_flags::platform }
+		{ "Resolve local symlinks", DEFAULT_LOCAL_SYMLINK_RESOLVE, option_flags::platform },
+		{ "Remote index", false, option_flags::normal },
+		{ "Prewarm connections", 2, option_flags::numeric_clamp, 0, 10 },
+		{ "Prefetch listings", 0, option_flags::numeric_clamp, 0, 4 }
 	});
 	return value;
 }
@@ -87,6 +87,9 @@ enum interfaceOptions : unsigned int
 	OPTION_TAB_DATA,
 	OPTION_SHOWN_OVERLAY,
 	OPTION_RESOLVE_LOCAL_SYMLINKS,
+	OPTION_REMOTE_INDEX,
+	OPTION_PREWARM_CONNECTIONS,
+	OPTION_PREFETCH_LISTINGS,
 
 	// Has to be last element
 	OPTIONS_NUM
@@ -17,6 +17,7 @@
 #include "queueview_failed.h"
 #include "queueview_successful.h"
 #include "commandqueue.h"
+#include "speedlimits_dialog.h"
 #include "statusbar.h"
 #include "remote_recursive_operation.h"
 #include "dragdropmanager.h"
@@ -27,6 +28,8 @@
 #include "../commonui/auto_ascii_files.h"
 #include "../commonui/misc.h"
 
+#include "../include/multicast_reader.h"
+
 #include <libfilezilla/glue/wxinvoker.hpp>
 
 #if WITH_LIBDBUS
@@ -48,6 +51,12 @@
 
 using namespace std::literals;
 
+namespace {
+// Budgets for listing directories ahead of time
+int const prefetch_max_per_directory = 16;
+int64_t const prefetch_max_listing_size = 1024 * 1024;
+}
+
 class CQueueViewDropTarget final : public CFileDropTarget<wxListCtrlEx>
 {
 public:
@@ -372,7 +381,7 @@ bool CQueueView::QueueFiles(const bool queueOnly, const CLocalPath& localPath, c
 	return true;
 }
 
-bool CQueueView::QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing)
+bool CQueueView::QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing, bool sharedRead)
 {
 	CServerItem* pServerItem = CreateServerItem(site);
 
@@ -383,6 +392,11 @@ bool CQueueView::QueueFiles(const bool queueOnly, Site const& site, CLocalRecurs
 		InsertItem(pServerItem, fileItem);
 	}
 	else {
+		if (!queueOnly) {
+			// Directories of files that are only queued get created by their transfers
+			pServerItem->PlanDirectory(listing.remotePath);
+		}
+
 		for (auto const& file : files) {
 			transfer_flags flags{};
 			if (queueOnly) {
@@ -393,6 +407,9 @@ bool CQueueView::QueueFiles(const bool queueOnly, Site const& site, CLocalRecurs
 			CFileItem* fileItem = new CFileItem(pServerItem, flags,
 				file.name, std::wstring(),
 				listing.localPath, listing.remotePath, file.size, {});
+			if (sharedRead) {
+				fileItem->SetSharedRead(m_pMainFrame->GetEngineContext().GetMulticastReaderHub().announce(listing.localPath.GetPath() + file.name));
+			}
 
 			InsertItem(pServerItem, fileItem);
 		}
@@ -446,6 +463,13 @@ void CQueueView::ProcessNotification(t_EngineData *pEngineData, std::unique_ptr<
 	case nId_asyncrequest:
 		{
 			auto asyncRequestNotification = unique_static_cast<CAsyncRequestNotification>(std::move(pNotification));
+			if (pEngineData->state == t_EngineData::prewarm && asyncRequestNotification->GetRequestID() == reqId_interactiveLogin) {
+				// Servers can ask for further input regardless of the logon type.
+				// Leave the logon to the transfers, they may prompt.
+				m_prewarmInteractive.insert(pEngineData->lastSite.server);
+				pEngineData->pEngine->Cancel();
+				break;
+			}
 			if (pEngineData->pItem) {
 				switch (asyncRequestNotification->GetRequestID()) {
 					case reqId_fileexists:
@@ -489,7 +513,14 @@ void CQueueView::ProcessNotification(t_EngineData *pEngineData, std::unique_ptr<
 		}
 		break;
 	case nId_transferstatus:
-		if (pEngineData->pItem && pEngineData->pStatusLineCtrl) {
+		if (pEngineData->state == t_EngineData::prefetch && pEngineData->active) {
+			// Don't let huge directories eat up the bandwidth
+			auto const& status = static_cast<CTransferStatusNotification const&>(*pNotification).GetStatus();
+			if (status && status.currentOffset > prefetch_max_listing_size) {
+				pEngineData->pEngine->Cancel();
+			}
+		}
+		else if (pEngineData->pItem && pEngineData->pStatusLineCtrl) {
 			auto const& transferStatusNotification = static_cast<CTransferStatusNotification const&>(*pNotification);
 			CTransferStatus const& status = transferStatusNotification.GetStatus();
 			if (pEngineData->active) {
@@ -548,7 +579,7 @@ bool CQueueView::CanStartTransfer(CServerItem const & server_item, t_EngineData
 		return true;
 	}
 
-	unsigned int active_count = static_cast<unsigned int>(server_item.m_activeCount);
+	unsigned int active_count = static_cast<unsigned int>(server_item.m_activeCount + server_item.GetDirectoryBatchCount());
 
 	CState* browsingStateOnSameServer = 0;
 	const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
@@ -776,6 +807,152 @@ bool CQueueView::TryStartNextTransfer()
 	return true;
 }
 
+void CQueueView::PrewarmConnections()
+{
+	if (m_quit || !m_activeMode) {
+		return;
+	}
+
+	int const maxPrewarm = options_.get_int(OPTION_PREWARM_CONNECTIONS);
+	if (m_prewarmCount >= maxPrewarm) {
+		return;
+	}
+
+	int const maxTransfers = options_.get_int(OPTION_NUMTRANSFERS);
+
+	// Connections being prewarmed occupy transfer slots just like transfers do
+	int freeSlots = maxTransfers - m_activeCount - m_prewarmCount;
+	if (freeSlots <= 0) {
+		return;
+	}
+
+	for (auto const& serverItem : m_serverList) {
+		Site const& site = serverItem->GetSite();
+
+		// Files that are going to need a connection of their own
+		int const queued = GetWaitingFileCount(*serverItem);
+		if (queued <= 0) {
+			continue;
+		}
+
+		int limit = maxTransfers;
+		if (site.connection_limit_) {
+			if (static_cast<int>(site.connection_limit_) < limit) {
+				limit = site.connection_limit_;
+			}
+
+			// As in CanStartTransfer, a browsing connection counts towards the site's limit
+			for (auto pState : *CContextManager::Get()->GetAllStates()) {
+				Site const& browsingSite = pState->GetSite();
+				if (browsingSite && browsingSite.server == site.server) {
+					--limit;
+					break;
+				}
+			}
+		}
+
+		// Connections that are logged in or logging in and can take a file
+		int warm = 0;
+		std::vector<t_EngineData*> unconnected;
+		int engines = 0;
+		for (auto const& pEngineData : m_engineData) {
+			if (pEngineData->transient) {
+				continue;
+			}
+			++engines;
+			if (pEngineData->active) {
+				if (pEngineData->state == t_EngineData::prewarm && pEngineData->lastSite == site) {
+					++warm;
+				}
+				continue;
+			}
+
+			if (!pEngineData->pEngine->IsConnected()) {
+				unconnected.push_back(pEngineData);
+			}
+			else if (pEngineData->lastSite == site) {
+				++warm;
+			}
+		}
+
+		// The site's idle slots, as far as there are files to fill them with
+		int const idle = limit - serverItem->m_activeCount - serverItem->GetDirectoryBatchCount();
+		int wanted = std::min(std::min(queued, idle) - warm, freeSlots);
+		if (wanted <= 0) {
+			continue;
+		}
+
+		Site connectSite = site;
+		if (!CanPrewarm(connectSite)) {
+			continue;
+		}
+
+		ApplySiteSpeedLimits(m_pMainFrame->GetEngineContext(), connectSite);
+		for (; wanted > 0; --wanted) {
+			t_EngineData* pEngineData;
+			if (!unconnected.empty()) {
+				pEngineData = unconnected.back();
+				unconnected.pop_back();
+			}
+			else if (engines < maxTransfers) {
+				pEngineData = CreateEngine();
+				++engines;
+			}
+			else {
+				return;
+			}
+
+			int res = pEngineData->pEngine->Execute(CConnectCommand(connectSite.server, connectSite.Handle(), connectSite.credentials, false));
+			if (res != FZ_REPLY_WOULDBLOCK) {
+				break;
+			}
+
+			delete pEngineData->m_idleDisconnectTimer;
+			pEngineData->m_idleDisconnectTimer = 0;
+			pEngineData->lastSite = connectSite;
+			pEngineData->active = true;
+			pEngineData->state = t_EngineData::prewarm;
+			if (++m_prewarmCount >= maxPrewarm || --freeSlots <= 0) {
+				return;
+			}
+		}
+	}
+}
+
+bool CQueueView::CanPrewarm(Site & site)
+{
+	// Don't prompt for passwords, one-time codes or key passphrases in the background
+	if (site.credentials.logonType_ == LogonType::interactive || m_prewarmInteractive.count(site.server)) {
+		return false;
+	}
+
+	auto failed = m_prewarmFailed.find(site.server);
+	if (failed != m_prewarmFailed.end()) {
+		if ((fz::monotonic_clock::now() - failed->second) < fz::duration::from_seconds(60)) {
+			return false;
+		}
+		m_prewarmFailed.erase(failed);
+	}
+
+	return CLoginManager::Get().GetPassword(site, true);
+}
+
+int CQueueView::GetWaitingFileCount(CServerItem const& serverItem) const
+{
+	return static_cast<int>(serverItem.GetQueuedFileCount(m_activeMode == 1)) - serverItem.m_activeCount;
+}
+
+void CQueueView::StopPrewarm(t_EngineData& data)
+{
+	wxASSERT(data.state == t_EngineData::prewarm);
+	wxASSERT(m_prewarmCount > 0);
+	if (m_prewarmCount > 0) {
+		--m_prewarmCount;
+	}
+	data.active = false;
+	data.state = t_EngineData::none;
+}
+
 void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification const& notification)
 {
 	wxASSERT(notification.commandId_ != ::Command::none);
@@ -786,6 +963,40 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 	// Process reply from the engine
 	int replyCode = notification.replyCode_;
 
+	if (pEngineData->state == t_EngineData::mkdirbatch) {
+		// Failures are left to the transfers, they create missing directories themselves
+		CServerItem* pServerItem = GetServerItem(pEngineData->lastSite);
+		if (pServerItem) {
+			pServerItem->DirectoryBatchFinished();
+		}
+		pEngineData->active = false;
+		pEngineData->state = t_EngineData::none;
+		AdvanceQueue();
+		return;
+	}
+
+	if (pEngineData->state == t_EngineData::prefetch) {
+		wxASSERT(m_prefetchCount > 0);
+		if (m_prefetchCount > 0) {
+			--m_prefetchCount;
+		}
+		pEngineData->active = false;
+		pEngineData->state = t_EngineData::none;
+		pEngineData->prefetchPath.clear();
+		AdvanceQueue();
+		return;
+	}
+
+	if (pEngineData->state == t_EngineData::prewarm) {
+		if (replyCode != FZ_REPLY_OK && (replyCode & FZ_REPLY_CANCELED) != FZ_REPLY_CANCELED) {
+			// Leave reporting the error to the transfer, but don't keep hammering the server
+			m_prewarmFailed[pEngineData->lastSite.server] = fz::monotonic_clock::now();
+		}
+		StopPrewarm(*pEngineData);
+		AdvanceQueue();
+		return;
+	}
+
 	if ((replyCode & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED) {
 		ResetReason reason;
 		if (pEngineData->pItem) {
@@ -1072,6 +1283,7 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 				Site const site = ((CServerItem*)data.pItem->GetTopLevelItem())->GetSite();
 
 				RemoveItem(data.pItem, false);
+				data.pItem->SetSharedRead({});
 
 				CQueueViewFailed* pQueueViewFailed = m_pQueue->GetQueueView_Failed();
 				CServerItem* pNewServerItem = pQueueViewFailed->CreateServerItem(site);
@@ -1094,6 +1306,7 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 
 					CServerItem* pNewServerItem = pQueueViewSuccessful->CreateServerItem(site);
 					static_cast<CFileItem&>(*data.pItem).clear_persistent_state();
+					data.pItem->SetSharedRead({});
 					data.pItem->UpdateTime();
 					data.pItem->SetParent(pNewServerItem);
 					data.pItem->SetStatusMessage(CFileItem::Status::none);
@@ -1233,6 +1446,7 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 			engineData.pItem->SetStatusMessage(CFileItem::Status::connecting);
 			RefreshItem(engineData.pItem);
 
+			ApplySiteSpeedLimits(m_pMainFrame->GetEngineContext(), engineData.lastSite);
 			int res = engineData.pEngine->Execute(CConnectCommand(engineData.lastSite.server, engineData.lastSite.Handle(), engineData.lastSite.credentials, false));
 
 			wxASSERT((res & FZ_REPLY_BUSY) != FZ_REPLY_BUSY);
@@ -1280,9 +1494,19 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 
 			int res;
 			if (!fileItem->Download()) {
-				auto cmd = CFileTransferCommand(fz::file_reader_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
-					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags, persistentState);
-				res = engineData.pEngine->Execute(cmd);
+				auto & context = m_pMainFrame->GetEngineContext();
+				std::wstring const localFile = fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile();
+				if (extraData && extraData->sharedRead_) {
+					// Also queued for other sites, try to read it only once
+					auto cmd = CFileTransferCommand(multicast_reader_factory(localFile, context.GetThreadPool(), context.GetMulticastReaderHub()),
+						fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags, persistentState);
+					res = engineData.pEngine->Execute(cmd);
+				}
+				else {
+					auto cmd = CFileTransferCommand(fz::file_reader_factory(localFile, context.GetThreadPool()),
+						fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags, persistentState);
+					res = engineData.pEngine->Execute(cmd);
+				}
 			}
 			else {
 				auto cmd = CFileTransferCommand(fz::file_writer_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
@@ -1381,6 +1605,10 @@ bool CQueueView::SetActive(bool active)
 				}
 				ResetEngine(*pEngineData, ResetReason::reset);
 			}
+			else if (pEngineData->state == t_EngineData::prewarm || pEngineData->state == t_EngineData::prefetch || pEngineData->state == t_EngineData::mkdirbatch) {
+				// Reply gets processed as usual
+				pEngineData->pEngine->Cancel();
+			}
 			else {
 				wxASSERT(pEngineData->pEngine);
 				if (!pEngineData->pEngine) {
@@ -2300,16 +2528,24 @@ t_EngineData* CQueueView::GetIdleEngine(Site const& site, bool allowTransient)
 		// Check whether we can create another engine
 		const int newEngineCount = options_.get_int(OPTION_NUMTRANSFERS);
 		if (newEngineCount > static_cast<int>(m_engineData.size()) - transient) {
-			pFirstIdle = new t_EngineData;
-			pFirstIdle->pEngine = new CFileZillaEngine(m_pMainFrame->GetEngineContext(), fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnEngineEvent(engine); }));
-
-			m_engineData.push_back(pFirstIdle);
+			pFirstIdle = CreateEngine();
 		}
 	}
 
 	return pFirstIdle;
 }
 
+t_EngineData* CQueueView::CreateEngine()
+{
+	t_EngineData* pEngineData = new t_EngineData;
+	pEngineData->pEngine = new CFileZillaEngine(m_pMainFrame->GetEngineContext(), fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnEngineEvent(engine); }));
+	pEngineData->pEngine->SetRateLimitGroup(_("Transfer queue").ToStdWstring());
+
+	m_engineData.push_back(pEngineData);
+
+	return pEngineData;
+}
+
 
 t_EngineData* CQueueView::GetEngineData(CFileZillaEngine const* pEngine)
 {
@@ -2395,6 +2631,168 @@ void CQueueView::TryRefreshListings()
 	}
 }
 
+void CQueueView::PrefetchListings(Site const& site, std::vector<CServerPath> && paths)
+{
+	if (!options_.get_int(OPTION_PREFETCH_LISTINGS)) {
+		return;
+	}
+
+	if (m_prefetchSite != site) {
+		CancelPrefetch();
+		m_prefetchSite = site;
+	}
+
+	m_prefetchPaths.clear();
+	for (auto & path : paths) {
+		if (static_cast<int>(m_prefetchPaths.size()) >= m_prefetchBudget) {
+			break;
+		}
+
+		bool listing{};
+		for (auto const& pEngineData : m_engineData) {
+			if (pEngineData->state == t_EngineData::prefetch && pEngineData->prefetchPath == path) {
+				listing = true;
+				break;
+			}
+		}
+		if (!listing) {
+			m_prefetchPaths.push_back(std::move(path));
+		}
+	}
+
+	TryPrefetchListings();
+}
+
+void CQueueView::CancelPrefetch(CServerPath const& keep)
+{
+	m_prefetchPaths.clear();
+	m_prefetchBudget = prefetch_max_per_directory;
+
+	for (auto const& pEngineData : m_engineData) {
+		if (pEngineData->active && pEngineData->state == t_EngineData::prefetch && pEngineData->prefetchPath != keep) {
+			pEngineData->pEngine->Cancel();
+		}
+	}
+}
+
+void CQueueView::TryPrefetchListings()
+{
+	if (m_quit || m_prefetchPaths.empty()) {
+		return;
+	}
+
+	int const maxPrefetch = options_.get_int(OPTION_PREFETCH_LISTINGS);
+	while (m_prefetchCount < maxPrefetch && !m_prefetchPaths.empty() && m_prefetchBudget > 0) {
+		// Only ever use engines not needed by the queue
+		t_EngineData* pEngineData = GetIdleEngine(m_prefetchSite);
+		if (!pEngineData) {
+			return;
+		}
+
+		if (!pEngineData->pEngine->IsConnected()) {
+			// Wait for connections already being made
+			for (auto const& data : m_engineData) {
+				if (data->state == t_EngineData::prewarm && data->lastSite == m_prefetchSite) {
+					return;
+				}
+			}
+
+			// Connecting counts against the same cap as prewarming for the queue
+			if (m_prewarmCount >= options_.get_int(OPTION_PREWARM_CONNECTIONS)) {
+				return;
+			}
+
+			Site site = m_prefetchSite;
+			if (!CanPrewarm(site)) {
+				return;
+			}
+
+			ApplySiteSpeedLimits(m_pMainFrame->GetEngineContext(), site);
+			if (pEngineData->pEngine->Execute(CConnectCommand(site.server, site.Handle(), site.credentials, false)) != FZ_REPLY_WOULDBLOCK) {
+				return;
+			}
+
+			delete pEngineData->m_idleDisconnectTimer;
+			pEngineData->m_idleDisconnectTimer = 0;
+			pEngineData->lastSite = site;
+			pEngineData->active = true;
+			pEngineData->state = t_EngineData::prewarm;
+			++m_prewarmCount;
+			return;
+		}
+		else if (pEngineData->lastSite != m_prefetchSite) {
+			// Don't steal connections to other sites
+			return;
+		}
+
+		CServerPath const path = m_prefetchPaths.front();
+		m_prefetchPaths.pop_front();
+
+		int res = pEngineData->pEngine->Execute(CListCommand(path, std::wstring(), LIST_FLAG_AVOID));
+		if (res != FZ_REPLY_WOULDBLOCK) {
+			// Already in the cache
+			continue;
+		}
+
+		delete pEngineData->m_idleDisconnectTimer;
+		pEngineData->m_idleDisconnectTimer = 0;
+		pEngineData->active = true;
+		pEngineData->state = t_EngineData::prefetch;
+		pEngineData->prefetchPath = path;
+		++m_prefetchCount;
+		--m_prefetchBudget;
+	}
+}
+
+void CQueueView::TryCreateDirectories()
+{
+	if (m_quit || !m_activeMode) {
+		return;
+	}
+
+	int const maxTransfers = options_.get_int(OPTION_NUMTRANSFERS);
+	for (auto * pServerItem : m_serverList) {
+		if (!pServerItem->HasPlannedDirectories()) {
+			continue;
+		}
+
+		Site const& site = pServerItem->GetSite();
+		int connections = maxTransfers;
+		if (site.connection_limit_ && static_cast<int>(site.connection_limit_) < connections) {
+			connections = site.connection_limit_;
+		}
+
+		for (;;) {
+			// Batches count against the connection limit like transfers do
+			if (pServerItem->m_activeCount + pServerItem->GetDirectoryBatchCount() >= connections) {
+				break;
+			}
+
+			// Only use established connections, starting the transfers takes care of connecting.
+			t_EngineData* pEngineData = GetIdleEngine(site);
+			if (!pEngineData || !pEngineData->pEngine->IsConnected() || pEngineData->lastSite != site) {
+				break;
+			}
+
+			auto paths = pServerItem->TakeDirectoryBatch(connections);
+			if (paths.empty()) {
+				break;
+			}
+
+			int res = pEngineData->pEngine->Execute(CMkdirCommand(std::move(paths), transfer_flags{}));
+			if (res != FZ_REPLY_WOULDBLOCK) {
+				pServerItem->DirectoryBatchFinished();
+				continue;
+			}
+
+			delete pEngineData->m_idleDisconnectTimer;
+			pEngineData->m_idleDisconnectTimer = 0;
+			pEngineData->active = true;
+			pEngineData->state = t_EngineData::mkdirbatch;
+		}
+	}
+}
+
 void CQueueView::OnAskPassword()
 {
 	while (!m_waitingForPassword.empty()) {
@@ -2463,9 +2861,13 @@ void CQueueView::AdvanceQueue(bool refresh)
 	}
 
 	insideAdvanceQueue = true;
+	TryCreateDirectories();
 	while (TryStartNextTransfer()) {
 	}
 
+	PrewarmConnections();
+	TryPrefetchListings();
+
 	// Set timer for connected, idle engines
 	for (unsigned int i = 0; i < m_engineData.size(); ++i) {
 		if (m_engineData[i]->active || m_engineData[i]->transient) {
@@ -2543,6 +2945,15 @@ void CQueueView::OnTimer(wxTimerEvent& event)
 
 	for (auto & pData : m_engineData) {
 		if (pData->m_idleDisconnectTimer && !pData->m_idleDisconnectTimer->IsRunning()) {
+			if (m_activeMode && pData->pEngine->IsConnected()) {
+				// Keep prewarmed connections around as long as files are waiting for them
+				auto it = std::find_if(m_serverList.cbegin(), m_serverList.cend(), [&](CServerItem const* item) { return item->GetSite() == pData->lastSite; });
+				if (it != m_serverList.cend() && GetWaitingFileCount(**it) > 0) {
+					pData->m_idleDisconnectTimer->Start(60000, true);
+					continue;
+				}
+			}
+
 			delete pData->m_idleDisconnectTimer;
 			pData->m_idleDisconnectTimer = 0;
 
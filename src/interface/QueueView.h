@@ -14,7 +14,9 @@
 
 #include <wx/progdlg.h>
 
+#include <deque>
 #include <list>
+#include <map>
 #include <set>
 
 namespace ActionAfterState {
@@ -73,11 +75,17 @@ struct t_EngineData final
 		list,
 		mkdir,
 		askpassword,
-		waitprimary
+		waitprimary,
+		prewarm, // Connecting ahead of time, holds a slot within the transfer limit
+		prefetch, // Listing a directory ahead of time, likewise
+		mkdirbatch // Creating directories ahead of the transfers, likewise
 	} state;
 
 	CFileItem* pItem;
 	Site lastSite;
+
+	// Directory being listed in prefetch state
+	CServerPath prefetchPath;
 	CStatusLineCtrl* pStatusLineCtrl;
 	wxTimer* m_idleDisconnectTimer;
 };
@@ -129,7 +137,9 @@ public:
 
 	void QueueFile_Finish(const bool start); // Need to be called after QueueFile
 	bool QueueFiles(const bool queueOnly, CLocalPath const& localPath, const CRemoteDataObject& dataObject);
-	bool QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing);
+	// If sharedRead is set, the files are also queued for other sites and
+	// concurrent uploads of the same file may share reads.
+	bool QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing, bool sharedRead = false);
 
 	void QueueProxyTransfer(const Site& sourceSite, const CServerPath& sourcePath, const std::wstring& fileName, const Site& targetSite, const CServerPath& targetPath);
 
@@ -156,6 +166,15 @@ public:
 
 	void RenameFileInTransfer(CFileZillaEngine *pEngine, std::wstring const& newName, bool local, fz::writer_factory_holder & new_writer);
 
+	// Lists the given directories in the background using idle transfer
+	// connections, so that entering them is served from the cache.
+	// Replaces directories of previous calls that have not been listed yet.
+	void PrefetchListings(Site const& site, std::vector<CServerPath> && paths);
+
+	// Called when navigating elsewhere, stops prefetching anything but the
+	// directory that got entered.
+	void CancelPrefetch(CServerPath const& keep = CServerPath());
+
 	static std::wstring ReplaceInvalidCharacters(COptionsBase& options, std::wstring const& filename, bool includeQuotesAndBreaks = false);
 
 	std::shared_ptr<CActionAfterBlocker> GetActionAfterBlocker();
@@ -175,6 +194,31 @@ protected:
 	// whether it is allowed to start another transfer on that server item
 	bool CanStartTransfer(const CServerItem& server_item, t_EngineData *&pEngineData);
 
+	// Connects idle engines to sites with queued files that are waiting
+	// for a free slot, so that their transfers can start right away.
+	void PrewarmConnections();
+	void StopPrewarm(t_EngineData& data);
+
+	// Fills in the password. Fails if logging on could need user input.
+	bool CanPrewarm(Site & site);
+	int GetWaitingFileCount(CServerItem const& serverItem) const;
+	int m_prewarmCount{};
+	std::map<CServer, fz::monotonic_clock> m_prewarmFailed;
+
+	// Servers that asked for input while logging on in the background
+	std::set<CServer> m_prewarmInteractive;
+
+	void TryPrefetchListings();
+	Site m_prefetchSite;
+	std::deque<CServerPath> m_prefetchPaths;
+	int m_prefetchCount{};
+
+	// Number of directories that may still be prefetched until the next navigation
+	int m_prefetchBudget{};
+
+	// Hands the directories planned for recursive uploads to idle connections
+	void TryCreateDirectories();
+
 	void ProcessReply(t_EngineData* pEngineData, COperationNotification const& notification);
 	void SendNextCommand(t_EngineData& engineData);
 
@@ -223,6 +267,7 @@ protected:
 	bool IsOtherEngineConnected(t_EngineData* pEngineData);
 
 	t_EngineData* GetIdleEngine(Site const& site = Site(), bool allowTransient = false);
+	t_EngineData* CreateEngine();
 	t_EngineData* GetEngineData(const CFileZillaEngine* pEngine);
 
 	std::vector<t_EngineData*> m_engineData;
@@ -21,9 +21,11 @@
 #include "queue.h"
 #include "RemoteListView.h"
 #include "remote_recursive_operation.h"
+#include "StatusView.h"
 #include "timeformatting.h"
 
 #include "../commonui/misc.h"
+#include "../commonui/tree_sync.h"
 
 #include "../include/sizeformatting.h"
 
@@ -400,10 +402,12 @@ protected:
 
 BEGIN_EVENT_TABLE(CRemoteListView, CFileListCtrl<CGenericFileData>)
 	EVT_LIST_ITEM_ACTIVATED(wxID_ANY, CRemoteListView::OnItemActivated)
+	EVT_LIST_ITEM_SELECTED(wxID_ANY, CRemoteListView::OnSelectionForPrefetch)
 	EVT_CONTEXT_MENU(CRemoteListView::OnContextMenu)
 	// Map both ID_DOWNLOAD and ID_ADDTOQUEUE to OnMenuDownload, code is identical
 	EVT_MENU(XRCID("ID_DOWNLOAD"), CRemoteListView::OnMenuDownload)
 	EVT_MENU(XRCID("ID_ADDTOQUEUE"), CRemoteListView::OnMenuDownload)
+	EVT_MENU(XRCID("ID_SYNC_DOWNLOAD"), CRemoteListView::OnMenuSyncDownload)
 	EVT_MENU(XRCID("ID_MKDIR"), CRemoteListView::OnMenuMkdir)
 	EVT_MENU(XRCID("ID_MKDIR_CHGDIR"), CRemoteListView::OnMenuMkdirChgDir)
 	EVT_MENU(XRCID("ID_NEW_FILE"), CRemoteListView::OnMenuNewfile)
@@ -826,6 +830,11 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	if (reset) {
 		ResetSearchPrefix();
 
+		if (m_pQueue) {
+			m_pQueue->CancelPrefetch(pDirectoryListing ? pDirectoryListing->path : CServerPath());
+			SchedulePrefetch();
+		}
+
 		if (IsComparing() && m_pDirectoryListing) {
 			ExitComparisonMode();
 		}
@@ -965,6 +974,76 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	}
 }
 
+void CRemoteListView::OnSelectionForPrefetch(wxListEvent& event)
+{
+	event.Skip();
+	SchedulePrefetch();
+}
+
+void CRemoteListView::SchedulePrefetch()
+{
+	if (!m_prefetchPending && m_pQueue && options_.get_int(OPTION_PREFETCH_LISTINGS)) {
+		m_prefetchPending = true;
+		CallAfter(&CRemoteListView::PrefetchSelected);
+	}
+}
+
+void CRemoteListView::PrefetchSelected()
+{
+	m_prefetchPending = false;
+
+	Site const& site = m_state.GetSite();
+	if (!site || !m_pDirectoryListing || IsComparing()) {
+		return;
+	}
+
+	// The focused item is the most likely one to be entered next
+	std::vector<int> items;
+	int const focused = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED);
+	if (focused > 0) {
+		items.push_back(focused);
+	}
+	int item = -1;
+	while ((item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) != -1 && items.size() < 8) {
+		if (item && item != focused) {
+			items.push_back(item);
+		}
+	}
+
+	std::vector<CServerPath> paths;
+	for (int i : items) {
+		int index = GetItemIndex(i);
+		if (index == -1 || m_fileData[index].comparison_flags == fill) {
+			continue;
+		}
+
+		CDirentry const& entry = (*m_pDirectoryListing)[index];
+		if (!entry.is_dir() || entry.is_link()) {
+			continue;
+		}
+
+		CServerPath path = m_pDirectoryListing->path;
+		if (path.AddSegment(entry.name)) {
+			paths.push_back(std::move(path));
+		}
+	}
+
+	// Followed by directories next to this one the user has been going back and forth between.
+	// Only those no longer cached, so that no connection gets opened just to hit the cache.
+	CDirectoryListing listing;
+	for (auto & sibling : m_state.GetRecentlyVisitedRemoteSiblings(m_pDirectoryListing->path)) {
+		if (m_state.engine_->CacheLookup(sibling, listing) != FZ_REPLY_OK &&
+			std::find(paths.cbegin(), paths.cend(), sibling) == paths.cend())
+		{
+			paths.push_back(std::move(sibling));
+		}
+	}
+
+	if (!paths.empty()) {
+		m_pQueue->PrefetchListings(site, std::move(paths));
+	}
+}
+
 void CRemoteListView::OnItemActivated(wxListEvent &event)
 {
 	int const action = options_.get_int(OPTION_DOUBLECLICK_ACTION_DIRECTORY);
@@ -1169,6 +1248,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 	item = new wxMenuItem(&menu, XRCID("ID_ADDTOQUEUE"), _("&Add files to queue"), _("Add selected files and folders to the transfer queue"));
 	item->SetBitmap(MakeBmpBundle(wxArtProvider::GetBitmap(_T("ART_DOWNLOADADD"), wxART_MENU)));
 	menu.Append(item);
+	menu.Append(XRCID("ID_SYNC_DOWNLOAD"), _("S&ynchronize to local"), _("Download only those of the selected files and directories that are missing or differ locally"));
 	menu.Append(XRCID("ID_ENTER"), _("E&nter directory"), _("Enter selected directory"));
 	menu.Append(XRCID("ID_EDIT"), _("&View/Edit"));
 
@@ -1208,6 +1288,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 			menu.Delete(XRCID("ID_ENTER"));
 		}
 		menu.Enable(XRCID("ID_DOWNLOAD"), false);
+		menu.Enable(XRCID("ID_SYNC_DOWNLOAD"), false);
 		menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 		menu.Enable(XRCID("ID_MKDIR"), false);
 		menu.Enable(XRCID("ID_MKDIR_CHGDIR"), false);
@@ -1223,6 +1304,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 	else if (GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED) == -1) {
 		menu.Delete(XRCID("ID_ENTER"));
 		menu.Enable(XRCID("ID_DOWNLOAD"), false);
+		menu.Enable(XRCID("ID_SYNC_DOWNLOAD"), false);
 		menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 		menu.Enable(XRCID("ID_DELETE"), false);
 		menu.Enable(XRCID("ID_RENAME"), false);
@@ -1267,6 +1349,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 		if (!count || fillCount == count) {
 			menu.Delete(XRCID("ID_ENTER"));
 			menu.Enable(XRCID("ID_DOWNLOAD"), false);
+			menu.Enable(XRCID("ID_SYNC_DOWNLOAD"), false);
 			menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 			menu.Enable(XRCID("ID_DELETE"), false);
 			menu.Enable(XRCID("ID_RENAME"), false);
@@ -1294,11 +1377,16 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 
 			if (!m_state.GetLocalDir().IsWriteable()) {
 				menu.Enable(XRCID("ID_DOWNLOAD"), false);
+				menu.Enable(XRCID("ID_SYNC_DOWNLOAD"), false);
 				menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 			}
 		}
 	}
 
+	if (!m_state.IsRemoteIdle()) {
+		menu.Enable(XRCID("ID_SYNC_DOWNLOAD"), false);
+	}
+
 	menu.Delete(XRCID(wxGetKeyState(WXK_SHIFT) ? "ID_GETURL" : "ID_GETURL_PASSWORD"));
 
 	PopupMenu(&menu);
@@ -1338,6 +1426,83 @@ void CRemoteListView::OnMenuDownload(wxCommandEvent& event)
 	TransferSelectedFiles(localDir, event.GetId() == XRCID("ID_ADDTOQUEUE"));
 }
 
+void CRemoteListView::OnMenuSyncDownload(wxCommandEvent&)
+{
+	CLocalPath const localDir = m_state.GetLocalDir();
+	CRemoteRecursiveOperation* pRecursiveOperation = m_state.GetRemoteRecursiveOperation();
+	Site const& site = m_state.GetSite();
+	if (!localDir.IsWriteable() || !m_pDirectoryListing || !site || !pRecursiveOperation || pRecursiveOperation->IsActive() || !m_state.IsRemoteIdle()) {
+		wxBell();
+		return;
+	}
+
+	auto sync = std::make_unique<tree_sync>(fz::duration::from_minutes(options_.get_int(OPTION_COMPARISON_THRESHOLD)));
+
+	// Only the selected files get compared, the other local files
+	// of this directory are none of our business.
+	sync->begin_download_dir(localDir);
+
+	bool added = false;
+	long item = -1;
+
+	recursion_root root(m_pDirectoryListing->path, false);
+	for (;;) {
+		item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+		if (item == -1) {
+			break;
+		}
+		if (!item) {
+			continue;
+		}
+
+		int index = GetItemIndex(item);
+		if (index == -1) {
+			continue;
+		}
+		if (m_fileData[index].comparison_flags == fill) {
+			continue;
+		}
+
+		CDirentry const& entry = (*m_pDirectoryListing)[index];
+		std::wstring const& name = entry.name;
+
+		if (entry.is_dir()) {
+			CLocalPath local_path(localDir);
+			local_path.AddSegment(CQueueView::ReplaceInvalidCharacters(options_, name));
+			root.add_dir_to_visit(m_pDirectoryListing->path, name, local_path, entry.is_link());
+		}
+		else {
+			std::wstring localFile = CQueueView::ReplaceInvalidCharacters(options_, name);
+			if (m_pDirectoryListing->path.GetType() == VMS && options_.get_int(OPTION_STRIP_VMS_REVISION)) {
+				localFile = StripVMSRevision(localFile);
+			}
+			if (!sync->need_download(localFile, entry.size, entry.has_date() ? entry.time : fz::datetime())) {
+				continue;
+			}
+			m_pQueue->QueueFile(false, true,
+				name, (name == localFile) ? std::wstring() : localFile,
+				localDir, m_pDirectoryListing->path, site, entry.size);
+			added = true;
+		}
+	}
+	if (added) {
+		m_pQueue->QueueFile_Finish(true);
+	}
+
+	if (!root.empty()) {
+		pRecursiveOperation->AddRecursionRoot(std::move(root));
+		pRecursiveOperation->SetTreeSync(std::move(sync));
+		CFilterManager filter;
+		pRecursiveOperation->StartRecursiveOperation(recursive_operation::recursive_transfer, filter.GetActiveFilters(), true, true);
+		if (!pRecursiveOperation->IsActive()) {
+			pRecursiveOperation->SetTreeSync(nullptr);
+		}
+	}
+	else if (m_state.GetMainFrame().GetStatusView()) {
+		m_state.GetMainFrame().GetStatusView()->AddToLog(logmsg::status, sync->get_plan().summary(), fz::datetime::now());
+	}
+}
+
 void CRemoteListView::TransferSelectedFiles(const CLocalPath& local_parent, bool queue_only, transfer_flags custom_flags, transfer_flags custom_flags_mask)
 {
 	bool idle = m_state.IsRemoteIdle();
@@ -107,10 +107,18 @@ protected:
 	CView *m_parentView{};
 	CEditHandler* edit_handler_{};
 
+	// Lists the selected directories and recently visited siblings of the
+	// current directory ahead of time, deferred to coalesce selection changes.
+	void SchedulePrefetch();
+	void PrefetchSelected();
+	bool m_prefetchPending{};
+
 	DECLARE_EVENT_TABLE()
 	void OnItemActivated(wxListEvent &event);
+	void OnSelectionForPrefetch(wxListEvent& event);
 	void OnContextMenu(wxContextMenuEvent& event);
 	void OnMenuDownload(wxCommandEvent& event);
+	void OnMenuSyncDownload(wxCommandEvent& event);
 	void OnMenuMkdir(wxCommandEvent&);
 	void OnMenuMkdirChgDir(wxCommandEvent&);
 	void OnMenuDelete(wxCommandEvent&);
@@ -697,6 +697,39 @@ void CRemoteTreeView::OnItemExpanding(wxTreeEvent& event)
 	}
 
 	Refresh(false);
+
+	PrefetchChildren(item);
+}
+
+void CRemoteTreeView::PrefetchChildren(wxTreeItemId const& item)
+{
+	Site const& site = m_state.GetSite();
+	if (!site || !m_pQueue || !options_.get_int(OPTION_PREFETCH_LISTINGS)) {
+		return;
+	}
+
+	// The directory itself if its contents are unknown, otherwise its subdirectories
+	std::vector<CServerPath> paths;
+	CServerPath const path = GetPathFromItem(item);
+	CDirectoryListing listing;
+	if (path.empty() || m_state.engine_->CacheLookup(path, listing) != FZ_REPLY_OK) {
+		if (!path.empty()) {
+			paths.push_back(path);
+		}
+	}
+	else {
+		wxTreeItemIdValue cookie;
+		for (wxTreeItemId child = GetFirstChild(item, cookie); child && paths.size() < 8; child = GetNextSibling(child)) {
+			CServerPath const childPath = GetPathFromItem(child);
+			if (!childPath.empty() && m_state.engine_->CacheLookup(childPath, listing) != FZ_REPLY_OK) {
+				paths.push_back(childPath);
+			}
+		}
+	}
+
+	if (!paths.empty()) {
+		m_pQueue->PrefetchListings(site, std::move(paths));
+	}
 }
 
 void CRemoteTreeView::SetItemImages(wxTreeItemId item, bool unknown)
@@ -5,6 +5,7 @@
 #include "remote_recursive_operation.h"
 #include "loginmanager.h"
 #include "queue.h"
+#include "remote_index.h"
 #include "RemoteListView.h"
 
 #include <algorithm>
@@ -314,5 +315,9 @@ void CCommandQueue::ProcessDirectoryListing(CDirectoryListingNotification const&
 
 	if (pListing && !listingNotification.Failed() && m_state.GetSite()) {
 		CContextManager::Get()->ProcessDirectoryListing(m_state.GetSite().server, pListing, listingIsRecursive ? 0 : &m_state);
+
+		if (auto * index = m_pMainFrame->GetRemoteIndex()) {
+			index->Store(m_state.GetSite().server, pListing);
+		}
 	}
 }
@@ -973,9 +973,12 @@ void CContextControl::RestoreTabs()
 			if (GetServer(tab, site) && last_path.SetSafePath(fz::to_wstring_from_utf8(tab.child("RemotePath").child_value()))) {
 				std::wstring last_site_path = fz::to_wstring_from_utf8(tab.child("Site").child_value());
 
-				std::unique_ptr<Site> ssite;
 				if (!last_site_path.empty()) {
 					auto ssite = CSiteManager::GetSiteByPath(m_mainFrame.GetOptions(), last_site_path, false).first;
+					if (!ssite) {
+						// Site might have been renamed or moved since
+						ssite = CSiteManager::GetSiteByServer(m_mainFrame.GetOptions(), site.server);
+					}
 					if (ssite && ssite->SameResource(site)) {
 						site = *ssite;
 					}
@@ -4,6 +4,7 @@
 #include "edithandler.h"
 #include "filezillaapp.h"
 #include "file_utils.h"
+#include "file_watcher.h"
 #include "Options.h"
 #include "queue.h"
 #include "textctrlex.h"
@@ -86,11 +87,14 @@ protected:
 };
 }
 
-CEditHandler::CEditHandler(COptionsBase & options)
+CEditHandler::CEditHandler(COptionsBase & options, fz::thread_pool & pool)
     : options_(options)
 {
 	m_timer.Bind(wxEVT_TIMER, [&](wxTimerEvent&) { CheckForModifications(); });
-	m_busyTimer.Bind(wxEVT_TIMER, [&](wxTimerEvent&) { CheckForModifications(); });
+	m_busyTimer.Bind(wxEVT_TIMER, [&](wxTimerEvent&) { DoCheckForModifications(); });
+
+	watcher_ = std::make_unique<CFileWatcher>(*this, pool);
+	Bind(fzEVT_WATCHED_FILES_CHANGED, [&](wxCommandEvent&) { OnWatchedFilesChanged(); });
 
 #ifdef __WXMSW__
 	m_lockfile_handle = INVALID_HANDLE_VALUE;
@@ -359,6 +363,7 @@ bool CEditHandler::AddFile(CEditHandler::fileType type, std::wstring const& loca
 
 		if (launched && options_.get_bool(OPTION_EDIT_TRACK_LOCAL)) {
 			m_fileDataList[type].emplace_back(std::move(data));
+			SetTimerState();
 		}
 		if (!launched) {
 			wxMessageBoxEx(wxString::Format(_("The file '%s' could not be opened:\nThe associated command failed"), localFile), _("Opening failed"), wxICON_EXCLAMATION);
@@ -393,6 +398,7 @@ bool CEditHandler::Remove(std::wstring const& fileName)
 	}
 
 	m_fileDataList[local].erase(iter);
+	SetTimerState();
 
 	return true;
 }
@@ -417,6 +423,7 @@ bool CEditHandler::Remove(std::wstring const& fileName, CServerPath const& remot
 	}
 
 	m_fileDataList[remote].erase(iter);
+	SetTimerState();
 
 	return true;
 }
@@ -453,6 +460,7 @@ bool CEditHandler::RemoveAll(bool force)
 		}
 	}
 	m_fileDataList[local].swap(keep);
+	SetTimerState();
 
 	return m_fileDataList[local].empty() && m_fileDataList[remote].empty();
 }
@@ -487,6 +495,7 @@ bool CEditHandler::RemoveAll(fileState state, Site const& site)
 		}
 	}
 	m_fileDataList[remote].swap(keep);
+	SetTimerState();
 
 	return true;
 }
@@ -686,9 +695,18 @@ bool CEditHandler::LaunchEditor(CEditHandler::fileType type, t_fileData& data)
 
 void CEditHandler::CheckForModifications()
 {
+	checkAll_ = true;
 	CallAfter([&]() { DoCheckForModifications(); });
 }
 
+void CEditHandler::OnWatchedFilesChanged()
+{
+	for (auto & file : watcher_->changed_files()) {
+		changedFiles_.insert(std::move(file));
+	}
+	DoCheckForModifications();
+}
+
 void CEditHandler::DoCheckForModifications()
 {
 	static bool insideCheckForModifications = false;
@@ -697,81 +715,102 @@ void CEditHandler::DoCheckForModifications()
 	}
 	insideCheckForModifications = true;
 
-	for (int i = 0; i < 2; ++i) {
-checkmodifications_loopbegin:
-		for (auto iter = m_fileDataList[i].begin(); iter != m_fileDataList[i].end(); ++iter) {
-			if (iter->state != edit) {
-				continue;
-			}
+	bool const all = checkAll_;
+	checkAll_ = false;
+	std::set<std::wstring> changed;
+	changed.swap(changedFiles_);
 
-			fz::datetime mtime;
-			bool is_link;
-			if (fz::local_filesys::get_file_info(fz::to_native(iter->localFile), is_link, 0, &mtime, 0) != fz::local_filesys::file) {
-				m_fileDataList[i].erase(iter);
+	// Remember what still needs to be checked for the next attempt
+	auto const defer = [&]() {
+		checkAll_ |= all;
+		changedFiles_.merge(changed);
+		insideCheckForModifications = false;
+	};
 
-				// Evil goto. Imo the next C++ standard needs a comefrom keyword.
-				goto checkmodifications_loopbegin;
-			}
+	bool restart;
+	do {
+		restart = false;
+		for (int i = 0; i < 2 && !restart; ++i) {
+			auto & files = m_fileDataList[i];
+			for (auto iter = files.begin(); iter != files.end(); ) {
+				if (iter->state != edit || (!all && changed.find(iter->localFile) == changed.end())) {
+					++iter;
+					continue;
+				}
 
-			if (mtime.empty()) {
-				continue;
-			}
+				fz::datetime mtime;
+				bool is_link;
+				if (fz::local_filesys::get_file_info(fz::to_native(iter->localFile), is_link, 0, &mtime, 0) != fz::local_filesys::file) {
+					iter = files.erase(iter);
+					continue;
+				}
 
-			if (!iter->modificationTime.empty() && !iter->modificationTime.compare(mtime)) {
-				continue;
-			}
+				if (mtime.empty() || (!iter->modificationTime.empty() && !iter->modificationTime.compare(mtime))) {
+					++iter;
+					continue;
+				}
 
-			// File has changed, ask user what to do
+				// File has changed, ask user what to do
 
-			m_busyTimer.Stop();
-			if (!wxDialogEx::CanShowPopupDialog()) {
-				m_busyTimer.Start(1000, true);
-				insideCheckForModifications = false;
-				return;
-			}
-			wxTopLevelWindow* pTopWindow = (wxTopLevelWindow*)wxTheApp->GetTopWindow();
-			if (pTopWindow && pTopWindow->IsIconized()) {
-				pTopWindow->RequestUserAttention(wxUSER_ATTENTION_INFO);
-				insideCheckForModifications = false;
-				return;
-			}
+				m_busyTimer.Stop();
+				if (!wxDialogEx::CanShowPopupDialog()) {
+					defer();
+					m_busyTimer.Start(1000, true);
+					return;
+				}
+				wxTopLevelWindow* pTopWindow = (wxTopLevelWindow*)wxTheApp->GetTopWindow();
+				if (pTopWindow && pTopWindow->IsIconized()) {
+					pTopWindow->RequestUserAttention(wxUSER_ATTENTION_INFO);
+					defer();
+					return;
+				}
 
-			bool remove;
-			int res = DisplayChangeNotification(CEditHandler::fileType(i), *iter, remove);
-			if (res == -1) {
-				continue;
-			}
+				bool remove;
+				int res = DisplayChangeNotification(CEditHandler::fileType(i), *iter, remove);
+				if (res == -1) {
+					++iter;
+					continue;
+				}
 
-			if (res == wxID_YES) {
-				UploadFile(CEditHandler::fileType(i), iter, remove);
-				goto checkmodifications_loopbegin;
-			}
-			else if (remove && res != wxID_CANCEL) {
-				if (i == static_cast<int>(remote)) {
-					if (fz::local_filesys::get_file_info(fz::to_native(iter->localFile), is_link, 0, &mtime, 0) != fz::local_filesys::file || wxRemoveFile(iter->localFile)) {
-						m_fileDataList[i].erase(iter);
-						goto checkmodifications_loopbegin;
+				if (res == wxID_YES) {
+					UploadFile(CEditHandler::fileType(i), iter, remove);
+				}
+				else if (remove && res != wxID_CANCEL) {
+					if (i == static_cast<int>(remote)) {
+						if (fz::local_filesys::get_file_info(fz::to_native(iter->localFile), is_link, 0, &mtime, 0) != fz::local_filesys::file || wxRemoveFile(iter->localFile)) {
+							files.erase(iter);
+						}
+						else {
+							iter->state = removing;
+						}
+					}
+					else {
+						files.erase(iter);
 					}
-					iter->state = removing;
+				}
+				else if (fz::local_filesys::get_file_info(fz::to_native(iter->localFile), is_link, 0, &mtime, 0) != fz::local_filesys::file) {
+					files.erase(iter);
 				}
 				else {
-					m_fileDataList[i].erase(iter);
-					goto checkmodifications_loopbegin;
+					iter->modificationTime = mtime;
 				}
-			}
-			else if (fz::local_filesys::get_file_info(fz::to_native(iter->localFile), is_link, 0, &mtime, 0) != fz::local_filesys::file) {
-				m_fileDataList[i].erase(iter);
-				goto checkmodifications_loopbegin;
-			}
-			else {
-				iter->modificationTime = mtime;
+
+				// The dialog ran the event loop, the lists might have changed in the meantime.
+				// Files already dealt with have their new modification time recorded.
+				restart = true;
+				break;
 			}
 		}
-	}
+	} while (restart);
 
 	SetTimerState();
 
 	insideCheckForModifications = false;
+
+	// Changes reported while the dialog was shown
+	if (checkAll_ || !changedFiles_.empty()) {
+		CallAfter([&]() { DoCheckForModifications(); });
+	}
 }
 
 int CEditHandler::DisplayChangeNotification(CEditHandler::fileType type, CEditHandler::t_fileData const& data, bool& remove)
@@ -910,15 +949,46 @@ bool CEditHandler::UploadFile(fileType type, std::list<t_fileData>::iterator ite
 
 void CEditHandler::SetTimerState()
 {
-	bool editing = GetFileCount(none, edit) != 0;
+	std::set<std::wstring> editing;
+	for (auto const& files : m_fileDataList) {
+		for (auto const& data : files) {
+			if (data.state == edit) {
+				editing.insert(data.localFile);
+			}
+		}
+	}
+
+	for (auto it = watched_.begin(); it != watched_.end(); ) {
+		if (editing.find(*it) == editing.end()) {
+			watcher_->unwatch(*it);
+			it = watched_.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	// Files might have been changed while not being watched, e.g. during an upload.
+	bool check{};
+	for (auto const& file : editing) {
+		if (watched_.insert(file).second) {
+			watcher_->watch(file);
+			check |= changedFiles_.insert(file).second;
+		}
+	}
+	if (check) {
+		CallAfter([&]() { DoCheckForModifications(); });
+	}
 
+	// Keep polling in case the watcher missed something, e.g. for network file systems
+	int const interval = watcher_->active() ? 60000 : 10000;
 	if (m_timer.IsRunning()) {
-		if (!editing) {
+		if (editing.empty() || m_timer.GetInterval() != interval) {
 			m_timer.Stop();
 		}
 	}
-	else if (editing) {
-		m_timer.Start(10000);
+	if (!editing.empty() && !m_timer.IsRunning()) {
+		m_timer.Start(interval);
 	}
 }
 
@@ -8,6 +8,12 @@
 
 #include <list>
 #include <map>
+#include <memory>
+#include <set>
+
+namespace fz {
+class thread_pool;
+}
 
 // Handles all aspects about remote file viewing/editing
 
@@ -25,12 +31,13 @@ enum type
 };
 }
 
+class CFileWatcher;
 class COptionsBase;
 class CQueueView;
 class CEditHandler final : protected wxEvtHandler
 {
 public:
-	CEditHandler(COptionsBase & options);
+	CEditHandler(COptionsBase & options, fz::thread_pool & pool);
 
 	// This tries to deletes all temporary files.
 	// If files are locked, they won't be removed though
@@ -117,7 +124,9 @@ public:
 	void SetQueue(CQueueView* pQueue) { m_pQueue = pQueue; }
 
 protected:
+	// Checks the files reported as changed, or all files if polling.
 	void DoCheckForModifications();
+	void OnWatchedFilesChanged();
 
 	/* Checks if file can be opened. One of these conditions has to be true:
 	 * - Filetype association of system has to exist
@@ -152,6 +161,12 @@ protected:
 	wxTimer m_timer;
 	wxTimer m_busyTimer;
 
+	// Files in edit state are watched, the timer only polls as fallback.
+	std::unique_ptr<CFileWatcher> watcher_;
+	std::set<std::wstring> watched_;
+	std::set<std::wstring> changedFiles_;
+	bool checkAll_{};
+
 	void RemoveTemporaryFiles(std::wstring const& temp);
 	void RemoveTemporaryFilesInSpecificDir(std::wstring const& temp);
 
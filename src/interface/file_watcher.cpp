@@ -0,0 +1,264 @@
+#include "filezilla.h"
+#include "file_watcher.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+wxDEFINE_EVENT(fzEVT_WATCHED_FILES_CHANGED, wxCommandEvent);
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+namespace {
+// Editors commonly write a file in several steps, e.g. truncate, write and
+// then touch it, or write a new file and rename it over the old one.
+fz::duration const settle_delay = fz::duration::from_milliseconds(500);
+
+uint32_t const watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+}
+
+CFileWatcher::CFileWatcher(wxEvtHandler & handler, fz::thread_pool & pool)
+	: handler_(handler)
+{
+	fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd_ == -1) {
+		return;
+	}
+	if (pipe2(wake_, O_CLOEXEC)) {
+		wake_[0] = -1;
+		wake_[1] = -1;
+		return;
+	}
+
+	thread_ = pool.spawn([this] { entry(); });
+	active_ = static_cast<bool>(thread_);
+}
+
+CFileWatcher::~CFileWatcher()
+{
+	if (thread_) {
+		char c = 0;
+		while (write(wake_[1], &c, 1) == -1 && errno == EINTR) {
+		}
+		thread_.join();
+	}
+
+	for (int fd : {fd_, wake_[0], wake_[1]}) {
+		if (fd != -1) {
+			close(fd);
+		}
+	}
+}
+
+void CFileWatcher::watch(std::wstring const& file)
+{
+	if (!active_) {
+		return;
+	}
+
+	fz::scoped_lock l(mutex_);
+	if (files_.find(file) != files_.end()) {
+		return;
+	}
+
+	std::string const native = fz::to_native(file);
+	size_t const pos = native.rfind('/');
+	if (pos == std::string::npos || pos + 1 == native.size()) {
+		return;
+	}
+	std::string const dir = pos ? native.substr(0, pos) : std::string("/");
+
+	int const wd = inotify_add_watch(fd_, dir.c_str(), watch_mask);
+	if (wd == -1) {
+		if (errno == ENOSPC || errno == ENOMEM) {
+			// Out of watches, the caller needs to poll everything
+			active_ = false;
+		}
+		return;
+	}
+
+	directories_[wd].files.emplace(native.substr(pos + 1), file);
+	files_.emplace(file, wd);
+}
+
+void CFileWatcher::unwatch(std::wstring const& file)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto it = files_.find(file);
+	if (it == files_.end()) {
+		return;
+	}
+
+	int const wd = it->second;
+	files_.erase(it);
+	pending_.erase(file);
+
+	auto dir = directories_.find(wd);
+	if (dir != directories_.end()) {
+		auto & files = dir->second.files;
+		for (auto f = files.begin(); f != files.end(); ++f) {
+			if (f->second == file) {
+				files.erase(f);
+				break;
+			}
+		}
+		if (files.empty()) {
+			inotify_rm_watch(fd_, wd);
+			directories_.erase(dir);
+		}
+	}
+}
+
+std::vector<std::wstring> CFileWatcher::changed_files()
+{
+	fz::scoped_lock l(mutex_);
+
+	std::vector<std::wstring> ret(changed_.begin(), changed_.end());
+	changed_.clear();
+	return ret;
+}
+
+void CFileWatcher::entry()
+{
+	alignas(inotify_event) char buffer[16 * 1024];
+
+	while (true) {
+		int timeout = -1;
+		{
+			fz::scoped_lock l(mutex_);
+			if (!pending_.empty()) {
+				auto const now = fz::monotonic_clock::now();
+				fz::monotonic_clock next;
+				for (auto const& p : pending_) {
+					if (!next || p.second < next) {
+						next = p.second;
+					}
+				}
+				timeout = (next > now) ? static_cast<int>((next - now).get_milliseconds()) + 1 : 0;
+			}
+		}
+
+		pollfd fds[2]{};
+		fds[0].fd = fd_;
+		fds[0].events = POLLIN;
+		fds[1].fd = wake_[0];
+		fds[1].events = POLLIN;
+		int res = poll(fds, 2, timeout);
+		if (res == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (fds[1].revents) {
+			break;
+		}
+
+		fz::scoped_lock l(mutex_);
+		bool const was_empty = changed_.empty();
+		auto const now = fz::monotonic_clock::now();
+
+		if (fds[0].revents & POLLIN) {
+			ssize_t len;
+			while ((len = read(fd_, buffer, sizeof(buffer))) > 0) {
+				for (char const* p = buffer; p < buffer + len; ) {
+					auto const& ev = *reinterpret_cast<inotify_event const*>(p);
+					p += sizeof(inotify_event) + ev.len;
+
+					if (ev.mask & IN_Q_OVERFLOW) {
+						// Events got lost, have everything checked
+						for (auto const& f : files_) {
+							changed_.insert(f.first);
+						}
+						continue;
+					}
+
+					auto dir = directories_.find(ev.wd);
+					if (dir == directories_.end()) {
+						continue;
+					}
+
+					if (ev.mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+						// Directory is gone, files in it are gone as well
+						for (auto const& f : dir->second.files) {
+							changed_.insert(f.second);
+							pending_.erase(f.second);
+							files_.erase(f.second);
+						}
+						if (!(ev.mask & IN_IGNORED)) {
+							inotify_rm_watch(fd_, ev.wd);
+						}
+						directories_.erase(dir);
+						continue;
+					}
+
+					if (!ev.len) {
+						continue;
+					}
+					auto f = dir->second.files.find(std::string_view(ev.name));
+					if (f != dir->second.files.end()) {
+						pending_[f->second] = now + settle_delay;
+					}
+				}
+			}
+		}
+
+		process_events(now);
+
+		if (was_empty && !changed_.empty()) {
+			handler_.QueueEvent(new wxCommandEvent(fzEVT_WATCHED_FILES_CHANGED));
+		}
+	}
+}
+
+void CFileWatcher::process_events(fz::monotonic_clock const& now)
+{
+	for (auto it = pending_.begin(); it != pending_.end(); ) {
+		if (it->second <= now) {
+			changed_.insert(it->first);
+			it = pending_.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+#else
+
+CFileWatcher::CFileWatcher(wxEvtHandler & handler, fz::thread_pool &)
+	: handler_(handler)
+{
+}
+
+CFileWatcher::~CFileWatcher()
+{
+}
+
+void CFileWatcher::watch(std::wstring const&)
+{
+}
+
+void CFileWatcher::unwatch(std::wstring const&)
+{
+}
+
+std::vector<std::wstring> CFileWatcher::changed_files()
+{
+	return {};
+}
+
+void CFileWatcher::entry()
+{
+}
+
+void CFileWatcher::process_events(fz::monotonic_clock const&)
+{
+}
+
+#endif
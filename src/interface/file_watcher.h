@@ -0,0 +1,69 @@
+#ifndef FILEZILLA_INTERFACE_FILE_WATCHER_HEADER
+#define FILEZILLA_INTERFACE_FILE_WATCHER_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <map>
+#include <set>
+
+wxDECLARE_EVENT(fzEVT_WATCHED_FILES_CHANGED, wxCommandEvent);
+
+// Watches files for modifications on a background thread, so that files being
+// edited need not be polled.
+//
+// Writes are debounced: A file is only reported once it has been closed after
+// writing, or moved into place, and nothing else happened to it for a short
+// while. Changes are coalesced, the handler gets a single
+// fzEVT_WATCHED_FILES_CHANGED until it calls changed_files().
+//
+// Only implemented using inotify. Otherwise, or if the watch limit has been
+// exhausted, active() returns false and the caller needs to keep polling.
+class CFileWatcher final
+{
+public:
+	CFileWatcher(wxEvtHandler & handler, fz::thread_pool & pool);
+	~CFileWatcher();
+
+	CFileWatcher(CFileWatcher const&) = delete;
+	CFileWatcher& operator=(CFileWatcher const&) = delete;
+
+	bool active() const { return active_; }
+
+	// Files need to be given with full path
+	void watch(std::wstring const& file);
+	void unwatch(std::wstring const& file);
+
+	// Returns the files that have changed, been replaced or removed since the
+	// last call.
+	std::vector<std::wstring> changed_files();
+
+private:
+	void entry();
+	void process_events(fz::monotonic_clock const& now);
+
+	wxEvtHandler & handler_;
+
+	fz::mutex mutex_;
+
+	// Watch descriptor to native names and full paths of the files in it
+	struct directory final
+	{
+		std::map<std::string, std::wstring, std::less<>> files;
+	};
+	std::map<int, directory> directories_;
+	std::map<std::wstring, int> files_;
+
+	// File and when it is considered settled
+	std::map<std::wstring, fz::monotonic_clock> pending_;
+	std::set<std::wstring> changed_;
+
+	int fd_{-1};
+	int wake_[2]{-1, -1};
+	bool active_{};
+
+	fz::async_task thread_;
+};
+
+#endif
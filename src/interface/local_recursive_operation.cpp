@@ -3,7 +3,15 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+#include <algorithm>
+
+#include "Mainfrm.h"
+#include "Options.h"
 #include "QueueView.h"
+#include "remote_recursive_operation.h"
+#include "StatusView.h"
+
+#include "../commonui/tree_sync.h"
 
 BEGIN_EVENT_TABLE(CLocalRecursiveOperation, wxEvtHandler)
 END_EVENT_TABLE()
@@ -11,8 +19,11 @@ END_EVENT_TABLE()
 
 CLocalRecursiveOperation::CLocalRecursiveOperation(CState& state)
 : local_recursive_operation(state.pool_)
+, CStateEventHandler(state)
 , state_(state)
 {
+	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR_OTHER);
+	state.RegisterHandler(this, STATECHANGE_REMOTE_RECURSION_STATUS);
 }
 
 CLocalRecursiveOperation::~CLocalRecursiveOperation()
@@ -34,7 +45,14 @@ bool CLocalRecursiveOperation::do_start_recursive_operation(OperationMode mode,
 	}
 
 	Site const& site = state_.GetSite();
-	if (site) {
+	if (!upload_targets_.empty()) {
+		if (mode != OperationMode::recursive_transfer) {
+			return false;
+		}
+
+		site_ = Site();
+	}
+	else if (site) {
 		site_ = site;
 	}
 	else {
@@ -60,12 +78,75 @@ bool CLocalRecursiveOperation::do_start_recursive_operation(OperationMode mode,
 
 void CLocalRecursiveOperation::StopRecursiveOperation()
 {
+	if (sync_) {
+		if (IsActive()) {
+			auto * statusView = state_.GetMainFrame().GetStatusView();
+			if (statusView) {
+				statusView->AddToLog(logmsg::status, sync_->get_plan().summary(), fz::datetime::now());
+			}
+		}
+
+		if (sync_listing_) {
+			// Nothing left that would need the remaining remote listings
+			sync_listing_ = false;
+			auto * remote = state_.GetRemoteRecursiveOperation();
+			if (remote && remote->GetOperationMode() == recursive_list) {
+				remote->StopRecursiveOperation();
+			}
+		}
+
+		sync_.reset();
+		sync_roots_.clear();
+		sync_local_done_ = false;
+		sync_listed_.clear();
+		sync_missing_.clear();
+		sync_parked_.clear();
+	}
+
 	local_recursive_operation::StopRecursiveOperation();
 
+	upload_scan_root_.clear();
+	upload_targets_.clear();
+
 	state_.NotifyHandlers(STATECHANGE_LOCAL_RECURSION_STATUS);
 	m_actionAfterBlocker.reset();
 }
 
+void CLocalRecursiveOperation::SetUploadTargets(CServerPath const& scan_root, std::vector<upload_target> && targets)
+{
+	if (IsActive()) {
+		return;
+	}
+
+	upload_scan_root_ = scan_root;
+	upload_targets_ = std::move(targets);
+}
+
+namespace {
+// Moves path from below old_root to below new_root
+CServerPath Rebase(CServerPath const& path, CServerPath const& old_root, CServerPath const& new_root)
+{
+	if (path.SegmentCount() < old_root.SegmentCount()) {
+		return CServerPath();
+	}
+
+	std::vector<std::wstring> segments;
+	CServerPath p = path;
+	for (size_t i = old_root.SegmentCount(); i < path.SegmentCount(); ++i) {
+		segments.push_back(p.GetLastSegment());
+		p.MakeParent();
+	}
+
+	CServerPath ret = new_root;
+	for (auto it = segments.crbegin(); it != segments.crend(); ++it) {
+		if (!ret.AddSegment(*it)) {
+			return CServerPath();
+		}
+	}
+	return ret;
+}
+}
+
 void CLocalRecursiveOperation::on_listed_directory()
 {
 	CallAfter(&CLocalRecursiveOperation::OnListedDirectory);
@@ -104,7 +185,24 @@ void CLocalRecursiveOperation::OnListedDirectory()
 		}
 		else {
 			if (queue) {
-				m_pQueue->QueueFiles(!m_immediate, site_, d);
+				if (sync_) {
+					SyncListing(d);
+				}
+				else if (upload_targets_.empty()) {
+					m_pQueue->QueueFiles(!m_immediate, site_, d);
+				}
+				else {
+					CServerPath const remotePath = std::move(d.remotePath);
+					for (auto & target : upload_targets_) {
+						d.remotePath = Rebase(remotePath, upload_scan_root_, target.remote_root_);
+						if (!d.remotePath.empty()) {
+							m_pQueue->QueueFiles(!m_immediate, target.site_, d, upload_targets_.size() > 1);
+							target.queued_files_ += d.files.size();
+							++target.queued_dirs_;
+						}
+					}
+					d.remotePath = remotePath;
+				}
 			}
 			++m_processedDirectories;
 			processed += d.files.size();
@@ -118,7 +216,14 @@ void CLocalRecursiveOperation::OnListedDirectory()
 
 	m_processedFiles += processed;
 	if (stop) {
-		StopRecursiveOperation();
+		LogWalkStatistics();
+		if (sync_ && sync_listing_ && !sync_parked_.empty()) {
+			// Remaining listings get queued once their remote counterparts are known
+			sync_local_done_ = true;
+		}
+		else {
+			StopRecursiveOperation();
+		}
 	}
 	else if (processed) {
 		state_.NotifyHandlers(STATECHANGE_LOCAL_RECURSION_STATUS);
@@ -129,6 +234,200 @@ void CLocalRecursiveOperation::OnListedDirectory()
 	}
 }
 
+void CLocalRecursiveOperation::LogWalkStatistics()
+{
+	if (COptions::Get()->get_int(OPTION_LOGGING_DEBUGLEVEL) < 2) {
+		return;
+	}
+
+	auto * statusView = state_.GetMainFrame().GetStatusView();
+	if (!statusView) {
+		return;
+	}
+
+	auto const stats = GetWalkStatistics();
+	statusView->AddToLog(logmsg::debug_info, fz::sprintf(L"Enumerated %u directories with %u entries in %d ms using %u threads, %u directories/s, %u entries/s",
+		stats.dirs_, stats.entries_, stats.elapsed_.get_milliseconds(), stats.threads_, stats.dirs_per_second(), stats.entries_per_second()), fz::datetime::now());
+}
+
+bool CLocalRecursiveOperation::StartSync(std::vector<CServerPath> const& remote_roots, ActiveFilters const& filters, bool immediate)
+{
+	auto * remote = state_.GetRemoteRecursiveOperation();
+	if (IsActive() || remote_roots.empty() || !remote || remote->IsActive() || !state_.IsRemoteIdle()) {
+		return false;
+	}
+
+	for (auto const& path : remote_roots) {
+		recursion_root root(path, true);
+		root.add_dir_to_visit(path, std::wstring());
+		remote->AddRecursionRoot(std::move(root));
+	}
+
+	sync_ = std::make_unique<tree_sync>(fz::duration::from_minutes(COptions::Get()->get_int(OPTION_COMPARISON_THRESHOLD)));
+	sync_roots_ = remote_roots;
+	sync_listing_ = true;
+
+	remote->StartRecursiveOperation(recursive_list, filters, true, true);
+	if (!remote->IsActive()) {
+		sync_listing_ = false;
+		remote->StopRecursiveOperation();
+		StopRecursiveOperation();
+		return false;
+	}
+
+	StartRecursiveOperation(recursive_transfer, filters, immediate);
+	if (!IsActive()) {
+		StopRecursiveOperation();
+		return false;
+	}
+
+	return true;
+}
+
+bool CLocalRecursiveOperation::IsBelowSyncRoot(CServerPath const& path) const
+{
+	for (auto const& root : sync_roots_) {
+		if (path == root || path.IsSubdirOf(root, false)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+CLocalRecursiveOperation::sync_target CLocalRecursiveOperation::LookupSyncTarget(CServerPath const& path, CDirectoryListing & remote) const
+{
+	if (sync_listed_.find(path) != sync_listed_.end()) {
+		// If it has since dropped out of the cache, treat it as new. Worst case some files get transferred again.
+		if (state_.engine_ && state_.engine_->CacheLookup(path, remote) == FZ_REPLY_OK) {
+			return sync_target::exists;
+		}
+		return sync_target::missing;
+	}
+
+	for (CServerPath p = path; !p.empty(); p = p.GetParent()) {
+		if (sync_missing_.find(p) != sync_missing_.end()) {
+			return sync_target::missing;
+		}
+		if (!p.HasParent() || std::find(sync_roots_.cbegin(), sync_roots_.cend(), p) != sync_roots_.cend()) {
+			break;
+		}
+	}
+
+	return sync_listing_ ? sync_target::unknown : sync_target::missing;
+}
+
+void CLocalRecursiveOperation::SyncListing(listing const& d)
+{
+	CDirectoryListing remote;
+	switch (LookupSyncTarget(d.remotePath, remote)) {
+	case sync_target::unknown:
+		sync_parked_[d.remotePath].push_back(d);
+		break;
+	case sync_target::missing:
+		QueueSyncedListing(listing(d), nullptr);
+		break;
+	case sync_target::exists:
+		QueueSyncedListing(listing(d), &remote);
+		break;
+	}
+}
+
+void CLocalRecursiveOperation::QueueSyncedListing(listing && d, CDirectoryListing const* remote)
+{
+	// Subdirectories not on the server, flush everything already waiting below them
+	for (auto const& dir : d.dirs) {
+		size_t const index = remote ? remote->FindFile_CmpCase(dir.name) : std::wstring::npos;
+		if (index != std::wstring::npos && (*remote)[index].is_dir()) {
+			continue;
+		}
+
+		CServerPath sub = d.remotePath;
+		if (!sub.AddSegment(dir.name)) {
+			continue;
+		}
+		sync_missing_.insert(sub);
+
+		auto it = sync_parked_.find(sub);
+		if (it != sync_parked_.end()) {
+			auto parked = std::move(it->second);
+			sync_parked_.erase(it);
+			for (auto & p : parked) {
+				QueueSyncedListing(std::move(p), nullptr);
+			}
+		}
+	}
+
+	if (sync_->filter_upload(d, remote)) {
+		m_pQueue->QueueFiles(!m_immediate, site_, d);
+	}
+}
+
+void CLocalRecursiveOperation::OnStateChange(t_statechange_notifications notification, std::wstring const&, void const* data)
+{
+	if (!sync_ || !sync_listing_ || m_operationMode == recursive_none) {
+		return;
+	}
+
+	if (notification == STATECHANGE_REMOTE_DIR_OTHER && data) {
+		auto const& remote = *reinterpret_cast<std::shared_ptr<CDirectoryListing> const*>(data);
+		if (remote && !remote->failed() && IsBelowSyncRoot(remote->path)) {
+			OnSyncRemoteListing(*remote);
+		}
+	}
+	else if (notification == STATECHANGE_REMOTE_RECURSION_STATUS) {
+		auto * remote = state_.GetRemoteRecursiveOperation();
+		if (!remote || !remote->IsActive()) {
+			sync_listing_ = false;
+			OnSyncRemoteListingDone();
+		}
+	}
+}
+
+void CLocalRecursiveOperation::OnSyncRemoteListing(CDirectoryListing const& remote)
+{
+	sync_listed_.insert(remote.path);
+
+	auto it = sync_parked_.find(remote.path);
+	if (it == sync_parked_.end()) {
+		return;
+	}
+
+	auto parked = std::move(it->second);
+	sync_parked_.erase(it);
+	for (auto & d : parked) {
+		QueueSyncedListing(std::move(d), &remote);
+	}
+	m_pQueue->QueueFile_Finish(m_immediate);
+
+	FinishSyncIfDone();
+}
+
+void CLocalRecursiveOperation::OnSyncRemoteListingDone()
+{
+	// Directories that failed to list are treated as new
+	while (!sync_parked_.empty()) {
+		auto it = sync_parked_.begin();
+		auto parked = std::move(it->second);
+		sync_parked_.erase(it);
+
+		CDirectoryListing remote;
+		bool const exists = !parked.empty() && LookupSyncTarget(parked.front().remotePath, remote) == sync_target::exists;
+		for (auto & d : parked) {
+			QueueSyncedListing(std::move(d), exists ? &remote : nullptr);
+		}
+	}
+	m_pQueue->QueueFile_Finish(m_immediate);
+
+	FinishSyncIfDone();
+}
+
+void CLocalRecursiveOperation::FinishSyncIfDone()
+{
+	if (sync_local_done_ && sync_parked_.empty()) {
+		StopRecursiveOperation();
+	}
+}
+
 void CLocalRecursiveOperation::OnListingFailed()
 {
 	m_failed = true;
@@ -1,13 +1,17 @@
 #ifndef FILEZILLA_LOCAL_RECURSIVE_OPERATION_HEADER
 #define FILEZILLA_LOCAL_RECURSIVE_OPERATION_HEADER
 
+#include "state.h"
 #include "../commonui/local_recursive_operation.h"
 
+#include <map>
+#include <set>
+
 class CQueueView;
 class CActionAfterBlocker;
-class CState;
+class tree_sync;
 
-class CLocalRecursiveOperation final : public local_recursive_operation, public wxEvtHandler
+class CLocalRecursiveOperation final : public local_recursive_operation, public wxEvtHandler, public CStateEventHandler
 {
 public:
 	CLocalRecursiveOperation(CState& state);
@@ -19,6 +23,32 @@ public:
 
 	void StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate = true, bool ignore_links = true);
 
+	// Uploading the same local tree to several sites: The tree is enumerated
+	// only once and each listing gets queued for every target.
+	class upload_target final
+	{
+	public:
+		Site site_;
+		CServerPath remote_root_;
+
+		uint64_t queued_files_{};
+		uint64_t queued_dirs_{};
+	};
+
+	// Remote paths of the recursion roots need to be below scan_root, they
+	// get rebased onto the remote root of each target.
+	void SetUploadTargets(CServerPath const& scan_root, std::vector<upload_target> && targets);
+	std::vector<upload_target> const& GetUploadTargets() const { return upload_targets_; }
+
+	// Synchronizes the recursion roots to the server, only files missing or
+	// differing on the server get queued.
+	//
+	// The remote trees below remote_roots get listed alongside the local
+	// enumeration. Each local listing is queued as soon as the state of its
+	// remote counterpart is known, so transfers start before the comparison
+	// has finished.
+	bool StartSync(std::vector<CServerPath> const& remote_roots, ActiveFilters const& filters, bool immediate = true);
+
 protected:
 	bool do_start_recursive_operation(OperationMode mode, ActiveFilters const& filters, bool ignore_links) override;
 	void on_listed_directory() override;
@@ -27,12 +57,53 @@ protected:
 	void OnListedDirectory();
 	void OnListingFailed();
 
+	// At debug level info or higher, logs the enumeration throughput
+	void LogWalkStatistics();
+
+	void OnStateChange(t_statechange_notifications notification, std::wstring const&, void const* data) override;
+
+	enum class sync_target
+	{
+		unknown,
+		missing,
+		exists
+	};
+	sync_target LookupSyncTarget(CServerPath const& path, CDirectoryListing & remote) const;
+	bool IsBelowSyncRoot(CServerPath const& path) const;
+
+	void SyncListing(listing const& d);
+	void QueueSyncedListing(listing && d, CDirectoryListing const* remote);
+	void OnSyncRemoteListing(CDirectoryListing const& remote);
+	void OnSyncRemoteListingDone();
+	void FinishSyncIfDone();
+
 	bool m_immediate{true};
 	CQueueView* m_pQueue{};
 	CState& state_;
 	Site site_;
 	std::shared_ptr<CActionAfterBlocker> m_actionAfterBlocker;
 
+	CServerPath upload_scan_root_;
+	std::vector<upload_target> upload_targets_;
+
+	std::unique_ptr<tree_sync> sync_;
+	std::vector<CServerPath> sync_roots_;
+
+	// Whether the remote recursive operation is still listing for us
+	bool sync_listing_{};
+
+	// Whether the enumeration is done, but listings are still waiting for their remote counterparts
+	bool sync_local_done_{};
+
+	// Remote directories listed since starting
+	std::set<CServerPath> sync_listed_;
+
+	// Remote directories known not to exist, everything below them is new
+	std::set<CServerPath> sync_missing_;
+
+	// Local listings waiting for the listing of their remote directory
+	std::map<CServerPath, std::vector<listing>> sync_parked_;
+
 	DECLARE_EVENT_TABLE()
 };
 
@@ -11,6 +11,8 @@
 
 #include <wx/filedlg.h>
 
+#include <algorithm>
+
 CQueueItem::CQueueItem(CQueueItem* parent)
 	: m_parent(parent)
 {
@@ -336,7 +338,7 @@ void CFileItem::SetTargetFile(std::wstring const& file)
 		if (!extra_data_) {
 			return;
 		}
-		if (extra_data_->extraFlags_.empty() && extra_data_->persistentState_.empty()) {
+		if (extra_data_->extraFlags_.empty() && extra_data_->persistentState_.empty() && !extra_data_->sharedRead_) {
 			extra_data_.clear();
 		}
 		else {
@@ -354,6 +356,29 @@ void CFileItem::SetTargetFile(std::wstring const& file)
 	}
 }
 
+void CFileItem::SetSharedRead(std::shared_ptr<multicast_announcement> && announcement)
+{
+	if (!announcement) {
+		if (!extra_data_) {
+			return;
+		}
+		if (extra_data_->targetFile_.empty() && extra_data_->extraFlags_.empty() && extra_data_->persistentState_.empty()) {
+			extra_data_.clear();
+		}
+		else {
+			extra_data_->sharedRead_.reset();
+		}
+	}
+	else {
+		if (!extra_data_) {
+			extra_data_ = std::move(fz::sparse_optional<extra_data>({{}, {}, {}, std::move(announcement)}));
+		}
+		else {
+			extra_data_->sharedRead_ = std::move(announcement);
+		}
+	}
+}
+
 void CFileItem::set_persistent_state(std::string && state)
 {
 	if (state.empty()) {
@@ -374,7 +399,7 @@ void CFileItem::clear_persistent_state()
 	if (!extra_data_) {
 		return;
 	}
-	if (extra_data_->extraFlags_.empty() && extra_data_->targetFile_.empty()) {
+	if (extra_data_->extraFlags_.empty() && extra_data_->targetFile_.empty() && !extra_data_->sharedRead_) {
 		extra_data_.clear();
 	}
 	else {
@@ -695,6 +720,71 @@ CFileItem* CServerItem::GetIdleChild(bool immediateOnly, TransferDirection direc
 	return item;
 }
 
+unsigned int CServerItem::GetQueuedFileCount(bool immediateOnly) const
+{
+	size_t count{};
+	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
+		count += m_fileList[1][i].size();
+		if (!immediateOnly) {
+			count += m_fileList[0][i].size();
+		}
+	}
+	return static_cast<unsigned int>(count);
+}
+
+namespace {
+size_t const directory_batch_min = 32;
+size_t const directory_batch_max = 512;
+}
+
+void CServerItem::PlanDirectory(CServerPath const& path)
+{
+	if (path.empty() || !path.HasParent()) {
+		return;
+	}
+
+	if (m_seenDirectories.insert(path).second) {
+		m_plannedDirectories[path.SegmentCount()].insert(path);
+	}
+}
+
+std::vector<CServerPath> CServerItem::TakeDirectoryBatch(int connections)
+{
+	std::vector<CServerPath> ret;
+
+	auto it = m_plannedDirectories.begin();
+	if (it == m_plannedDirectories.end()) {
+		return ret;
+	}
+	if (m_directoryBatches && it->first != m_directoryBatchLevel) {
+		return ret;
+	}
+
+	// Spread each level evenly over the connections
+	auto & level = it->second;
+	size_t const size = std::clamp(level.size() / static_cast<size_t>(std::max(connections, 1)) + 1, directory_batch_min, directory_batch_max);
+	while (!level.empty() && ret.size() < size) {
+		ret.push_back(*level.begin());
+		level.erase(level.begin());
+	}
+
+	m_directoryBatchLevel = it->first;
+	if (level.empty()) {
+		m_plannedDirectories.erase(it);
+	}
+	++m_directoryBatches;
+
+	return ret;
+}
+
+void CServerItem::DirectoryBatchFinished()
+{
+	wxASSERT(m_directoryBatches > 0);
+	if (m_directoryBatches > 0) {
+		--m_directoryBatches;
+	}
+}
+
 bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 {
 	if (!pItem) {
@@ -7,6 +7,11 @@
 
 #include <libfilezilla/optional.hpp>
 #include <functional>
+#include <map>
+#include <memory>
+#include <set>
+
+class multicast_announcement;
 
 enum class QueuePriority : unsigned char {
 	lowest,
@@ -97,6 +102,9 @@ public:
 
 	CFileItem* GetIdleChild(bool immadiateOnly, TransferDirection direction);
 
+	// Includes active files
+	unsigned int GetQueuedFileCount(bool immediateOnly) const;
+
 	virtual bool RemoveChild(CQueueItem* pItem, bool destroy = true, bool forward = true) override; // Removes a child item with is somewhere in the tree of children
 	virtual bool TryRemoveAll() override;
 
@@ -117,6 +125,19 @@ public:
 
 	int m_activeCount;
 
+	// Remote directories of recursive uploads get created in batches ahead of
+	// the files going into them. Shallower directories go first, a level is only
+	// started once all batches of the levels above have finished.
+	void PlanDirectory(CServerPath const& path);
+	bool HasPlannedDirectories() const { return !m_plannedDirectories.empty(); }
+
+	// Returns an empty batch if the next level has to wait
+	std::vector<CServerPath> TakeDirectoryBatch(int connections);
+	void DirectoryBatchFinished();
+
+	// Each batch being created occupies a connection
+	int GetDirectoryBatchCount() const { return m_directoryBatches; }
+
 	const std::vector<CQueueItem*>& GetChildren() const { return m_children; }
 
 	void Sort(int col, bool reverse);
@@ -143,6 +164,12 @@ protected:
 		int child;
 	};
 	std::vector<t_cacheItem> m_lookupCache;
+
+	// By number of segments
+	std::map<size_t, std::set<CServerPath>> m_plannedDirectories;
+	std::set<CServerPath> m_seenDirectories;
+	size_t m_directoryBatchLevel{};
+	int m_directoryBatches{};
 };
 
 struct t_EngineData;
@@ -174,6 +201,9 @@ public:
 		std::wstring targetFile_;
 		std::wstring extraFlags_;
 		std::string persistentState_;
+
+		// Set on uploads of a file queued for several sites, lets them share reads
+		std::shared_ptr<multicast_announcement> sharedRead_;
 	};
 
 	std::wstring const& GetLocalFile() const { return !Download() ? GetSourceFile() : (extra_data_ && !extra_data_->targetFile_.empty() ? extra_data_->targetFile_ : m_sourceFile); }
@@ -222,6 +252,7 @@ public:
 	virtual bool TryRemoveAll() override final;
 
 	void SetTargetFile(std::wstring const& file);
+	void SetSharedRead(std::shared_ptr<multicast_announcement> && announcement);
 
 	void set_persistent_state(std::string && state);
 	void clear_persistent_state();
@@ -54,7 +54,9 @@ namespace server_table_column_names
 		post_login_commands,
 		name,
 		parameters,
-		site_path
+		site_path,
+		speed_limit_inbound,
+		speed_limit_outbound
 	};
 }
 
@@ -77,7 +79,9 @@ _column server_table_columns[] = {
 	{ "post_login_commands", Column_type::text, 0 },
 	{ "name", Column_type::text, 0 },
 	{ "parameters", Column_type::text, 0 },
-	{ "site_path", Column_type::text, default_null }
+	{ "site_path", Column_type::text, default_null },
+	{ "speed_limit_inbound", Column_type::integer, 0 },
+	{ "speed_limit_outbound", Column_type::integer, 0 }
 };
 
 namespace file_table_column_names
@@ -307,7 +311,7 @@ bool CQueueStorage::Impl::MigrateSchema()
 	bool ret = sqlite3_exec(db_, "PRAGMA user_version", int_callback, &version, 0) == SQLITE_OK;
 
 	if (ret) {
-		if (version > 8) {
+		if (version > 9) {
 			ret = false;
 		}
 		else if (version > 0) {
@@ -350,9 +354,13 @@ bool CQueueStorage::Impl::MigrateSchema()
 			if (ret && version < 8) {
 				ret = sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN persistent_state BLOB DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
 			}
+			if (ret && version < 9) {
+				ret = sqlite3_exec(db_, "ALTER TABLE servers ADD COLUMN speed_limit_inbound INTEGER", 0, 0, 0) == SQLITE_OK;
+				ret &= sqlite3_exec(db_, "ALTER TABLE servers ADD COLUMN speed_limit_outbound INTEGER", 0, 0, 0) == SQLITE_OK;
+			}
 		}
-		if (ret && version != 8) {
-			ret = sqlite3_exec(db_, "PRAGMA user_version = 8", 0, 0, 0) == SQLITE_OK;
+		if (ret && version != 9) {
+			ret = sqlite3_exec(db_, "PRAGMA user_version = 9", 0, 0, 0) == SQLITE_OK;
 		}
 	}
 
@@ -750,6 +758,8 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 		break;
 	}
 	Bind(insertServerQuery_, server_table_column_names::max_connections, site.connection_limit_);
+	Bind(insertServerQuery_, server_table_column_names::speed_limit_inbound, site.speed_limit_inbound_);
+	Bind(insertServerQuery_, server_table_column_names::speed_limit_outbound, site.speed_limit_outbound_);
 
 	switch (site.server.GetEncodingType())
 	{
@@ -1112,6 +1122,14 @@ int64_t CQueueStorage::Impl::ParseServerFromRow(Site & site)
 	}
 	site.connection_limit_ = static_cast<unsigned int>(maximumMultipleConnections);
 
+	int64_t const speedLimitInbound = GetColumnInt64(selectServersQuery_, server_table_column_names::speed_limit_inbound);
+	int64_t const speedLimitOutbound = GetColumnInt64(selectServersQuery_, server_table_column_names::speed_limit_outbound);
+	if (speedLimitInbound < 0 || speedLimitOutbound < 0) {
+		return INVALID_DATA;
+	}
+	site.speed_limit_inbound_ = static_cast<unsigned int>(speedLimitInbound);
+	site.speed_limit_outbound_ = static_cast<unsigned int>(speedLimitOutbound);
+
 	std::wstring encodingType = GetColumnText(selectServersQuery_, server_table_column_names::encoding);
 	if (encodingType.empty() || encodingType == _T("Auto")) {
 		site.server.SetEncodingType(ENCODING_AUTO);
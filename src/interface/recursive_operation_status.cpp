@@ -96,10 +96,18 @@ void CRecursiveOperationStatus::UpdateText()
 	auto const mode = operation->GetOperationMode();
 	bool show = mode != recursive_operation::recursive_none && mode != recursive_operation::recursive_list;
 	if (show) {
+		auto const* local_op = m_local ? m_state.GetLocalRecursiveOperation() : nullptr;
+		size_t const targets = local_op ? local_op->GetUploadTargets().size() : 0;
+
 		switch (mode) {
 		case recursive_operation::recursive_transfer:
 		case recursive_operation::recursive_transfer_flatten:
-			text = _("Recursively adding files to queue.");
+			if (targets) {
+				text = wxString::Format(wxPLURAL("Recursively adding files to queue for %d site.", "Recursively adding files to queue for %d sites.", targets), static_cast<int>(targets));
+			}
+			else {
+				text = _("Recursively adding files to queue.");
+			}
 			break;
 		case recursive_operation::recursive_delete:
 			text = _("Recursively deleting files and directories.");
@@ -118,6 +126,24 @@ void CRecursiveOperationStatus::UpdateText()
 		std::wstring const dirs = fz::sprintf(fztranslate("%llu directory", "%llu directories", countDirs), countDirs);
 		// @translator: Example: Processed 5 files in 1 directory
 		m_pTextCtrl[1]->SetLabel(wxString::Format(_("Processed %s in %s."), files, dirs));
+
+		wxString tooltip;
+		if (targets) {
+			for (auto const& target : local_op->GetUploadTargets()) {
+				unsigned long long const targetFiles = static_cast<unsigned long long>(target.queued_files_);
+				unsigned long long const targetDirs = static_cast<unsigned long long>(target.queued_dirs_);
+				if (!tooltip.empty()) {
+					tooltip += '\n';
+				}
+				// @translator: Example: example.com: Queued 5 files in 1 directory
+				tooltip += wxString::Format(_("%s: Queued %s in %s."), target.site_.GetName().empty() ? target.site_.Format(ServerFormat::with_optional_port) : target.site_.GetName(),
+					fz::sprintf(fztranslate("%llu file", "%llu files", targetFiles), targetFiles),
+					fz::sprintf(fztranslate("%llu directory", "%llu directories", targetDirs), targetDirs));
+			}
+		}
+		SetToolTip(tooltip);
+		m_pTextCtrl[0]->SetToolTip(tooltip);
+		m_pTextCtrl[1]->SetToolTip(tooltip);
 	}
 }
 
@@ -0,0 +1,427 @@
+#include "filezilla.h"
+#include "remote_index.h"
+
+#include "../commonui/filter.h"
+
+#include <sqlite3.h>
+
+#include <map>
+#include <set>
+
+namespace {
+char const* const schema[] = {
+	"CREATE TABLE IF NOT EXISTS servers (id INTEGER PRIMARY KEY, key TEXT NOT NULL UNIQUE)",
+	"CREATE TABLE IF NOT EXISTS directories (id INTEGER PRIMARY KEY, server INTEGER NOT NULL, path TEXT NOT NULL, parent TEXT NOT NULL, listed INTEGER NOT NULL, UNIQUE (server, path))",
+	"CREATE INDEX IF NOT EXISTS directories_parent ON directories (server, parent)",
+	"CREATE TABLE IF NOT EXISTS entries (directory INTEGER NOT NULL, name TEXT NOT NULL, size INTEGER NOT NULL, time INTEGER, accuracy INTEGER NOT NULL, flags INTEGER NOT NULL)",
+	"CREATE INDEX IF NOT EXISTS entries_directory ON entries (directory)",
+	"CREATE TABLE IF NOT EXISTS trigrams (trigram INTEGER NOT NULL, directory INTEGER NOT NULL, PRIMARY KEY (trigram, directory)) WITHOUT ROWID",
+	"CREATE INDEX IF NOT EXISTS trigrams_directory ON trigrams (directory)"
+};
+
+std::wstring server_key(CServer const& server)
+{
+	return fz::sprintf(L"%d %s %u %s", server.GetProtocol(), fz::str_tolower_ascii(server.GetHost()), server.GetPort(), server.GetUser());
+}
+
+void add_trigrams(std::set<int64_t> & trigrams, std::wstring const& name)
+{
+	std::wstring const lower = fz::str_tolower(name);
+	for (size_t i = 0; i + 3 <= lower.size(); ++i) {
+		int64_t const t = (static_cast<int64_t>(lower[i] & 0x1fffff) << 42) | (static_cast<int64_t>(lower[i + 1] & 0x1fffff) << 21) | (lower[i + 2] & 0x1fffff);
+		trigrams.insert(t);
+	}
+}
+
+// Returns a string every matching name needs to contain, if there is one.
+std::wstring required_substring(CFilter const& filter)
+{
+	if (filter.matchType != CFilter::all && (filter.matchType != CFilter::any || filter.filters.size() != 1)) {
+		return std::wstring();
+	}
+
+	std::wstring ret;
+	for (auto const& condition : filter.filters) {
+		// Contains, equals, begins with and ends with. Not regular expressions.
+		if (condition.type == filter_name && condition.condition <= 3 && condition.strValue.size() > ret.size()) {
+			ret = condition.strValue;
+		}
+	}
+	return ret;
+}
+
+bool bind(sqlite3_stmt* statement, int index, int64_t value)
+{
+	return sqlite3_bind_int64(statement, index, value) == SQLITE_OK;
+}
+
+bool bind(sqlite3_stmt* statement, int index, std::string const& value)
+{
+	return sqlite3_bind_text(statement, index, value.c_str(), value.size(), SQLITE_TRANSIENT) == SQLITE_OK;
+}
+
+std::string column_text(sqlite3_stmt* statement, int index)
+{
+	auto text = reinterpret_cast<char const*>(sqlite3_column_text(statement, index));
+	return text ? std::string(text, sqlite3_column_bytes(statement, index)) : std::string();
+}
+
+// Resets the statement when going out of scope
+struct reset_statement final
+{
+	explicit reset_statement(sqlite3_stmt* s)
+		: s_(s)
+	{}
+
+	~reset_statement()
+	{
+		sqlite3_reset(s_);
+		sqlite3_clear_bindings(s_);
+	}
+
+	sqlite3_stmt* s_;
+};
+}
+
+CRemoteIndex::CRemoteIndex(std::wstring const& file, fz::thread_pool & pool)
+{
+	if (sqlite3_open(fz::to_utf8(file).c_str(), &db_) != SQLITE_OK) {
+		sqlite3_close(db_);
+		db_ = nullptr;
+		return;
+	}
+
+	sqlite3_exec(db_, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr);
+	sqlite3_exec(db_, "PRAGMA synchronous=NORMAL", nullptr, nullptr, nullptr);
+	for (auto const& query : schema) {
+		if (sqlite3_exec(db_, query, nullptr, nullptr, nullptr) != SQLITE_OK) {
+			sqlite3_close(db_);
+			db_ = nullptr;
+			return;
+		}
+	}
+
+	if (!Prepare()) {
+		sqlite3_close(db_);
+		db_ = nullptr;
+		return;
+	}
+
+	thread_ = pool.spawn([this] { entry(); });
+	if (!thread_) {
+		sqlite3_close(db_);
+		db_ = nullptr;
+	}
+}
+
+CRemoteIndex::~CRemoteIndex()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	thread_.join();
+
+	if (db_) {
+		sqlite3_close_v2(db_);
+	}
+}
+
+bool CRemoteIndex::Prepare()
+{
+	auto const prepare = [this](sqlite3_stmt*& statement, char const* query) {
+		return sqlite3_prepare_v2(db_, query, -1, &statement, nullptr) == SQLITE_OK;
+	};
+
+	// Statements get finalized by sqlite3_close_v2
+	return prepare(selectServer_, "SELECT id FROM servers WHERE key=?1") &&
+		prepare(insertServer_, "INSERT INTO servers (key) VALUES (?1)") &&
+		prepare(selectDirectory_, "SELECT id, listed FROM directories WHERE server=?1 AND path=?2") &&
+		prepare(insertDirectory_, "INSERT INTO directories (server, path, parent, listed) VALUES (?1, ?2, ?3, ?4)") &&
+		prepare(updateDirectory_, "UPDATE directories SET listed=?2 WHERE id=?1") &&
+		prepare(selectChildren_, "SELECT path FROM directories WHERE server=?1 AND parent=?2") &&
+		prepare(selectSubtree_, "SELECT id, path, listed FROM directories WHERE server=?1 AND (path=?2 OR (path>?3 AND path<?4))") &&
+		prepare(deleteDirectory_, "DELETE FROM directories WHERE id=?1") &&
+		prepare(insertEntry_, "INSERT INTO entries (directory, name, size, time, accuracy, flags) VALUES (?1, ?2, ?3, ?4, ?5, ?6)") &&
+		prepare(selectEntries_, "SELECT name, size, time, accuracy, flags FROM entries WHERE directory=?1") &&
+		prepare(deleteEntries_, "DELETE FROM entries WHERE directory=?1") &&
+		prepare(insertTrigram_, "INSERT OR IGNORE INTO trigrams (trigram, directory) VALUES (?1, ?2)") &&
+		prepare(selectTrigram_, "SELECT directory FROM trigrams WHERE trigram=?1") &&
+		prepare(deleteTrigrams_, "DELETE FROM trigrams WHERE directory=?1");
+}
+
+void CRemoteIndex::Store(CServer const& server, std::shared_ptr<CDirectoryListing> const& listing)
+{
+	if (!db_ || !listing || listing->failed() || listing->path.empty()) {
+		return;
+	}
+
+	fz::scoped_lock l(mutex_);
+	pending_.push_back({server_key(server), listing, fz::datetime::now()});
+	cond_.signal(l);
+}
+
+void CRemoteIndex::entry()
+{
+	fz::scoped_lock l(mutex_);
+	while (!quit_) {
+		if (pending_.empty()) {
+			cond_.wait(l);
+			continue;
+		}
+
+		std::deque<pending> work;
+		work.swap(pending_);
+		l.unlock();
+
+		{
+			fz::scoped_lock dl(db_mutex_);
+			sqlite3_exec(db_, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+			for (auto const& p : work) {
+				int64_t const server = GetServerId(p.server, true);
+				if (server > 0) {
+					StoreListing(server, *p.listing, p.listed);
+				}
+			}
+			sqlite3_exec(db_, "END TRANSACTION", nullptr, nullptr, nullptr);
+		}
+
+		l.lock();
+	}
+}
+
+int64_t CRemoteIndex::GetServerId(std::wstring const& key, bool create)
+{
+	std::string const k = fz::to_utf8(key);
+	{
+		reset_statement r(selectServer_);
+		bind(selectServer_, 1, k);
+		if (sqlite3_step(selectServer_) == SQLITE_ROW) {
+			return sqlite3_column_int64(selectServer_, 0);
+		}
+	}
+
+	if (!create) {
+		return -1;
+	}
+
+	reset_statement r(insertServer_);
+	bind(insertServer_, 1, k);
+	if (sqlite3_step(insertServer_) != SQLITE_DONE) {
+		return -1;
+	}
+	return sqlite3_last_insert_rowid(db_);
+}
+
+int64_t CRemoteIndex::GetDirectoryId(int64_t server, std::string const& path)
+{
+	reset_statement r(selectDirectory_);
+	bind(selectDirectory_, 1, server);
+	bind(selectDirectory_, 2, path);
+	if (sqlite3_step(selectDirectory_) == SQLITE_ROW) {
+		return sqlite3_column_int64(selectDirectory_, 0);
+	}
+	return -1;
+}
+
+void CRemoteIndex::StoreListing(int64_t server, CDirectoryListing const& listing, fz::datetime const& listed)
+{
+	std::string const path = fz::to_utf8(listing.path.GetSafePath());
+	int64_t const listed_t = static_cast<int64_t>(listed.get_time_t());
+
+	int64_t id = GetDirectoryId(server, path);
+	if (id > 0) {
+		RemoveDirectory(id);
+
+		reset_statement r(updateDirectory_);
+		bind(updateDirectory_, 1, id);
+		bind(updateDirectory_, 2, listed_t);
+		sqlite3_step(updateDirectory_);
+	}
+	else {
+		std::string const parent = listing.path.HasParent() ? fz::to_utf8(listing.path.GetParent().GetSafePath()) : std::string();
+
+		reset_statement r(insertDirectory_);
+		bind(insertDirectory_, 1, server);
+		bind(insertDirectory_, 2, path);
+		bind(insertDirectory_, 3, parent);
+		bind(insertDirectory_, 4, listed_t);
+		if (sqlite3_step(insertDirectory_) != SQLITE_DONE) {
+			return;
+		}
+		id = sqlite3_last_insert_rowid(db_);
+	}
+
+	std::set<std::string> subdirs;
+	std::set<int64_t> trigrams;
+	for (size_t i = 0; i < listing.size(); ++i) {
+		CDirentry const& entry = listing[i];
+
+		reset_statement r(insertEntry_);
+		bind(insertEntry_, 1, id);
+		bind(insertEntry_, 2, fz::to_utf8(entry.name));
+		bind(insertEntry_, 3, entry.size);
+		if (entry.has_date()) {
+			bind(insertEntry_, 4, static_cast<int64_t>(entry.time.get_time_t()));
+		}
+		bind(insertEntry_, 5, static_cast<int64_t>(entry.time.get_accuracy()));
+		bind(insertEntry_, 6, static_cast<int64_t>(entry.flags & ~CDirentry::flag_unsure));
+		sqlite3_step(insertEntry_);
+
+		add_trigrams(trigrams, entry.name);
+
+		if (entry.is_dir()) {
+			CServerPath subdir = listing.path;
+			if (subdir.AddSegment(entry.name)) {
+				subdirs.insert(fz::to_utf8(subdir.GetSafePath()));
+			}
+		}
+	}
+
+	for (auto const& t : trigrams) {
+		reset_statement r(insertTrigram_);
+		bind(insertTrigram_, 1, t);
+		bind(insertTrigram_, 2, id);
+		sqlite3_step(insertTrigram_);
+	}
+
+	// Forget subdirectories that are gone
+	std::vector<std::string> gone;
+	{
+		reset_statement r(selectChildren_);
+		bind(selectChildren_, 1, server);
+		bind(selectChildren_, 2, path);
+		while (sqlite3_step(selectChildren_) == SQLITE_ROW) {
+			auto child = column_text(selectChildren_, 0);
+			if (subdirs.find(child) == subdirs.end()) {
+				gone.emplace_back(std::move(child));
+			}
+		}
+	}
+	for (auto const& child : gone) {
+		RemoveSubtree(server, child);
+	}
+}
+
+void CRemoteIndex::RemoveDirectory(int64_t id)
+{
+	for (auto statement : {deleteEntries_, deleteTrigrams_}) {
+		reset_statement r(statement);
+		bind(statement, 1, id);
+		sqlite3_step(statement);
+	}
+}
+
+void CRemoteIndex::RemoveSubtree(int64_t server, std::string const& path)
+{
+	// Safe paths of subdirectories begin with the safe path of their parent, followed by a space
+	std::vector<int64_t> ids;
+	{
+		reset_statement r(selectSubtree_);
+		bind(selectSubtree_, 1, server);
+		bind(selectSubtree_, 2, path);
+		bind(selectSubtree_, 3, path + " ");
+		bind(selectSubtree_, 4, path + "!");
+		while (sqlite3_step(selectSubtree_) == SQLITE_ROW) {
+			ids.push_back(sqlite3_column_int64(selectSubtree_, 0));
+		}
+	}
+
+	for (auto const id : ids) {
+		RemoveDirectory(id);
+
+		reset_statement r(deleteDirectory_);
+		bind(deleteDirectory_, 1, id);
+		sqlite3_step(deleteDirectory_);
+	}
+}
+
+bool CRemoteIndex::Search(CServer const& server, CServerPath const& root, CFilter const& filter, search_result_handler const& handler)
+{
+	if (!db_) {
+		return false;
+	}
+
+	fz::scoped_lock l(db_mutex_);
+
+	int64_t const serverId = GetServerId(server_key(server), false);
+	if (serverId <= 0) {
+		return false;
+	}
+
+	std::string const path = fz::to_utf8(root.GetSafePath());
+	if (GetDirectoryId(serverId, path) <= 0) {
+		return false;
+	}
+
+	struct directory
+	{
+		std::string path;
+		int64_t listed;
+	};
+	std::map<int64_t, directory> directories;
+	{
+		reset_statement r(selectSubtree_);
+		bind(selectSubtree_, 1, serverId);
+		bind(selectSubtree_, 2, path);
+		bind(selectSubtree_, 3, path + " ");
+		bind(selectSubtree_, 4, path + "!");
+		while (sqlite3_step(selectSubtree_) == SQLITE_ROW) {
+			directories.emplace(sqlite3_column_int64(selectSubtree_, 0), directory{column_text(selectSubtree_, 1), sqlite3_column_int64(selectSubtree_, 2)});
+		}
+	}
+
+	// Only look at directories containing all trigrams of the name being searched for
+	std::set<int64_t> trigrams;
+	add_trigrams(trigrams, required_substring(filter));
+	for (auto const& t : trigrams) {
+		std::set<int64_t> candidates;
+		reset_statement r(selectTrigram_);
+		bind(selectTrigram_, 1, t);
+		while (sqlite3_step(selectTrigram_) == SQLITE_ROW) {
+			candidates.insert(sqlite3_column_int64(selectTrigram_, 0));
+		}
+
+		for (auto it = directories.begin(); it != directories.end(); ) {
+			if (candidates.find(it->first) == candidates.end()) {
+				it = directories.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+		if (directories.empty()) {
+			break;
+		}
+	}
+
+	for (auto const& d : directories) {
+		auto listing = std::make_shared<CDirectoryListing>();
+		if (!listing->path.SetSafePath(fz::to_wstring_from_utf8(d.second.path))) {
+			continue;
+		}
+		listing->m_firstListTime = fz::monotonic_clock::now();
+
+		std::vector<fz::shared_value<CDirentry>> entries;
+		{
+			reset_statement r(selectEntries_);
+			bind(selectEntries_, 1, d.first);
+			while (sqlite3_step(selectEntries_) == SQLITE_ROW) {
+				CDirentry entry;
+				entry.name = fz::to_wstring_from_utf8(column_text(selectEntries_, 0));
+				entry.size = sqlite3_column_int64(selectEntries_, 1);
+				if (sqlite3_column_type(selectEntries_, 2) != SQLITE_NULL) {
+					entry.time = fz::datetime(static_cast<time_t>(sqlite3_column_int64(selectEntries_, 2)), static_cast<fz::datetime::accuracy>(sqlite3_column_int(selectEntries_, 3)));
+				}
+				entry.flags = sqlite3_column_int(selectEntries_, 4);
+				entries.emplace_back(std::move(entry));
+			}
+		}
+		listing->Assign(std::move(entries));
+
+		handler(listing, fz::datetime(static_cast<time_t>(d.second.listed), fz::datetime::seconds));
+	}
+
+	return true;
+}
@@ -0,0 +1,89 @@
+#ifndef FILEZILLA_INTERFACE_REMOTE_INDEX_HEADER
+#define FILEZILLA_INTERFACE_REMOTE_INDEX_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+class CDirectoryListing;
+class CFilter;
+class CServer;
+class CServerPath;
+struct sqlite3;
+struct sqlite3_stmt;
+
+// Persistent index of remote directory listings, so that remote searches can be
+// answered without crawling the server.
+//
+// Every listing received from the engine replaces the indexed contents of its
+// directory, subdirectories no longer present are dropped. A trigram index over
+// the lowercase names points to the directories containing them, so searches by
+// name only need to look at a few directories.
+//
+// Listings are written on a background thread.
+class CRemoteIndex final
+{
+public:
+	CRemoteIndex(std::wstring const& file, fz::thread_pool & pool);
+	~CRemoteIndex();
+
+	CRemoteIndex(CRemoteIndex const&) = delete;
+	CRemoteIndex& operator=(CRemoteIndex const&) = delete;
+
+	bool opened() const { return db_ != nullptr; }
+
+	void Store(CServer const& server, std::shared_ptr<CDirectoryListing> const& listing);
+
+	// Calls the function for every indexed directory at or below root that may
+	// contain entries matching the filter, along with the time it got listed.
+	// Returns false if root itself has not been indexed.
+	typedef std::function<void(std::shared_ptr<CDirectoryListing> const&, fz::datetime const&)> search_result_handler;
+	bool Search(CServer const& server, CServerPath const& root, CFilter const& filter, search_result_handler const& handler);
+
+private:
+	void entry();
+
+	bool Prepare();
+	int64_t GetServerId(std::wstring const& key, bool create);
+	int64_t GetDirectoryId(int64_t server, std::string const& path);
+	void StoreListing(int64_t server, CDirectoryListing const& listing, fz::datetime const& listed);
+	void RemoveDirectory(int64_t id);
+	void RemoveSubtree(int64_t server, std::string const& path);
+
+	sqlite3* db_{};
+	fz::mutex db_mutex_;
+
+	sqlite3_stmt* selectServer_{};
+	sqlite3_stmt* insertServer_{};
+	sqlite3_stmt* selectDirectory_{};
+	sqlite3_stmt* insertDirectory_{};
+	sqlite3_stmt* updateDirectory_{};
+	sqlite3_stmt* selectChildren_{};
+	sqlite3_stmt* selectSubtree_{};
+	sqlite3_stmt* deleteDirectory_{};
+	sqlite3_stmt* insertEntry_{};
+	sqlite3_stmt* selectEntries_{};
+	sqlite3_stmt* deleteEntries_{};
+	sqlite3_stmt* insertTrigram_{};
+	sqlite3_stmt* selectTrigram_{};
+	sqlite3_stmt* deleteTrigrams_{};
+
+	fz::mutex mutex_;
+	fz::condition cond_;
+	struct pending
+	{
+		std::wstring server;
+		std::shared_ptr<CDirectoryListing> listing;
+		fz::datetime listed;
+	};
+	std::deque<pending> pending_;
+	bool quit_{};
+
+	fz::async_task thread_;
+};
+
+#endif
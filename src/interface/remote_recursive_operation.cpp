@@ -3,10 +3,13 @@
 #include "commandqueue.h"
 #include "chmoddialog.h"
 #include "filter_manager.h"
+#include "Mainfrm.h"
 #include "Options.h"
 #include "queue.h"
+#include "StatusView.h"
 
 #include "../commonui/misc.h"
+#include "../commonui/tree_sync.h"
 
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
@@ -44,7 +47,7 @@ void CRemoteRecursiveOperation::OnStateChange(t_statechange_notifications notifi
 	}
 }
 
-void CRemoteRecursiveOperation::StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate)
+void CRemoteRecursiveOperation::StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate, bool refresh)
 {
 	if (!m_state.IsRemoteConnected()) {
 		assert(!"StartRecursiveOperation while disconnected");
@@ -55,7 +58,7 @@ void CRemoteRecursiveOperation::StartRecursiveOperation(OperationMode mode, Acti
 	}
 	m_immediate = immediate;
 	m_failed = false;
-	remote_recursive_operation::start_recursive_operation(mode, filters, COptions::Get()->get_bool(OPTION_REMOTE_ROP_LISTING_REFFRESH));
+	remote_recursive_operation::start_recursive_operation(mode, filters, refresh || COptions::Get()->get_bool(OPTION_REMOTE_ROP_LISTING_REFFRESH));
 }
 
 void CRemoteRecursiveOperation::do_start_recursive_operation(OperationMode mode, ActiveFilters const& filters)
@@ -171,6 +174,12 @@ void CRemoteRecursiveOperation::handle_listing_failed()
 void CRemoteRecursiveOperation::StopRecursiveOperation()
 {
 	bool notify = m_operationMode != recursive_none;
+	if (notify && sync_) {
+		auto * statusView = m_state.GetMainFrame().GetStatusView();
+		if (statusView) {
+			statusView->AddToLog(logmsg::status, sync_->get_plan().summary(), fz::datetime::now());
+		}
+	}
 	remote_recursive_operation::StopRecursiveOperation();
 	if (notify) {
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
@@ -13,7 +13,8 @@ public:
 	CRemoteRecursiveOperation(CState& state);
 	virtual ~CRemoteRecursiveOperation();
 
-	void StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate = true);
+	// If refresh is set, cached listings are not used regardless of OPTION_REMOTE_ROP_LISTING_REFFRESH
+	void StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate = true, bool refresh = false);
 	void SetImmediate(bool immediate);
 
 	void StopRecursiveOperation() override;
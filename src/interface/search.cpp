@@ -6,8 +6,10 @@
 #include "commandqueue.h"
 #include "filelistctrl.h"
 #include "file_utils.h"
+#include "Mainfrm.h"
 #include "Options.h"
 #include "queue.h"
+#include "remote_index.h"
 #include "remote_recursive_operation.h"
 #include "textctrlex.h"
 #include "timeformatting.h"
@@ -685,10 +687,11 @@ bool CSearchDialog::Load()
 
 	conditionsSizer->Add(new wxCustomHeightListCtrl(this, XRCID("ID_CONDITIONS"), wxDefaultPosition, wxSize(350, 120), wxVSCROLL| wxSUNKEN_BORDER | wxTAB_TRAVERSAL), 0, wxGROW);
 
-	auto criteriaSizer = lay.createFlex(3, 1);
+	auto criteriaSizer = lay.createFlex(4, 1);
 	criteriaSizer->Add(new wxCheckBox(this, XRCID("ID_CASE"), _("Conditions are c&ase sensitive")), 0, wxALIGN_CENTRE_VERTICAL);
 	criteriaSizer->Add(new wxCheckBox(this, XRCID("ID_FIND_FILES"), _("Find &files")), 0, wxALIGN_CENTRE_VERTICAL);
 	criteriaSizer->Add(new wxCheckBox(this, XRCID("ID_FIND_DIRS"), _("Find d&irectories")), 0, wxALIGN_CENTRE_VERTICAL);
+	criteriaSizer->Add(new wxCheckBox(this, XRCID("ID_USE_INDEX"), _("Search i&ndex of previously listed directories")), 0, wxALIGN_CENTRE_VERTICAL);
 	conditionsSizer->Add(criteriaSizer, 0);
 
 	auto compareSizer = lay.createFlex(4, 1);
@@ -765,6 +768,7 @@ bool CSearchDialog::Load()
 	xrc_call(*this, "ID_CASE", &wxCheckBox::SetValue, m_search_filter.matchCase);
 	xrc_call(*this, "ID_FIND_FILES", &wxCheckBox::SetValue, m_search_filter.filterFiles);
 	xrc_call(*this, "ID_FIND_DIRS", &wxCheckBox::SetValue, m_search_filter.filterDirs);
+	xrc_call(*this, "ID_USE_INDEX", &wxCheckBox::SetValue, options_.get_bool(OPTION_REMOTE_INDEX));
 
 	Layout();
 
@@ -1133,6 +1137,17 @@ void CSearchDialog::OnSearch(wxCommandEvent&)
 	}
 
 	m_visited.clear();
+	xrc_call(*this, "ID_RESULTS_LABEL", &wxStaticText::SetLabel, _("Results:"));
+
+	if (mode_ == search_mode::remote) {
+		bool const use_index = xrc_call(*this, "ID_USE_INDEX", &wxCheckBox::GetValue);
+		options_.set(OPTION_REMOTE_INDEX, use_index);
+		if (use_index && SearchIndex()) {
+			searching_ = false;
+			SetCtrlState();
+			return;
+		}
+	}
 
 	// Start
 	if (mode_ == search_mode::comparison) {
@@ -1161,6 +1176,30 @@ void CSearchDialog::OnSearch(wxCommandEvent&)
 	SetCtrlState();
 }
 
+bool CSearchDialog::SearchIndex()
+{
+	auto * index = m_state.GetMainFrame().GetRemoteIndex();
+	if (!index) {
+		return false;
+	}
+
+	fz::datetime oldest;
+	auto const handler = [&](std::shared_ptr<CDirectoryListing> const& listing, fz::datetime const& listed) {
+		if (oldest.empty() || listed < oldest) {
+			oldest = listed;
+		}
+		ProcessDirectoryListing(listing);
+	};
+	if (!index->Search(m_state.GetSite().server, m_remote_search_root, m_search_filter, handler)) {
+		return false;
+	}
+
+	if (!oldest.empty()) {
+		xrc_call(*this, "ID_RESULTS_LABEL", &wxStaticText::SetLabel, wxString::Format(_("Results from index, oldest directory listed %s:"), CTimeFormat::Format(oldest)));
+	}
+	return true;
+}
+
 void CSearchDialog::Stop()
 {
 	if (!searching_) {
@@ -1218,6 +1257,8 @@ void CSearchDialog::SetCtrlState()
 	xrc_call(*this, "ID_COMPARE_SIZE", &wxRadioButton::Show, comparison);
 	xrc_call(*this, "ID_COMPARE_DATE", &wxRadioButton::Show, comparison);
 	xrc_call(*this, "ID_COMPARE_HIDEIDENTICAL", &wxCheckBox::Show, comparison);
+	xrc_call(*this, "ID_USE_INDEX", &wxCheckBox::Show, mode_ == search_mode::remote);
+	xrc_call(*this, "ID_USE_INDEX", &wxCheckBox::Enable, !searching_);
 
 	m_remoteResults->Show(comparison);
 	m_remoteStatusBar->Show(comparison);
@@ -62,6 +62,9 @@ protected:
 
 	void Stop();
 
+	// Returns false if the search root has not been indexed
+	bool SearchIndex();
+
 	DECLARE_EVENT_TABLE()
 	void OnSearch(wxCommandEvent& event);
 	void OnContextMenu(wxContextMenuEvent& event);
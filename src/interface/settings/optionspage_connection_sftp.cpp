@@ -23,6 +23,7 @@ struct COptionsPageConnectionSFTP::impl
 	wxButton* remove_{};
 
 	wxCheckBox* compression_{};
+	wxCheckBox* share_{};
 };
 
 COptionsPageConnectionSFTP::COptionsPageConnectionSFTP()
@@ -76,6 +77,9 @@ bool COptionsPageConnectionSFTP::CreateControls(wxWindow* parent)
 
 		impl_->compression_ = new wxCheckBox(box, nullID, _("&Enable compression"));
 		inner->Add(impl_->compression_);
+		impl_->share_ = new wxCheckBox(box, nullID, _("&Share a single SSH connection between transfers to the same server"));
+		inner->Add(impl_->share_);
+		inner->Add(new wxStaticText(box, nullID, _("Transfers using a shared connection are interrupted if the connection they share is closed.")));
 	}
 	return true;
 }
@@ -102,6 +106,7 @@ bool COptionsPageConnectionSFTP::LoadPage()
 	SetCtrlState();
 
 	impl_->compression_->SetValue(m_pOptions->get_int(OPTION_SFTP_COMPRESSION) != 0);
+	impl_->share_->SetValue(m_pOptions->get_int(OPTION_SFTP_SHARE_CONNECTIONS) != 0);
 
 	return !failure;
 }
@@ -121,6 +126,7 @@ bool COptionsPageConnectionSFTP::SavePage()
 	}
 
 	m_pOptions->set(OPTION_SFTP_COMPRESSION, impl_->compression_->GetValue() ? 1 : 0);
+	m_pOptions->set(OPTION_SFTP_SHARE_CONNECTIONS, impl_->share_->GetValue() ? 1 : 0);
 
 	return true;
 }
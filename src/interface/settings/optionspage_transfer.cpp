@@ -25,6 +25,7 @@ struct COptionsPageTransfer::impl final
 	wxTextCtrlEx* replace_{};
 
 	wxCheckBox* preallocate_{};
+	wxCheckBox* verify_{};
 };
 
 COptionsPageTransfer::COptionsPageTransfer()
@@ -133,6 +134,13 @@ bool COptionsPageTransfer::CreateControls(wxWindow* parent)
 		inner->Add(impl_->preallocate_);
 	}
 
+	{
+		auto [box, inner] = lay.createStatBox(main, _("Verification"), 1);
+		impl_->verify_ = new wxCheckBox(box, nullID, _("&Verify checksums of transferred files"));
+		inner->Add(impl_->verify_);
+		inner->Add(new wxStaticText(box, nullID, _("Requires server support for the HASH, XSHA256, XSHA1, XMD5 or XCRC commands (FTP) or the check-file extension (SFTP).")));
+	}
+
 	GetSizer()->Fit(this);
 
 	return true;
@@ -160,6 +168,7 @@ bool COptionsPageTransfer::LoadPage()
 	impl_->replace_->ChangeValue(m_pOptions->get_string(OPTION_INVALID_CHAR_REPLACE));
 
 	impl_->preallocate_->SetValue(m_pOptions->get_bool(OPTION_PREALLOCATE_SPACE));
+	impl_->verify_->SetValue(m_pOptions->get_bool(OPTION_VERIFY_TRANSFERS));
 
 	return true;
 }
@@ -178,6 +187,7 @@ bool COptionsPageTransfer::SavePage()
 	m_pOptions->set(OPTION_INVALID_CHAR_REPLACE, impl_->replace_->GetValue().ToStdWstring());
 	m_pOptions->set(OPTION_INVALID_CHAR_REPLACE_ENABLE, impl_->enable_replace_->GetValue());
 	m_pOptions->set(OPTION_PREALLOCATE_SPACE, impl_->preallocate_->GetValue());
+	m_pOptions->set(OPTION_VERIFY_TRANSFERS, impl_->verify_->GetValue());
 
 	return true;
 }
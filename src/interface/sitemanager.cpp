@@ -268,6 +268,13 @@ std::pair<std::unique_ptr<Site>, Bookmark> CSiteManager::GetSiteByPath(COptionsB
 	return ret;
 }
 
+std::unique_ptr<Site> CSiteManager::GetSiteByServer(COptionsBase & options, CServer const& server)
+{
+	CLocalPath settings_path{options.get_string(OPTION_DEFAULT_SETTINGSDIR)};
+	app_paths paths{settings_path, GetDefaultsDir()};
+	return site_manager::GetSiteByServer(paths, server);
+}
+
 std::wstring CSiteManager::AddServer(Site site)
 {
 	// We have to synchronize access to sitemanager.xml so that multiple processed don't write
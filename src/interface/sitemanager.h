@@ -21,6 +21,7 @@ public:
 	static std::unique_ptr<Site> GetSiteById(int id);
 
 	static std::pair<std::unique_ptr<Site>, Bookmark> GetSiteByPath(COptionsBase & options, std::wstring const& sitePath, bool printErrors = true);
+	static std::unique_ptr<Site> GetSiteByServer(COptionsBase & options, CServer const& server);
 
 	static std::wstring AddServer(Site site);
 	static bool AddBookmark(std::wstring sitePath, wxString const& name, wxString const& local_dir, CServerPath const& remote_dir, bool sync, bool comparison);
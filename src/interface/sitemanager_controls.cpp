@@ -16,6 +16,7 @@
 #endif
 
 #include "../include/s3sse.h"
+#include "../include/sizeformatting.h"
 
 #include <libfilezilla/translate.hpp>
 
@@ -1288,17 +1289,25 @@ bool AdvancedSiteControls::UpdateSite(Site & site, bool silent)
 
 struct TransferSettingsSiteControls::impl final
 {
+	impl(COptionsBase & options)
+		: options_(options)
+	{}
+
+	COptionsBase & options_;
+
 	wxStaticText* transfermode_desc_{};
 	wxRadioButton* transfermode_default_{};
 	wxRadioButton* transfermode_active_{};
 	wxRadioButton* transfermode_passive_{};
 	wxCheckBox* limit_max_conns_{};
 	wxSpinCtrlEx* max_conns_{};
+	wxTextCtrlEx* speed_limit_inbound_{};
+	wxTextCtrlEx* speed_limit_outbound_{};
 };
 
-TransferSettingsSiteControls::TransferSettingsSiteControls(wxWindow & parent, DialogLayout const& lay, wxFlexGridSizer & sizer)
+TransferSettingsSiteControls::TransferSettingsSiteControls(wxWindow & parent, DialogLayout const& lay, wxFlexGridSizer & sizer, COptionsBase & options)
 	: SiteControls(parent)
-	, impl_(std::make_unique<impl>())
+	, impl_(std::make_unique<impl>(options))
 {
 	impl_->transfermode_desc_ = new wxStaticText(&parent, nullID, _("&Transfer mode:"));
 	sizer.Add(impl_->transfermode_desc_);
@@ -1322,6 +1331,21 @@ TransferSettingsSiteControls::TransferSettingsSiteControls(wxWindow & parent, Di
 	impl_->max_conns_->SetRange(1, 10);
 	row->Add(impl_->max_conns_, lay.valign);
 
+	sizer.Add(new wxStaticText(&parent, nullID, _("Speed limits for this site, enter 0 for unlimited speed:")));
+	row = lay.createFlex(3);
+	sizer.Add(row, 0, wxLEFT, lay.dlgUnits(10));
+	wxString const unit = SizeFormatter(impl_->options_).GetUnitSymbol(UnitPrefix::kilo, 1024);
+	row->Add(new wxStaticText(&parent, nullID, _("Download &limit:")), lay.valign);
+	impl_->speed_limit_inbound_ = new wxTextCtrlEx(&parent, nullID);
+	impl_->speed_limit_inbound_->SetMaxLength(9);
+	row->Add(impl_->speed_limit_inbound_, lay.valign)->SetMinSize(wxSize(lay.dlgUnits(35), -1));
+	row->Add(new wxStaticText(&parent, nullID, wxString::Format(_("(in %s/s)"), unit)), lay.valign);
+	row->Add(new wxStaticText(&parent, nullID, _("U&pload limit:")), lay.valign);
+	impl_->speed_limit_outbound_ = new wxTextCtrlEx(&parent, nullID);
+	impl_->speed_limit_outbound_->SetMaxLength(9);
+	row->Add(impl_->speed_limit_outbound_, lay.valign)->SetMinSize(wxSize(lay.dlgUnits(35), -1));
+	row->Add(new wxStaticText(&parent, nullID, wxString::Format(_("(in %s/s)"), unit)), lay.valign);
+
 	impl_->limit_max_conns_->Bind(wxEVT_CHECKBOX, [&](wxCommandEvent const& ev){ impl_->max_conns_->Enable(ev.IsChecked()); });
 }
 
@@ -1335,12 +1359,16 @@ void TransferSettingsSiteControls::SetSite(Site const& site, bool predefined)
 	impl_->transfermode_active_->Enable(!predefined);
 	impl_->transfermode_passive_->Enable(!predefined);
 	impl_->limit_max_conns_->Enable(!predefined);
+	impl_->speed_limit_inbound_->Enable(!predefined);
+	impl_->speed_limit_outbound_->Enable(!predefined);
 
 	if (!site) {
 		impl_->transfermode_default_->SetValue(true);
 		impl_->limit_max_conns_->SetValue(false);
 		impl_->max_conns_->Enable(false);
 		impl_->max_conns_->SetValue(1);
+		impl_->speed_limit_inbound_->ChangeValue(L"0");
+		impl_->speed_limit_outbound_->ChangeValue(L"0");
 	}
 	else {
 		if (CServer::ProtocolHasFeature(site.server.GetProtocol(), ProtocolFeature::TransferMode)) {
@@ -1366,11 +1394,22 @@ void TransferSettingsSiteControls::SetSite(Site const& site, bool predefined)
 			impl_->max_conns_->SetValue(1);
 		}
 
+		impl_->speed_limit_inbound_->ChangeValue(fz::to_wstring(site.speed_limit_inbound_));
+		impl_->speed_limit_outbound_->ChangeValue(fz::to_wstring(site.speed_limit_outbound_));
 	}
 }
 
-bool TransferSettingsSiteControls::UpdateSite(Site & site, bool)
+bool TransferSettingsSiteControls::UpdateSite(Site & site, bool silent)
 {
+	unsigned long inbound{}, outbound{};
+	if (!impl_->speed_limit_inbound_->GetValue().ToULong(&inbound) || !impl_->speed_limit_outbound_->GetValue().ToULong(&outbound)) {
+		if (!silent) {
+			wxString const unit = SizeFormatter(impl_->options_).GetUnitSymbol(UnitPrefix::kilo, 1024);
+			wxMessageBoxEx(wxString::Format(_("Please enter speed limits greater or equal to 0 %s/s."), unit), _("Site Manager - Invalid data"), wxICON_EXCLAMATION, wxGetTopLevelParent(&parent_));
+		}
+		return false;
+	}
+
 	if (CServer::ProtocolHasFeature(site.server.GetProtocol(), ProtocolFeature::TransferMode)) {
 		if (impl_->transfermode_active_->GetValue()) {
 			site.server.SetPasvMode(MODE_ACTIVE);
@@ -1393,6 +1432,9 @@ bool TransferSettingsSiteControls::UpdateSite(Site & site, bool)
 		site.connection_limit_ = 0;
 	}
 
+	site.speed_limit_inbound_ = static_cast<unsigned int>(inbound);
+	site.speed_limit_outbound_ = static_cast<unsigned int>(outbound);
+
 	return true;
 }
 
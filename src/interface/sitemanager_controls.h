@@ -81,7 +81,7 @@ public:
 class TransferSettingsSiteControls final : public SiteControls
 {
 public:
-	TransferSettingsSiteControls(wxWindow & parent, DialogLayout const& lay, wxFlexGridSizer & sizer);
+	TransferSettingsSiteControls(wxWindow & parent, DialogLayout const& lay, wxFlexGridSizer & sizer, COptionsBase & options);
 	~TransferSettingsSiteControls();
 
 	virtual void SetSite(Site const& site, bool predefined) override;
@@ -82,7 +82,7 @@ bool CSiteManagerSite::Load(wxWindow* parent, bool with_comments_and_color)
 		transferPage_ = new wxPanel(this);
 		AddPage(transferPage_, _("Transfer Settings"));
 		auto * main = lay.createMain(transferPage_, 1);
-		controls_.emplace_back(std::make_unique<TransferSettingsSiteControls>(*transferPage_, lay, *main));
+		controls_.emplace_back(std::make_unique<TransferSettingsSiteControls>(*transferPage_, lay, *main, options_));
 	}
 
 	{
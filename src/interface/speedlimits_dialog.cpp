@@ -1,9 +1,12 @@
 #include "filezilla.h"
 #include "speedlimits_dialog.h"
 #include "Options.h"
+#include "serverdata.h"
 #include "textctrlex.h"
 #include "themeprovider.h"
 
+#include "../include/bandwidth_scheduler.h"
+#include "../include/engine_context.h"
 #include "../include/sizeformatting.h"
 
 struct CSpeedLimitsDialog::impl final
@@ -131,3 +134,11 @@ void CSpeedLimitsDialog::OnToggleEnable(wxCommandEvent& event)
 	impl_->download_->Enable(event.IsChecked());
 	impl_->upload_->Enable(event.IsChecked());
 }
+
+void ApplySiteSpeedLimits(CFileZillaEngineContext & context, Site const& site)
+{
+	auto const limit = [](unsigned int kib) {
+		return kib ? static_cast<fz::rate::type>(kib) * 1024 : fz::rate::unlimited;
+	};
+	context.GetBandwidthScheduler().set_site_limits(site.server, limit(site.speed_limit_inbound_), limit(site.speed_limit_outbound_));
+}
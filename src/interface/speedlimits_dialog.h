@@ -3,7 +3,13 @@
 
 #include "dialogex.h"
 
+class CFileZillaEngineContext;
 class COptionsBase;
+class Site;
+
+// Passes the speed limits configured for the site on to the engine
+void ApplySiteSpeedLimits(CFileZillaEngineContext & context, Site const& site);
+
 class CSpeedLimitsDialog final : public wxDialogEx
 {
 public:
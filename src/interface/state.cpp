@@ -4,6 +4,7 @@
 #include "Options.h"
 #include "Mainfrm.h"
 #include "queue.h"
+#include "speedlimits_dialog.h"
 #include "filezillaapp.h"
 #include "local_recursive_operation.h"
 #include "remote_recursive_operation.h"
@@ -391,18 +392,9 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 
 	wxASSERT(pDirectoryListing->m_firstListTime);
 
-	if (pDirectoryListing && m_pDirectoryListing &&
-		pDirectoryListing->path == m_pDirectoryListing->path.GetParent())
-	{
-		m_previouslyVisitedRemoteSubdir = m_pDirectoryListing->path.GetLastSegment();
-	}
-	else {
-		m_previouslyVisitedRemoteSubdir.clear();
-	}
-
 	if (!primary) {
 		if (!m_pDirectoryListing || m_pDirectoryListing->path != pDirectoryListing->path) {
-			// We aren't interested in these listings
+			// We aren't interested in these listings, e.g. those listed ahead of time
 			return true;
 		}
 	}
@@ -410,6 +402,15 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 		m_last_path = pDirectoryListing->path;
 	}
 
+	if (pDirectoryListing && m_pDirectoryListing &&
+		pDirectoryListing->path == m_pDirectoryListing->path.GetParent())
+	{
+		m_previouslyVisitedRemoteSubdir = m_pDirectoryListing->path.GetLastSegment();
+	}
+	else {
+		m_previouslyVisitedRemoteSubdir.clear();
+	}
+
 	if (m_pDirectoryListing && m_pDirectoryListing->path == pDirectoryListing->path &&
 		pDirectoryListing->failed())
 	{
@@ -419,6 +420,17 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 
 	m_pDirectoryListing = pDirectoryListing;
 
+	if (primary) {
+		auto it = std::find(m_recentRemoteDirs.begin(), m_recentRemoteDirs.end(), pDirectoryListing->path);
+		if (it != m_recentRemoteDirs.end()) {
+			m_recentRemoteDirs.erase(it);
+		}
+		else if (m_recentRemoteDirs.size() >= 16) {
+			m_recentRemoteDirs.pop_back();
+		}
+		m_recentRemoteDirs.push_front(pDirectoryListing->path);
+	}
+
 	NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
 
 	bool compare = m_changeDirFlags.compare;
@@ -554,6 +566,7 @@ void CState::SetSite(Site const& site, CServerPath const& path)
 	}
 
 	m_site = site;
+	m_recentRemoteDirs.clear();
 
 	UpdateTitle();
 
@@ -562,6 +575,22 @@ void CState::SetSite(Site const& site, CServerPath const& path)
 	NotifyHandlers(STATECHANGE_SERVER);
 }
 
+std::vector<CServerPath> CState::GetRecentlyVisitedRemoteSiblings(CServerPath const& path) const
+{
+	std::vector<CServerPath> ret;
+
+	CServerPath const parent = path.GetParent();
+	if (!parent.empty()) {
+		for (auto const& dir : m_recentRemoteDirs) {
+			if (dir != path && dir.GetParent() == parent) {
+				ret.push_back(dir);
+			}
+		}
+	}
+
+	return ret;
+}
+
 Site const& CState::GetSite() const
 {
 	return m_site;
@@ -590,6 +619,7 @@ bool CState::Connect(Site const& site, CServerPath const& path, bool compare)
 	SetSite(site, path);
 
 	// Use m_site from here on
+	ApplySiteSpeedLimits(m_mainFrame.GetEngineContext(), m_site);
 	m_pCommandQueue->ProcessCommand(new CConnectCommand(m_site.server, m_site.Handle(), m_site.credentials));
 	m_pCommandQueue->ProcessCommand(new CListCommand(path, std::wstring(), LIST_FLAG_FALLBACK_CURRENT));
 
@@ -1403,6 +1433,7 @@ void CState::UpdateSite(std::wstring const& oldPath, Site const& newSite)
 		if (m_site.SitePath() == oldPath && m_site.GetOriginalServer().SameResource(newSite.GetOriginalServer())) {
 			// Update handles
 			m_site.Update(newSite);
+			ApplySiteSpeedLimits(m_mainFrame.GetEngineContext(), m_site);
 			changed = true;
 		}
 	}
@@ -7,6 +7,7 @@
 
 #include "../include/local_path.h"
 
+#include <deque>
 #include <memory>
 
 enum t_statechange_notifications
@@ -212,6 +213,10 @@ public:
 	void ClearPreviouslyVisitedLocalSubdir() { m_previouslyVisitedLocalSubdir.clear(); }
 	void ClearPreviouslyVisitedRemoteSubdir() { m_previouslyVisitedRemoteSubdir.clear(); }
 
+	// Remote directories next to the given one that got visited on the
+	// current site, most recently visited first.
+	std::vector<CServerPath> GetRecentlyVisitedRemoteSiblings(CServerPath const& path) const;
+
 	void UpdateKnownSites(std::vector<CSiteManagerDialog::_connected_site> const& active_sites);
 	void UpdateSite(std::wstring const& oldPath, Site const& newSite);
 
@@ -280,6 +285,8 @@ protected:
 
 	std::wstring m_previouslyVisitedLocalSubdir;
 	std::wstring m_previouslyVisitedRemoteSubdir;
+
+	std::deque<CServerPath> m_recentRemoteDirs;
 };
 
 class CGlobalStateEventHandler
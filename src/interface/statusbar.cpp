@@ -318,11 +318,12 @@ EVT_MENU(XRCID("ID_SPEEDLIMITCONTEXT_CONFIGURE"), CStatusBar::OnSpeedLimitsConfi
 EVT_TIMER(wxID_ANY, CStatusBar::OnTimer)
 END_EVENT_TABLE()
 
-CStatusBar::CStatusBar(wxTopLevelWindow* pParent, activity_logger& al, COptionsBase& options)
+CStatusBar::CStatusBar(wxTopLevelWindow* pParent, activity_logger& al, bandwidth_scheduler& scheduler, COptionsBase& options)
 	: CWidgetsStatusBar(pParent)
 	, COptionChangeEventHandler(this)
 	, options_(options)
 	, activity_logger_(al)
+	, bandwidth_scheduler_(scheduler)
 {
 	// Speedlimits
 	options_.watch(OPTION_SPEEDLIMIT_ENABLE, this);
@@ -719,6 +720,17 @@ void CStatusBar::OnActivity()
 	else {
 		activityTimer_.Stop();
 	}
+
+	auto const now = fz::monotonic_clock::now();
+	if (!last_bandwidth_usage_ || (now - last_bandwidth_usage_) >= fz::duration::from_seconds(1)) {
+		UpdateBandwidthUsage(now);
+	}
+}
+
+void CStatusBar::UpdateBandwidthUsage(fz::monotonic_clock const& now)
+{
+	bandwidth_usage_ = bandwidth_scheduler_.extract_usage();
+	last_bandwidth_usage_ = now;
 }
 
 
@@ -741,19 +753,49 @@ void CStatusBar::UpdateActivityTooltip()
 		format = SizeFormat::iec;
 	}
 
+	auto const formatSpeed = [&](uint64_t speed) {
+		return SizeFormatter::Format(speed, true, format,
+		                             options_.get_bool(OPTION_SIZE_USETHOUSANDSEP),
+		                             options_.get_int(OPTION_SIZE_DECIMALPLACES));
+	};
 
-	std::wstring const upSpeed = SizeFormatter::Format(speeds[0], true, format,
-	                                                 options_.get_bool(OPTION_SIZE_USETHOUSANDSEP),
-													 options_.get_int(OPTION_SIZE_DECIMALPLACES));
-
-	std::wstring const dlSpeed = SizeFormatter::Format(speeds[1], true, format,
-	                                                 options_.get_bool(OPTION_SIZE_USETHOUSANDSEP),
-													 options_.get_int(OPTION_SIZE_DECIMALPLACES));
-
+	std::wstring const upSpeed = formatSpeed(speeds[0]);
+	std::wstring const dlSpeed = formatSpeed(speeds[1]);
 
 	wxString tooltipText;
 	tooltipText.Printf(_("Network activity:") + L"\n    " + _("Download: %s/s") + L"\n    " + _("Upload: %s/s"), dlSpeed, upSpeed);
 
+	// Rates are averaged over at least a second. If idle for a while, the last ones are stale.
+	if (!last_bandwidth_usage_ || (now - last_bandwidth_usage_) >= fz::duration::from_seconds(2)) {
+		UpdateBandwidthUsage(now);
+	}
+
+	// Only the global limiter if not connected anywhere
+	if (bandwidth_usage_.size() > 1) {
+		auto const formatRate = [&](bandwidth_scheduler::usage const& u, fz::direction::type d) {
+			if (u.limits[d] != fz::rate::unlimited) {
+				return wxString::Format(_("%s/s of %s/s"), formatSpeed(u.rates[d]), formatSpeed(u.limits[d]));
+			}
+			return wxString::Format(_("%s/s"), formatSpeed(u.rates[d]));
+		};
+
+		tooltipText += L"\n" + _("Bandwidth usage:");
+		for (auto const& u : bandwidth_usage_) {
+			wxString name;
+			if (!u.depth) {
+				name = _("All connections");
+			}
+			else if (u.name.empty()) {
+				name = _("Browsing");
+			}
+			else {
+				name = u.name;
+			}
+			tooltipText += L"\n" + wxString(L' ', 4 * (u.depth + 1));
+			tooltipText += wxString::Format(_("%s: Download %s, upload %s"), name, formatRate(u, fz::direction::inbound), formatRate(u, fz::direction::outbound));
+		}
+	}
+
 	activityLeds_[0]->SetToolTip(tooltipText);
 	activityLeds_[1]->SetToolTip(tooltipText);
 }
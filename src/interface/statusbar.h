@@ -4,6 +4,7 @@
 #include "option_change_event_handler.h"
 #include "state.h"
 
+#include "../include/bandwidth_scheduler.h"
 #include "../include/sizeformatting.h"
 
 #include <wx/timer.h>
@@ -96,7 +97,7 @@ class COptionsBase;
 class CStatusBar final : public CWidgetsStatusBar, public COptionChangeEventHandler, protected CGlobalStateEventHandler
 {
 public:
-	CStatusBar(wxTopLevelWindow* parent, activity_logger& al, COptionsBase& options);
+	CStatusBar(wxTopLevelWindow* parent, activity_logger& al, bandwidth_scheduler& scheduler, COptionsBase& options);
 	virtual ~CStatusBar();
 
 	void DisplayQueueSize(int64_t totalSize, bool hasUnknown);
@@ -132,6 +133,7 @@ protected:
 	bool m_hasUnknownFiles{};
 
 	activity_logger& activity_logger_;
+	bandwidth_scheduler& bandwidth_scheduler_;
 
 	CLed* activityLeds_[2]{};
 	wxStaticBitmap* m_pDataTypeIndicator{};
@@ -145,6 +147,10 @@ protected:
 	std::array<std::pair<fz::monotonic_clock, std::pair<uint64_t, uint64_t>>, 20> past_activity_;
 	size_t past_activity_index_{};
 
+	std::vector<bandwidth_scheduler::usage> bandwidth_usage_;
+	fz::monotonic_clock last_bandwidth_usage_;
+	void UpdateBandwidthUsage(fz::monotonic_clock const& now);
+
 	DECLARE_EVENT_TABLE()
 	void OnSpeedLimitsEnable(wxCommandEvent& event);
 	void OnSpeedLimitsConfigure(wxCommandEvent& event);
@@ -92,11 +92,13 @@ int fzprintf_raw_untrusted(sftpEventTypes type, const char* fmt, ...)
     }
     *s = 0;
 
+    /* A single call per line, the data thread may be writing too */
     if (type != sftpUnknown) {
-        fputc((int)type + '0', stdout);
+        fprintf(stdout, "%c%s\n", (int)type + '0', str);
+    }
+    else {
+        fprintf(stdout, "%s\n", str);
     }
-    fputs(str, stdout);
-    fputc('\n', stdout);
     fflush(stdout);
 
     sfree(str);
@@ -117,8 +119,7 @@ int fzprintf_raw(sftpEventTypes type, const char* fmt, ...)
     va_start(ap, fmt);
     str = dupvprintf(fmt, ap);
 
-    fputc((char)type + '0', stdout);
-    fputs(str, stdout);
+    fprintf(stdout, "%c%s", (int)type + '0', str);
     fflush(stdout);
 
     sfree(str);
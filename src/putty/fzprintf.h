@@ -1,4 +1,4 @@
-#define FZSFTP_PROTOCOL_VERSION 11
+#define FZSFTP_PROTOCOL_VERSION 16
 
 typedef enum
 {
@@ -33,6 +33,7 @@ typedef enum
     sftp_io_open,
     sftp_io_nextbuf,
     sftp_io_finalize,
+    sftpBatchResult, /* payload: index of the item within a batch command and 1 on success, 0 on failure */
 } sftpEventTypes;
 
 extern bool pending_reply;
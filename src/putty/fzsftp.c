@@ -12,13 +12,15 @@ int limit[2] = { 0, 0 };
 char* input_pushback = 0;
 
 #ifndef _WINDOWS
+#include <pthread.h>
 #include <unistd.h>
 
 char *input_buf = 0;
 int input_buflen = 0, input_bufsize = 0;
 #endif
 
-char* priority_read()
+/* Reads the next line starting with '-', other lines are pushed back */
+static char* read_priority_line()
 {
 #ifdef _WINDOWS
     char* ret = 0;
@@ -83,12 +85,79 @@ char* priority_read()
                 input_pushback = line;
             }
         }
-        ret = line;
+        else {
+            ret = line;
+        }
     }
 #endif //_WINDOWS
     return ret;
 }
 
+#ifdef _WINDOWS
+char* priority_read()
+{
+    return read_priority_line();
+}
+
+char* wakeup_read()
+{
+    return read_priority_line();
+}
+#else
+/*
+ * During downloads both the main thread and the data thread wait for
+ * priority lines. Ring wakeups, the only lines consisting of a lone '-',
+ * are meant for the latter. Only one thread reads stdin at a time and
+ * hands lines meant for the other one over.
+ */
+static pthread_mutex_t priority_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t priority_cond = PTHREAD_COND_INITIALIZER;
+static bool priority_reading = false;
+static char* priority_lines[2];
+
+static char* read_routed_line(int wakeup)
+{
+    char* ret;
+
+    pthread_mutex_lock(&priority_mutex);
+    while (!priority_lines[wakeup]) {
+        if (priority_reading) {
+            pthread_cond_wait(&priority_cond, &priority_mutex);
+            continue;
+        }
+
+        priority_reading = true;
+        pthread_mutex_unlock(&priority_mutex);
+        char* line = read_priority_line();
+        pthread_mutex_lock(&priority_mutex);
+        priority_reading = false;
+
+        int slot = !strcmp(line, "-");
+        if (priority_lines[slot]) {
+            fzprintf(sftpError, "Unexpected priority line");
+            cleanup_exit(1);
+        }
+        priority_lines[slot] = line;
+        pthread_cond_broadcast(&priority_cond);
+    }
+    ret = priority_lines[wakeup];
+    priority_lines[wakeup] = NULL;
+    pthread_mutex_unlock(&priority_mutex);
+
+    return ret;
+}
+
+char* priority_read()
+{
+    return read_routed_line(0);
+}
+
+char* wakeup_read()
+{
+    return read_routed_line(1);
+}
+#endif
+
 static int ReadQuotas(int i)
 {
     char* line = priority_read();
@@ -377,3 +446,48 @@ uintptr_t next_int(char ** s)
     }
     return ret;
 }
+
+int ring_acquire(struct fzsftp_ring* ring, uint8_t* memory, size_t memory_size, uint8_t** buffer, int* size)
+{
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+        __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != tail) {
+            if (!__atomic_exchange_n(&ring->consumer_waiting, 0, __ATOMIC_SEQ_CST)) {
+                /* Engine has seen the flag already, swallow its wakeup */
+                sfree(wakeup_read());
+            }
+            break;
+        }
+        fznotify1(sftp_io_nextbuf, 0);
+        sfree(wakeup_read());
+    }
+
+    struct fzsftp_ring_slot const* slot = &ring->slots[tail % FZSFTP_RING_SLOTS];
+    if (slot->size <= 0) {
+        return slot->size ? -1 : 0;
+    }
+    if (slot->offset > memory_size || (uint64_t)slot->size > memory_size - slot->offset || slot->size > INT_MAX) {
+        fzprintf(sftpError, "Invalid buffer descriptor");
+        return -1;
+    }
+    *buffer = memory + slot->offset;
+    *size = (int)slot->size;
+    return 1;
+}
+
+void ring_release(struct fzsftp_ring* ring, int used)
+{
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    ring->slots[tail % FZSFTP_RING_SLOTS].size = used;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ring->producer_waiting, __ATOMIC_SEQ_CST)) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head - (tail + 1) <= __atomic_load_n(&ring->wake_below, __ATOMIC_RELAXED) &&
+            __atomic_exchange_n(&ring->producer_waiting, 0, __ATOMIC_SEQ_CST))
+        {
+            fznotify1(sftp_io_nextbuf, 0);
+        }
+    }
+}
@@ -2,6 +2,9 @@
 #define FILEZILLA_PUTTY_FZSFTP_HEADER
 
 char* priority_read();
+/* Waits for the engine's "-" answer to sftp_io_nextbuf, may be called
+ * from the data thread while the main thread uses priority_read. */
+char* wakeup_read();
 
 int ProcessQuotaCmd(const char* line);
 int RequestQuota(int i, int bytes);
@@ -30,4 +33,47 @@ int fz_timer_check(_fztimer *timer);
 
 uintptr_t next_int(char ** s);
 
+/*
+ * Descriptor ring shared with the engine, placed in one buffer of its
+ * shared memory pool. The engine produces descriptors (filled buffers for
+ * uploads, empty buffers for downloads), fzsftp consumes them in order and
+ * advances tail once done with a buffer. For downloads, the number of bytes
+ * written into the buffer is stored in the slot before advancing tail.
+ *
+ * The pipe is only used for wakeups: fzsftp sets consumer_waiting and sends
+ * sftp_io_nextbuf when the ring is empty, the engine answers with a single
+ * "-" line. The engine sets producer_waiting if it is waiting for buffers to
+ * be released, fzsftp then sends sftp_io_nextbuf once no more than
+ * wake_below descriptors are left.
+ *
+ * Layout needs to match sftp_io_ring in the engine.
+ */
+#define FZSFTP_RING_SLOTS 32
+
+struct fzsftp_ring_slot
+{
+    uint64_t offset;
+    int64_t size; /* 0 on EOF, -1 on error */
+};
+
+struct fzsftp_ring
+{
+    uint64_t head;
+    uint8_t pad0[56];
+    uint64_t tail;
+    uint8_t pad1[56];
+    uint32_t consumer_waiting;
+    uint8_t pad2[60];
+    uint32_t producer_waiting;
+    uint32_t wake_below;
+    uint8_t pad3[56];
+    struct fzsftp_ring_slot slots[FZSFTP_RING_SLOTS];
+};
+
+/* Returns 1 and the next buffer, 0 on EOF or -1 on error. */
+int ring_acquire(struct fzsftp_ring* ring, uint8_t* memory, size_t memory_size, uint8_t** buffer, int* size);
+
+/* Hands the current buffer back to the engine. used is ignored for uploads. */
+void ring_release(struct fzsftp_ring* ring, int used);
+
 #endif
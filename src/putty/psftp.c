@@ -335,7 +335,6 @@ int sftp_get_file(char *fname, char *outfname, bool restart)
     while (!xfer_done(xfer)) {
         void *vbuf;
         int retd, len;
-        int wpos, wlen;
 
         xfer_download_queue(xfer);
         pktin = sftp_recv();
@@ -351,28 +350,17 @@ int sftp_get_file(char *fname, char *outfname, bool restart)
         }
 
         while (xfer_download_data(xfer, &vbuf, &len)) {
-            unsigned char *buf = (unsigned char *)vbuf;
-
-            wpos = 0;
-            while (file && wpos < len) {
-                wlen = write_to_file(file, buf + wpos, len - wpos);
-                if (wlen <= 0) {
-                    if (!shown_err) {
-                        fzprintf(sftpError, "error while writing local file");
-                        shown_err = true;
-                    }
-                    ret = 0;
-                    xfer_set_error(xfer);
-                    break;
+            if (!write_to_file_async(file, vbuf, len)) {
+                if (!shown_err) {
+                    fzprintf(sftpError, "error while writing local file");
+                    shown_err = true;
                 }
-                wpos += wlen;
-            }
-            if (wpos < len) {               /* we had an error */
                 ret = 0;
                 xfer_set_error(xfer);
             }
-            winterval += wpos;
-            sfree(vbuf);
+            else {
+                winterval += len;
+            }
         }
 
         if (fz_timer_check(&timer)) {
@@ -955,6 +943,120 @@ int sftp_cmd_mkdir(struct sftp_command *cmd)
     return ret;
 }
 
+/* Receives the replies to the outstanding mkdirs requests */
+static void mkdirs_wait(struct sftp_request **reqs, char *results,
+                        size_t count, size_t outstanding, bool stat_replies)
+{
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+    struct fxp_attrs attrs;
+    size_t i;
+
+    /* Servers may reply in any order */
+    while (outstanding) {
+        pktin = sftp_recv();
+        if (pktin == NULL) {
+            seat_connection_fatal(
+                psftp_seat, "did not receive SFTP response packet from server");
+        }
+        req = sftp_find_request(pktin);
+        for (i = 0; i < count; i++) {
+            if (reqs[i] && reqs[i] == req)
+                break;
+        }
+        if (i == count) {
+            seat_connection_fatal(
+                psftp_seat,
+                "unable to understand SFTP response packet from server: %s",
+                fxp_error());
+        }
+
+        reqs[i] = NULL;
+        if (!stat_replies) {
+            if (fxp_mkdir_recv(pktin, req))
+                results[i] = '1';
+        } else {
+            if (fxp_stat_recv(pktin, req, &attrs) &&
+                (attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) &&
+                (attrs.permissions & 0170000) == 0040000)
+                results[i] = '2';
+        }
+        --outstanding;
+    }
+}
+
+/*
+ * Creates several directories at once. All requests are sent before
+ * waiting for any reply. The reply holds one character per directory,
+ * '1' if it got created, '2' if it already existed, '0' otherwise.
+ */
+int sftp_cmd_mkdirs(struct sftp_command *cmd)
+{
+    char *results;
+    char **dirs;
+    struct sftp_request **reqs;
+    size_t i, count, outstanding;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords < 2) {
+        fzprintf(sftpError, "mkdirs: expects at least one directory");
+        return 0;
+    }
+
+    count = cmd->nwords - 1;
+    reqs = snewn(count, struct sftp_request *);
+    dirs = snewn(count, char *);
+    results = snewn(count + 1, char);
+    memset(results, '0', count);
+    results[count] = 0;
+
+    outstanding = 0;
+    for (i = 0; i < count; i++) {
+        /* Absolute paths need no round trip to canonify them */
+        if (cmd->words[i + 1][0] == '/')
+            dirs[i] = dupstr(cmd->words[i + 1]);
+        else
+            dirs[i] = canonify(cmd->words[i + 1], false);
+        if (!dirs[i]) {
+            reqs[i] = NULL;
+            continue;
+        }
+
+        reqs[i] = fxp_mkdir_send(dirs[i], NULL);
+        sftp_register(reqs[i]);
+        ++outstanding;
+    }
+    mkdirs_wait(reqs, results, count, outstanding, false);
+
+    /*
+     * Servers report existing directories differently, e.g. as
+     * SSH_FX_FAILURE. Tell those apart from actual failures.
+     */
+    outstanding = 0;
+    for (i = 0; i < count; i++) {
+        if (results[i] == '0' && dirs[i]) {
+            reqs[i] = fxp_stat_send(dirs[i]);
+            sftp_register(reqs[i]);
+            ++outstanding;
+        }
+    }
+    mkdirs_wait(reqs, results, count, outstanding, true);
+
+    fzprintf(sftpReply, "%s", results);
+
+    for (i = 0; i < count; i++)
+        sfree(dirs[i]);
+    sfree(dirs);
+    sfree(results);
+    sfree(reqs);
+
+    return 1;
+}
+
 static int sftp_action_rmdir(char *dir)
 {
     struct sftp_packet *pktin;
@@ -1041,6 +1143,84 @@ int sftp_cmd_rm(struct sftp_command *cmd)
     return ret;
 }
 
+/*
+ * Removes several files in the same directory, keeping many requests
+ * in flight at once instead of waiting for each reply. The result of
+ * each file is reported by its index.
+ */
+#define MAX_BATCH_REQUESTS 64
+
+int sftp_cmd_mrm(struct sftp_command *cmd)
+{
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords < 3) {
+        fzprintf(sftpError, "mrm: expects a directory and at least one filename");
+        return 0;
+    }
+
+    char *dir = canonify(cmd->words[1], false);
+    if (!dir) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[1], fxp_error());
+        return 0;
+    }
+    const char *slash = (*dir && dir[strlen(dir) - 1] == '/') ? "" : "/";
+
+    int count = cmd->nwords - 2;
+    struct sftp_request **reqs = snewn(count, struct sftp_request *);
+    int sent = 0, done = 0, first = 0, ret = 1;
+
+    while (done < count) {
+        while (sent < count && sent - done < MAX_BATCH_REQUESTS) {
+            char *fname = dupcat(dir, slash, cmd->words[sent + 2]);
+            reqs[sent] = fxp_remove_send(fname);
+            sftp_register(reqs[sent]);
+            sfree(fname);
+            ++sent;
+        }
+
+        struct sftp_packet *pktin = sftp_recv();
+        if (pktin == NULL) {
+            seat_connection_fatal(
+                psftp_seat, "did not receive SFTP response packet from server");
+        }
+        struct sftp_request *rreq = sftp_find_request(pktin);
+
+        int i;
+        for (i = first; i < sent && reqs[i] != rreq; ++i);
+        if (!rreq || i == sent) {
+            seat_connection_fatal(
+                psftp_seat,
+                "unable to understand SFTP response packet from server: %s",
+                fxp_error());
+            sfree(reqs);
+            sfree(dir);
+            return -1;
+        }
+        reqs[i] = NULL;
+        while (first < sent && !reqs[first]) {
+            ++first;
+        }
+        ++done;
+
+        if (fxp_remove_recv(pktin, rreq)) {
+            fzprintf(sftpBatchResult, "%d 1", i);
+        }
+        else {
+            fzprintf(sftpError, "rm %s%s%s: %s", dir, slash, cmd->words[i + 2], fxp_error());
+            fzprintf(sftpBatchResult, "%d 0", i);
+            ret = 0;
+        }
+    }
+
+    sfree(reqs);
+    sfree(dir);
+    return ret;
+}
+
 static int sftp_action_mv(char* source, char* target)
 {
     struct sftp_packet *pktin;
@@ -1147,23 +1327,14 @@ static int sftp_action_chmod(void *vctx, char *fname)
     return 1;
 }
 
-int sftp_cmd_chmod(struct sftp_command *cmd)
+/*
+ * Parses a mode specifier into the bits to clear and to flip. Returns
+ * 0 after printing an error if the specifier is invalid.
+ */
+static int chmod_parse_mode(char *mode, struct sftp_context_chmod *ctx)
 {
-    char *mode;
-    struct sftp_context_chmod actx, *ctx = &actx;
-
-    if (!backend) {
-        not_connected();
-        return 0;
-    }
-
-    if (cmd->nwords != 3) {
-        fzprintf(sftpError, "chmod: expects a mode specifier and a filename");
-        return 0;
-    }
-
     /*
-     * Attempt to parse the mode specifier in cmd->words[1]. We
+     * Attempt to parse the mode specifier. We
      * don't support the full horror of Unix chmod; instead we
      * support a much simpler syntax in which the user can either
      * specify an octal number, or a comma-separated sequence of
@@ -1174,7 +1345,6 @@ int sftp_cmd_chmod(struct sftp_command *cmd)
      * [ugoa] specifications other than exactly u or exactly g.
      */
     ctx->attrs_clr = ctx->attrs_xor = 0;
-    mode = cmd->words[1];
     if (mode[0] >= '0' && mode[0] <= '9') {
         if (mode[strspn(mode, "01234567")]) {
             fzprintf(sftpError, "chmod: numeric file modes should"
@@ -1267,6 +1437,26 @@ int sftp_cmd_chmod(struct sftp_command *cmd)
         }
     }
 
+    return 1;
+}
+
+int sftp_cmd_chmod(struct sftp_command *cmd)
+{
+    struct sftp_context_chmod actx, *ctx = &actx;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords != 3) {
+        fzprintf(sftpError, "chmod: expects a mode specifier and a filename");
+        return 0;
+    }
+
+    if (!chmod_parse_mode(cmd->words[1], ctx)) {
+        return 0;
+    }
 
     char * cname = canonify(cmd->words[2], false);
     if (!cname) {
@@ -1279,6 +1469,142 @@ int sftp_cmd_chmod(struct sftp_command *cmd)
     return 0;
 }
 
+/*
+ * Changes the permissions of several files in the same directory, each
+ * with its own mode specifier, keeping many requests in flight at once.
+ * Numeric modes are set right away, symbolic ones need the current
+ * permissions first. The result of each file is reported by its index.
+ */
+int sftp_cmd_mchmod(struct sftp_command *cmd)
+{
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords < 4 || cmd->nwords % 2) {
+        fzprintf(sftpError, "mchmod: expects a directory and pairs of mode specifier and filename");
+        return 0;
+    }
+
+    char *dir = canonify(cmd->words[1], false);
+    if (!dir) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[1], fxp_error());
+        return 0;
+    }
+    const char *slash = (*dir && dir[strlen(dir) - 1] == '/') ? "" : "/";
+
+    int count = (cmd->nwords - 2) / 2;
+    struct sftp_request **reqs = snewn(count, struct sftp_request *);
+    struct sftp_context_chmod *ctxs = snewn(count, struct sftp_context_chmod);
+    bool *setting = snewn(count, bool);
+    int sent = 0, done = 0, first = 0, outstanding = 0, ret = 1;
+
+    while (done < count) {
+        while (sent < count && outstanding < MAX_BATCH_REQUESTS) {
+            int i = sent++;
+            reqs[i] = NULL;
+            if (!chmod_parse_mode(cmd->words[2 + 2 * i], &ctxs[i])) {
+                fzprintf(sftpBatchResult, "%d 0", i);
+                ret = 0;
+                ++done;
+                continue;
+            }
+
+            char *fname = dupcat(dir, slash, cmd->words[3 + 2 * i]);
+            if (ctxs[i].attrs_clr == 07777) {
+                struct fxp_attrs attrs;
+                attrs.flags = SSH_FILEXFER_ATTR_PERMISSIONS;
+                attrs.permissions = ctxs[i].attrs_xor;
+                reqs[i] = fxp_setstat_send(fname, attrs);
+                setting[i] = true;
+            }
+            else {
+                reqs[i] = fxp_stat_send(fname);
+                setting[i] = false;
+            }
+            sftp_register(reqs[i]);
+            sfree(fname);
+            ++outstanding;
+        }
+        if (!outstanding) {
+            continue;
+        }
+
+        struct sftp_packet *pktin = sftp_recv();
+        if (pktin == NULL) {
+            seat_connection_fatal(
+                psftp_seat, "did not receive SFTP response packet from server");
+        }
+        struct sftp_request *rreq = sftp_find_request(pktin);
+
+        int i;
+        for (i = first; i < sent && (!rreq || reqs[i] != rreq); ++i);
+        if (!rreq || i == sent) {
+            seat_connection_fatal(
+                psftp_seat,
+                "unable to understand SFTP response packet from server: %s",
+                fxp_error());
+            sfree(setting);
+            sfree(ctxs);
+            sfree(reqs);
+            sfree(dir);
+            return -1;
+        }
+        reqs[i] = NULL;
+        --outstanding;
+
+        const char *name = cmd->words[3 + 2 * i];
+        if (!setting[i]) {
+            struct fxp_attrs attrs;
+            bool result = fxp_stat_recv(pktin, rreq, &attrs);
+            if (!result || !(attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS)) {
+                fzprintf(sftpError, "get attrs for %s%s%s: %s", dir, slash, name,
+                         result ? "file permissions not provided" : fxp_error());
+                fzprintf(sftpBatchResult, "%d 0", i);
+                ret = 0;
+            }
+            else {
+                unsigned oldperms = attrs.permissions & 07777;
+                attrs.flags = SSH_FILEXFER_ATTR_PERMISSIONS;
+                attrs.permissions &= ~ctxs[i].attrs_clr;
+                attrs.permissions ^= ctxs[i].attrs_xor;
+                if ((attrs.permissions & 07777) == oldperms) {
+                    fzprintf(sftpBatchResult, "%d 1", i);
+                }
+                else {
+                    char *fname = dupcat(dir, slash, name);
+                    reqs[i] = fxp_setstat_send(fname, attrs);
+                    sftp_register(reqs[i]);
+                    sfree(fname);
+                    setting[i] = true;
+                    ++outstanding;
+                    continue;
+                }
+            }
+        }
+        else if (fxp_setstat_recv(pktin, rreq)) {
+            fzprintf(sftpBatchResult, "%d 1", i);
+        }
+        else {
+            fzprintf(sftpError, "set attrs for %s%s%s: %s", dir, slash, name, fxp_error());
+            fzprintf(sftpBatchResult, "%d 0", i);
+            ret = 0;
+        }
+
+        ++done;
+        while (first < sent && !reqs[first]) {
+            ++first;
+        }
+    }
+
+    sfree(setting);
+    sfree(ctxs);
+    sfree(reqs);
+    sfree(dir);
+    return ret;
+}
+
 static int sftp_cmd_chmtime(struct sftp_command *cmd)
 {
     char *p;
@@ -1411,6 +1737,108 @@ static int sftp_cmd_mtime(struct sftp_command *cmd)
     return 1;
 }
 
+/*
+ * Replies with type, size and modification time of a single file, or
+ * with a question mark if it does not exist.
+ */
+static int sftp_cmd_stat(struct sftp_command *cmd)
+{
+    char *filename, *cname;
+    int result;
+    char type;
+    int64_t size;
+    uint64_t mtime;
+    struct fxp_attrs attrs = {0};
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords != 2) {
+        fzprintf(sftpError, "stat: expects exactly one filename as argument");
+        return 0;
+    }
+
+    filename = cmd->words[1];
+
+    cname = canonify(filename, false);
+    if (!cname) {
+        fzprintf(sftpError, "%s: canonify: %s", filename, fxp_error());
+        return 0;
+    }
+    req = fxp_stat_send(cname);
+    pktin = sftp_wait_for_reply(req);
+    result = fxp_stat_recv(pktin, req, &attrs);
+
+    if (!result) {
+        if (fxp_error_type() == SSH_FX_NO_SUCH_FILE) {
+            sfree(cname);
+            fzprintf(sftpReply, "?");
+            return 1;
+        }
+        fzprintf(sftpError, "get attrs for %s: %s", cname,
+               fxp_error());
+
+        sfree(cname);
+        return 0;
+    }
+
+    sfree(cname);
+
+    type = '-';
+    if ((attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) &&
+        (attrs.permissions & 0170000) == 0040000) {
+        type = 'd';
+    }
+    size = (attrs.flags & SSH_FILEXFER_ATTR_SIZE) ? (int64_t)attrs.size : -1;
+    mtime = (attrs.flags & SSH_FILEXFER_ATTR_ACMODTIME) ? attrs.mtime : 0;
+
+    fzprintf(sftpReply, "%c %"PRId64" %"PRIu64, type, size, mtime);
+    return 1;
+}
+
+static int sftp_cmd_chkfile(struct sftp_command *cmd)
+{
+    char *filename, *cname, *digest;
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords != 2) {
+        fzprintf(sftpError, "chkfile: expects exactly one filename as argument");
+        return 0;
+    }
+
+    filename = cmd->words[1];
+
+    cname = canonify(filename, false);
+    if (!cname) {
+        fzprintf(sftpError, "%s: canonify: %s", filename, fxp_error());
+        return 0;
+    }
+
+    req = fxp_check_file_send(cname, "sha256,sha1,md5,crc32");
+    pktin = sftp_wait_for_reply(req);
+    digest = fxp_check_file_recv(pktin, req);
+    if (!digest) {
+        fzprintf(sftpError, "check-file for %s: %s", cname, fxp_error());
+        sfree(cname);
+        return 0;
+    }
+    sfree(cname);
+
+    fzprintf(sftpReply, "%s", digest);
+    sfree(digest);
+    return 1;
+}
+
 static int sftp_cmd_open(struct sftp_command *cmd)
 {
     int portnumber;
@@ -1459,6 +1887,9 @@ static struct sftp_cmd_lookup {
     {
         "cd", sftp_cmd_cd
     },
+    {
+        "chkfile", sftp_cmd_chkfile
+    },
     {
         "chmod", sftp_cmd_chmod
     },
@@ -1487,9 +1918,18 @@ static struct sftp_cmd_lookup {
     {
         "ls", sftp_cmd_ls
     },
+    {
+        "mchmod", sftp_cmd_mchmod
+    },
     {
         "mkdir", sftp_cmd_mkdir
     },
+    {
+        "mkdirs", sftp_cmd_mkdirs
+    },
+    {
+        "mrm", sftp_cmd_mrm
+    },
     {
         "mtime", sftp_cmd_mtime
     },
@@ -1522,6 +1962,9 @@ static struct sftp_cmd_lookup {
     },
     {
         "rmdir", sftp_cmd_rmdir
+    },
+    {
+        "stat", sftp_cmd_stat
     }
 };
 
@@ -2134,8 +2577,9 @@ int psftp_init_utf8_locale()
 }
 #endif
 
-const bool share_can_be_downstream = false; // FZ: We're standalone
-const bool share_can_be_upstream = false;
+// FZ: Only used if the engine passes -share
+const bool share_can_be_downstream = true;
+const bool share_can_be_upstream = true;
 
 static stdio_sink stderr_ss;
 static StripCtrlChars *stderr_scc;
@@ -102,6 +102,9 @@ void close_rfile(RFile *f);
 WFile *open_new_file(const char *name, long perms);
 /* Returns <0 on error, 0 on eof, or number of bytes written, as usual */
 int write_to_file(WFile *f, void *buffer, int length);
+/* Writes all of the buffer, possibly in the background, and frees it.
+ * Returns false if this or an earlier write has failed. */
+bool write_to_file_async(WFile *f, void *buffer, int length);
 int finalize_wfile(WFile *);
 void set_file_times(WFile *f, unsigned long mtime, unsigned long atime);
 /* Closes and frees the WFile */
@@ -565,6 +565,57 @@ bool fxp_rename_recv(struct sftp_packet *pktin, struct sftp_request *req)
     return id == 1;
 }
 
+struct sftp_request *fxp_check_file_send(const char *fname,
+                                         const char *algorithms)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "check-file-name");
+    put_stringz(pktout, fname);
+    put_stringz(pktout, algorithms);
+    put_uint64(pktout, 0);             /* start offset */
+    put_uint64(pktout, 0);             /* length, 0 up to the end */
+    put_uint32(pktout, 0);             /* block size, 0 for a single hash */
+    sftp_send(pktout);
+
+    return req;
+}
+
+char *fxp_check_file_recv(struct sftp_packet *pktin,
+                          struct sftp_request *req)
+{
+    sfree(req);
+    if (pktin->type == SSH_FXP_EXTENDED_REPLY) {
+        ptrlen algorithm, hash;
+        strbuf *sb;
+        size_t i;
+
+        get_string(pktin);             /* "check-file" */
+        algorithm = get_string(pktin);
+        hash = make_ptrlen(get_ptr(pktin), get_avail(pktin));
+        if (get_err(pktin) || !algorithm.len || !hash.len) {
+            fxp_internal_error("malformed check-file reply");
+            sftp_pkt_free(pktin);
+            return NULL;
+        }
+
+        sb = strbuf_new();
+        put_datapl(sb, algorithm);
+        put_byte(sb, ' ');
+        for (i = 0; i < hash.len; i++)
+            strbuf_catf(sb, "%02x", ((const unsigned char *)hash.ptr)[i]);
+        sftp_pkt_free(pktin);
+        return strbuf_to_str(sb);
+    } else {
+        fxp_got_status(pktin);
+        sftp_pkt_free(pktin);
+        return NULL;
+    }
+}
+
 /*
  * Retrieve the attributes of a file. We have fxp_stat which works
  * on filenames, and fxp_fstat which works on open file handles.
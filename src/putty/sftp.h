@@ -223,6 +223,17 @@ struct sftp_request *fxp_rename_send(const char *srcfname,
                                      const char *dstfname);
 bool fxp_rename_recv(struct sftp_packet *pktin, struct sftp_request *req);
 
+/*
+ * Checksum a file on the server through the check-file-name
+ * extension. algorithms is a comma-separated list in order of
+ * preference. The result is the algorithm used followed by a space
+ * and the digest in hex, or NULL on failure.
+ */
+struct sftp_request *fxp_check_file_send(const char *fname,
+                                         const char *algorithms);
+char *fxp_check_file_recv(struct sftp_packet *pktin,
+                          struct sftp_request *req);
+
 /*
  * Return file attributes.
  */
@@ -36,6 +36,83 @@
 #define INLINE
 #endif
 
+/*
+ * Decide whether we can build the x86 vector implementations. They
+ * are compiled with per-function target attributes and only used
+ * after checking the CPU at run time.
+ */
+#define CCP_SIMD_NONE 0
+#define CCP_SIMD_SSE2 1
+#define CCP_SIMD_AVX2 2
+
+#if defined _FORCE_SOFTWARE_CCP
+#elif defined(__clang__)
+#   if __has_attribute(target) && __has_include(<immintrin.h>) &&       \
+    (defined(__x86_64__) || defined(__i386))
+#       define HW_CCP
+#   endif
+#elif defined(__GNUC__)
+#   if (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) &&      \
+    (defined(__x86_64__) || defined(__i386))
+#       define HW_CCP
+#   endif
+#elif defined(_MSC_VER)
+#   if (defined(_M_X64) || defined(_M_IX86)) && _MSC_VER >= 1800
+#       define HW_CCP
+#   endif
+#endif
+
+#ifdef HW_CCP
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+#    define FUNC_SSE2 __attribute__ ((target("sse2")))
+#    define FUNC_AVX2 __attribute__ ((target("avx2")))
+#else
+#    define FUNC_SSE2
+#    define FUNC_AVX2
+#endif
+
+static int ccp_simd_available(void)
+{
+#if defined(__clang__) || defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return CCP_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return CCP_SIMD_SSE2;
+#else
+    int info[4];
+    int max_leaf;
+    bool sse2, os_avx;
+
+    __cpuid(info, 0);
+    max_leaf = info[0];
+    __cpuid(info, 1);
+    sse2 = (info[3] & (1 << 26)) != 0;
+    /* AVX and OSXSAVE, and the OS saves the YMM registers */
+    os_avx = (info[2] & (1 << 28)) && (info[2] & (1 << 27)) &&
+        (_xgetbv(0) & 6) == 6;
+    if (os_avx && max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            return CCP_SIMD_AVX2;
+    }
+    if (sse2)
+        return CCP_SIMD_SSE2;
+#endif
+    return CCP_SIMD_NONE;
+}
+#else
+static int ccp_simd_available(void)
+{
+    return CCP_SIMD_NONE;
+}
+#endif
+
 /* ChaCha20 implementation, only supporting 256-bit keys */
 
 /* State for each ChaCha20 instance */
@@ -50,6 +127,8 @@ struct chacha20 {
     unsigned char current[64];
     /* The index of the above currently used to allow a true streaming cipher */
     int currentIndex;
+    /* Widest vector implementation usable for whole blocks, CCP_SIMD_* */
+    int simd;
 };
 
 static INLINE void chacha20_round(struct chacha20 *ctx)
@@ -155,11 +234,197 @@ static void chacha20_iv(struct chacha20 *ctx, const unsigned char *iv)
     ctx->currentIndex = 64;
 }
 
+#ifdef HW_CCP
+
+/*
+ * Multi-block ChaCha20. Vector lane i computes the block with counter
+ * state[12] + i, so SSE2 produces 4 and AVX2 8 blocks per call. The
+ * keystream is xored straight into blk, which has to hold all of
+ * those blocks. The caller ensures the lane counters don't wrap.
+ */
+
+#define ROTL128(v, n)                                                   \
+    _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define QROP128(a, b, c, n)                                             \
+    a = _mm_add_epi32(a, b);                                            \
+    c = _mm_xor_si128(c, a);                                            \
+    c = ROTL128(c, n)
+#define QUARTER128(a, b, c, d)                                          \
+    QROP128(x[a], x[b], x[d], 16);                                      \
+    QROP128(x[c], x[d], x[b], 12);                                      \
+    QROP128(x[a], x[b], x[d], 8);                                       \
+    QROP128(x[c], x[d], x[b], 7)
+
+static FUNC_SSE2 void chacha20_blocks_sse2(
+    const uint32_t *state, unsigned char *blk)
+{
+    __m128i x[16], s[16];
+    int i, j;
+
+    for (i = 0; i < 16; ++i)
+        s[i] = _mm_set1_epi32((int)state[i]);
+    s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+    for (i = 0; i < 16; ++i)
+        x[i] = s[i];
+
+    for (i = 0; i < 20; i += 2) {
+        QUARTER128(0, 4, 8, 12);
+        QUARTER128(1, 5, 9, 13);
+        QUARTER128(2, 6, 10, 14);
+        QUARTER128(3, 7, 11, 15);
+        QUARTER128(0, 5, 10, 15);
+        QUARTER128(1, 6, 11, 12);
+        QUARTER128(2, 7, 8, 13);
+        QUARTER128(3, 4, 9, 14);
+    }
+
+    /* Transpose each group of four words from word-per-vector into
+     * block-per-vector order */
+    for (i = 0; i < 16; i += 4) {
+        __m128i a = _mm_add_epi32(x[i + 0], s[i + 0]);
+        __m128i b = _mm_add_epi32(x[i + 1], s[i + 1]);
+        __m128i c = _mm_add_epi32(x[i + 2], s[i + 2]);
+        __m128i d = _mm_add_epi32(x[i + 3], s[i + 3]);
+        __m128i t0 = _mm_unpacklo_epi32(a, b);
+        __m128i t1 = _mm_unpacklo_epi32(c, d);
+        __m128i t2 = _mm_unpackhi_epi32(a, b);
+        __m128i t3 = _mm_unpackhi_epi32(c, d);
+        __m128i out[4];
+        out[0] = _mm_unpacklo_epi64(t0, t1);
+        out[1] = _mm_unpackhi_epi64(t0, t1);
+        out[2] = _mm_unpacklo_epi64(t2, t3);
+        out[3] = _mm_unpackhi_epi64(t2, t3);
+        for (j = 0; j < 4; ++j) {
+            __m128i *p = (__m128i *)(blk + 64 * j + 4 * i);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), out[j]));
+        }
+    }
+
+    smemclr(x, sizeof(x));
+}
+
+#undef ROTL128
+#undef QROP128
+#undef QUARTER128
+
+#define ROTL256(v, n)                                                   \
+    _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+#define QROP256(a, b, c, n)                                             \
+    a = _mm256_add_epi32(a, b);                                         \
+    c = _mm256_xor_si256(c, a);                                         \
+    c = ROTL256(c, n)
+#define QUARTER256(a, b, c, d)                                          \
+    QROP256(x[a], x[b], x[d], 16);                                      \
+    QROP256(x[c], x[d], x[b], 12);                                      \
+    QROP256(x[a], x[b], x[d], 8);                                       \
+    QROP256(x[c], x[d], x[b], 7)
+
+static FUNC_AVX2 void chacha20_blocks_avx2(
+    const uint32_t *state, unsigned char *blk)
+{
+    __m256i x[16], s[16], t[4][4];
+    int i, j;
+
+    for (i = 0; i < 16; ++i)
+        s[i] = _mm256_set1_epi32((int)state[i]);
+    s[12] = _mm256_add_epi32(s[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    for (i = 0; i < 16; ++i)
+        x[i] = s[i];
+
+    for (i = 0; i < 20; i += 2) {
+        QUARTER256(0, 4, 8, 12);
+        QUARTER256(1, 5, 9, 13);
+        QUARTER256(2, 6, 10, 14);
+        QUARTER256(3, 7, 11, 15);
+        QUARTER256(0, 5, 10, 15);
+        QUARTER256(1, 6, 11, 12);
+        QUARTER256(2, 7, 8, 13);
+        QUARTER256(3, 4, 9, 14);
+    }
+
+    /* The transpose works within 128-bit halves, leaving blocks 0-3
+     * in the low and blocks 4-7 in the high halves */
+    for (i = 0; i < 4; ++i) {
+        __m256i a = _mm256_add_epi32(x[4 * i + 0], s[4 * i + 0]);
+        __m256i b = _mm256_add_epi32(x[4 * i + 1], s[4 * i + 1]);
+        __m256i c = _mm256_add_epi32(x[4 * i + 2], s[4 * i + 2]);
+        __m256i d = _mm256_add_epi32(x[4 * i + 3], s[4 * i + 3]);
+        __m256i t0 = _mm256_unpacklo_epi32(a, b);
+        __m256i t1 = _mm256_unpacklo_epi32(c, d);
+        __m256i t2 = _mm256_unpackhi_epi32(a, b);
+        __m256i t3 = _mm256_unpackhi_epi32(c, d);
+        t[i][0] = _mm256_unpacklo_epi64(t0, t1);
+        t[i][1] = _mm256_unpackhi_epi64(t0, t1);
+        t[i][2] = _mm256_unpacklo_epi64(t2, t3);
+        t[i][3] = _mm256_unpackhi_epi64(t2, t3);
+    }
+
+    for (j = 0; j < 4; ++j) {
+        __m256i out[4];
+        out[0] = _mm256_permute2x128_si256(t[0][j], t[1][j], 0x20);
+        out[1] = _mm256_permute2x128_si256(t[2][j], t[3][j], 0x20);
+        out[2] = _mm256_permute2x128_si256(t[0][j], t[1][j], 0x31);
+        out[3] = _mm256_permute2x128_si256(t[2][j], t[3][j], 0x31);
+        for (i = 0; i < 4; ++i) {
+            /* Block j, then block j + 4 */
+            __m256i *p = (__m256i *)(blk + 64 * j + 256 * (i >> 1) +
+                                     32 * (i & 1));
+            _mm256_storeu_si256(
+                p, _mm256_xor_si256(_mm256_loadu_si256(p), out[i]));
+        }
+    }
+
+    smemclr(x, sizeof(x));
+    smemclr(t, sizeof(t));
+}
+
+#undef ROTL256
+#undef QROP256
+#undef QUARTER256
+
+/* Encrypts as many whole blocks as the vector code can take, returns
+ * the number of bytes done */
+static int chacha20_encrypt_blocks(struct chacha20 *ctx,
+                                   unsigned char *blk, int len)
+{
+    int done = 0;
+
+    if (ctx->simd >= CCP_SIMD_AVX2) {
+        while (len - done >= 8 * 64 && ctx->state[12] <= 0xFFFFFFFFU - 7) {
+            chacha20_blocks_avx2(ctx->state, blk + done);
+            ctx->state[12] += 8;
+            if (!ctx->state[12])
+                ++ctx->state[13];
+            done += 8 * 64;
+        }
+    }
+    if (ctx->simd >= CCP_SIMD_SSE2) {
+        while (len - done >= 4 * 64 && ctx->state[12] <= 0xFFFFFFFFU - 3) {
+            chacha20_blocks_sse2(ctx->state, blk + done);
+            ctx->state[12] += 4;
+            if (!ctx->state[12])
+                ++ctx->state[13];
+            done += 4 * 64;
+        }
+    }
+
+    return done;
+}
+
+#endif /* HW_CCP */
+
 static void chacha20_encrypt(struct chacha20 *ctx, unsigned char *blk, int len)
 {
     while (len) {
         /* If we don't have any state left, then cycle to the next */
         if (ctx->currentIndex >= 64) {
+#ifdef HW_CCP
+            int done = chacha20_encrypt_blocks(ctx, blk, len);
+            blk += done;
+            len -= done;
+            if (!len)
+                break;
+#endif
             chacha20_round(ctx);
         }
 
@@ -763,6 +1028,9 @@ struct poly1305 {
     /* Buffer in case we get less that a multiple of 16 bytes */
     unsigned char buffer[16];
     int bufferIndex;
+
+    /* CCP_SIMD_*, only AVX2 has a vector implementation */
+    int simd;
 };
 
 static void poly1305_init(struct poly1305 *ctx)
@@ -808,6 +1076,240 @@ static void poly1305_feed_chunk(struct poly1305 *ctx,
     bigval_mul_mod_p(&ctx->h, &c, &ctx->r);
 }
 
+#ifdef HW_CCP
+
+/*
+ * Poly1305 over four blocks at a time with AVX2. Values are kept in
+ * radix 2^26 so that 32x32-bit multiplies suffice, every 64-bit lane
+ * holds one limb of one of four interleaved accumulators.
+ *
+ * Lane i accumulates blocks i, i+4, i+8, ..., multiplying by r^4 at
+ * every step except the last, which multiplies by r^(4-i) instead.
+ * The sum of the lanes is then the same as the serial computation.
+ */
+
+#define POLY26_MASK 0x3ffffff
+
+typedef struct poly26 {
+    uint64_t l[5];
+} poly26;
+
+/* Imports a 17 byte little-endian value below 2^130 */
+static void poly26_import(poly26 *r, const unsigned char *data)
+{
+    uint64_t lo = GET_64BIT_LSB_FIRST(data);
+    uint64_t hi = GET_64BIT_LSB_FIRST(data + 8);
+
+    r->l[0] = lo & POLY26_MASK;
+    r->l[1] = (lo >> 26) & POLY26_MASK;
+    r->l[2] = ((lo >> 52) | (hi << 12)) & POLY26_MASK;
+    r->l[3] = (hi >> 14) & POLY26_MASK;
+    r->l[4] = (hi >> 40) | ((uint64_t)data[16] << 24);
+}
+
+static void poly26_carry(poly26 *h)
+{
+    uint64_t c;
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+        c = h->l[i] >> 26;
+        h->l[i] &= POLY26_MASK;
+        h->l[i + 1] += c;
+    }
+    c = h->l[4] >> 26;
+    h->l[4] &= POLY26_MASK;
+    h->l[0] += c * 5;
+    c = h->l[0] >> 26;
+    h->l[0] &= POLY26_MASK;
+    h->l[1] += c;
+}
+
+/* Reduces fully mod p and exports as 17 byte little-endian value */
+static void poly26_export(poly26 *h, unsigned char *data)
+{
+    uint64_t g[5], c, mask;
+    int i;
+
+    poly26_carry(h);
+    poly26_carry(h);
+
+    /* Subtract p if h >= p, i.e. if h + 5 reaches 2^130 */
+    c = 5;
+    for (i = 0; i < 5; ++i) {
+        g[i] = h->l[i] + c;
+        c = g[i] >> 26;
+        g[i] &= POLY26_MASK;
+    }
+    mask = 0 - c;
+    for (i = 0; i < 5; ++i)
+        h->l[i] = (h->l[i] & ~mask) | (g[i] & mask);
+    for (i = 0; i < 4; ++i) {
+        h->l[i + 1] += h->l[i] >> 26;
+        h->l[i] &= POLY26_MASK;
+    }
+
+    PUT_64BIT_LSB_FIRST(data, h->l[0] | (h->l[1] << 26) | (h->l[2] << 52));
+    PUT_64BIT_LSB_FIRST(data + 8, (h->l[2] >> 12) | (h->l[3] << 14) |
+                        (h->l[4] << 40));
+    data[16] = (unsigned char)(h->l[4] >> 24);
+    smemclr(g, sizeof(g));
+}
+
+static void poly26_mul(poly26 *r, const poly26 *a, const poly26 *b)
+{
+    uint64_t s1 = b->l[1] * 5, s2 = b->l[2] * 5;
+    uint64_t s3 = b->l[3] * 5, s4 = b->l[4] * 5;
+    poly26 d;
+
+    d.l[0] = a->l[0] * b->l[0] + a->l[1] * s4 + a->l[2] * s3 +
+        a->l[3] * s2 + a->l[4] * s1;
+    d.l[1] = a->l[0] * b->l[1] + a->l[1] * b->l[0] + a->l[2] * s4 +
+        a->l[3] * s3 + a->l[4] * s2;
+    d.l[2] = a->l[0] * b->l[2] + a->l[1] * b->l[1] + a->l[2] * b->l[0] +
+        a->l[3] * s4 + a->l[4] * s3;
+    d.l[3] = a->l[0] * b->l[3] + a->l[1] * b->l[2] + a->l[2] * b->l[1] +
+        a->l[3] * b->l[0] + a->l[4] * s4;
+    d.l[4] = a->l[0] * b->l[4] + a->l[1] * b->l[3] + a->l[2] * b->l[2] +
+        a->l[3] * b->l[1] + a->l[4] * b->l[0];
+    poly26_carry(&d);
+    *r = d;
+}
+
+static FUNC_AVX2 void poly1305_blocks_avx2(
+    poly26 *h, const poly26 *rpow, const unsigned char *buf, int groups)
+{
+    const __m256i mask = _mm256_set1_epi64x(POLY26_MASK);
+    const __m256i hibit = _mm256_set1_epi64x(1 << 24);
+    __m256i r4[5], s4[5], rf[5], sf[5], a[5], d[5], c;
+    uint64_t sum[4];
+    int i;
+
+    for (i = 0; i < 5; ++i) {
+        r4[i] = _mm256_set1_epi64x(rpow[3].l[i]);
+        s4[i] = _mm256_set1_epi64x(rpow[3].l[i] * 5);
+        rf[i] = _mm256_set_epi64x(rpow[0].l[i], rpow[1].l[i],
+                                  rpow[2].l[i], rpow[3].l[i]);
+        sf[i] = _mm256_set_epi64x(rpow[0].l[i] * 5, rpow[1].l[i] * 5,
+                                  rpow[2].l[i] * 5, rpow[3].l[i] * 5);
+        a[i] = _mm256_set_epi64x(0, 0, 0, h->l[i]);
+    }
+
+    for (; groups; --groups, buf += 64) {
+        const __m256i *r = groups > 1 ? r4 : rf;
+        const __m256i *s = groups > 1 ? s4 : sf;
+
+        /* Split the four blocks into low and high 64-bit halves, one
+         * block per lane */
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)buf);
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(buf + 32));
+        __m256i lo = _mm256_permute4x64_epi64(
+            _mm256_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i hi = _mm256_permute4x64_epi64(
+            _mm256_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+
+        a[0] = _mm256_add_epi64(a[0], _mm256_and_si256(lo, mask));
+        a[1] = _mm256_add_epi64(
+            a[1], _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask));
+        a[2] = _mm256_add_epi64(
+            a[2], _mm256_and_si256(_mm256_or_si256(
+                _mm256_srli_epi64(lo, 52), _mm256_slli_epi64(hi, 12)), mask));
+        a[3] = _mm256_add_epi64(
+            a[3], _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask));
+        a[4] = _mm256_add_epi64(
+            a[4], _mm256_or_si256(_mm256_srli_epi64(hi, 40), hibit));
+
+#define MUL(x, y) _mm256_mul_epu32(x, y)
+#define ADD(x, y) _mm256_add_epi64(x, y)
+        d[0] = ADD(ADD(ADD(ADD(MUL(a[0], r[0]), MUL(a[1], s[4])),
+                           MUL(a[2], s[3])), MUL(a[3], s[2])),
+                   MUL(a[4], s[1]));
+        d[1] = ADD(ADD(ADD(ADD(MUL(a[0], r[1]), MUL(a[1], r[0])),
+                           MUL(a[2], s[4])), MUL(a[3], s[3])),
+                   MUL(a[4], s[2]));
+        d[2] = ADD(ADD(ADD(ADD(MUL(a[0], r[2]), MUL(a[1], r[1])),
+                           MUL(a[2], r[0])), MUL(a[3], s[4])),
+                   MUL(a[4], s[3]));
+        d[3] = ADD(ADD(ADD(ADD(MUL(a[0], r[3]), MUL(a[1], r[2])),
+                           MUL(a[2], r[1])), MUL(a[3], r[0])),
+                   MUL(a[4], s[4]));
+        d[4] = ADD(ADD(ADD(ADD(MUL(a[0], r[4]), MUL(a[1], r[3])),
+                           MUL(a[2], r[2])), MUL(a[3], r[1])),
+                   MUL(a[4], r[0]));
+#undef MUL
+#undef ADD
+
+        /* Partial carry, leaves all limbs small enough for the next
+         * round of multiplications */
+        for (i = 0; i < 4; ++i) {
+            c = _mm256_srli_epi64(d[i], 26);
+            d[i] = _mm256_and_si256(d[i], mask);
+            d[i + 1] = _mm256_add_epi64(d[i + 1], c);
+        }
+        c = _mm256_srli_epi64(d[4], 26);
+        d[4] = _mm256_and_si256(d[4], mask);
+        d[0] = _mm256_add_epi64(
+            d[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+        c = _mm256_srli_epi64(d[0], 26);
+        d[0] = _mm256_and_si256(d[0], mask);
+        d[1] = _mm256_add_epi64(d[1], c);
+
+        for (i = 0; i < 5; ++i)
+            a[i] = d[i];
+    }
+
+    for (i = 0; i < 5; ++i) {
+        _mm256_storeu_si256((__m256i *)sum, a[i]);
+        h->l[i] = sum[0] + sum[1] + sum[2] + sum[3];
+    }
+    poly26_carry(h);
+
+    smemclr(sum, sizeof(sum));
+    smemclr(a, sizeof(a));
+    smemclr(d, sizeof(d));
+}
+
+/* Feeds as many whole groups of four blocks as possible to the vector
+ * code, returns the number of bytes consumed */
+static int poly1305_feed_blocks(struct poly1305 *ctx,
+                                const unsigned char *buf, int len)
+{
+    unsigned char tmp[17];
+    poly26 h, rpow[4];
+    bigval hv;
+    int groups = len / 64;
+
+    /* Not worth computing the powers of r for short messages */
+    if (ctx->simd < CCP_SIMD_AVX2 || groups < 4)
+        return 0;
+
+    bigval_export_le(&ctx->r, tmp, 16);
+    tmp[16] = 0;
+    poly26_import(&rpow[0], tmp);
+    poly26_mul(&rpow[1], &rpow[0], &rpow[0]);
+    poly26_mul(&rpow[2], &rpow[1], &rpow[0]);
+    poly26_mul(&rpow[3], &rpow[1], &rpow[1]);
+
+    hv = ctx->h;
+    bigval_final_reduce(&hv);
+    bigval_export_le(&hv, tmp, 17);
+    poly26_import(&h, tmp);
+
+    poly1305_blocks_avx2(&h, rpow, buf, groups);
+
+    poly26_export(&h, tmp);
+    bigval_import_le(&ctx->h, tmp, 17);
+
+    smemclr(tmp, sizeof(tmp));
+    smemclr(rpow, sizeof(rpow));
+    smemclr(&h, sizeof(h));
+    smemclr(&hv, sizeof(hv));
+
+    return groups * 64;
+}
+
+#endif /* HW_CCP */
+
 static void poly1305_feed(struct poly1305 *ctx,
                           const unsigned char *buf, int len)
 {
@@ -824,6 +1326,14 @@ static void poly1305_feed(struct poly1305 *ctx,
         }
     }
 
+#ifdef HW_CCP
+    if (!ctx->bufferIndex) {
+        int done = poly1305_feed_blocks(ctx, buf, len);
+        buf += done;
+        len -= done;
+    }
+#endif
+
     /* Process 16 byte whole chunks */
     while (len >= 16) {
         poly1305_feed_chunk(ctx, buf, 16);
@@ -962,6 +1472,10 @@ static ssh_cipher *ccp_new(const ssh_cipheralg *alg)
     struct ccp_context *ctx = snew(struct ccp_context);
     BinarySink_INIT(ctx, poly_BinarySink_write);
     poly1305_init(&ctx->mac);
+    /* The length cipher only ever sees 4 bytes at a time */
+    ctx->a_cipher.simd = CCP_SIMD_NONE;
+    ctx->b_cipher.simd = ccp_simd_available();
+    ctx->mac.simd = ctx->b_cipher.simd;
     ctx->ciph.vt = alg;
     return &ctx->ciph;
 }
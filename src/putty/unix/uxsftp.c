@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
 #include "putty.h"
 #include "ssh.h"
@@ -124,6 +125,7 @@ struct RFile {
     int mapping_;
     uint8_t * memory_;
     size_t memory_size_;
+    struct fzsftp_ring * ring_;
     int state;
     uint8_t * buffer_;
     int remaining_;
@@ -148,9 +150,16 @@ RFile *open_existing_file(const char *name, uint64_t offset,
 
     int mapping = next_int(&p);
     size_t memory_size = next_int(&p);
+    next_int(&p);
+    size_t ring_offset = next_int(&p);
 
     sfree(s);
 
+    if (ring_offset > memory_size || memory_size - ring_offset < sizeof(struct fzsftp_ring)) {
+        fzprintf(sftpError, "Invalid descriptor ring offset");
+        return NULL;
+    }
+
     uint8_t* memory = mmap(NULL, memory_size, PROT_READ|PROT_WRITE, MAP_SHARED, mapping, 0);
     if (!memory || memory == MAP_FAILED) {
         int err = errno;
@@ -163,6 +172,7 @@ RFile *open_existing_file(const char *name, uint64_t offset,
     ret->mapping_ = mapping;
     ret->memory_ = memory;
     ret->memory_size_ = memory_size;
+    ret->ring_ = (struct fzsftp_ring*)(memory + ring_offset);
     ret->remaining_ = 0;
     ret->buffer_  = NULL;
     ret->state = ok;
@@ -210,21 +220,13 @@ int read_from_file(RFile *f, void *buffer, int length)
 {
 #if 1
     if (f->state == ok && !f->remaining_) {
-        fznotify1(sftp_io_nextbuf, 0);
-        char * s = priority_read();
-        if (s[1] == '-') {
+        int r = ring_acquire(f->ring_, f->memory_, f->memory_size_, &f->buffer_, &f->remaining_);
+        if (r < 0) {
             f->state = error;
-            return -1;
         }
-        else if (s[1] == 0) {
+        else if (!r) {
             f->state = eof;
         }
-        else {
-            char * p = s + 1;
-            f->buffer_ = f->memory_ + next_int(&p);
-            f->remaining_ = (int)next_int(&p);
-        }
-        sfree(s);
     }
     if (f->state == eof) {
         return 0;
@@ -239,6 +241,9 @@ int read_from_file(RFile *f, void *buffer, int length)
     memcpy(buffer, f->buffer_, length);
     f->remaining_ -= length;
     f->buffer_ += length;
+    if (!f->remaining_) {
+        ring_release(f->ring_, 0);
+    }
     return length;
 #else
     return read(f->fd, buffer, length);
@@ -258,21 +263,54 @@ void close_rfile(RFile *f)
     sfree(f);
 }
 
+/* Downloaded data waiting for the data thread */
+struct wfile_block {
+    void * data;
+    int len;
+    struct wfile_block * next;
+};
+
 struct WFile {
 #if 1
     int mapping_;
     uint8_t * memory_;
     size_t memory_size_;
+    struct fzsftp_ring * ring_;
     int state;
     uint8_t * buffer_;
     int remaining_;
     int size_;
+
+    /* Data thread, see write_to_file_async */
+    pthread_t thread_;
+    bool thread_running_;
+    bool thread_failed_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;
+    struct wfile_block * queue_head_;
+    struct wfile_block * queue_tail_;
+    int queued_;
+    bool stop_;
+    bool failed_;
 #else
     int fd;
     char *name;
 #endif
 };
 
+static void init_wfile_queue(WFile *f)
+{
+    f->thread_running_ = false;
+    f->thread_failed_ = false;
+    pthread_mutex_init(&f->mutex_, NULL);
+    pthread_cond_init(&f->cond_, NULL);
+    f->queue_head_ = NULL;
+    f->queue_tail_ = NULL;
+    f->queued_ = 0;
+    f->stop_ = false;
+    f->failed_ = false;
+}
+
 WFile *open_new_file(const char *name, long perms)
 {
 #if 1
@@ -286,9 +324,16 @@ WFile *open_new_file(const char *name, long perms)
 
     int mapping = next_int(&p);
     size_t memory_size = next_int(&p);
+    next_int(&p);
+    size_t ring_offset = next_int(&p);
 
     sfree(s);
 
+    if (ring_offset > memory_size || memory_size - ring_offset < sizeof(struct fzsftp_ring)) {
+        fzprintf(sftpError, "Invalid descriptor ring offset");
+        return NULL;
+    }
+
     uint8_t* memory = mmap(0, memory_size, PROT_READ|PROT_WRITE, MAP_SHARED, mapping, 0);
     if (!memory || memory == MAP_FAILED) {
         int err = errno;
@@ -301,10 +346,12 @@ WFile *open_new_file(const char *name, long perms)
     ret->mapping_ = mapping;
     ret->memory_ = memory;
     ret->memory_size_ = memory_size;
+    ret->ring_ = (struct fzsftp_ring*)(memory + ring_offset);
     ret->remaining_ = 0;
     ret->buffer_  = NULL;
     ret->state = ok;
     ret->size_ = 0;
+    init_wfile_queue(ret);
 
     return ret;
 #else
@@ -338,12 +385,19 @@ WFile *open_existing_wfile(const char *name, uint64_t *size)
 
     int mapping = next_int(&p);
     size_t memory_size = next_int(&p);
+    uint64_t offset = next_int(&p);
     if (size) {
-        *size = next_int(&p);
+        *size = offset;
     }
+    size_t ring_offset = next_int(&p);
 
     sfree(s);
 
+    if (ring_offset > memory_size || memory_size - ring_offset < sizeof(struct fzsftp_ring)) {
+        fzprintf(sftpError, "Invalid descriptor ring offset");
+        return NULL;
+    }
+
     uint8_t* memory = mmap(0, memory_size, PROT_READ|PROT_WRITE, MAP_SHARED, mapping, 0);
     if (!memory || memory == MAP_FAILED) {
         int err = errno;
@@ -356,10 +410,12 @@ WFile *open_existing_wfile(const char *name, uint64_t *size)
     ret->mapping_ = mapping;
     ret->memory_ = memory;
     ret->memory_size_ = memory_size;
+    ret->ring_ = (struct fzsftp_ring*)(memory + ring_offset);
     ret->remaining_ = 0;
     ret->buffer_ = NULL;
     ret->state = ok;
     ret->size_ = 0;
+    init_wfile_queue(ret);
 
     return ret;
 #else
@@ -392,22 +448,16 @@ int write_to_file(WFile *f, void *buffer, int length)
 {
 #if 1
     if (f->state == ok && !f->remaining_) {
-        fznotify1(sftp_io_nextbuf, f->size_ - f->remaining_);
-        char * s = priority_read();
-        if (s[1] == '-') {
+        int r = ring_acquire(f->ring_, f->memory_, f->memory_size_, &f->buffer_, &f->remaining_);
+        if (r < 0) {
             f->state = error;
-            return -1;
         }
-        else if (s[1] == 0) {
+        else if (!r) {
             f->state = eof;
         }
         else {
-            char * p = s + 1;
-            f->buffer_ = f->memory_ + next_int(&p);
-            f->remaining_ = (int)next_int(&p);
             f->size_ = f->remaining_;
         }
-        sfree(s);
     }
     if (f->state == eof) {
         return 0;
@@ -422,6 +472,10 @@ int write_to_file(WFile *f, void *buffer, int length)
     memcpy(f->buffer_, buffer, length);
     f->remaining_ -= length;
     f->buffer_ += length;
+    if (!f->remaining_) {
+        ring_release(f->ring_, f->size_);
+        f->size_ = 0;
+    }
     return length;
 #else
     char *p = (char *)buffer;
@@ -446,18 +500,173 @@ int write_to_file(WFile *f, void *buffer, int length)
 #endif
 }
 
+static bool write_block(WFile *f, void *buffer, int length)
+{
+    char *p = (char *)buffer;
+    int pos = 0;
+
+    while (pos < length) {
+        int wlen = write_to_file(f, p + pos, length - pos);
+        if (wlen <= 0) {
+            return false;
+        }
+        pos += wlen;
+    }
+    return true;
+}
+
+/*
+ * Hands the downloaded data over to the data thread, which waits for
+ * buffers from the engine and copies the data into them. Meanwhile the
+ * main thread can go on receiving and decrypting the next packets.
+ */
+static void *wfile_thread(void *arg)
+{
+    WFile *f = (WFile *)arg;
+
+    pthread_mutex_lock(&f->mutex_);
+    while (true) {
+        struct wfile_block *b;
+        bool failed;
+
+        while (!f->queue_head_ && !f->stop_) {
+            pthread_cond_wait(&f->cond_, &f->mutex_);
+        }
+        b = f->queue_head_;
+        if (!b) {
+            break;
+        }
+        f->queue_head_ = b->next;
+        if (!f->queue_head_) {
+            f->queue_tail_ = NULL;
+        }
+        failed = f->failed_;
+        pthread_mutex_unlock(&f->mutex_);
+
+        if (!failed) {
+            failed = !write_block(f, b->data, b->len);
+        }
+
+        pthread_mutex_lock(&f->mutex_);
+        if (failed) {
+            f->failed_ = true;
+        }
+        f->queued_ -= b->len;
+        pthread_cond_broadcast(&f->cond_);
+
+        sfree(b->data);
+        sfree(b);
+    }
+    pthread_mutex_unlock(&f->mutex_);
+
+    return NULL;
+}
+
+/* Amount of data the data thread may fall behind */
+#define WFILE_QUEUE_LIMIT (1024 * 1024)
+
+bool write_to_file_async(WFile *f, void *buffer, int length)
+{
+    struct wfile_block *b;
+    bool success;
+
+    if (!f->thread_running_ && !f->thread_failed_) {
+        if (pthread_create(&f->thread_, NULL, wfile_thread, f)) {
+            f->thread_failed_ = true;
+        }
+        else {
+            f->thread_running_ = true;
+        }
+    }
+    if (!f->thread_running_) {
+        success = !f->failed_ && write_block(f, buffer, length);
+        if (!success) {
+            f->failed_ = true;
+        }
+        sfree(buffer);
+        return success;
+    }
+
+    b = snew(struct wfile_block);
+    b->data = buffer;
+    b->len = length;
+    b->next = NULL;
+
+    pthread_mutex_lock(&f->mutex_);
+    while (f->queued_ >= WFILE_QUEUE_LIMIT && !f->failed_) {
+        pthread_cond_wait(&f->cond_, &f->mutex_);
+    }
+    success = !f->failed_;
+    if (success) {
+        if (f->queue_tail_) {
+            f->queue_tail_->next = b;
+        }
+        else {
+            f->queue_head_ = b;
+        }
+        f->queue_tail_ = b;
+        f->queued_ += length;
+        pthread_cond_broadcast(&f->cond_);
+    }
+    pthread_mutex_unlock(&f->mutex_);
+
+    if (!success) {
+        sfree(buffer);
+        sfree(b);
+    }
+    return success;
+}
+
+/* Lets the data thread finish, discarding anything not yet written if
+ * requested. */
+static void stop_wfile_thread(WFile *f, bool discard)
+{
+    if (!f->thread_running_) {
+        return;
+    }
+
+    pthread_mutex_lock(&f->mutex_);
+    if (discard) {
+        while (f->queue_head_) {
+            struct wfile_block *b = f->queue_head_;
+            f->queue_head_ = b->next;
+            f->queued_ -= b->len;
+            sfree(b->data);
+            sfree(b);
+        }
+        f->queue_tail_ = NULL;
+    }
+    f->stop_ = true;
+    pthread_cond_broadcast(&f->cond_);
+    pthread_mutex_unlock(&f->mutex_);
+
+    pthread_join(f->thread_, NULL);
+    f->thread_running_ = false;
+}
+
 int finalize_wfile(WFile *f)
 {
 #if 1
+    stop_wfile_thread(f, false);
+    if (f->failed_) {
+        return 0;
+    }
     if (f->state == eof) {
         return 1;
     }
     if (f->state != ok) {
         return 0;
     }
-    fznotify1(sftp_io_finalize, f->size_ - f->remaining_);
+    if (f->size_) {
+        ring_release(f->ring_, f->size_ - f->remaining_);
+        f->size_ = 0;
+        f->remaining_ = 0;
+    }
+    fznotify1(sftp_io_finalize, 0);
     char * s = priority_read();
-    if (s[1] != '1') {
+    int success = s[1] == '1';
+    sfree(s);
+    if (!success) {
         f->state = error;
         return 0;
     }
@@ -485,6 +694,9 @@ void close_wfile(WFile *f)
         return;
     }
 #if 1
+    stop_wfile_thread(f, true);
+    pthread_cond_destroy(&f->cond_);
+    pthread_mutex_destroy(&f->mutex_);
     munmap(f->memory_, f->memory_size_);
 #else
     close(f->fd);
@@ -0,0 +1,311 @@
+/*
+ * uxsftpbench.c: loopback download benchmark for fzsftp.
+ *
+ * Stands in for the engine: starts fzsftp, logs in with a key file,
+ * downloads the same remote file a number of times through the shared
+ * memory descriptor ring and reports the throughput. Meant to be run
+ * against a local sshd to see what fzsftp itself can do.
+ *
+ * Usage: sftpbench [-f fzsftp] [-i keyfile] [-P port] [-n count] [-C]
+ *                  user@host remotefile
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "fzprintf.h"
+#include "fzsftp.h"
+
+/* Fewer buffers than ring slots, just like the engine */
+#define NBUFFERS 16
+#define BUFFER_SIZE (256 * 1024)
+#define RING_SIZE 4096
+
+static pid_t child;
+static FILE *to_child;
+static FILE *from_child;
+
+static int mapping = -1;
+static uint8_t *memory;
+static size_t memory_size;
+static struct fzsftp_ring *ring;
+
+/* Ring bookkeeping for the current download */
+static uint64_t pushed;
+static uint64_t reclaimed;
+static uint64_t received;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void fail(const char *msg)
+{
+    fprintf(stderr, "sftpbench: %s\n", msg);
+    exit(1);
+}
+
+static void send_line(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(to_child, fmt, ap);
+    va_end(ap);
+    fputc('\n', to_child);
+    fflush(to_child);
+}
+
+/* Same as SftpInputParser::lines() in the engine */
+static int event_lines(int type)
+{
+    switch (type) {
+      case sftpUsedQuotaRecv:
+      case sftpUsedQuotaSend:
+      case sftp_io_size:
+        return 0;
+      case sftpAskHostkey:
+      case sftpAskHostkeyChanged:
+      case sftpAskHostkeyBetteralg:
+        return 2;
+      case sftpListentry:
+        return 3;
+      default:
+        return 1;
+    }
+}
+
+/* Reads the next event, with the text of its first line if any */
+static int read_event(char *text, size_t size)
+{
+    int c = fgetc(from_child);
+    int type, lines, i;
+
+    if (c == EOF)
+        fail("fzsftp exited");
+    type = c - '0';
+    lines = event_lines(type);
+
+    *text = 0;
+    for (i = 0; i < lines; i++) {
+        char line[4096];
+        if (!fgets(line, sizeof(line), from_child))
+            fail("fzsftp exited");
+        line[strcspn(line, "\r\n")] = 0;
+        if (!i) {
+            snprintf(text, size, "%s", line);
+        }
+    }
+
+    return type;
+}
+
+static void setup_memory(void)
+{
+    char name[] = "/tmp/sftpbench-XXXXXX";
+
+    memory_size = RING_SIZE + NBUFFERS * BUFFER_SIZE;
+    mapping = mkstemp(name);
+    if (mapping < 0)
+        fail("Could not create shared memory");
+    unlink(name);
+    if (ftruncate(mapping, memory_size))
+        fail("Could not size shared memory");
+    memory = mmap(NULL, memory_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  mapping, 0);
+    if (memory == MAP_FAILED)
+        fail("Could not map shared memory");
+    ring = (struct fzsftp_ring *)memory;
+}
+
+static void spawn(const char *exe, bool compress)
+{
+    int in[2], out[2];
+
+    if (pipe(in) || pipe(out))
+        fail("pipe failed");
+
+    child = fork();
+    if (child < 0)
+        fail("fork failed");
+    if (!child) {
+        dup2(in[0], 0);
+        dup2(out[1], 1);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        if (compress)
+            execlp(exe, exe, "-v", "-C", (char *)NULL);
+        else
+            execlp(exe, exe, "-v", (char *)NULL);
+        perror("exec");
+        _exit(127);
+    }
+
+    close(in[0]);
+    close(out[1]);
+    to_child = fdopen(in[1], "w");
+    from_child = fdopen(out[0], "r");
+}
+
+/* Hands every buffer fzsftp is done with back to it, empty. */
+static void pump(void)
+{
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    while (reclaimed < tail) {
+        struct fzsftp_ring_slot *slot =
+            &ring->slots[reclaimed % FZSFTP_RING_SLOTS];
+        if (slot->size > 0)
+            received += slot->size;
+        ++reclaimed;
+    }
+
+    while (pushed - reclaimed < NBUFFERS) {
+        struct fzsftp_ring_slot *slot =
+            &ring->slots[pushed % FZSFTP_RING_SLOTS];
+        slot->offset = RING_SIZE + (pushed % NBUFFERS) * BUFFER_SIZE;
+        slot->size = BUFFER_SIZE;
+        ++pushed;
+    }
+    __atomic_store_n(&ring->head, pushed, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&ring->consumer_waiting, 0, __ATOMIC_SEQ_CST))
+        send_line("-");
+}
+
+/* Runs a command until fzsftp is done with it. */
+static bool run(const char *fmt, const char *arg1, const char *arg2)
+{
+    char text[4096];
+
+    send_line(fmt, arg1, arg2);
+    while (true) {
+        int type = read_event(text, sizeof(text));
+        switch (type) {
+          case sftpDone:
+            return !strcmp(text, "1");
+          case sftpError:
+            fprintf(stderr, "fzsftp: %s\n", text);
+            break;
+          case sftpAskHostkey:
+          case sftpAskHostkeyChanged:
+            /* Trust once, don't touch the host key cache */
+            send_line("n");
+            break;
+          case sftpAskHostkeyBetteralg:
+          case sftpAskPassword:
+          case sftpRequestPreamble:
+          case sftpRequestInstruction:
+            fail("Interactive login is not supported, use a key file");
+            break;
+          case sftpUsedQuotaRecv:
+            send_line("-0-");
+            break;
+          case sftpUsedQuotaSend:
+            send_line("-1-");
+            break;
+          case sftp_io_open:
+            memset(ring, 0, sizeof(*ring));
+            ring->wake_below = NBUFFERS / 2;
+            pushed = reclaimed = received = 0;
+            send_line("-%d %zu 0 0", mapping, memory_size);
+            pump();
+            break;
+          case sftp_io_nextbuf:
+            pump();
+            break;
+          case sftp_io_finalize:
+            pump();
+            send_line("-1");
+            break;
+          default:
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *exe = "fzsftp", *keyfile = NULL, *port = "22";
+    const char *target, *remote;
+    bool compress = false;
+    int count = 5, i;
+    uint64_t total = 0;
+    double total_time = 0;
+    struct rusage usage;
+    char text[4096];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:i:P:n:C")) != -1) {
+        switch (opt) {
+          case 'f': exe = optarg; break;
+          case 'i': keyfile = optarg; break;
+          case 'P': port = optarg; break;
+          case 'n': count = atoi(optarg); break;
+          case 'C': compress = true; break;
+          default:
+            fprintf(stderr, "Usage: %s [-f fzsftp] [-i keyfile] [-P port] "
+                    "[-n count] [-C] user@host remotefile\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2 || count <= 0) {
+        fprintf(stderr, "Usage: %s [-f fzsftp] [-i keyfile] [-P port] "
+                "[-n count] [-C] user@host remotefile\n", argv[0]);
+        return 1;
+    }
+    target = argv[optind];
+    remote = argv[optind + 1];
+
+    setup_memory();
+    spawn(exe, compress);
+
+    if (read_event(text, sizeof(text)) != sftpReply ||
+        strncmp(text, "fzSftp started", 14))
+        fail("Unexpected greeting from fzsftp");
+
+    if (keyfile && !run("keyfile \"%s\"", keyfile, NULL))
+        fail("keyfile command failed");
+    if (!run("open \"%s\" %s", target, port))
+        fail("Could not log in");
+
+    for (i = 0; i < count; i++) {
+        double start = now(), secs;
+        if (!run("get \"%s\" \"%s\"", remote, "/dev/null"))
+            fail("Download failed");
+        secs = now() - start;
+        printf("run %d: %" PRIu64 " bytes in %.3f s, %.1f MB/s\n", i + 1,
+               received, secs, received / secs / 1000000.0);
+        total += received;
+        total_time += secs;
+    }
+
+    fclose(to_child);
+    waitpid(child, NULL, 0);
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    printf("total: %" PRIu64 " bytes in %.3f s, %.1f MB/s, "
+           "fzsftp cpu %.3f s user %.3f s sys\n",
+           total, total_time, total / total_time / 1000000.0,
+           usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0,
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0);
+
+    return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * Unix implementation of SSH connection-sharing IPC setup.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/file.h>
+
+#include "tree234.h"
+#include "putty.h"
+#include "network.h"
+#include "proxy.h"
+#include "ssh.h"
+
+#define CONNSHARE_SOCKETDIR_PREFIX "/tmp/fzsftp-connshare"
+#define SALT_FILENAME "salt"
+#define SALT_SIZE 64
+#ifndef PIPE_BUF
+#define PIPE_BUF _POSIX_PIPE_BUF
+#endif
+
+static char *make_parentdir_name(void)
+{
+    char *username, *parent;
+
+    username = get_username();
+    parent = dupprintf("%s.%s", CONNSHARE_SOCKETDIR_PREFIX, username);
+    sfree(username);
+    assert(*parent == '/');
+
+    return parent;
+}
+
+/*
+ * The salt is shared by all processes of this user, it keeps
+ * "user@host" strings out of the socket names which are visible
+ * to other users, e.g. in 'netstat -x'.
+ */
+static bool read_salt(const char *parentdirname, unsigned char *saltbuf,
+                      char **logtext)
+{
+    char *saltname;
+    int saltfd, ret;
+    size_t got;
+
+    saltname = dupprintf("%s/%s", parentdirname, SALT_FILENAME);
+    saltfd = open(saltname, O_RDONLY);
+    if (saltfd < 0) {
+        char *tmpname;
+        int pid, i;
+
+        if (errno != ENOENT) {
+            *logtext = dupprintf("%s: open: %s", saltname, strerror(errno));
+            sfree(saltname);
+            return false;
+        }
+
+        /*
+         * Another process may be creating the salt file at the same
+         * time. Write it under a different name first, then hard-link
+         * it into place. That way an existing salt file never changes.
+         */
+        pid = getpid();
+        for (i = 0;; i++) {
+            tmpname = dupprintf("%s/%s.tmp.%d.%d",
+                                parentdirname, SALT_FILENAME, pid, i);
+            saltfd = open(tmpname, O_WRONLY | O_EXCL | O_CREAT, 0400);
+            if (saltfd >= 0)
+                break;
+            if (errno != EEXIST) {
+                *logtext = dupprintf("%s: open: %s", tmpname,
+                                     strerror(errno));
+                sfree(tmpname);
+                sfree(saltname);
+                return false;
+            }
+            sfree(tmpname);
+        }
+
+        random_read(saltbuf, SALT_SIZE);
+        ret = write(saltfd, saltbuf, SALT_SIZE);
+        /* Less than PIPE_BUF bytes, so the write is atomic */
+        assert(SALT_SIZE < PIPE_BUF);
+        if (ret < 0) {
+            *logtext = dupprintf("%s: write: %s", tmpname, strerror(errno));
+            close(saltfd);
+            unlink(tmpname);
+            sfree(tmpname);
+            sfree(saltname);
+            return false;
+        }
+        if (close(saltfd) < 0) {
+            *logtext = dupprintf("%s: close: %s", tmpname, strerror(errno));
+            unlink(tmpname);
+            sfree(tmpname);
+            sfree(saltname);
+            return false;
+        }
+
+        /* EEXIST just means another process was faster */
+        if (link(tmpname, saltname) < 0 && errno != EEXIST) {
+            *logtext = dupprintf("%s: link: %s", saltname, strerror(errno));
+            unlink(tmpname);
+            sfree(tmpname);
+            sfree(saltname);
+            return false;
+        }
+        unlink(tmpname);
+        sfree(tmpname);
+
+        saltfd = open(saltname, O_RDONLY);
+        if (saltfd < 0) {
+            *logtext = dupprintf("%s: open: %s", saltname, strerror(errno));
+            sfree(saltname);
+            return false;
+        }
+    }
+
+    for (got = 0; got < SALT_SIZE; got += ret) {
+        ret = read(saltfd, saltbuf + got, SALT_SIZE - got);
+        if (ret <= 0) {
+            *logtext = dupprintf("%s: read: %s", saltname,
+                                 ret == 0 ? "unexpected EOF" :
+                                 strerror(errno));
+            close(saltfd);
+            sfree(saltname);
+            return false;
+        }
+    }
+
+    close(saltfd);
+    sfree(saltname);
+    return true;
+}
+
+static char *make_dirname(const char *pi_name, char **logtext)
+{
+    char *parentdirname, *dirname, *err;
+    unsigned char saltbuf[SALT_SIZE];
+    unsigned char digest[32];
+    char name[65];
+    int i;
+
+    parentdirname = make_parentdir_name();
+    if ((err = make_dir_and_check_ours(parentdirname)) != NULL) {
+        *logtext = err;
+        sfree(parentdirname);
+        return NULL;
+    }
+
+    if (!read_salt(parentdirname, saltbuf, logtext)) {
+        sfree(parentdirname);
+        return NULL;
+    }
+
+    ssh_hash *h = ssh_hash_new(&ssh_sha256);
+    put_data(h, saltbuf, SALT_SIZE);
+    put_stringz(h, pi_name);
+    ssh_hash_final(h, digest);
+    smemclr(saltbuf, sizeof(saltbuf));
+
+    for (i = 0; i < 32; i++) {
+        sprintf(name + 2*i, "%02x", digest[i]);
+    }
+
+    dirname = dupprintf("%s/%s", parentdirname, name);
+    sfree(parentdirname);
+
+    return dirname;
+}
+
+int platform_ssh_share(const char *pi_name, Conf *conf,
+                       Plug *downplug, Plug *upplug, Socket **sock,
+                       char **logtext, char **ds_err, char **us_err,
+                       bool can_upstream, bool can_downstream)
+{
+    char *dirname, *lockname, *sockname, *err;
+    int lockfd;
+    Socket *retsock;
+
+    dirname = make_dirname(pi_name, logtext);
+    if (!dirname) {
+        return SHARE_NONE;
+    }
+
+    if ((err = make_dir_and_check_ours(dirname)) != NULL) {
+        *logtext = err;
+        sfree(dirname);
+        return SHARE_NONE;
+    }
+
+    /*
+     * Hold a lock while deciding whether to become upstream or
+     * downstream, so that two processes connecting at the same time
+     * don't both become upstream.
+     */
+    lockname = dupcat(dirname, "/lock");
+    lockfd = open(lockname, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (lockfd < 0) {
+        *logtext = dupprintf("%s: open: %s", lockname, strerror(errno));
+        sfree(dirname);
+        sfree(lockname);
+        return SHARE_NONE;
+    }
+    if (flock(lockfd, LOCK_EX) < 0) {
+        *logtext = dupprintf("%s: flock(LOCK_EX): %s",
+                             lockname, strerror(errno));
+        sfree(dirname);
+        sfree(lockname);
+        close(lockfd);
+        return SHARE_NONE;
+    }
+
+    sockname = dupprintf("%s/socket", dirname);
+    sfree(dirname);
+    sfree(lockname);
+
+    *logtext = NULL;
+
+    if (can_downstream) {
+        retsock = new_connection(unix_sock_addr(sockname),
+                                 "", 0, false, true, false, false,
+                                 downplug, conf);
+        if (sk_socket_error(retsock) == NULL) {
+            *logtext = sockname;
+            *sock = retsock;
+            close(lockfd);
+            return SHARE_DOWNSTREAM;
+        }
+        sfree(*ds_err);
+        *ds_err = dupprintf("%s: %s", sockname, sk_socket_error(retsock));
+        sk_close(retsock);
+    }
+
+    if (can_upstream) {
+        /* A stale socket of an upstream that went away */
+        unlink(sockname);
+        retsock = new_unix_listener(unix_sock_addr(sockname), upplug);
+        if (sk_socket_error(retsock) == NULL) {
+            *logtext = sockname;
+            *sock = retsock;
+            close(lockfd);
+            return SHARE_UPSTREAM;
+        }
+        sfree(*us_err);
+        *us_err = dupprintf("%s: %s", sockname, sk_socket_error(retsock));
+        sk_close(retsock);
+    }
+
+    assert(*ds_err || *us_err);
+
+    sfree(sockname);
+    close(lockfd);
+    return SHARE_NONE;
+}
+
+void platform_ssh_share_cleanup(const char *name)
+{
+    char *dirname, *filename, *logtext = NULL;
+
+    dirname = make_dirname(name, &logtext);
+    if (!dirname) {
+        sfree(logtext);
+        return;
+    }
+
+    filename = dupcat(dirname, "/socket");
+    remove(filename);
+    sfree(filename);
+
+    filename = dupcat(dirname, "/lock");
+    remove(filename);
+    sfree(filename);
+
+    rmdir(dirname);
+
+    /*
+     * The parent directory is kept deliberately, other users cannot
+     * put their own directory in its place and the salt gets reused.
+     */
+    sfree(dirname);
+}
@@ -111,6 +111,7 @@ struct RFile {
 #if 1
     uint8_t * memory_;
     size_t memory_size_;
+    struct fzsftp_ring * ring_;
     int state;
     uint8_t* buffer_;
     int remaining_;
@@ -135,9 +136,17 @@ RFile *open_existing_file(const char *name, uint64_t offset,
 
     HANDLE mapping = (HANDLE)next_int(&p);
     size_t memory_size = next_int(&p);
+    next_int(&p);
+    size_t ring_offset = next_int(&p);
 
     sfree(s);
 
+    if (ring_offset > memory_size || memory_size - ring_offset < sizeof(struct fzsftp_ring)) {
+        CloseHandle(mapping);
+        fzprintf(sftpError, "Invalid descriptor ring offset");
+        return NULL;
+    }
+
     uint8_t* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, memory_size);
     CloseHandle(mapping);
     if (!memory) {
@@ -148,6 +157,7 @@ RFile *open_existing_file(const char *name, uint64_t offset,
     ret = snew(RFile);
     ret->memory_ = memory;
     ret->memory_size_ = memory_size;
+    ret->ring_ = (struct fzsftp_ring*)(memory + ring_offset);
     ret->remaining_ = 0;
     ret->buffer_  = NULL;
     ret->state = ok;
@@ -196,21 +206,13 @@ int read_from_file(RFile *f, void *buffer, int length)
 {
 #if 1
     if (f->state == ok && !f->remaining_) {
-        fznotify1(sftp_io_nextbuf, 0);
-        char * s = priority_read();
-        if (s[1] == '-') {
+        int r = ring_acquire(f->ring_, f->memory_, f->memory_size_, &f->buffer_, &f->remaining_);
+        if (r < 0) {
             f->state = error;
-            return -1;
         }
-        else if (s[1] == 0) {
+        else if (!r) {
             f->state = eof;
         }
-        else {
-            char * p = s + 1;
-            f->buffer_ = f->memory_ + next_int(&p);
-            f->remaining_ = (int)next_int(&p);
-        }
-        sfree(s);
     }
     if (f->state == eof) {
         return 0;
@@ -225,6 +227,9 @@ int read_from_file(RFile *f, void *buffer, int length)
     memcpy(buffer, f->buffer_, length);
     f->remaining_ -= length;
     f->buffer_ += length;
+    if (!f->remaining_) {
+        ring_release(f->ring_, 0);
+    }
     return length;
 #else
     DWORD read;
@@ -252,6 +257,7 @@ struct WFile {
 #if 1
     uint8_t * memory_;
     size_t memory_size_;
+    struct fzsftp_ring * ring_;
     int state;
     uint8_t* buffer_;
     int remaining_;
@@ -275,9 +281,17 @@ WFile *open_new_file(const char *name, long perms)
 
     HANDLE mapping = (HANDLE)next_int(&p);
     size_t memory_size = next_int(&p);
+    next_int(&p);
+    size_t ring_offset = next_int(&p);
 
     sfree(s);
 
+    if (ring_offset > memory_size || memory_size - ring_offset < sizeof(struct fzsftp_ring)) {
+        CloseHandle(mapping);
+        fzprintf(sftpError, "Invalid descriptor ring offset");
+        return NULL;
+    }
+
     uint8_t* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, memory_size);
     CloseHandle(mapping);
     if (!memory) {
@@ -288,6 +302,7 @@ WFile *open_new_file(const char *name, long perms)
     ret = snew(WFile);
     ret->memory_ = memory;
     ret->memory_size_ = memory_size;
+    ret->ring_ = (struct fzsftp_ring*)(memory + ring_offset);
     ret->remaining_ = 0;
     ret->buffer_  = NULL;
     ret->state = ok;
@@ -329,12 +344,20 @@ WFile *open_existing_wfile(const char *name, uint64_t *size)
 
     HANDLE mapping = (HANDLE)next_int(&p);
     size_t memory_size = next_int(&p);
+    uint64_t offset = next_int(&p);
     if (size) {
-        *size = next_int(&p);
+        *size = offset;
     }
+    size_t ring_offset = next_int(&p);
 
     sfree(s);
 
+    if (ring_offset > memory_size || memory_size - ring_offset < sizeof(struct fzsftp_ring)) {
+        CloseHandle(mapping);
+        fzprintf(sftpError, "Invalid descriptor ring offset");
+        return NULL;
+    }
+
     uint8_t* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, memory_size);
     CloseHandle(mapping);
     if (!memory) {
@@ -345,6 +368,7 @@ WFile *open_existing_wfile(const char *name, uint64_t *size)
     ret = snew(WFile);
     ret->memory_ = memory;
     ret->memory_size_ = memory_size;
+    ret->ring_ = (struct fzsftp_ring*)(memory + ring_offset);
     ret->remaining_ = 0;
     ret->buffer_  = NULL;
     ret->state = ok;
@@ -382,22 +406,16 @@ int write_to_file(WFile *f, void *buffer, int length)
 {
 #if 1
     if (f->state == ok && !f->remaining_) {
-        fznotify1(sftp_io_nextbuf, f->size_ - f->remaining_);
-        char * s = priority_read();
-        if (s[1] == '-') {
+        int r = ring_acquire(f->ring_, f->memory_, f->memory_size_, &f->buffer_, &f->remaining_);
+        if (r < 0) {
             f->state = error;
-            return -1;
         }
-        else if (s[1] == 0) {
+        else if (!r) {
             f->state = eof;
         }
         else {
-            char * p = s + 1;
-            f->buffer_ = f->memory_ + next_int(&p);
-            f->remaining_ = (int)next_int(&p);
             f->size_ = f->remaining_;
         }
-        sfree(s);
     }
     if (f->state == eof) {
         return 0;
@@ -412,6 +430,10 @@ int write_to_file(WFile *f, void *buffer, int length)
     memcpy(f->buffer_, buffer, length);
     f->remaining_ -= length;
     f->buffer_ += length;
+    if (!f->remaining_) {
+        ring_release(f->ring_, f->size_);
+        f->size_ = 0;
+    }
     return length;
 #else
     DWORD written;
@@ -422,6 +444,23 @@ int write_to_file(WFile *f, void *buffer, int length)
 #endif
 }
 
+bool write_to_file_async(WFile *f, void *buffer, int length)
+{
+    char *p = (char *)buffer;
+    int pos = 0;
+
+    while (pos < length) {
+        int wlen = write_to_file(f, p + pos, length - pos);
+        if (wlen <= 0) {
+            break;
+        }
+        pos += wlen;
+    }
+    sfree(buffer);
+
+    return pos == length;
+}
+
 int finalize_wfile(WFile *f)
 {
 #if 1
@@ -431,9 +470,16 @@ int finalize_wfile(WFile *f)
     if (f->state != ok) {
         return 0;
     }
-    fznotify1(sftp_io_finalize, f->size_ - f->remaining_);
-    char const* s = priority_read();
-    if (s[1] != '1') {
+    if (f->size_) {
+        ring_release(f->ring_, f->size_ - f->remaining_);
+        f->size_ = 0;
+        f->remaining_ = 0;
+    }
+    fznotify1(sftp_io_finalize, 0);
+    char * s = priority_read();
+    int success = s[1] == '1';
+    sfree(s);
+    if (!success) {
         f->state = error;
         return 0;
     }
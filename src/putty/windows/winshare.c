@@ -0,0 +1,148 @@
+/*
+ * Windows implementation of SSH connection-sharing IPC setup.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "tree234.h"
+#include "putty.h"
+#include "network.h"
+#include "proxy.h"
+#include "ssh.h"
+
+#if !defined NO_SECURITY
+
+#include "wincapi.h"
+#include "winsecur.h"
+
+#define CONNSHARE_PIPE_PREFIX "\\\\.\\pipe\\fzsftp-connshare"
+#define CONNSHARE_MUTEX_PREFIX "Local\\fzsftp-connshare-mutex"
+
+static char *make_name(const char *prefix, const char *name)
+{
+    char *username, *retname;
+
+    username = get_username();
+    retname = dupprintf("%s.%s.%s", prefix, username, name);
+    sfree(username);
+
+    return retname;
+}
+
+int platform_ssh_share(const char *pi_name, Conf *conf,
+                       Plug *downplug, Plug *upplug, Socket **sock,
+                       char **logtext, char **ds_err, char **us_err,
+                       bool can_upstream, bool can_downstream)
+{
+    char *name, *mutexname, *pipename;
+    HANDLE mutex;
+    Socket *retsock;
+    PSECURITY_DESCRIPTOR psd;
+    PACL acl;
+    SECURITY_ATTRIBUTES sa;
+
+    /*
+     * Obfuscating the identifier keeps "user@host" out of the pipe
+     * name and also gets rid of characters not allowed in it.
+     */
+    name = capi_obfuscate_string(pi_name);
+    if (!name) {
+        *logtext = dupprintf("Unable to call CryptProtectMemory: %s",
+                             win_strerror(GetLastError()));
+        return SHARE_NONE;
+    }
+
+    /*
+     * Hold a mutex while deciding whether to become upstream or
+     * downstream, so that two processes connecting at the same time
+     * don't both become upstream.
+     */
+    mutexname = make_name(CONNSHARE_MUTEX_PREFIX, name);
+    if (!make_private_security_descriptor(MUTEX_ALL_ACCESS,
+                                          &psd, &acl, logtext)) {
+        sfree(mutexname);
+        sfree(name);
+        return SHARE_NONE;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = psd;
+    sa.bInheritHandle = false;
+
+    mutex = CreateMutex(&sa, false, mutexname);
+    LocalFree(psd);
+    LocalFree(acl);
+    if (!mutex) {
+        *logtext = dupprintf("CreateMutex(\"%s\") failed: %s",
+                             mutexname, win_strerror(GetLastError()));
+        sfree(mutexname);
+        sfree(name);
+        return SHARE_NONE;
+    }
+    sfree(mutexname);
+
+    WaitForSingleObject(mutex, INFINITE);
+
+    pipename = make_name(CONNSHARE_PIPE_PREFIX, name);
+    sfree(name);
+
+    *logtext = NULL;
+
+    if (can_downstream) {
+        retsock = new_named_pipe_client(pipename, downplug);
+        if (sk_socket_error(retsock) == NULL) {
+            *logtext = pipename;
+            *sock = retsock;
+            ReleaseMutex(mutex);
+            CloseHandle(mutex);
+            return SHARE_DOWNSTREAM;
+        }
+        sfree(*ds_err);
+        *ds_err = dupprintf("%s: %s", pipename, sk_socket_error(retsock));
+        sk_close(retsock);
+    }
+
+    if (can_upstream) {
+        retsock = new_named_pipe_listener(pipename, upplug);
+        if (sk_socket_error(retsock) == NULL) {
+            *logtext = pipename;
+            *sock = retsock;
+            ReleaseMutex(mutex);
+            CloseHandle(mutex);
+            return SHARE_UPSTREAM;
+        }
+        sfree(*us_err);
+        *us_err = dupprintf("%s: %s", pipename, sk_socket_error(retsock));
+        sk_close(retsock);
+    }
+
+    assert(*ds_err || *us_err);
+
+    sfree(pipename);
+    ReleaseMutex(mutex);
+    CloseHandle(mutex);
+    return SHARE_NONE;
+}
+
+void platform_ssh_share_cleanup(const char *name)
+{
+    /* Named pipes go away with their last handle */
+}
+
+#else /* !defined NO_SECURITY */
+
+int platform_ssh_share(const char *pi_name, Conf *conf,
+                       Plug *downplug, Plug *upplug, Socket **sock,
+                       char **logtext, char **ds_err, char **us_err,
+                       bool can_upstream, bool can_downstream)
+{
+    return SHARE_NONE;
+}
+
+void platform_ssh_share_cleanup(const char *name)
+{
+}
+
+#endif /* !defined NO_SECURITY */
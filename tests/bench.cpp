@@ -0,0 +1,782 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/directorylisting.h"
+#include "../src/include/engine_context.h"
+#include "../src/include/engine_options.h"
+#include "../src/include/FileZillaEngine.h"
+#include "../src/include/misc.h"
+
+#include "bench_server.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/util.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <locale.h>
+
+#ifndef FZ_WINDOWS
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+/*
+ * End-to-end benchmark of the engine data path.
+ *
+ * Drives CFileZillaEngine headlessly against local stand-in servers and
+ * measures throughput, CPU time and memory of a few fixed scenarios. For
+ * FTP and FTPS an in-process stand-in is forked, see bench_server.h. SFTP
+ * needs an external server, e.g. a local sshd, given with --sftp.
+ *
+ * Results are printed as one JSON object per line, suitable for regression
+ * tracking. Not run by `make check`, use `make benchmark` or run it directly.
+ *
+ * Changes spanning the engine and fzsftp, such as the buffer exchange over
+ * the shared descriptor ring, can only be compared across two builds, the
+ * baseline having the change reverted. Run each build against the same
+ * sshd, e.g.
+ *   bench --protocols sftp --scenarios huge --sftp 127.0.0.1 --runs 5 --label before
+ * and compare the medians of mb_per_s and cpu_seconds_per_gb per label.
+ */
+
+using namespace std::literals;
+
+namespace {
+struct bench_config final
+{
+	std::vector<std::string> protocols{"ftp", "ftps"};
+	std::vector<std::string> scenarios{"huge", "tiny", "listing"};
+
+	int64_t huge_size{1024 * 1024 * 1024};
+	int tiny_count{100000};
+	int64_t tiny_size{1024};
+	int listing_entries{200000};
+	int connections{1};
+	int delay{};
+	int runs{1};
+	std::string label;
+
+	std::string sftp_host;
+	unsigned int sftp_port{22};
+	std::wstring sftp_user;
+	std::wstring sftp_password;
+	std::wstring sftp_key;
+	std::wstring sftp_path{L"/tmp/fzbench"};
+	std::wstring fzsftp;
+
+	std::vector<std::pair<std::string, std::wstring>> engine_options;
+
+	std::wstring workdir;
+	std::string output;
+	bool verbose{};
+};
+
+class bench_options final : public COptionsBase
+{
+public:
+	bool set_by_name(std::string const& name, std::wstring const& value)
+	{
+		auto index = optionsIndex::invalid;
+		{
+			fz::scoped_write_lock l(mtx_);
+			add_missing(l);
+			auto it = name_to_option_.find(name);
+			if (it != name_to_option_.end()) {
+				index = static_cast<optionsIndex>(it->second);
+			}
+		}
+		if (index == optionsIndex::invalid) {
+			return false;
+		}
+		set(index, value);
+		return true;
+	}
+
+private:
+	virtual void notify_changed() override {}
+};
+
+class bench_encoding_converter final : public CustomEncodingConverterBase
+{
+public:
+	virtual std::wstring toLocal(std::wstring const&, char const* buffer, size_t len) const override
+	{
+		return fz::to_wstring(std::string_view(buffer, len));
+	}
+
+	virtual std::string toServer(std::wstring const&, wchar_t const* buffer, size_t len) const override
+	{
+		return fz::to_string(std::wstring_view(buffer, len));
+	}
+};
+
+// Executes a queue of commands on one engine, answering all requests so
+// that nothing needs interaction.
+class bench_engine final
+{
+public:
+	bench_engine(CFileZillaEngineContext & context, fz::mutex & mtx, fz::condition & cond, bool verbose)
+		: engine_(context, [&mtx, &cond](CFileZillaEngine*) {
+			fz::scoped_lock l(mtx);
+			cond.signal(l);
+		})
+		, verbose_(verbose)
+	{
+	}
+
+	void add(std::unique_ptr<CCommand> && command)
+	{
+		commands_.push_back(std::move(command));
+	}
+
+	void next();
+	void process();
+
+	bool busy() const { return busy_; }
+
+	int failures_{};
+	uint64_t entries_{};
+
+private:
+	void on_reply(int reply);
+
+	CFileZillaEngine engine_;
+	std::deque<std::unique_ptr<CCommand>> commands_;
+	bool busy_{};
+	bool const verbose_{};
+};
+
+void bench_engine::next()
+{
+	while (!commands_.empty()) {
+		auto command = std::move(commands_.front());
+		commands_.pop_front();
+
+		int const res = engine_.Execute(*command);
+		if (res == FZ_REPLY_WOULDBLOCK) {
+			busy_ = true;
+			return;
+		}
+		on_reply(res);
+	}
+	busy_ = false;
+}
+
+void bench_engine::on_reply(int reply)
+{
+	if (reply != FZ_REPLY_OK && reply != FZ_REPLY_DISCONNECTED) {
+		++failures_;
+	}
+}
+
+void bench_engine::process()
+{
+	std::unique_ptr<CNotification> notification;
+	while ((notification = engine_.GetNextNotification())) {
+		switch (notification->GetID()) {
+		case nId_logmsg:
+			if (verbose_) {
+				std::wcerr << static_cast<CLogmsgNotification const&>(*notification).msg << std::endl;
+			}
+			break;
+		case nId_operation:
+			on_reply(static_cast<COperationNotification const&>(*notification).replyCode_);
+			next();
+			break;
+		case nId_listing:
+			{
+				auto const& n = static_cast<CDirectoryListingNotification const&>(*notification);
+				CDirectoryListing listing;
+				if (n.Primary() && !n.Failed() && engine_.CacheLookup(n.GetPath(), listing) == FZ_REPLY_OK) {
+					entries_ += listing.size();
+				}
+			}
+			break;
+		case nId_asyncrequest:
+			{
+				auto request = unique_static_cast<CAsyncRequestNotification>(std::move(notification));
+				switch (request->GetRequestID()) {
+				case reqId_fileexists:
+					static_cast<CFileExistsNotification&>(*request).overwriteAction = CFileExistsNotification::overwrite;
+					break;
+				case reqId_hostkey:
+				case reqId_hostkeyChanged:
+					static_cast<CHostKeyNotification&>(*request).m_trust = true;
+					break;
+				case reqId_certificate:
+					static_cast<CCertificateNotification&>(*request).trusted_ = true;
+					break;
+				case reqId_insecure_connection:
+					static_cast<CInsecureConnectionNotification&>(*request).allow_ = true;
+					break;
+				case reqId_tls_no_resumption:
+					static_cast<FtpTlsNoResumptionNotification&>(*request).allow_ = true;
+					break;
+				default:
+					break;
+				}
+				engine_.SetAsyncRequestReply(std::move(request));
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// Runs until all engines have executed their queued commands
+void run(std::vector<std::unique_ptr<bench_engine>> & engines, fz::mutex & mtx, fz::condition & cond)
+{
+	for (auto & engine : engines) {
+		engine->next();
+	}
+
+	for (;;) {
+		bool busy{};
+		for (auto & engine : engines) {
+			engine->process();
+			busy |= engine->busy();
+		}
+		if (!busy) {
+			break;
+		}
+
+		fz::scoped_lock l(mtx);
+		cond.wait(l);
+	}
+}
+
+struct usage final
+{
+	static usage now()
+	{
+		usage ret;
+		ret.time_ = fz::monotonic_clock::now();
+#ifndef FZ_WINDOWS
+		for (int who : {RUSAGE_SELF, RUSAGE_CHILDREN}) {
+			rusage r{};
+			if (!getrusage(who, &r)) {
+				ret.cpu_ += r.ru_utime.tv_sec + r.ru_stime.tv_sec + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) / 1000000.0;
+			}
+		}
+#endif
+		return ret;
+	}
+
+	fz::monotonic_clock time_;
+	double cpu_{};
+};
+
+// The peak resident set size can be reset per scenario on Linux, elsewhere
+// it is the peak since the start of the process.
+void reset_peak_rss()
+{
+#ifdef __linux__
+	std::ofstream f("/proc/self/clear_refs");
+	f << "5";
+#endif
+}
+
+uint64_t peak_rss_kib()
+{
+#ifdef __linux__
+	std::ifstream f("/proc/self/status");
+	std::string line;
+	while (std::getline(f, line)) {
+		if (fz::starts_with(line, "VmHWM:"s)) {
+			return fz::to_integral<uint64_t>(fz::trimmed(std::string_view(line).substr(6), " \tkB"));
+		}
+	}
+#endif
+#ifndef FZ_WINDOWS
+	rusage r{};
+	if (!getrusage(RUSAGE_SELF, &r)) {
+		return static_cast<uint64_t>(r.ru_maxrss);
+	}
+#endif
+	return 0;
+}
+
+struct measurement final
+{
+	std::string to_json() const
+	{
+		double const s = seconds_ > 0 ? seconds_ : 1e-9;
+
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(3);
+		out << "{";
+		if (!label_.empty()) {
+			out << "\"label\":\"" << escaped(label_) << "\",";
+		}
+		out << "\"protocol\":\"" << protocol_ << "\",\"scenario\":\"" << scenario_ << "\",\"run\":" << run_;
+		out << ",\"seconds\":" << seconds_ << ",\"bytes\":" << bytes_ << ",\"files\":" << files_ << ",\"entries\":" << entries_;
+		out << ",\"mb_per_s\":" << bytes_ / s / 1000000 << ",\"files_per_s\":" << files_ / s << ",\"entries_per_s\":" << entries_ / s;
+		out << ",\"cpu_seconds\":" << cpu_ << ",\"cpu_seconds_per_gb\":";
+		if (bytes_) {
+			out << cpu_ / (bytes_ / 1000000000.0);
+		}
+		else {
+			out << "null";
+		}
+		out << ",\"peak_rss_kib\":" << peak_rss_ << ",\"failures\":" << failures_ << "}";
+		return out.str();
+	}
+
+	static std::string escaped(std::string const& s)
+	{
+		std::string ret;
+		for (auto c : s) {
+			if (c == '"' || c == '\\') {
+				ret += '\\';
+			}
+			else if (static_cast<unsigned char>(c) < 0x20) {
+				continue;
+			}
+			ret += c;
+		}
+		return ret;
+	}
+
+	std::string label_;
+	std::string protocol_;
+	std::string scenario_;
+	int run_{};
+	double seconds_{};
+	uint64_t bytes_{};
+	uint64_t files_{};
+	uint64_t entries_{};
+	double cpu_{};
+	uint64_t peak_rss_{};
+	int failures_{};
+};
+
+// One pass over all scenarios for a single protocol
+class bench_protocol final
+{
+public:
+	bench_protocol(bench_config const& config, CFileZillaEngineContext & context, std::string const& protocol, CServer const& server, Credentials const& credentials, CServerPath const& remote, CServerPath const& listing)
+		: config_(config)
+		, context_(context)
+		, protocol_(protocol)
+		, server_(server)
+		, credentials_(credentials)
+		, remote_(remote)
+		, listing_(listing)
+	{}
+
+	// Commands are distributed over the given number of connections. The
+	// scenario itself starts after all connections have been established and
+	// the setup commands have been run, their failures are ignored.
+	measurement measure(std::string const& scenario, int connections, std::unique_ptr<CCommand> && setup, std::vector<std::unique_ptr<CCommand>> && commands, uint64_t bytes, uint64_t files);
+
+	bench_config const& config_;
+	CFileZillaEngineContext & context_;
+	std::string const protocol_;
+	CServer const server_;
+	Credentials const credentials_;
+	CServerPath const remote_;
+	CServerPath const listing_;
+
+private:
+	fz::mutex mtx_;
+	fz::condition cond_;
+};
+
+measurement bench_protocol::measure(std::string const& scenario, int connections, std::unique_ptr<CCommand> && setup, std::vector<std::unique_ptr<CCommand>> && commands, uint64_t bytes, uint64_t files)
+{
+	measurement m;
+	m.protocol_ = protocol_;
+	m.scenario_ = scenario;
+
+	std::vector<std::unique_ptr<bench_engine>> engines;
+	for (int i = 0; i < connections; ++i) {
+		engines.push_back(std::make_unique<bench_engine>(context_, mtx_, cond_, config_.verbose));
+		engines.back()->add(std::make_unique<CConnectCommand>(server_, ServerHandle(), credentials_, false));
+	}
+	run(engines, mtx_, cond_);
+	for (auto const& engine : engines) {
+		m.failures_ += engine->failures_;
+		engine->failures_ = 0;
+	}
+	if (m.failures_) {
+		return m;
+	}
+
+	if (setup) {
+		engines.front()->add(std::move(setup));
+		run(engines, mtx_, cond_);
+		engines.front()->failures_ = 0;
+	}
+
+	for (size_t i = 0; i < commands.size(); ++i) {
+		engines[i % engines.size()]->add(std::move(commands[i]));
+	}
+
+	reset_peak_rss();
+	auto const start = usage::now();
+	run(engines, mtx_, cond_);
+	m.seconds_ = (fz::monotonic_clock::now() - start.time_).get_milliseconds() / 1000.0;
+
+	// Disconnect and destroy the engines before taking the CPU time so that
+	// child processes such as fzsftp have been reaped and are accounted.
+	for (auto & engine : engines) {
+		m.failures_ += engine->failures_;
+		m.entries_ += engine->entries_;
+		engine->failures_ = 0;
+		engine->add(std::make_unique<CDisconnectCommand>());
+	}
+	run(engines, mtx_, cond_);
+	engines.clear();
+
+	m.cpu_ = usage::now().cpu_ - start.cpu_;
+	m.peak_rss_ = peak_rss_kib();
+	if (!m.failures_) {
+		m.bytes_ = bytes;
+		m.files_ = files;
+	}
+	return m;
+}
+
+bool create_file(std::wstring const& name, int64_t size)
+{
+	if (fz::local_filesys::get_size(fz::to_native(name)) == size) {
+		return true;
+	}
+
+	fz::file f(fz::to_native(name), fz::file::writing, fz::file::empty);
+	if (!f.opened()) {
+		return false;
+	}
+
+	std::string const block(1024 * 1024, 'x');
+	while (size > 0) {
+		auto const chunk = std::min(size, static_cast<int64_t>(block.size()));
+		if (f.write(block.data(), chunk) != chunk) {
+			return false;
+		}
+		size -= chunk;
+	}
+	return true;
+}
+
+std::wstring tiny_name(int i)
+{
+	return fz::sprintf(L"f%06d", i);
+}
+
+bool run_protocol(bench_config const& config, bench_protocol & p, int run, std::ostream & out)
+{
+	auto & pool = p.context_.GetThreadPool();
+	std::wstring const up = config.workdir + L"/up";
+	std::wstring const down = config.workdir + L"/down/" + fz::to_wstring(p.protocol_);
+	CServerPath const tiny_remote(p.remote_, L"tiny");
+
+	auto report = [&](measurement m) {
+		m.label_ = config.label;
+		m.run_ = run;
+		out << m.to_json() << std::endl;
+		return !m.failures_;
+	};
+
+	bool success = true;
+	for (auto const& scenario : config.scenarios) {
+		if (scenario == "huge") {
+			std::vector<std::unique_ptr<CCommand>> commands;
+			commands.push_back(std::make_unique<CFileTransferCommand>(fz::file_reader_factory(up + L"/huge", pool), p.remote_, L"huge", transfer_flags::none));
+			success &= report(p.measure("huge-upload", 1, std::make_unique<CMkdirCommand>(p.remote_, transfer_flags::none), std::move(commands), config.huge_size, 1));
+
+			commands.clear();
+			commands.push_back(std::make_unique<CFileTransferCommand>(fz::file_writer_factory(down + L"/huge", pool), p.remote_, L"huge", transfer_flags::download));
+			success &= report(p.measure("huge-download", 1, nullptr, std::move(commands), config.huge_size, 1));
+		}
+		else if (scenario == "tiny") {
+			std::vector<std::unique_ptr<CCommand>> commands;
+			for (int i = 0; i < config.tiny_count; ++i) {
+				commands.push_back(std::make_unique<CFileTransferCommand>(fz::file_reader_factory(up + L"/tiny/" + tiny_name(i), pool), tiny_remote, tiny_name(i), transfer_flags::none));
+			}
+			success &= report(p.measure("tiny-upload", config.connections, std::make_unique<CMkdirCommand>(tiny_remote, transfer_flags::none), std::move(commands), config.tiny_size * config.tiny_count, config.tiny_count));
+
+			commands.clear();
+			for (int i = 0; i < config.tiny_count; ++i) {
+				commands.push_back(std::make_unique<CFileTransferCommand>(fz::file_writer_factory(down + L"/tiny/" + tiny_name(i), pool), tiny_remote, tiny_name(i), transfer_flags::download));
+			}
+			success &= report(p.measure("tiny-download", config.connections, nullptr, std::move(commands), config.tiny_size * config.tiny_count, config.tiny_count));
+		}
+		else if (scenario == "listing") {
+			std::vector<std::unique_ptr<CCommand>> commands;
+			commands.push_back(std::make_unique<CListCommand>(p.listing_, std::wstring(), LIST_FLAG_REFRESH));
+			success &= report(p.measure("listing", 1, nullptr, std::move(commands), 0, 0));
+		}
+	}
+	return success;
+}
+
+bool prepare_workdir(bench_config const& config)
+{
+	std::wstring const up = config.workdir + L"/up";
+	if (!fz::mkdir(fz::to_native(up + L"/tiny"), true)) {
+		return false;
+	}
+	for (auto const& protocol : config.protocols) {
+		if (!fz::mkdir(fz::to_native(config.workdir + L"/down/" + fz::to_wstring(protocol) + L"/tiny"), true)) {
+			return false;
+		}
+	}
+
+	for (auto const& scenario : config.scenarios) {
+		if (scenario == "huge" && !create_file(up + L"/huge", config.huge_size)) {
+			return false;
+		}
+		if (scenario == "tiny") {
+			for (int i = 0; i < config.tiny_count; ++i) {
+				if (!create_file(up + L"/tiny/" + tiny_name(i), config.tiny_size)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void print_usage()
+{
+	std::cerr <<
+		"Usage: bench [options]\n"
+		"\n"
+		"  --protocols LIST       Comma-separated, out of ftp, ftps and sftp. Default: ftp,ftps\n"
+		"  --scenarios LIST       Comma-separated, out of huge, tiny and listing. Default: all\n"
+		"  --huge-size MIB        Size of the huge file. Default: 1024\n"
+		"  --tiny-count N         Number of tiny files. Default: 100000\n"
+		"  --tiny-size BYTES      Size of each tiny file. Default: 1024\n"
+		"  --listing-entries N    Entries in the listed directory of the stand-in. Default: 200000\n"
+		"  --connections N        Parallel connections for tiny files. Default: 1\n"
+		"  --delay MS             Delay added to each stand-in control reply. Default: 0\n"
+		"  --runs N               Repeats all scenarios N times. Default: 1\n"
+		"  --label TEXT           Added to each result, e.g. to tell builds apart\n"
+		"  --sftp HOST[:PORT]     SFTP server, e.g. a local sshd. Needed for the sftp protocol\n"
+		"  --sftp-user USER\n"
+		"  --sftp-password PASS\n"
+		"  --sftp-key FILE\n"
+		"  --sftp-path PATH       Remote scratch directory. Default: /tmp/fzbench\n"
+		"  --fzsftp FILE          fzsftp executable. Default: ../src/putty/fzsftp\n"
+		"  --set NAME=VALUE       Sets an engine option by name, e.g. \"Local file I/O=1\"\n"
+		"  --workdir DIR          Local files are created here and reused between runs\n"
+		"  --output FILE          Write results to file instead of stdout\n"
+		"  --verbose              Print engine log messages\n"
+		"\n"
+		"For delays affecting throughput, add netem to the loopback device, e.g.\n"
+		"  tc qdisc add dev lo root netem delay 10ms\n";
+}
+
+bool parse_args(int argc, char* argv[], bench_config & config)
+{
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg = argv[i];
+		if (arg == "--verbose") {
+			config.verbose = true;
+			continue;
+		}
+		if (arg == "--help" || i + 1 >= argc) {
+			return false;
+		}
+
+		std::string const value = argv[++i];
+		if (arg == "--protocols") {
+			config.protocols = fz::strtok(value, ',');
+		}
+		else if (arg == "--scenarios") {
+			config.scenarios = fz::strtok(value, ',');
+		}
+		else if (arg == "--huge-size") {
+			config.huge_size = fz::to_integral<int64_t>(value) * 1024 * 1024;
+		}
+		else if (arg == "--tiny-count") {
+			config.tiny_count = fz::to_integral<int>(value);
+		}
+		else if (arg == "--tiny-size") {
+			config.tiny_size = fz::to_integral<int64_t>(value);
+		}
+		else if (arg == "--listing-entries") {
+			config.listing_entries = fz::to_integral<int>(value);
+		}
+		else if (arg == "--connections") {
+			config.connections = std::max(1, fz::to_integral<int>(value));
+		}
+		else if (arg == "--delay") {
+			config.delay = fz::to_integral<int>(value);
+		}
+		else if (arg == "--runs") {
+			config.runs = std::max(1, fz::to_integral<int>(value));
+		}
+		else if (arg == "--label") {
+			config.label = value;
+		}
+		else if (arg == "--sftp") {
+			size_t const pos = value.rfind(':');
+			config.sftp_host = value.substr(0, pos);
+			if (pos != std::string::npos) {
+				config.sftp_port = fz::to_integral<unsigned int>(value.substr(pos + 1));
+			}
+		}
+		else if (arg == "--sftp-user") {
+			config.sftp_user = fz::to_wstring(value);
+		}
+		else if (arg == "--sftp-password") {
+			config.sftp_password = fz::to_wstring(value);
+		}
+		else if (arg == "--sftp-key") {
+			config.sftp_key = fz::to_wstring(value);
+		}
+		else if (arg == "--sftp-path") {
+			config.sftp_path = fz::to_wstring(value);
+		}
+		else if (arg == "--fzsftp") {
+			config.fzsftp = fz::to_wstring(value);
+		}
+		else if (arg == "--set") {
+			size_t const pos = value.find('=');
+			if (pos == std::string::npos) {
+				return false;
+			}
+			config.engine_options.emplace_back(value.substr(0, pos), fz::to_wstring(value.substr(pos + 1)));
+		}
+		else if (arg == "--workdir") {
+			config.workdir = fz::to_wstring(value);
+		}
+		else if (arg == "--output") {
+			config.output = value;
+		}
+		else {
+			return false;
+		}
+	}
+
+	if (config.workdir.empty()) {
+		char const* tmp = getenv("TMPDIR");
+		config.workdir = fz::to_wstring(std::string(tmp && *tmp ? tmp : "/tmp")) + L"/fzbench";
+	}
+	if (config.fzsftp.empty()) {
+		config.fzsftp = L"../src/putty/fzsftp";
+	}
+	return true;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	bench_config config;
+	if (!parse_args(argc, argv, config)) {
+		print_usage();
+		return 1;
+	}
+
+#ifdef FZ_WINDOWS
+	std::cerr << "The benchmark is not supported on this platform" << std::endl;
+	return 1;
+#else
+	// The stand-in servers get forked before the engine creates any threads
+	bool const need_ftp = std::find(config.protocols.begin(), config.protocols.end(), "ftp") != config.protocols.end();
+	bool const need_ftps = std::find(config.protocols.begin(), config.protocols.end(), "ftps") != config.protocols.end();
+
+	bench_server_config server_config;
+	server_config.delay = fz::duration::from_milliseconds(config.delay);
+	server_config.listing_entries = config.listing_entries;
+
+	bench_server ftp_server;
+	if (need_ftp && !ftp_server.start(server_config)) {
+		std::cerr << "Could not start FTP stand-in" << std::endl;
+		return 1;
+	}
+
+	server_config.tls = true;
+	bench_server ftps_server;
+	if (need_ftps && !ftps_server.start(server_config)) {
+		std::cerr << "Could not start FTPS stand-in" << std::endl;
+		return 1;
+	}
+
+	if (!prepare_workdir(config)) {
+		std::cerr << "Could not create local files in " << fz::to_string(config.workdir) << std::endl;
+		return 1;
+	}
+
+	std::ofstream file;
+	if (!config.output.empty()) {
+		file.open(config.output);
+		if (!file) {
+			std::cerr << "Could not open " << config.output << std::endl;
+			return 1;
+		}
+	}
+	std::ostream & out = config.output.empty() ? std::cout : file;
+
+	bench_options options;
+	options.set(OPTION_FZSFTP_EXECUTABLE, config.fzsftp);
+	for (auto const& [name, value] : config.engine_options) {
+		if (!options.set_by_name(name, value)) {
+			std::cerr << "Unknown engine option " << name << std::endl;
+			return 1;
+		}
+	}
+
+	bench_encoding_converter converter;
+	CFileZillaEngineContext context(options, converter);
+
+	bool success = true;
+	for (auto const& protocol : config.protocols) {
+		CServer server;
+		Credentials credentials;
+		credentials.logonType_ = LogonType::normal;
+		CServerPath remote(L"/fzbench");
+		CServerPath listing(L"/listing");
+
+		if (protocol == "ftp" || protocol == "ftps") {
+			auto const port = (protocol == "ftp") ? ftp_server.port() : ftps_server.port();
+			server = CServer((protocol == "ftp") ? INSECURE_FTP : FTPES, DEFAULT, L"127.0.0.1", port);
+			server.SetUser(L"bench");
+			credentials.SetPass(L"bench");
+		}
+		else if (protocol == "sftp") {
+			if (config.sftp_host.empty()) {
+				std::cerr << "The sftp protocol needs --sftp" << std::endl;
+				return 1;
+			}
+			server = CServer(SFTP, DEFAULT, fz::to_wstring(config.sftp_host), config.sftp_port);
+			server.SetUser(config.sftp_user);
+			if (!config.sftp_key.empty()) {
+				credentials.logonType_ = LogonType::key;
+				credentials.keyFile_ = config.sftp_key;
+			}
+			else {
+				credentials.SetPass(config.sftp_password);
+			}
+			remote = CServerPath(config.sftp_path);
+			listing = CServerPath(remote, L"tiny");
+		}
+		else {
+			std::cerr << "Unknown protocol " << protocol << std::endl;
+			return 1;
+		}
+
+		bench_protocol p(config, context, protocol, server, credentials, remote, listing);
+		for (int run = 0; run < config.runs; ++run) {
+			success &= run_protocol(config, p, run, out);
+		}
+	}
+
+	return success ? 0 : 1;
+#endif
+}
@@ -0,0 +1,825 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "bench_server.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/logger.hpp>
+#include <libfilezilla/socket.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/tls_layer.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#ifndef FZ_WINDOWS
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std::literals;
+
+#ifndef FZ_WINDOWS
+namespace {
+class ftp_server;
+class ftp_session;
+
+struct session_closed_event_type{};
+typedef fz::simple_event<session_closed_event_type, ftp_session*> session_closed_event;
+
+// Directory path to entries. The size of subdirectories is -1.
+typedef std::map<std::string, std::map<std::string, int64_t>> vfs;
+
+// Splits an absolute path into parent and name
+std::pair<std::string, std::string> split(std::string const& path)
+{
+	size_t const pos = path.rfind('/');
+	return {pos ? path.substr(0, pos) : "/"s, path.substr(pos + 1)};
+}
+
+class ftp_server final : public fz::event_handler
+{
+public:
+	ftp_server(fz::thread_pool & pool, fz::event_loop & loop, bench_server_config const& config);
+	virtual ~ftp_server();
+
+	int listen();
+
+	fz::thread_pool & pool_;
+	bench_server_config const config_;
+
+	vfs files_;
+
+	std::string key_;
+	std::string cert_;
+
+	std::string const pattern_ = std::string(256 * 1024, 'x');
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+	void on_socket_event(fz::socket_event_source*, fz::socket_event_flag t, int error);
+	void on_session_closed(ftp_session* session);
+
+	std::unique_ptr<fz::listen_socket> listen_socket_;
+	std::map<ftp_session*, std::unique_ptr<ftp_session>> sessions_;
+};
+
+class ftp_session final : public fz::event_handler
+{
+public:
+	ftp_session(ftp_server & server, std::unique_ptr<fz::socket> && socket);
+	virtual ~ftp_session();
+
+	void start();
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+	void on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+	void on_timer(fz::timer_id);
+
+	void on_control_event(fz::socket_event_flag t, int error);
+	void on_data_event(fz::socket_event_flag t, int error);
+	void on_accept();
+
+	void process_command(std::string const& line);
+	void reply(std::string const& msg);
+	void send_control();
+	void close();
+
+	bool open_passive(bool extended);
+	void start_transfer();
+	void continue_transfer();
+	void end_transfer(bool success);
+	void reset_data();
+
+	std::string resolve(std::string const& arg) const;
+	std::string listing(std::string const& dir) const;
+
+	// Returns -1 if there is no such file
+	int64_t file_size(std::string const& path) const;
+
+	ftp_server & server_;
+
+	std::unique_ptr<fz::socket> socket_;
+	std::unique_ptr<fz::tls_layer> tls_;
+	fz::socket_interface* control_{};
+
+	std::string in_;
+	std::string out_;
+	std::deque<std::string> delayed_;
+	bool start_tls_{};
+	bool quit_{};
+	bool closed_{};
+
+	std::string cwd_{"/"};
+	int64_t rest_{};
+	bool protect_data_{};
+
+	std::unique_ptr<fz::listen_socket> pasv_;
+	std::unique_ptr<fz::socket> data_socket_;
+	std::unique_ptr<fz::tls_layer> data_tls_;
+	fz::socket_interface* data_{};
+	bool data_ready_{};
+	bool shutting_down_{};
+
+	enum class transfer {
+		none,
+		retr,
+		stor,
+		list
+	};
+	transfer transfer_{transfer::none};
+	int64_t remaining_{};
+	int64_t received_{};
+	std::string stor_dir_;
+	std::string stor_name_;
+	std::string list_;
+	size_t list_offset_{};
+};
+
+ftp_server::ftp_server(fz::thread_pool & pool, fz::event_loop & loop, bench_server_config const& config)
+	: fz::event_handler(loop)
+	, pool_(pool)
+	, config_(config)
+{
+	files_["/"];
+	auto & listing = files_["/listing"];
+	for (int i = 0; i < config_.listing_entries; ++i) {
+		listing[fz::sprintf("file%07d", i)] = 1024 + i % 4096;
+	}
+	files_["/"]["listing"] = -1;
+
+	if (config_.tls) {
+		auto const pair = fz::tls_layer::generate_selfsigned_certificate(fz::native_string(), "CN=localhost", {"localhost"});
+		key_ = pair.first;
+		cert_ = pair.second;
+	}
+}
+
+ftp_server::~ftp_server()
+{
+	remove_handler();
+	sessions_.clear();
+	listen_socket_.reset();
+}
+
+int ftp_server::listen()
+{
+	listen_socket_ = std::make_unique<fz::listen_socket>(pool_, this);
+	if (listen_socket_->listen(fz::address_type::ipv4, 0)) {
+		return -1;
+	}
+	int error;
+	return listen_socket_->local_port(error);
+}
+
+void ftp_server::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event, session_closed_event>(ev, this,
+		&ftp_server::on_socket_event,
+		&ftp_server::on_session_closed);
+}
+
+void ftp_server::on_socket_event(fz::socket_event_source*, fz::socket_event_flag t, int)
+{
+	if (t != fz::socket_event_flag::connection) {
+		return;
+	}
+
+	int error;
+	auto socket = listen_socket_->accept(error);
+	if (socket) {
+		socket->set_flags(fz::socket::flag_nodelay, true);
+		auto session = std::make_unique<ftp_session>(*this, std::move(socket));
+		auto & s = *session;
+		sessions_[&s] = std::move(session);
+		s.start();
+	}
+}
+
+void ftp_server::on_session_closed(ftp_session* session)
+{
+	sessions_.erase(session);
+}
+
+ftp_session::ftp_session(ftp_server & server, std::unique_ptr<fz::socket> && socket)
+	: fz::event_handler(server.event_loop_)
+	, server_(server)
+	, socket_(std::move(socket))
+	, control_(socket_.get())
+{
+	socket_->set_event_handler(this);
+}
+
+ftp_session::~ftp_session()
+{
+	remove_handler();
+	reset_data();
+	tls_.reset();
+	socket_.reset();
+}
+
+void ftp_session::start()
+{
+	reply("220 Benchmark stand-in ready");
+}
+
+void ftp_session::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event, fz::timer_event>(ev, this,
+		&ftp_session::on_socket_event,
+		&ftp_session::on_timer);
+}
+
+void ftp_session::on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error)
+{
+	if (closed_) {
+		return;
+	}
+
+	if (source == socket_.get() || (tls_ && source == tls_.get())) {
+		on_control_event(t, error);
+	}
+	else if (pasv_ && source == pasv_.get()) {
+		on_accept();
+	}
+	else if (data_ && source == data_) {
+		on_data_event(t, error);
+	}
+}
+
+void ftp_session::on_timer(fz::timer_id)
+{
+	if (!delayed_.empty()) {
+		out_ += delayed_.front();
+		delayed_.pop_front();
+		send_control();
+	}
+}
+
+void ftp_session::on_control_event(fz::socket_event_flag t, int error)
+{
+	if (error) {
+		close();
+		return;
+	}
+
+	if (t == fz::socket_event_flag::read) {
+		char buf[4096];
+		for (;;) {
+			int const read = control_->read(buf, sizeof(buf), error);
+			if (read <= 0) {
+				if (!read || error != EAGAIN) {
+					close();
+				}
+				return;
+			}
+
+			in_.append(buf, read);
+			size_t pos;
+			while ((pos = in_.find("\r\n")) != std::string::npos) {
+				std::string const line = in_.substr(0, pos);
+				in_.erase(0, pos + 2);
+				process_command(line);
+				if (closed_) {
+					return;
+				}
+			}
+			if (in_.size() > 8192) {
+				close();
+				return;
+			}
+		}
+	}
+	else if (t == fz::socket_event_flag::write) {
+		send_control();
+	}
+}
+
+void ftp_session::reply(std::string const& msg)
+{
+	if (server_.config_.delay) {
+		delayed_.push_back(msg + "\r\n");
+		add_timer(server_.config_.delay, true);
+	}
+	else {
+		out_ += msg;
+		out_ += "\r\n";
+		send_control();
+	}
+}
+
+void ftp_session::send_control()
+{
+	while (!out_.empty()) {
+		int error;
+		int const written = control_->write(out_.data(), static_cast<unsigned int>(out_.size()), error);
+		if (written <= 0) {
+			if (error != EAGAIN) {
+				close();
+			}
+			return;
+		}
+		out_.erase(0, written);
+	}
+
+	if (!delayed_.empty()) {
+		return;
+	}
+
+	if (quit_) {
+		close();
+	}
+	else if (start_tls_) {
+		start_tls_ = false;
+		tls_ = std::make_unique<fz::tls_layer>(event_loop_, this, *socket_, nullptr, fz::get_null_logger());
+		control_ = tls_.get();
+		if (!tls_->set_certificate(server_.key_, server_.cert_, fz::native_string()) || !tls_->server_handshake()) {
+			close();
+		}
+	}
+}
+
+void ftp_session::close()
+{
+	if (!closed_) {
+		closed_ = true;
+		server_.send_event<session_closed_event>(this);
+	}
+}
+
+std::string ftp_session::resolve(std::string const& arg) const
+{
+	std::string path = (!arg.empty() && arg[0] == '/') ? arg : cwd_ + "/" + arg;
+
+	std::vector<std::string> segments;
+	for (auto const& segment : fz::strtok(path, '/')) {
+		if (segment == "..") {
+			if (!segments.empty()) {
+				segments.pop_back();
+			}
+		}
+		else if (segment != ".") {
+			segments.push_back(segment);
+		}
+	}
+
+	std::string ret;
+	for (auto const& segment : segments) {
+		ret += "/" + segment;
+	}
+	return ret.empty() ? "/"s : ret;
+}
+
+int64_t ftp_session::file_size(std::string const& path) const
+{
+	auto const [dir, name] = split(path);
+	auto it = server_.files_.find(dir);
+	if (it == server_.files_.end()) {
+		return -1;
+	}
+	auto file = it->second.find(name);
+	return file == it->second.end() ? -1 : file->second;
+}
+
+std::string ftp_session::listing(std::string const& dir) const
+{
+	std::string ret;
+	auto it = server_.files_.find(dir);
+	if (it != server_.files_.end()) {
+		for (auto const& [name, size] : it->second) {
+			if (size < 0) {
+				ret += "type=dir;modify=20260101000000; " + name + "\r\n";
+			}
+			else {
+				ret += fz::sprintf("type=file;size=%d;modify=20260101000000; %s\r\n", size, name);
+			}
+		}
+	}
+	return ret;
+}
+
+void ftp_session::process_command(std::string const& line)
+{
+	size_t const pos = line.find(' ');
+	std::string const cmd = fz::str_toupper_ascii(line.substr(0, pos));
+	std::string const arg = pos == std::string::npos ? std::string() : line.substr(pos + 1);
+
+	if (cmd == "USER") {
+		reply("331 Password required");
+	}
+	else if (cmd == "PASS") {
+		reply("230 Logged on");
+	}
+	else if (cmd == "SYST") {
+		reply("215 UNIX Type: L8");
+	}
+	else if (cmd == "FEAT") {
+		std::string features = "211-Features:\r\n MDTM\r\n REST STREAM\r\n SIZE\r\n MLST type*;size*;modify*;\r\n MLSD\r\n UTF8\r\n EPSV\r\n";
+		if (server_.config_.tls) {
+			features += " AUTH TLS\r\n PBSZ\r\n PROT\r\n";
+		}
+		reply(features + "211 End");
+	}
+	else if (cmd == "AUTH") {
+		if (server_.config_.tls && (fz::str_toupper_ascii(arg) == "TLS" || fz::str_toupper_ascii(arg) == "SSL")) {
+			reply("234 Using authentication type TLS");
+			start_tls_ = true;
+		}
+		else {
+			reply("504 Auth type not supported");
+		}
+	}
+	else if (cmd == "PBSZ") {
+		reply("200 PBSZ=0");
+	}
+	else if (cmd == "PROT") {
+		protect_data_ = fz::str_toupper_ascii(arg) == "P";
+		reply("200 Protection level set");
+	}
+	else if (cmd == "PWD") {
+		reply("257 \"" + cwd_ + "\" is current directory.");
+	}
+	else if (cmd == "CWD" || cmd == "CDUP") {
+		std::string const path = resolve(cmd == "CDUP" ? ".."s : arg);
+		if (server_.files_.count(path)) {
+			cwd_ = path;
+			reply("250 CWD successful");
+		}
+		else {
+			reply("550 No such directory");
+		}
+	}
+	else if (cmd == "MKD") {
+		std::string const path = resolve(arg);
+		auto const [parent, name] = split(path);
+		auto it = server_.files_.find(parent);
+		if (it == server_.files_.end() || path == "/") {
+			reply("550 Cannot create directory");
+		}
+		else {
+			it->second[name] = -1;
+			server_.files_[path];
+			reply("257 \"" + path + "\" created");
+		}
+	}
+	else if (cmd == "RMD") {
+		std::string const path = resolve(arg);
+		auto const [parent, name] = split(path);
+		server_.files_.erase(path);
+		auto it = server_.files_.find(parent);
+		if (it != server_.files_.end()) {
+			it->second.erase(name);
+		}
+		reply("250 Directory removed");
+	}
+	else if (cmd == "DELE" || cmd == "SIZE" || cmd == "MDTM") {
+		std::string const path = resolve(arg);
+		int64_t const size = file_size(path);
+		if (size < 0) {
+			reply("550 File not found");
+		}
+		else if (cmd == "DELE") {
+			auto const [dir, name] = split(path);
+			server_.files_[dir].erase(name);
+			reply("250 File deleted");
+		}
+		else if (cmd == "SIZE") {
+			reply(fz::sprintf("213 %d", size));
+		}
+		else {
+			reply("213 20260101000000");
+		}
+	}
+	else if (cmd == "TYPE" || cmd == "OPTS" || cmd == "CLNT" || cmd == "NOOP" || cmd == "MODE" || cmd == "STRU") {
+		reply("200 OK");
+	}
+	else if (cmd == "REST") {
+		rest_ = fz::to_integral<int64_t>(arg);
+		reply("350 Restarting");
+	}
+	else if (cmd == "PASV" || cmd == "EPSV") {
+		if (!open_passive(cmd == "EPSV")) {
+			reply("421 Could not create socket");
+		}
+	}
+	else if (cmd == "MLSD" || cmd == "LIST" || cmd == "NLST") {
+		std::string const dir = (arg.empty() || arg[0] == '-') ? cwd_ : resolve(arg);
+		if (!server_.files_.count(dir)) {
+			reply("550 No such directory");
+		}
+		else {
+			list_ = listing(dir);
+			list_offset_ = 0;
+			transfer_ = transfer::list;
+			start_transfer();
+		}
+	}
+	else if (cmd == "RETR") {
+		int64_t const size = file_size(resolve(arg));
+		if (size < 0) {
+			reply("550 File not found");
+		}
+		else {
+			remaining_ = std::max(int64_t(0), size - rest_);
+			transfer_ = transfer::retr;
+			start_transfer();
+		}
+	}
+	else if (cmd == "STOR" || cmd == "APPE") {
+		auto const [dir, name] = split(resolve(arg));
+		if (!server_.files_.count(dir)) {
+			reply("550 No such directory");
+		}
+		else {
+			stor_dir_ = dir;
+			stor_name_ = name;
+			received_ = rest_;
+			transfer_ = transfer::stor;
+			start_transfer();
+		}
+	}
+	else if (cmd == "QUIT") {
+		reply("221 Goodbye");
+		quit_ = true;
+	}
+	else {
+		reply("502 Command not implemented");
+	}
+}
+
+bool ftp_session::open_passive(bool extended)
+{
+	reset_data();
+
+	pasv_ = std::make_unique<fz::listen_socket>(server_.pool_, this);
+	if (pasv_->listen(fz::address_type::ipv4, 0)) {
+		pasv_.reset();
+		return false;
+	}
+
+	int error;
+	int const port = pasv_->local_port(error);
+	if (port <= 0) {
+		pasv_.reset();
+		return false;
+	}
+
+	if (extended) {
+		reply(fz::sprintf("229 Entering Extended Passive Mode (|||%d|)", port));
+	}
+	else {
+		reply(fz::sprintf("227 Entering Passive Mode (127,0,0,1,%d,%d)", port / 256, port % 256));
+	}
+	return true;
+}
+
+void ftp_session::on_accept()
+{
+	int error;
+	data_socket_ = pasv_->accept(error);
+	if (!data_socket_) {
+		return;
+	}
+	pasv_.reset();
+
+	if (protect_data_) {
+		data_tls_ = std::make_unique<fz::tls_layer>(event_loop_, this, *data_socket_, nullptr, fz::get_null_logger());
+		data_ = data_tls_.get();
+		if (!data_tls_->set_certificate(server_.key_, server_.cert_, fz::native_string()) || !data_tls_->server_handshake(tls_ ? tls_->get_session_parameters() : std::vector<uint8_t>())) {
+			reset_data();
+			if (transfer_ != transfer::none) {
+				end_transfer(false);
+			}
+		}
+	}
+	else {
+		data_socket_->set_event_handler(this);
+		data_ = data_socket_.get();
+		data_ready_ = true;
+		continue_transfer();
+	}
+}
+
+void ftp_session::on_data_event(fz::socket_event_flag t, int error)
+{
+	if (error) {
+		if (transfer_ != transfer::none) {
+			end_transfer(false);
+		}
+		else {
+			reset_data();
+		}
+		return;
+	}
+
+	if (t == fz::socket_event_flag::connection) {
+		data_ready_ = true;
+	}
+	continue_transfer();
+}
+
+void ftp_session::start_transfer()
+{
+	rest_ = 0;
+	if (!data_ && !pasv_) {
+		transfer_ = transfer::none;
+		reply("425 Use PASV first");
+		return;
+	}
+
+	reply("150 Opening data connection");
+	continue_transfer();
+}
+
+void ftp_session::continue_transfer()
+{
+	if (!data_ready_ || transfer_ == transfer::none) {
+		return;
+	}
+
+	int error{};
+	if (shutting_down_) {
+		error = data_->shutdown();
+		if (error != EAGAIN) {
+			end_transfer(!error);
+		}
+		return;
+	}
+
+	if (transfer_ == transfer::stor) {
+		char buf[64 * 1024];
+		for (;;) {
+			int const read = data_->read(buf, sizeof(buf), error);
+			if (read < 0) {
+				if (error != EAGAIN) {
+					end_transfer(false);
+				}
+				return;
+			}
+			if (!read) {
+				server_.files_[stor_dir_][stor_name_] = received_;
+				end_transfer(true);
+				return;
+			}
+			received_ += read;
+		}
+	}
+
+	for (;;) {
+		char const* p{};
+		int64_t size{};
+		if (transfer_ == transfer::retr) {
+			p = server_.pattern_.data();
+			size = std::min(remaining_, static_cast<int64_t>(server_.pattern_.size()));
+		}
+		else {
+			p = list_.data() + list_offset_;
+			size = static_cast<int64_t>(list_.size() - list_offset_);
+			if (size > 256 * 1024) {
+				size = 256 * 1024;
+			}
+		}
+
+		if (!size) {
+			shutting_down_ = true;
+			error = data_->shutdown();
+			if (error != EAGAIN) {
+				end_transfer(!error);
+			}
+			return;
+		}
+
+		int const written = data_->write(p, static_cast<unsigned int>(size), error);
+		if (written <= 0) {
+			if (error != EAGAIN) {
+				end_transfer(false);
+			}
+			return;
+		}
+		if (transfer_ == transfer::retr) {
+			remaining_ -= written;
+		}
+		else {
+			list_offset_ += written;
+		}
+	}
+}
+
+void ftp_session::end_transfer(bool success)
+{
+	transfer_ = transfer::none;
+	reset_data();
+	reply(success ? "226 Transfer complete" : "426 Transfer aborted");
+}
+
+void ftp_session::reset_data()
+{
+	data_ = nullptr;
+	data_ready_ = false;
+	shutting_down_ = false;
+	data_tls_.reset();
+	data_socket_.reset();
+	pasv_.reset();
+	list_.clear();
+}
+}
+#endif
+
+bench_server::~bench_server()
+{
+	stop();
+}
+
+bool bench_server::start([[maybe_unused]] bench_server_config const& config)
+{
+#ifdef FZ_WINDOWS
+	return false;
+#else
+	stop();
+
+	// The first pipe reports the port to the parent, the second keeps the
+	// child alive until closed by the parent.
+	int port_pipe[2];
+	int life_pipe[2];
+	if (pipe(port_pipe)) {
+		return false;
+	}
+	if (pipe(life_pipe)) {
+		::close(port_pipe[0]);
+		::close(port_pipe[1]);
+		return false;
+	}
+
+	pid_t const pid = fork();
+	if (pid < 0) {
+		::close(port_pipe[0]);
+		::close(port_pipe[1]);
+		::close(life_pipe[0]);
+		::close(life_pipe[1]);
+		return false;
+	}
+
+	if (!pid) {
+		::close(port_pipe[0]);
+		::close(life_pipe[1]);
+		signal(SIGPIPE, SIG_IGN);
+
+		int port = -1;
+		{
+			fz::thread_pool pool;
+			fz::event_loop loop(pool);
+			ftp_server server(pool, loop, config);
+			port = server.listen();
+			[[maybe_unused]] auto r = write(port_pipe[1], &port, sizeof(port));
+			::close(port_pipe[1]);
+
+			if (port > 0) {
+				char c;
+				while (read(life_pipe[0], &c, 1) > 0) {
+				}
+			}
+		}
+		_exit(port > 0 ? 0 : 1);
+	}
+
+	::close(port_pipe[1]);
+	::close(life_pipe[0]);
+	pid_ = pid;
+	pipe_ = life_pipe[1];
+
+	int port = -1;
+	if (read(port_pipe[0], &port, sizeof(port)) != sizeof(port) || port <= 0) {
+		port = -1;
+	}
+	::close(port_pipe[0]);
+	if (port <= 0) {
+		stop();
+		return false;
+	}
+
+	port_ = static_cast<unsigned short>(port);
+	return true;
+#endif
+}
+
+void bench_server::stop()
+{
+#ifndef FZ_WINDOWS
+	if (pipe_ != -1) {
+		::close(pipe_);
+		pipe_ = -1;
+	}
+	if (pid_ > 0) {
+		int status;
+		waitpid(pid_, &status, 0);
+		pid_ = -1;
+	}
+	port_ = 0;
+#endif
+}
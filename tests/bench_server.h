@@ -0,0 +1,55 @@
+#ifndef FILEZILLA_TESTS_BENCH_SERVER_HEADER
+#define FILEZILLA_TESTS_BENCH_SERVER_HEADER
+
+#include <libfilezilla/time.hpp>
+
+#include <string>
+
+/*
+ * Minimal FTP server used as a local stand-in by the benchmark.
+ *
+ * Files are not stored. Uploads are discarded after their size has been
+ * recorded, downloads are filled with a fixed pattern. In addition to
+ * what has been uploaded, the directory /listing is populated with a
+ * configurable number of entries for listing benchmarks.
+ *
+ * The server runs in a child process so that its CPU time and memory are
+ * not accounted to the engine being measured. It needs to be started before
+ * the benchmark creates any threads.
+ */
+
+struct bench_server_config final
+{
+	// Enables AUTH TLS with a self-signed certificate
+	bool tls{};
+
+	// Added to each control connection reply. Models the round-trip bound
+	// parts of a session, e.g. many small files. For delays affecting
+	// throughput, use netem on the loopback device instead.
+	fz::duration delay;
+
+	int listing_entries{};
+};
+
+class bench_server final
+{
+public:
+	bench_server() = default;
+	~bench_server();
+
+	bench_server(bench_server const&) = delete;
+	bench_server& operator=(bench_server const&) = delete;
+
+	// Returns false if the server could not be started
+	bool start(bench_server_config const& config);
+	void stop();
+
+	unsigned short port() const { return port_; }
+
+private:
+	int pid_{-1};
+	int pipe_{-1};
+	unsigned short port_{};
+};
+
+#endif